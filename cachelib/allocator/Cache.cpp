@@ -424,6 +424,8 @@ void CacheBase::updateGlobalCacheStats(const std::string& statPrefix) const {
                           stats.numNvmAbortedPutOnTombstone);
     counters_.updateDelta(statPrefix + "nvm.puts.aborted_on_inflightget",
                           stats.numNvmAbortedPutOnInflightGet);
+    counters_.updateDelta(statPrefix + "nvm.puts.aborted_on_pool_quota",
+                          stats.numNvmAbortedPutOnPoolQuota);
     counters_.updateDelta(statPrefix + "nvm.puts.encode_failure",
                           stats.numNvmPutEncodeFailure);
 
@@ -55,6 +55,7 @@
 #include "cachelib/allocator/KAllocation.h"
 #include "cachelib/allocator/MemoryMonitor.h"
 #include "cachelib/allocator/NvmAdmissionPolicy.h"
+#include "cachelib/allocator/NvmPromotionPolicy.h"
 #include "cachelib/allocator/NvmCacheState.h"
 #include "cachelib/allocator/PoolOptimizeStrategy.h"
 #include "cachelib/allocator/PoolOptimizer.h"
@@ -540,6 +541,16 @@ class CacheAllocator : public CacheBase {
   //                  key does not exist.
   ReadHandle find(Key key);
 
+  // look up several items at once. Same as calling find() for each key, but
+  // the keys that miss DRAM are looked up in the nvm cache with one batch
+  // request so that items stored next to each other share device reads.
+  //
+  // @param keys      the keys for lookup
+  //
+  // @return          a read handle for every key, in the order of @keys. A
+  //                  handle is nullptr if its key does not exist.
+  std::vector<ReadHandle> findBatch(const std::vector<Key>& keys);
+
   // Warning: this API is synchronous today with HybridCache. This means as
   //          opposed to find(), we will block on an item being read from
   //          flash until it is loaded into DRAM-cache. In find(), if an item
@@ -1920,6 +1931,12 @@ class CacheAllocator : public CacheBase {
   // returns true if nvmcache is enabled and we should write this item.
   bool shouldWriteToNvmCacheExclusive(const Item& item);
 
+  // returns true if an item of pool @pid found in nvmcache should be
+  // inserted into DRAM.
+  bool shouldPromoteFromNvmCache(Key key, PoolId pid) {
+    return !nvmPromotionPolicy_ || nvmPromotionPolicy_->accept(key, pid);
+  }
+
   // Serialize the metadata for the cache into an IOBUf. The caller can now
   // use this to serialize into a serializer by estimating the size and
   // calling writeToBuffer.
@@ -2087,6 +2104,51 @@ class CacheAllocator : public CacheBase {
                      : false;
   }
 
+  // Moves NVM space between BigHash and BlockCache of the last engine pair,
+  // which has to be set up with a resizable BigHash
+  // (navy::BigHashConfig::setMaxSizePct). Resizes BigHash to @size bytes
+  // and BlockCache to the rest, evicting the items in the space given up.
+  // Returns the new BigHash size, or 0 if there is no NVM cache.
+  uint64_t resizeNvmSmallItemCache(uint64_t size) {
+    return nvmCache_ ? nvmCache_->resizeSmallItemCache(size) : 0;
+  }
+
+  // Writes every item in NVM to @file, which can be a pipe or a socket to
+  // the host of another cache warming up from this one. Runs on the calling
+  // thread while the cache keeps serving traffic. Returns the number of
+  // items exported, or 0 if there is no NVM cache.
+  // @throw std::runtime_error if writing to @file fails
+  uint64_t exportNvmCache(folly::File file) {
+    return nvmCache_ ? nvmCache_->exportItems(std::move(file)) : 0;
+  }
+
+  // Inserts the items written by exportNvmCache from @file into NVM,
+  // skipping the ones that expired meanwhile. Meant for a new cache before
+  // it takes traffic. Returns the number of items imported, or 0 if there
+  // is no NVM cache.
+  // @throw std::invalid_argument if @file is not an export of a NVM cache
+  uint64_t importNvmCache(folly::File file) {
+    return nvmCache_ ? nvmCache_->importItems(std::move(file)) : 0;
+  }
+
+  // Limits the NVM bytes the items of pool @pid can hold to @quota. Items of
+  // a pool over its quota are not written to NVM when they are evicted from
+  // DRAM. 0 means unlimited. Returns false if there is no NVM cache.
+  // @throw std::invalid_argument if @pid is not a valid pool id
+  bool setNvmPoolQuota(PoolId pid, uint64_t quota) {
+    if (!nvmCache_) {
+      return false;
+    }
+    nvmCache_->setPoolQuota(pid, quota);
+    return true;
+  }
+
+  // Returns the estimated NVM bytes the items of pool @pid hold, 0 if there
+  // is no NVM cache.
+  uint64_t getNvmPoolUsage(PoolId pid) const {
+    return nvmCache_ ? nvmCache_->getPoolUsage(pid) : 0;
+  }
+
   // returns the background mover stats
   BackgroundMoverStats getBackgroundMoverStats(MoverDir direction) const {
     auto stats = BackgroundMoverStats{};
@@ -2341,6 +2403,9 @@ class CacheAllocator : public CacheBase {
   // admission policy for nvmcache
   std::shared_ptr<NvmAdmissionPolicy<CacheT>> nvmAdmissionPolicy_;
 
+  // promotion policy from nvmcache into DRAM. nullptr promotes every hit.
+  std::shared_ptr<NvmPromotionPolicy<CacheT>> nvmPromotionPolicy_;
+
   // indicates if the shutdown of cache is in progress or not
   std::atomic<bool> shutDownInProgress_{false};
 
@@ -2535,6 +2600,9 @@ void CacheAllocator<CacheTrait>::initCommon(bool dramCacheAttached) {
           config_.rejectFirstAPNumEntries, config_.rejectFirstAPNumSplits,
           config_.rejectFirstSuffixIgnoreLength,
           config_.rejectFirstUseDramHitSignal);
+    } else if (config_.historyBasedAPConfig) {
+      nvmAdmissionPolicy_ = std::make_shared<HistoryBasedAP<CacheT>>(
+          *config_.historyBasedAPConfig);
     }
     if (config_.nvmAdmissionMinTTL > 0) {
       if (!nvmAdmissionPolicy_) {
@@ -2542,6 +2610,7 @@ void CacheAllocator<CacheTrait>::initCommon(bool dramCacheAttached) {
       }
       nvmAdmissionPolicy_->initMinTTL(config_.nvmAdmissionMinTTL);
     }
+    nvmPromotionPolicy_ = config_.nvmPromotionPolicy;
   }
   initStats();
   initNvmCache(dramCacheAttached);
@@ -2561,9 +2630,15 @@ void CacheAllocator<CacheTrait>::initNvmCache(bool dramCacheAttached) {
   // is not persisted is not supported.
   const bool shouldDrop = config_.dropNvmCacheOnShmNew && !dramCacheAttached;
 
+  // A cache that can be rebuilt by scanning the device survives an unclean
+  // shutdown
+  const bool startFresh =
+      config_.nvmConfig->navyConfig.isScanRecoveryEnabled()
+          ? nvmCacheState_.shouldDropNvmCache()
+          : nvmCacheState_.shouldStartFresh();
+
   // if we are dealing with persistency, cache directory should be enabled
-  const bool truncate = config_.cacheDir.empty() ||
-                        nvmCacheState_.shouldStartFresh() || shouldDrop;
+  const bool truncate = config_.cacheDir.empty() || startFresh || shouldDrop;
   if (truncate) {
     nvmCacheState_.markTruncated();
   }
@@ -4262,7 +4337,10 @@ CacheAllocator<CacheTrait>::findImpl(typename Item::Key key, AccessMode mode) {
   // nvm-cache. Naively accessing the memory directly after this can be slow.
   // We also don't need to call `markUseful()` as if we have a hit, we will
   // have promoted this item into DRAM cache at the front of eviction queue.
-  return nvmCache_->find(HashedKey{key});
+  if (nvmAdmissionPolicy_ && nvmAdmissionPolicy_->tracksAccess()) {
+    nvmAdmissionPolicy_->trackAccess(key);
+  }
+  return nvmCache_->find(HashedKey{key}, mode == AccessMode::kWrite);
 }
 
 template <typename CacheTrait>
@@ -4282,6 +4360,37 @@ CacheAllocator<CacheTrait>::find(typename Item::Key key) {
   return findImpl(key, AccessMode::kRead);
 }
 
+template <typename CacheTrait>
+std::vector<typename CacheAllocator<CacheTrait>::ReadHandle>
+CacheAllocator<CacheTrait>::findBatch(const std::vector<Key>& keys) {
+  std::vector<ReadHandle> handles(keys.size());
+  std::vector<size_t> missIdx;
+  std::vector<HashedKey> missKeys;
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto handle = findInternalWithExpiration(keys[i], AllocatorApiEvent::FIND);
+    if (handle || !nvmCache_) {
+      markUseful(handle, AccessMode::kRead);
+      handles[i] = std::move(handle);
+      continue;
+    }
+    // See findImpl() about the dram miss-path
+    if (nvmAdmissionPolicy_ && nvmAdmissionPolicy_->tracksAccess()) {
+      nvmAdmissionPolicy_->trackAccess(keys[i]);
+    }
+    missIdx.push_back(i);
+    missKeys.push_back(HashedKey{keys[i]});
+  }
+  if (missKeys.empty()) {
+    return handles;
+  }
+
+  auto nvmHandles = nvmCache_->findBatch(missKeys);
+  for (size_t j = 0; j < missIdx.size(); j++) {
+    handles[missIdx[j]] = std::move(nvmHandles[j]);
+  }
+  return handles;
+}
+
 template <typename CacheTrait>
 void CacheAllocator<CacheTrait>::markUseful(const ReadHandle& handle,
                                             AccessMode mode) {
@@ -6050,6 +6159,9 @@ util::StatsMap CacheAllocator<CacheTrait>::getNvmCacheStatsMap() const {
   if (nvmAdmissionPolicy_) {
     nvmAdmissionPolicy_->getCounters(ret.createCountVisitor());
   }
+  if (nvmPromotionPolicy_) {
+    nvmPromotionPolicy_->getCounters(ret.createCountVisitor());
+  }
   return ret;
 }
 } // namespace facebook::cachelib
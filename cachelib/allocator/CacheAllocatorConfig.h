@@ -33,6 +33,7 @@
 #include "cachelib/allocator/MemoryMonitor.h"
 #include "cachelib/allocator/MemoryTierCacheConfig.h"
 #include "cachelib/allocator/NvmAdmissionPolicy.h"
+#include "cachelib/allocator/NvmPromotionPolicy.h"
 #include "cachelib/allocator/PoolOptimizeStrategy.h"
 #include "cachelib/allocator/RebalanceStrategy.h"
 #include "cachelib/allocator/Util.h"
@@ -113,6 +114,14 @@ class CacheAllocatorConfig {
                                                   size_t suffixIgnoreLength,
                                                   bool useDramHitSignal);
 
+  // enable the history based admission policy, which learns from DRAM
+  // misses which items are read back from flash. Overlooked if a custom
+  // policy or the reject first policy is set.
+  //
+  // @throw std::invalid_argument if the config is invalid
+  CacheAllocatorConfig& enableHistoryBasedAPForNvm(
+      HistoryBasedAPConfig config);
+
   // enable an admission policy for NvmCache. If this is set, other supported
   // options like enableRejectFirstAP etc are overlooked.
   //
@@ -120,6 +129,17 @@ class CacheAllocatorConfig {
   CacheAllocatorConfig& setNvmCacheAdmissionPolicy(
       std::shared_ptr<NvmAdmissionPolicy<CacheT>> policy);
 
+  // enable a policy deciding which nvm cache hits are inserted into DRAM.
+  // Hits that are not promoted are served from a handle to an item that is
+  // not inserted into the cache. By default every hit is promoted. Changes
+  // made through such a handle are dropped with it, so pools that mutate
+  // items read from nvm should always be promoted.
+  //
+  // @throw std::invalid_argument if nullptr is passed or nvmcache is not
+  //        used.
+  CacheAllocatorConfig& setNvmPromotionPolicy(
+      std::shared_ptr<NvmPromotionPolicy<CacheT>> policy);
+
   // enables encoding items before they go into nvmcache
   CacheAllocatorConfig& setNvmCacheEncodeCallback(NvmCacheEncodeCb cb);
 
@@ -607,6 +627,9 @@ class CacheAllocatorConfig {
   // custom user provided admission policy
   std::shared_ptr<NvmAdmissionPolicy<CacheT>> nvmCacheAP{nullptr};
 
+  // custom user provided promotion policy from nvmcache into DRAM
+  std::shared_ptr<NvmPromotionPolicy<CacheT>> nvmPromotionPolicy{nullptr};
+
   // Config for nvmcache type
   folly::Optional<NvmCacheConfig> nvmConfig;
 
@@ -623,6 +646,10 @@ class CacheAllocatorConfig {
   // admit
   bool rejectFirstUseDramHitSignal{true};
 
+  // configuration for the history based admission policy to nvmcache.
+  // Disabled when empty.
+  folly::Optional<HistoryBasedAPConfig> historyBasedAPConfig;
+
   // Must enable this in order to call `allocateZeroedSlab`.
   // Otherwise, it will throw.
   // This is required for compact cache
@@ -755,6 +782,23 @@ CacheAllocatorConfig<T>& CacheAllocatorConfig<T>::enableRejectFirstAPForNvm(
   return *this;
 }
 
+template <typename T>
+CacheAllocatorConfig<T>& CacheAllocatorConfig<T>::enableHistoryBasedAPForNvm(
+    HistoryBasedAPConfig config) {
+  if (config.numShards == 0 || config.numHistoryEntries < config.numShards) {
+    throw std::invalid_argument(folly::sformat(
+        "Need at least one history entry per shard. Entries: {}, shards: {}",
+        config.numHistoryEntries,
+        config.numShards));
+  }
+  if (config.admitThreshold < 0 || config.admitThreshold > 1) {
+    throw std::invalid_argument(folly::sformat(
+        "Admit threshold must be within [0, 1]: {}", config.admitThreshold));
+  }
+  historyBasedAPConfig.assign(std::move(config));
+  return *this;
+}
+
 template <typename T>
 CacheAllocatorConfig<T>& CacheAllocatorConfig<T>::enableNvmCache(
     NvmCacheConfig config) {
@@ -779,6 +823,22 @@ CacheAllocatorConfig<T>& CacheAllocatorConfig<T>::setNvmCacheAdmissionPolicy(
   return *this;
 }
 
+template <typename T>
+CacheAllocatorConfig<T>& CacheAllocatorConfig<T>::setNvmPromotionPolicy(
+    std::shared_ptr<NvmPromotionPolicy<T>> policy) {
+  if (!nvmConfig) {
+    throw std::invalid_argument(
+        "NvmCache promotion policy can not be set unless nvmcache is used");
+  }
+
+  if (!policy) {
+    throw std::invalid_argument("Setting a null promotion policy");
+  }
+
+  nvmPromotionPolicy = std::move(policy);
+  return *this;
+}
+
 template <typename T>
 CacheAllocatorConfig<T>& CacheAllocatorConfig<T>::setNvmCacheEncodeCallback(
     NvmCacheEncodeCb cb) {
@@ -1254,6 +1314,8 @@ std::map<std::string, std::string> CacheAllocatorConfig<T>::serialize() const {
   configMap["removeCb"] = removeCb ? "set" : "empty";
   configMap["nvmAP"] = nvmCacheAP ? "custom" : "empty";
   configMap["nvmAPRejectFirst"] = rejectFirstAPNumEntries ? "set" : "empty";
+  configMap["nvmAPHistoryBased"] = historyBasedAPConfig ? "set" : "empty";
+  configMap["nvmPromotionPolicy"] = nvmPromotionPolicy ? "custom" : "empty";
   configMap["moveCb"] = moveCb ? "set" : "empty";
   configMap["enableZeroedSlabAllocs"] = std::to_string(enableZeroedSlabAllocs);
   configMap["lockMemory"] = std::to_string(lockMemory);
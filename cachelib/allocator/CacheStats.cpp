@@ -50,7 +50,7 @@ struct SizeVerify {};
 
 void Stats::populateGlobalCacheStats(GlobalCacheStats& ret) const {
 #ifndef SKIP_SIZE_VERIFY
-  SizeVerify<sizeof(Stats)> a = SizeVerify<16368>{};
+  SizeVerify<sizeof(Stats)> a = SizeVerify<16376>{};
   std::ignore = a;
 #endif
   ret.numCacheGets = numCacheGets.get();
@@ -77,6 +77,7 @@ void Stats::populateGlobalCacheStats(GlobalCacheStats& ret) const {
   ret.numNvmAbortedPutOnTombstone += numNvmAbortedPutOnTombstone.get();
   ret.numNvmCompactionFiltered += numNvmCompactionFiltered.get();
   ret.numNvmAbortedPutOnInflightGet = numNvmAbortedPutOnInflightGet.get();
+  ret.numNvmAbortedPutOnPoolQuota = numNvmAbortedPutOnPoolQuota.get();
   ret.numNvmCleanEvict = numNvmCleanEvict.get();
   ret.numNvmCleanDoubleEvict = numNvmCleanDoubleEvict.get();
   ret.numNvmDestructorCalls = numNvmDestructorCalls.get();
@@ -412,6 +412,9 @@ struct GlobalCacheStats {
   // number of puts that observed an inflight get and aborted
   uint64_t numNvmAbortedPutOnInflightGet{0};
 
+  // number of puts aborted because their pool is over its nvm quota
+  uint64_t numNvmAbortedPutOnPoolQuota{0};
+
   // number of evictions from NvmCache
   uint64_t numNvmEvictions{0};
 
@@ -99,6 +99,9 @@ struct Stats {
   // number of puts that observed an inflight concurrent get and aborted
   AtomicCounter numNvmAbortedPutOnInflightGet{0};
 
+  // number of puts aborted because their pool is over its nvm quota
+  AtomicCounter numNvmAbortedPutOnPoolQuota{0};
+
   // number of items that are filtered by compaction
   AtomicCounter numNvmCompactionFiltered{0};
 
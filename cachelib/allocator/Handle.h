@@ -395,7 +395,9 @@ struct ReadHandleImpl {
       // refcount so that alloc_.release does not decrement it to negative.
       alloc_.adjustHandleCountForThread_private(1);
       try {
-        alloc_.release(it, /* isNascent */ false);
+        // Items served from nvm without promotion are never inserted
+        alloc_.release(it,
+                       flags_ & static_cast<uint8_t>(HandleFlags::kNascent));
       } catch (const std::exception& e) {
         XLOGF(CRITICAL, "Failed to release {:#10x} : {}",
               static_cast<void*>(it), e.what());
@@ -16,10 +16,18 @@
 
 #pragma once
 
+#include <folly/Format.h>
 #include <folly/Range.h>
 
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
 #include "cachelib/common/ApproxSplitSet.h"
 #include "cachelib/common/AtomicCounter.h"
+#include "cachelib/common/CountMinSketch.h"
 #include "cachelib/common/PercentileStats.h"
 #include "cachelib/common/Time.h"
 
@@ -131,6 +139,10 @@ class NvmAdmissionPolicy {
   // @param key   key corresponding to the item
   virtual void trackAccess(typename Item::Key) {}
 
+  // Whether the policy makes use of trackAccess(). The cache only reports
+  // accesses to policies that do, since tracking is on the DRAM miss path.
+  virtual bool tracksAccess() const { return false; }
+
   // Set minTTL. This method should be called only once.
   void initMinTTL(uint64_t minTTL) {
     auto initValue = minTTL_.load(std::memory_order_relaxed);
@@ -240,5 +252,304 @@ class RejectFirstAP final : public NvmAdmissionPolicy<Cache> {
   AtomicCounter admitsByDramHits_{0};
   const bool useDramHitSignal_{true};
 };
+
+// Parameters of HistoryBasedAP.
+struct HistoryBasedAPConfig {
+  // Number of recently offered keys remembered to label decisions.
+  uint32_t numHistoryEntries{1 << 18};
+
+  // Number of independently locked shards of the history.
+  uint32_t numShards{256};
+
+  // An offered key looked up again within this window counts as a flash
+  // re-read. This should approximate how long an item stays in flash
+  // before its region is reclaimed.
+  uint32_t labelWindowSecs{3600};
+
+  // Minimum predicted re-read probability to admit an item.
+  double admitThreshold{0.5};
+
+  // Step size of the online gradient updates.
+  double learningRate{0.05};
+
+  // Admit everything until this many labels were learned from.
+  uint64_t warmupLabels{10000};
+
+  // Length of the key suffix to ignore, like RejectFirstAP.
+  size_t suffixIgnoreLength{0};
+};
+
+// A Flashield-style admission policy that learns which items are worth
+// writing to flash. Each candidate is described by a few DRAM access
+// features (whether it was hit in DRAM, time since insert, time since last
+// access, size, and how often the key was read back from flash before) and
+// scored by an online logistic regression model. Items predicted to be read
+// back from flash within the label window are admitted.
+//
+// Labels come from the cache: a DRAM miss (reported through trackAccess) on
+// a key offered to the policy within the label window is a positive example,
+// and a key that is not looked up again within the window is a negative
+// one. Rejected items are labeled too, so the model keeps learning while it
+// rejects, and the precision and recall of its decisions are exported.
+template <typename Cache>
+class HistoryBasedAP final : public NvmAdmissionPolicy<Cache> {
+ public:
+  using Item = typename Cache::Item;
+  using ChainedItemIter = typename Cache::ChainedItemIter;
+
+  using Config = HistoryBasedAPConfig;
+
+  // @throw std::invalid_argument on bad config
+  explicit HistoryBasedAP(Config config)
+      : config_{std::move(config)},
+        slotsPerShard_{config_.numShards > 0
+                           ? config_.numHistoryEntries / config_.numShards
+                           : 0} {
+    if (slotsPerShard_ == 0) {
+      throw std::invalid_argument(folly::sformat(
+          "Need at least one history entry per shard. Entries: {}, shards: "
+          "{}",
+          config_.numHistoryEntries,
+          config_.numShards));
+    }
+    if (config_.admitThreshold < 0 || config_.admitThreshold > 1) {
+      throw std::invalid_argument(folly::sformat(
+          "Admit threshold must be within [0, 1]: {}",
+          config_.admitThreshold));
+    }
+    shards_.reserve(config_.numShards);
+    for (uint32_t i = 0; i < config_.numShards; i++) {
+      shards_.push_back(std::make_unique<Shard>(slotsPerShard_));
+    }
+  }
+
+  bool tracksAccess() const final override { return true; }
+
+  // Labels the last decision for @key as a flash re-read. Called on every
+  // DRAM miss.
+  void trackAccess(typename Item::Key key) final override {
+    const auto keyHash = hashKey(key);
+    auto& shard = getShard(keyHash);
+    Features features{};
+    bool admitted = false;
+    bool reread = false;
+    {
+      std::lock_guard<std::mutex> l{shard.mutex};
+      auto& entry = shard.slots[slotIndex(keyHash)];
+      if (entry.keyHash != keyHash) {
+        return;
+      }
+      features = entry.features;
+      admitted = entry.admitted;
+      reread = util::getCurrentTimeSec() - entry.offeredTime <=
+               config_.labelWindowSecs;
+      if (reread) {
+        shard.rereads.increment(keyHash);
+      }
+      entry = HistoryEntry{};
+    }
+    learn(features, admitted, reread);
+  }
+
+  // Returns the predicted probability of @item being read back from flash.
+  double predict(const Item& item) {
+    const auto rereads = getRereadCount(hashKey(item.getKey()));
+    return predict(makeFeatures(item, item.getTotalSize(), rereads));
+  }
+
+ protected:
+  bool acceptImpl(const Item& item,
+                  folly::Range<ChainedItemIter> chainedItems) final override {
+    uint64_t size = item.getTotalSize();
+    for (const auto& c : chainedItems) {
+      size += c.getTotalSize();
+    }
+    const auto keyHash = hashKey(item.getKey());
+    return decide(keyHash, [&](uint32_t rereads) {
+      return makeFeatures(item, size, rereads);
+    });
+  }
+
+  // Without the item only the key history is known.
+  bool acceptImpl(typename Item::Key key) final override {
+    return decide(hashKey(key), [](uint32_t rereads) {
+      Features features{};
+      features[kBias] = 1;
+      features[kRereads] = rereadFeature(rereads);
+      return features;
+    });
+  }
+
+  void getCountersImpl(const util::CounterVisitor& visitor) final override {
+    const auto tp = truePositives_.get();
+    const auto fp = falsePositives_.get();
+    const auto fn = falseNegatives_.get();
+    visitor("ap.history_true_positives", tp,
+            util::CounterVisitor::CounterType::RATE);
+    visitor("ap.history_false_positives", fp,
+            util::CounterVisitor::CounterType::RATE);
+    visitor("ap.history_true_negatives", trueNegatives_.get(),
+            util::CounterVisitor::CounterType::RATE);
+    visitor("ap.history_false_negatives", fn,
+            util::CounterVisitor::CounterType::RATE);
+    visitor("ap.history_precision",
+            tp + fp > 0 ? static_cast<double>(tp) / (tp + fp) : 0);
+    visitor("ap.history_recall",
+            tp + fn > 0 ? static_cast<double>(tp) / (tp + fn) : 0);
+    visitor("ap.history_warming_up", isWarmingUp() ? 1 : 0);
+  }
+
+ private:
+  // Feature indices. All features are scaled to roughly [0, 1].
+  enum FeatureIndex : size_t {
+    kBias = 0,
+    kDramHit,
+    kAge,
+    kIdle,
+    kSize,
+    kRereads,
+    kNumFeatures,
+  };
+  using Features = std::array<float, kNumFeatures>;
+
+  struct HistoryEntry {
+    // 0 means the slot is empty
+    uint64_t keyHash{0};
+    uint32_t offeredTime{0};
+    bool admitted{false};
+    Features features{};
+  };
+
+  struct Shard {
+    explicit Shard(uint32_t numSlots)
+        : slots(numSlots), rereads{numSlots, kSketchDepth} {}
+
+    std::mutex mutex;
+    // Direct mapped; a newer key replaces an older one in its slot
+    std::vector<HistoryEntry> slots;
+    // How often each key was read back from flash
+    util::CountMinSketch16 rereads;
+  };
+
+  static constexpr uint32_t kSketchDepth{4};
+
+  static float logScale(double v, double maxLog2) {
+    return static_cast<float>(std::min(std::log2(1 + v) / maxLog2, 1.0));
+  }
+
+  static float rereadFeature(uint32_t rereads) { return logScale(rereads, 8); }
+
+  static Features makeFeatures(const Item& item,
+                               uint64_t size,
+                               uint32_t rereads) {
+    const auto now = util::getCurrentTimeSec();
+    const auto created = item.getCreationTime();
+    const auto accessed = item.getLastAccessTime();
+    Features features{};
+    features[kBias] = 1;
+    features[kDramHit] = accessed > created ? 1 : 0;
+    features[kAge] = logScale(now > created ? now - created : 0, 24);
+    features[kIdle] = logScale(now > accessed ? now - accessed : 0, 24);
+    features[kSize] = logScale(size, 32);
+    features[kRereads] = rereadFeature(rereads);
+    return features;
+  }
+
+  uint64_t hashKey(typename Item::Key key) const {
+    const size_t len = key.size() > config_.suffixIgnoreLength
+                           ? key.size() - config_.suffixIgnoreLength
+                           : key.size();
+    const auto keyHash = folly::hash::SpookyHashV2::Hash64(key.data(), len, 0);
+    return keyHash == 0 ? 1 : keyHash;
+  }
+
+  Shard& getShard(uint64_t keyHash) {
+    return *shards_[keyHash % shards_.size()];
+  }
+
+  size_t slotIndex(uint64_t keyHash) const {
+    return (keyHash / shards_.size()) % slotsPerShard_;
+  }
+
+  uint32_t getRereadCount(uint64_t keyHash) {
+    auto& shard = getShard(keyHash);
+    std::lock_guard<std::mutex> l{shard.mutex};
+    return shard.rereads.getCount(keyHash);
+  }
+
+  bool isWarmingUp() const {
+    return numLabels_.load(std::memory_order_relaxed) < config_.warmupLabels;
+  }
+
+  double predict(const Features& features) const {
+    double z = 0;
+    for (size_t i = 0; i < kNumFeatures; i++) {
+      z += weights_[i].load(std::memory_order_relaxed) * features[i];
+    }
+    return 1 / (1 + std::exp(-z));
+  }
+
+  // Records the decision for @keyHash and labels the decision it replaces
+  // if that one has aged out of the label window.
+  template <typename MakeFeaturesFn>
+  bool decide(uint64_t keyHash, MakeFeaturesFn&& makeFeaturesFn) {
+    auto& shard = getShard(keyHash);
+    const auto now = util::getCurrentTimeSec();
+    HistoryEntry expired;
+    bool admit = false;
+    {
+      std::lock_guard<std::mutex> l{shard.mutex};
+      auto features = makeFeaturesFn(shard.rereads.getCount(keyHash));
+      admit = isWarmingUp() || predict(features) >= config_.admitThreshold;
+
+      auto& entry = shard.slots[slotIndex(keyHash)];
+      // A key offered again without a lookup in between was not re-read.
+      // A colliding key only gives a label once the window has passed.
+      if (entry.keyHash == keyHash ||
+          (entry.keyHash != 0 &&
+           now - entry.offeredTime > config_.labelWindowSecs)) {
+        expired = entry;
+      }
+      entry.keyHash = keyHash;
+      entry.offeredTime = now;
+      entry.admitted = admit;
+      entry.features = features;
+    }
+    if (expired.keyHash != 0) {
+      learn(expired.features, expired.admitted, false /* reread */);
+    }
+    return admit;
+  }
+
+  // One step of stochastic gradient descent on the log loss. Concurrent
+  // updates may overwrite each other, which only slows down learning.
+  void learn(const Features& features, bool admitted, bool reread) {
+    if (reread) {
+      (admitted ? truePositives_ : falseNegatives_).inc();
+    } else {
+      (admitted ? falsePositives_ : trueNegatives_).inc();
+    }
+    numLabels_.fetch_add(1, std::memory_order_relaxed);
+
+    const double error = (reread ? 1.0 : 0.0) - predict(features);
+    for (size_t i = 0; i < kNumFeatures; i++) {
+      auto w = weights_[i].load(std::memory_order_relaxed);
+      weights_[i].store(w + config_.learningRate * error * features[i],
+                        std::memory_order_relaxed);
+    }
+  }
+
+  const Config config_;
+  const uint32_t slotsPerShard_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::array<std::atomic<double>, kNumFeatures> weights_{};
+  std::atomic<uint64_t> numLabels_{0};
+
+  AtomicCounter truePositives_{0};
+  AtomicCounter falsePositives_{0};
+  AtomicCounter trueNegatives_{0};
+  AtomicCounter falseNegatives_{0};
+};
 } // namespace cachelib
 } // namespace facebook
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/hash/SpookyHashV2.h>
+
+#include "cachelib/allocator/memory/Slab.h"
+#include "cachelib/common/ApproxSplitSet.h"
+#include "cachelib/common/AtomicCounter.h"
+#include "cachelib/common/Utils.h"
+
+namespace facebook {
+namespace cachelib {
+
+// Base class for promotion policy from nvm cache into DRAM.
+// Every nvm hit asks the policy whether the item should be inserted into
+// DRAM. A rejected hit is served from a handle to an item that is not
+// inserted into the cache and is freed once the last handle to it is
+// released, so one-hit items of scan-like traffic do not evict DRAM items.
+template <typename Cache>
+class NvmPromotionPolicy {
+ public:
+  using Item = typename Cache::Item;
+  virtual ~NvmPromotionPolicy() = default;
+
+  // The method that the outside class calls to get the promotion decision.
+  // It captures the common logics (e.g statistics) then
+  // delicates the detailed implementation to subclasses in acceptImpl.
+  //
+  // @param key   key of the item found in nvm cache
+  // @param pid   pool the item is allocated from
+  // @return true if the item should be inserted into DRAM
+  virtual bool accept(typename Item::Key key, PoolId pid) final {
+    overallCount_.inc();
+    const bool decision = acceptImpl(key, pid);
+    if (decision) {
+      promoted_.inc();
+    } else {
+      rejected_.inc();
+    }
+    return decision;
+  }
+
+  // The method that exposes stats.
+  virtual void getCounters(const util::CounterVisitor& visitor) final {
+    getCountersImpl(visitor);
+    visitor("promotion.called", overallCount_.get(),
+            util::CounterVisitor::CounterType::RATE);
+    visitor("promotion.promoted", promoted_.get(),
+            util::CounterVisitor::CounterType::RATE);
+    visitor("promotion.rejected", rejected_.get(),
+            util::CounterVisitor::CounterType::RATE);
+  }
+
+  // Implement this method for the detailed promotion decision logic.
+  // By default this promotes all items.
+  virtual bool acceptImpl(typename Item::Key, PoolId) { return true; }
+
+  // Implementation specific statistics.
+  // Please include a prefix/postfix with the name of implementation to avoid
+  // collision with base level stats.
+  virtual void getCountersImpl(const util::CounterVisitor&) {}
+
+ private:
+  AtomicCounter overallCount_{0};
+  AtomicCounter promoted_{0};
+  AtomicCounter rejected_{0};
+};
+
+// a promotion policy that promotes an item on its second nvm hit. It keeps
+// track of a number (numEntries) of unique keys recently hit in nvm and
+// rejects the hit if the key is not among them, backed by
+// cachelib/common/ApproxSplitSet
+template <typename Cache>
+class SecondHitPromotionPolicy final : public NvmPromotionPolicy<Cache> {
+ public:
+  using Item = typename Cache::Item;
+
+  // @param numEntries number of keys to be tracked
+  // @param numSplits number of splits in the ApporxSplitSet
+  SecondHitPromotionPolicy(uint64_t numEntries, uint32_t numSplits)
+      : tracker_{numEntries, numSplits} {}
+
+ protected:
+  bool acceptImpl(typename Item::Key key, PoolId) final override {
+    const auto keyHash =
+        folly::hash::SpookyHashV2::Hash64(key.data(), key.size(), 0);
+    // if key already existed, return true. If we are inserting it for
+    // the first time, we insert to track and return false
+    return tracker_.insert(keyHash);
+  }
+
+  void getCountersImpl(const util::CounterVisitor& visitor) final override {
+    visitor("promotion.second_hit_keys_tracked", tracker_.numKeysTracked());
+    visitor("promotion.second_hit_tracking_window_secs",
+            tracker_.trackingWindowDurationSecs());
+  }
+
+ private:
+  ApproxSplitSet tracker_;
+};
+
+} // namespace cachelib
+} // namespace facebook
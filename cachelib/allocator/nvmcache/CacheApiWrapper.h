@@ -112,6 +112,17 @@ class CacheAPIWrapperForNvm {
     return cache.insertImpl(handle, AllocatorApiEvent::INSERT_FROM_NVM);
   }
 
+  // Ask the promotion policy whether an item found in nvmcache should be
+  // inserted into DRAM.
+  //
+  // @param cache  the cache instance using nvmcache
+  // @param key    the key of the item
+  // @param pid    the pool the item is allocated from
+  // @return true if the item should be inserted through insertFromNvm
+  static bool shouldPromoteFromNvm(C& cache, Key key, PoolId pid) {
+    return cache.shouldPromoteFromNvmCache(key, pid);
+  }
+
   // Acquire the wait context for the handle. This is used by nvmcache to
   // maintain a list of waiters.
   //
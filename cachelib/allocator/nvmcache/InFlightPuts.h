@@ -16,11 +16,12 @@
 
 #pragma once
 
-#include <folly/Hash.h>
+#include <folly/Expected.h>
 #include <folly/Range.h>
-#include <folly/container/F14Map.h>
-#include <folly/fibers/TimedMutex.h>
-#include <folly/lang/Align.h>
+#include <folly/ScopeGuard.h>
+#include <folly/concurrency/ConcurrentHashMap.h>
+#include <folly/fibers/FiberManager.h>
+#include <folly/hash/SpookyHashV2.h>
 #include <folly/logging/xlog.h>
 
 #include <utility>
@@ -28,59 +29,66 @@
 namespace facebook {
 namespace cachelib {
 
-using folly::fibers::TimedMutex;
-
 // Utility to track inflight puts in nvmcache through a token. Tokens can be
-// invalidated and can be used to execute some function if not invalidated. The
-// user guarantees that the lifetime of the token is within the lifetime of the
-// string piece with which they obtain the token.
-class alignas(folly::hardware_destructive_interference_size) InFlightPuts {
-  using LockGuard = std::lock_guard<TimedMutex>;
-  using UniqueLock = std::unique_lock<TimedMutex>;
-
+// invalidated and can be used to execute some function if not invalidated.
+//
+// Tokens are tracked by the hash of their key in a concurrent hash map, so
+// that invalidations on the lookup path do not take a lock. Two keys with
+// the same 64-bit hash share a token, which can only fail or cancel a put
+// to nvmcache and never lets a stale put through.
+class InFlightPuts {
  public:
   class PutToken;
 
+  // TRY_LOCK_FAIL is no longer returned since acquiring a token does not
+  // take a lock.
   enum class PutTokenError { TRY_LOCK_FAIL, TOKEN_EXISTS, CALLBACK_FAILED };
 
   // inserts an in-flight put into the map if none exists and acquires a
-  // token.  If a token is acquired successfully, will call fn() while
-  // holding the mutex_. If fn() returns false, deletes the token otherwise
-  // return the valid token.
+  // token. If a token is acquired successfully, will call fn() before any
+  // invalidation of the key can complete. If fn() returns false, deletes the
+  // token otherwise return the valid token.
   template <typename F>
   folly::Expected<PutToken, PutTokenError> tryAcquireToken(
       folly::StringPiece key, F&& fn) {
-    UniqueLock l(mutex_, std::try_to_lock);
-    if (!l.owns_lock()) {
-      return folly::makeUnexpected(PutTokenError::TRY_LOCK_FAIL);
-    }
-
-    auto ret = keys_.emplace(key, true);
+    const auto hash = hashKey(key);
     // record for same key being inflight written to nvmcache should be rare.
     // In that case, fail the latter one.
-    if (!ret.second) {
+    if (!keys_.try_emplace(hash, State::kExecuting).second) {
       return folly::makeUnexpected(PutTokenError::TOKEN_EXISTS);
     }
 
+    auto eraseGuard = folly::makeGuard([&]() { keys_.erase(hash); });
     bool fnRet = std::forward<F>(fn)();
     if (fnRet) {
-      return PutToken{key, *this};
+      eraseGuard.dismiss();
+      keys_.assign(hash, State::kValid);
+      return PutToken{hash, *this};
     }
 
     // if fn() failed, erase the token
-    auto eraseRet = keys_.erase(key);
-    XDCHECK_EQ(eraseRet, 1u);
     return folly::makeUnexpected(PutTokenError::CALLBACK_FAILED);
   }
 
   // marks the token as invalidated. This will ensure that we dont execute any
   // function on this token and simply remove the token when the token gets
-  // destroyed.
+  // destroyed. If a function is being executed on the token, waits for it to
+  // finish.
   void invalidateToken(folly::StringPiece key) {
-    LockGuard l(mutex_);
-    auto it = keys_.find(key);
-    if (it != keys_.end()) {
-      it->second = false;
+    const auto hash = hashKey(key);
+    while (true) {
+      {
+        auto it = keys_.find(hash);
+        if (it == keys_.cend() || it->second == State::kInvalid) {
+          return;
+        }
+        if (it->second == State::kValid &&
+            keys_.assign_if_equal(hash, State::kValid, State::kInvalid)) {
+          return;
+        }
+      }
+      // executing or raced with another update of the token
+      folly::fibers::yield();
     }
   }
 
@@ -91,7 +99,7 @@ class alignas(folly::hardware_destructive_interference_size) InFlightPuts {
     PutToken() noexcept {}
     ~PutToken() {
       if (puts_) {
-        puts_->removeToken(key_);
+        puts_->removeToken(hash_);
       }
     }
 
@@ -100,7 +108,8 @@ class alignas(folly::hardware_destructive_interference_size) InFlightPuts {
     PutToken& operator=(const PutToken&) = delete;
 
     // moving is okay
-    PutToken(PutToken&& other) noexcept : key_(other.key_), puts_(other.puts_) {
+    PutToken(PutToken&& other) noexcept
+        : hash_(other.hash_), puts_(other.puts_) {
       other.reset();
     }
 
@@ -121,7 +130,7 @@ class alignas(folly::hardware_destructive_interference_size) InFlightPuts {
     template <typename F>
     bool executeIfValid(F&& fn) {
       if (isValid() &&
-          puts_->executeIfValid(key_, std::forward<decltype(fn)>(fn))) {
+          puts_->executeIfValid(hash_, std::forward<decltype(fn)>(fn))) {
         // successfully executed, reset the token.
         reset();
         return true;
@@ -132,54 +141,61 @@ class alignas(folly::hardware_destructive_interference_size) InFlightPuts {
    private:
     void reset() noexcept {
       puts_ = nullptr;
-      key_.clear();
+      hash_ = 0;
       XDCHECK(!isValid());
     }
 
     friend InFlightPuts;
-    PutToken(folly::StringPiece key, InFlightPuts& puts)
-        : key_(key), puts_(&puts) {}
+    PutToken(uint64_t hash, InFlightPuts& puts) : hash_(hash), puts_(&puts) {}
 
-    // key corresponding to the token
-    folly::StringPiece key_{};
+    // hash of the key corresponding to the token
+    uint64_t hash_{0};
 
     // map holding the state
     InFlightPuts* puts_{nullptr};
   };
 
  private:
+  enum class State : uint8_t {
+    kValid,
+    kInvalid,
+    // a function is being executed on the token, or the token is being
+    // acquired. Invalidations wait for this to finish.
+    kExecuting,
+  };
+
+  static uint64_t hashKey(folly::StringPiece key) {
+    return folly::hash::SpookyHashV2::Hash64(key.data(), key.size(), 0);
+  }
+
   // execute only if the token is present and was not invalidated.
-  //  @param key the item key
+  //  @param hash the hash of the item key
   //  @param fn  function to execute
   //
   //  @return  true if the function was executed and token was destroyed
   //          appropriately
   //  @throw    if fn throws, token is preserved.
   template <typename F>
-  bool executeIfValid(folly::StringPiece key, F&& fn) {
-    LockGuard l(mutex_);
-    auto it = keys_.find(key);
-    const bool valid = it != keys_.end() && it->second;
-    if (valid) {
-      fn();
-      keys_.erase(it);
-      return true;
+  bool executeIfValid(uint64_t hash, F&& fn) {
+    if (!keys_.assign_if_equal(hash, State::kValid, State::kExecuting)) {
+      return false;
     }
-    return false;
+    auto restoreGuard =
+        folly::makeGuard([&]() { keys_.assign(hash, State::kValid); });
+    fn();
+    restoreGuard.dismiss();
+    keys_.erase(hash);
+    return true;
   }
 
   // erases the record from inflight map.
-  void removeToken(folly::StringPiece key) {
-    LockGuard l(mutex_);
-    auto res = keys_.erase(key);
+  void removeToken(uint64_t hash) {
+    auto res = keys_.erase(hash);
     XDCHECK_EQ(res, 1u);
   }
 
-  // map storing the presence of a token  and its validity
-  folly::F14FastMap<folly::StringPiece, bool, folly::Hash> keys_;
-
-  // mutex protecting the map.
-  TimedMutex mutex_;
+  // map storing the presence of a token and its state, by key hash
+  folly::ConcurrentHashMap<uint64_t, State> keys_;
 };
 
 } // namespace cachelib
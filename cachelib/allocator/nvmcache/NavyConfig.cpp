@@ -64,13 +64,26 @@ RandomAPConfig& RandomAPConfig::setAdmProbability(double admProbability) {
 }
 
 // device settings
-void NavyConfig::enableAsyncIo(unsigned int qDepth, bool enableIoUring) {
+void NavyConfig::enableAsyncIo(unsigned int qDepth,
+                               bool enableIoUring,
+                               bool registerBuffers,
+                               bool batchSubmit) {
+  if (registerBuffers && !enableIoUring) {
+    throw std::invalid_argument(
+        "io buffer registration is only supported with io_uring");
+  }
+  if (batchSubmit && !enableIoUring) {
+    throw std::invalid_argument(
+        "batched io submission is only supported with io_uring");
+  }
   if (!qDepth && !qDepth_) {
     XDCHECK_EQ(ioEngine_, IoEngine::Sync);
     return;
   }
 
   ioEngine_ = enableIoUring ? IoEngine::IoUring : IoEngine::LibAio;
+  ioUringRegisterBuffers_ = registerBuffers;
+  ioUringBatchSubmit_ = batchSubmit;
   if (qDepth) {
     qDepth_ = qDepth;
   }
@@ -102,6 +115,19 @@ void NavyConfig::setRaidFiles(std::vector<std::string> raidPaths,
   truncateFile_ = truncateFile;
 }
 
+void NavyConfig::setEmulatedSsd(EmulatedSsdConfig emulatedSsdConfig) {
+  if (emulatedSsdConfig.queueDepth == 0 ||
+      emulatedSsdConfig.numChannels == 0) {
+    throw std::invalid_argument(folly::sformat(
+        "emulated SSD needs a queue depth and channels, got {} and {}",
+        emulatedSsdConfig.queueDepth, emulatedSsdConfig.numChannels));
+  }
+  if (emulatedSsdConfig.eraseBlockSize == 0) {
+    throw std::invalid_argument("emulated SSD erase block size must be > 0");
+  }
+  emulatedSsdConfig_ = emulatedSsdConfig;
+}
+
 BlockCacheConfig& BlockCacheConfig::enableHitsBasedReinsertion(
     uint8_t hitsThreshold) {
   reinsertionConfig_.enableHitsBased(hitsThreshold);
@@ -146,6 +172,32 @@ BlockCacheConfig& BlockCacheConfig::setCleanRegions(
   return *this;
 }
 
+BlockCacheConfig& BlockCacheConfig::setSparseReclaimThreshold(
+    double threshold) {
+  if (threshold < 0 || threshold > 1) {
+    throw std::invalid_argument(folly::sformat(
+        "sparse reclaim threshold should be in the range of [0, 1], but is {}",
+        threshold));
+  }
+  sparseReclaimThreshold_ = threshold;
+  return *this;
+}
+
+BlockCacheConfig& BlockCacheConfig::setExpiryBuckets(
+    std::vector<uint32_t> expiryBuckets) {
+  for (size_t i = 0; i < expiryBuckets.size(); i++) {
+    if (expiryBuckets[i] == 0 ||
+        (i > 0 && expiryBuckets[i] <= expiryBuckets[i - 1])) {
+      throw std::invalid_argument(folly::sformat(
+          "expiry buckets should be positive and strictly ascending, but {} "
+          "is given",
+          folly::join(",", expiryBuckets)));
+    }
+  }
+  expiryBuckets_ = std::move(expiryBuckets);
+  return *this;
+}
+
 // BigHash settings
 BigHashConfig& BigHashConfig::setSizePctAndMaxItemSize(
     unsigned int sizePct, uint64_t smallItemMaxSize) {
@@ -163,6 +215,17 @@ BigHashConfig& BigHashConfig::setSizePctAndMaxItemSize(
   return *this;
 }
 
+BigHashConfig& BigHashConfig::setMaxSizePct(unsigned int maxSizePct) {
+  if (maxSizePct > 100) {
+    throw std::invalid_argument(folly::sformat(
+        "BigHash max size pct should be in the range of [0, 100], but {} is "
+        "set",
+        maxSizePct));
+  }
+  maxSizePct_ = maxSizePct;
+  return *this;
+}
+
 // job scheduler settings
 
 void NavyConfig::setReaderAndWriterThreads(unsigned int readerThreads,
@@ -225,6 +288,8 @@ std::map<std::string, std::string> EnginesConfig::serialize() const {
   // BlockCache settings
   configMap["navyConfig::blockCacheLru"] =
       blockCache().isLruEnabled() ? "true" : "false";
+  configMap["navyConfig::blockCacheCostBenefit"] =
+      blockCache().isCostBenefitEnabled() ? "true" : "false";
   configMap["navyConfig::blockCacheRegionSize"] =
       folly::to<std::string>(blockCache().getRegionSize());
   configMap["navyConfig::blockCacheCleanRegions"] =
@@ -247,6 +312,8 @@ std::map<std::string, std::string> EnginesConfig::serialize() const {
   // BigHash settings
   configMap["navyConfig::bigHashSizePct"] =
       folly::to<std::string>(bigHash().getSizePct());
+  configMap["navyConfig::bigHashMaxSizePct"] =
+      folly::to<std::string>(bigHash().getMaxSizePct());
   configMap["navyConfig::bigHashBucketSize"] =
       folly::to<std::string>(bigHash().getBucketSize());
   configMap["navyConfig::bigHashBucketBfSize"] =
@@ -288,7 +355,29 @@ std::map<std::string, std::string> NavyConfig::serialize() const {
       folly::to<std::string>(deviceMaxWriteSize_);
   configMap["navyConfig::ioEngine"] = getIoEngineName(ioEngine_).str();
   configMap["navyConfig::QDepth"] = folly::to<std::string>(qDepth_);
+  configMap["navyConfig::ioUringRegisterBuffers"] =
+      ioUringRegisterBuffers_ ? "true" : "false";
+  configMap["navyConfig::ioUringBatchSubmit"] =
+      ioUringBatchSubmit_ ? "true" : "false";
+  configMap["navyConfig::ioClassInflightLimits"] =
+      folly::join(",", ioClassInflightLimits_);
   configMap["navyConfig::enableFDP"] = folly::to<std::string>(enableFDP_);
+  configMap["navyConfig::checksumType"] =
+      getChecksumTypeName(checksumType_).str();
+  configMap["navyConfig::encryptionThreads"] =
+      folly::to<std::string>(encryptionThreads_);
+  configMap["navyConfig::discard"] = discardEnabled_ ? "true" : "false";
+  configMap["navyConfig::maxDiscardRate"] =
+      folly::to<std::string>(maxDiscardRate_);
+  configMap["navyConfig::emulatedSsd"] =
+      emulatedSsdConfig_
+          ? folly::sformat("qd={},channels={},readUs={},writeUs={},eraseUs={}",
+                           emulatedSsdConfig_->queueDepth,
+                           emulatedSsdConfig_->numChannels,
+                           emulatedSsdConfig_->readLatencyUs,
+                           emulatedSsdConfig_->writeLatencyUs,
+                           emulatedSsdConfig_->eraseLatencyUs)
+          : "none";
 
   // Job scheduler settings
   configMap["navyConfig::readerThreads"] =
@@ -307,6 +396,8 @@ std::map<std::string, std::string> NavyConfig::serialize() const {
   configMap["navyConfig::maxParcelMemoryMB"] =
       folly::to<std::string>(maxParcelMemoryMB_);
 
+  configMap["navyConfig::tieredEngines"] =
+      tieredEngines_ ? "true" : "false";
   if (enginesConfigs_.size() > 1) {
     for (size_t idx = 0; idx < enginesConfigs_.size(); idx++) {
       const auto& c = enginesConfigs_[idx];
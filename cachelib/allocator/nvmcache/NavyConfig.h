@@ -19,6 +19,9 @@
 #include <folly/json/dynamic.h>
 #include <folly/logging/xlog.h>
 
+#include <algorithm>
+#include <array>
+#include <optional>
 #include <stdexcept>
 
 #include "cachelib/allocator/nvmcache/BlockCacheReinsertionPolicy.h"
@@ -263,6 +266,17 @@ class BlockCacheConfig {
   // Enable FIFO eviction policy (LRU will be disabled).
   BlockCacheConfig& enableFifo() noexcept {
     lru_ = false;
+    costBenefit_ = false;
+    return *this;
+  }
+
+  // Enable cost-benefit eviction policy (LRU and segmented FIFO will be
+  // disabled). Regions are picked by age * (1 - u) / (1 + u), u being the
+  // fraction of the region still live, so mostly dead regions go first.
+  BlockCacheConfig& enableCostBenefit() noexcept {
+    sFifoSegmentRatio_.clear();
+    lru_ = false;
+    costBenefit_ = true;
     return *this;
   }
 
@@ -277,6 +291,7 @@ class BlockCacheConfig {
       std::vector<unsigned int> sFifoSegmentRatio) noexcept {
     sFifoSegmentRatio_ = std::move(sFifoSegmentRatio);
     lru_ = false;
+    costBenefit_ = false;
     return *this;
   }
 
@@ -337,8 +352,72 @@ class BlockCacheConfig {
     return *this;
   }
 
+  // Enable sparse reclaim. When the live bytes of a region fall below
+  // @threshold of its written bytes, reclaim reads only the live entries
+  // instead of the whole region. This costs 12 bytes of DRAM per item.
+  // @throw std::invalid_argument if @threshold is not in the range of 0~1.
+  BlockCacheConfig& setSparseReclaimThreshold(double threshold);
+
+  // Reclaim regions none of whose entries are referenced any more, because
+  // they were all removed or overwritten, without reading them back.
+  BlockCacheConfig& setReclaimDeadWithoutRead(bool enable) noexcept {
+    reclaimDeadWithoutRead_ = enable;
+    return *this;
+  }
+
+  // Group writes into separate regions by the remaining TTL of the items, so
+  // that whole regions expire together and can be reclaimed without reads.
+  // @param expiryBuckets  ascending TTL boundaries in seconds, e.g.
+  //                       {60, 3600, 86400}. Items past the last boundary or
+  //                       without TTL share one more bucket.
+  // Every bucket keeps its own open region, so in-mem buffers must be at least
+  // the number of buckets plus one (times the number of SFIFO segments).
+  // @throw std::invalid_argument if @expiryBuckets is not strictly ascending
+  //        or contains 0.
+  BlockCacheConfig& setExpiryBuckets(std::vector<uint32_t> expiryBuckets);
+
+  // Write a footer into every region so that, after an unclean shutdown, the
+  // cache is rebuilt by scanning the device instead of being dropped. Items
+  // removed or replaced since they were written to flash may come back after
+  // such a rebuild, so only enable it if that is acceptable.
+  BlockCacheConfig& setScanRecovery(bool scanRecovery) noexcept {
+    scanRecovery_ = scanRecovery;
+    return *this;
+  }
+
+  // Keep up to @sizeMB of recently flushed region buffers in memory and serve
+  // reads of those regions from them instead of the device. Memory is
+  // allocated in whole regions on top of the in-mem buffers. 0 disables it.
+  BlockCacheConfig& setFlushedRegionCacheSizeMB(uint32_t sizeMB) noexcept {
+    flushedRegionCacheSizeMB_ = sizeMB;
+    return *this;
+  }
+
+  // Read regions in chunks of @size bytes when reclaiming them, reading the
+  // next chunk while the entries of the current one are evicted or
+  // reinserted. This bounds the memory of each reclaim thread to two chunks
+  // instead of a whole region, which makes large regions affordable. Must be
+  // a multiple of the device block size. 0 reads whole regions.
+  BlockCacheConfig& setReclaimChunkSize(uint32_t size) noexcept {
+    reclaimChunkSize_ = size;
+    return *this;
+  }
+
+  // Store values up to @size bytes that do not fit in a region as chunks in
+  // several regions, so items much larger than the region size can be cached
+  // without raising it. The chunks are read in parallel on lookup and an
+  // item is dropped as a whole when any of its chunks is evicted. Chunked
+  // items don't get destructor callbacks, so this can't be used with item
+  // destructor. 0 disables it.
+  BlockCacheConfig& setMaxChunkedItemSize(uint64_t size) noexcept {
+    maxChunkedItemSize_ = size;
+    return *this;
+  }
+
   bool isLruEnabled() const { return lru_; }
 
+  bool isCostBenefitEnabled() const { return costBenefit_; }
+
   const std::vector<unsigned int>& getSFifoSegmentRatio() const {
     return sFifoSegmentRatio_;
   }
@@ -361,9 +440,29 @@ class BlockCacheConfig {
 
   bool isPreciseRemove() const { return preciseRemove_; }
 
+  double getSparseReclaimThreshold() const { return sparseReclaimThreshold_; }
+
+  bool isReclaimDeadWithoutRead() const { return reclaimDeadWithoutRead_; }
+
+  const std::vector<uint32_t>& getExpiryBuckets() const {
+    return expiryBuckets_;
+  }
+
+  bool isScanRecoveryEnabled() const { return scanRecovery_; }
+
+  uint32_t getFlushedRegionCacheSizeMB() const {
+    return flushedRegionCacheSizeMB_;
+  }
+
+  uint32_t getReclaimChunkSize() const { return reclaimChunkSize_; }
+
+  uint64_t getMaxChunkedItemSize() const { return maxChunkedItemSize_; }
+
  private:
   // Whether Navy BlockCache will use region-based LRU eviction policy.
   bool lru_{true};
+  // Whether Navy BlockCache will use the cost-benefit eviction policy.
+  bool costBenefit_{false};
   // The ratio of segments for segmented FIFO eviction policy.
   // Once segmented FIFO is enabled, lru_ will be false.
   std::vector<unsigned int> sFifoSegmentRatio_;
@@ -385,6 +484,24 @@ class BlockCacheConfig {
   // Whether to remove an item by checking the key (true) or only the hash value
   // (false).
   bool preciseRemove_{false};
+  // Fraction of live bytes below which a region is reclaimed by reading only
+  // its live entries. 0 means sparse reclaim is disabled.
+  double sparseReclaimThreshold_{0};
+  // Whether regions without live entries are reclaimed without reading them.
+  bool reclaimDeadWithoutRead_{false};
+  // TTL boundaries (in seconds) grouping writes into regions by expiry.
+  // Empty means writes are not grouped by expiry.
+  std::vector<uint32_t> expiryBuckets_;
+  // Whether regions carry footers for rebuilding the cache after a crash.
+  bool scanRecovery_{false};
+  // Memory (in MB) for recently flushed region buffers that serve reads.
+  uint32_t flushedRegionCacheSizeMB_{0};
+  // Size (in bytes) of the chunks regions are read in during reclaim. 0 means
+  // regions are read whole.
+  uint32_t reclaimChunkSize_{0};
+  // Largest value (in bytes) stored in chunks across regions. 0 means values
+  // must fit in a region.
+  uint64_t maxChunkedItemSize_{0};
 
   // Intended size of the block cache.
   // If 0, this block cache takes all the space left on the device.
@@ -402,6 +519,7 @@ class BlockCacheConfig {
  * - set maximum item size
  * - set bucket size
  * - set bloom filter size (0 to disable bloom filter)
+ * - let BigHash grow into the space of BlockCache at runtime
  * - get the values of all the above parameters
  */
 class BigHashConfig {
@@ -428,10 +546,23 @@ class BigHashConfig {
     return *this;
   }
 
+  // Reserve up to @maxSizePct of the device for BigHash, so that space can
+  // move between BigHash and BlockCache at runtime
+  // (CacheAllocator::resizeNvmSmallItemCache). BigHash starts at sizePct
+  // and BlockCache uses the rest. Only the last pair of engines can be
+  // resizable. Default value is 0, meaning the split is fixed.
+  // @throw std::invalid_argument if maxSizePct is not in the range of
+  //        [0, 100].
+  BigHashConfig& setMaxSizePct(unsigned int maxSizePct);
+
   bool isBloomFilterEnabled() const { return bucketBfSize_ > 0; }
 
+  bool isResizable() const { return maxSizePct_ > 0; }
+
   unsigned int getSizePct() const { return sizePct_; }
 
+  unsigned int getMaxSizePct() const { return maxSizePct_; }
+
   uint32_t getBucketSize() const { return bucketSize_; }
 
   uint64_t getBucketBfSize() const { return bucketBfSize_; }
@@ -442,6 +573,9 @@ class BigHashConfig {
   // Percentage of how much of the device out of all is given to BigHash
   // engine in Navy, e.g. 50.
   unsigned int sizePct_{0};
+  // Percentage of the device BigHash can grow to at runtime. 0 if BigHash
+  // can't be resized.
+  unsigned int maxSizePct_{0};
   // Navy BigHash engine's bucket size (must be multiple of the minimum
   // device io block size).
   // This size determines how big each bucket is and what is the physical
@@ -488,6 +622,78 @@ inline const folly::StringPiece getIoEngineName(IoEngine e) {
   return "invalid";
 }
 
+// Class of a device IO. Background classes (region flushes and reclaim reads)
+// can be capped so that bursts of them don't queue up in front of user IOs.
+enum class IoClass : uint8_t { UserRead = 0, UserWrite, Flush, Reclaim };
+
+constexpr size_t kNumIoClasses = 4;
+
+inline const folly::StringPiece getIoClassName(IoClass c) {
+  switch (c) {
+  case IoClass::UserRead:
+    return "user_read";
+  case IoClass::UserWrite:
+    return "user_write";
+  case IoClass::Flush:
+    return "flush";
+  case IoClass::Reclaim:
+    return "reclaim";
+  }
+  XDCHECK(false);
+  return "invalid";
+}
+
+// Checksum used for Navy values (BlockCache entries and BigHash buckets).
+// Crc32c maps to the SSE4.2 / ARMv8 CRC instructions when available and is
+// noticeably cheaper than the table-driven Crc32 on large values.
+enum class ChecksumType : uint8_t { Crc32 = 0, Crc32c };
+
+inline const folly::StringPiece getChecksumTypeName(ChecksumType type) {
+  switch (type) {
+  case ChecksumType::Crc32:
+    return "crc32";
+  case ChecksumType::Crc32c:
+    return "crc32c";
+  }
+  XDCHECK(false);
+  return "invalid";
+}
+
+// Performance model of an SSD emulated on top of DRAM or a file, so that
+// Navy tuning can be benchmarked reproducibly without NVMe hardware. All
+// times are in microseconds and bandwidths in MB/s; 0 bandwidth is
+// unlimited.
+struct EmulatedSsdConfig {
+  // Max IOs outstanding on the device; later IOs queue in the host
+  uint32_t queueDepth{128};
+  // Independent flash channels serving reads and erases in parallel
+  uint32_t numChannels{8};
+  // Mean flash latencies. Writes complete once they land in the write
+  // buffer; only erases issued by the GC model hit the flash synchronously.
+  uint32_t readLatencyUs{80};
+  uint32_t writeLatencyUs{20};
+  uint32_t eraseLatencyUs{3000};
+  // Latencies are drawn uniformly within +/- jitterPct of the mean and are
+  // multiplied by tailLatencyFactor with probability tailProbability.
+  uint32_t latencyJitterPct{10};
+  double tailProbability{0.001};
+  uint32_t tailLatencyFactor{10};
+  // Host interface transfer rate for reads, and the rate the write buffer
+  // is drained to flash at
+  uint32_t readBandwidthMBps{3000};
+  uint32_t writeBandwidthMBps{1500};
+  // Writes beyond a full write buffer stall until it drains
+  uint64_t writeBufferSize{64 * 1024 * 1024};
+  // Once more than gcThresholdPct of the device holds written (not yet
+  // discarded) data, every eraseBlockSize bytes written costs an erase on
+  // a channel and writes drain gcWriteAmplification times slower.
+  uint32_t gcThresholdPct{90};
+  uint64_t eraseBlockSize{4 * 1024 * 1024};
+  double gcWriteAmplification{2.0};
+  // Seed of the latency distribution, for reproducible runs
+  uint64_t seed{0};
+};
+
 /**
  * NavyConfig provides APIs for users to set up Navy related settings for
  * NvmCache.
@@ -512,6 +718,14 @@ class NavyConfig {
     return enginesConfigs_[0].bigHash().getSizePct() > 0;
   }
   bool isFDPEnabled() const { return enableFDP_; }
+  // Whether any block cache can be rebuilt by scanning the device.
+  bool isScanRecoveryEnabled() const {
+    return std::any_of(enginesConfigs_.begin(), enginesConfigs_.end(),
+                       [](const EnginesConfig& enginesConfig) {
+                         return enginesConfig.blockCache()
+                             .isScanRecoveryEnabled();
+                       });
+  }
 
   std::map<std::string, std::string> serialize() const;
 
@@ -537,7 +751,22 @@ class NavyConfig {
   bool getTruncateFile() const { return truncateFile_; }
   uint32_t getDeviceMaxWriteSize() const { return deviceMaxWriteSize_; }
   IoEngine getIoEngine() const { return ioEngine_; }
+  ChecksumType getChecksumType() const { return checksumType_; }
+  uint32_t getEncryptionThreads() const { return encryptionThreads_; }
+  bool isDiscardEnabled() const { return discardEnabled_; }
+  bool usesEmulatedSsd() const { return emulatedSsdConfig_.has_value(); }
+  const EmulatedSsdConfig& getEmulatedSsdConfig() const {
+    return *emulatedSsdConfig_;
+  }
+  uint64_t getMaxDiscardRate() const { return maxDiscardRate_; }
   unsigned int getQDepth() const { return qDepth_; }
+  bool isIoUringRegisterBuffersEnabled() const {
+    return ioUringRegisterBuffers_;
+  }
+  bool isIoUringBatchSubmitEnabled() const { return ioUringBatchSubmit_; }
+  uint32_t getIoClassInflightLimit(IoClass ioClass) const {
+    return ioClassInflightLimits_[static_cast<size_t>(ioClass)];
+  }
   bool hasDeviceDataCorruptionForTesting() const {
     return testingBadDeviceHasDataCorruption_;
   }
@@ -626,7 +855,53 @@ class NavyConfig {
   // If enabled already via job config settings, this will override
   // the qDepth_ or enableIoUring_.
   // If qDepth is 0, existing qDepth_ will be used
-  void enableAsyncIo(unsigned int qDepth, bool enableIoUring);
+  // If registerBuffers is true, long-lived IO buffers (BlockCache in-mem
+  // region buffers) are registered with io_uring and flushed with
+  // WRITE_FIXED, saving the per-IO page pinning. Requires io_uring and
+  // enough RLIMIT_MEMLOCK; otherwise Navy falls back to regular IOs.
+  // If batchSubmit is true, the IOs issued by the fibers of a Navy thread
+  // during one event loop iteration are handed to io_uring with a single
+  // submit call, and completions that are already available are handled
+  // right away. Requires io_uring.
+  // @throw std::invalid_argument if registerBuffers or batchSubmit is set
+  //                              without io_uring
+  void enableAsyncIo(unsigned int qDepth,
+                     bool enableIoUring,
+                     bool registerBuffers = false,
+                     bool batchSubmit = false);
+
+  // Cap the number of in-flight device IOs of the given class. 0 (default)
+  // means unlimited. Capping Flush and Reclaim keeps background work from
+  // inflating user lookup tail latency during reclaim bursts, at the cost of
+  // slower region turnover.
+  void setIoClassInflightLimit(IoClass ioClass, uint32_t limit) noexcept {
+    ioClassInflightLimits_[static_cast<size_t>(ioClass)] = limit;
+  }
+
+  // Select the checksum used for values (BlockCache entries with
+  // checksumming enabled and BigHash buckets). Changing it drops the
+  // persisted cache on the next restart.
+  void setChecksumType(ChecksumType type) noexcept { checksumType_ = type; }
+
+  // Encrypt and decrypt on a pool of @numThreads threads so that encryption
+  // of large IOs (region flushes and reclaim reads) overlaps the device IO.
+  // 0 (default) encrypts inline. Only used with a device encryptor.
+  void setEncryptionThreads(uint32_t numThreads) noexcept {
+    encryptionThreads_ = numThreads;
+  }
+
+  // Discard (TRIM) regions when they are reclaimed and the whole cache when
+  // it is reset, so the SSD garbage collector does not relocate dead data.
+  // @maxBytesPerSec caps the discard bandwidth; 0 (default) is unlimited.
+  void enableDiscard(uint64_t maxBytesPerSec = 0) noexcept {
+    discardEnabled_ = true;
+    maxDiscardRate_ = maxBytesPerSec;
+  }
+
+  // Put the performance model of an SSD in front of the configured memory
+  // file, simple file or RAID files, for benchmarking without NVMe drives.
+  // @throw std::invalid_argument if queueDepth or numChannels is 0
+  void setEmulatedSsd(EmulatedSsdConfig emulatedSsdConfig);
 
   // ============ BlockCache settings =============
   // Return BlockCacheConfig for configuration.
@@ -644,6 +919,13 @@ class NavyConfig {
   void setEnginesSelector(EnginesSelector selector) {
     selector_ = std::move(selector);
   }
+  // Use the first engine pair as a small hot tier (e.g. on a fast,
+  // high-endurance partition) and the second as the cold tier. All inserts
+  // go to the hot pair and lookups check it first. Items the hot pair's
+  // reinsertion policy keeps stay hot, and the rest of its evictions are
+  // demoted to the cold pair instead of being dropped. Requires exactly two
+  // engine pairs and no selector.
+  void setTieredEngines(bool tiered) noexcept { tieredEngines_ = tiered; }
 
   // ============ Job scheduler settings =============
   // Set the number of reader threads and writer threads.
@@ -675,6 +957,8 @@ class NavyConfig {
 
   EnginesSelector getEnginesSelector() const { return selector_; }
 
+  bool isTieredEnginesEnabled() const { return tieredEngines_; }
+
  private:
   // ============ AP settings =============
   // Name of the admission policy.
@@ -712,11 +996,35 @@ class NavyConfig {
   // 0 for Sync io engine and >1 for libaio and io_uring
   unsigned int qDepth_{0};
 
+  // Whether to register long-lived IO buffers with io_uring
+  bool ioUringRegisterBuffers_{false};
+
+  // Whether to submit io_uring IOs once per event loop iteration
+  bool ioUringBatchSubmit_{false};
+
+  // Max in-flight device IOs per IoClass; 0 means unlimited
+  std::array<uint32_t, kNumIoClasses> ioClassInflightLimits_{};
+
+  // Checksum used for values when checksumming is enabled
+  ChecksumType checksumType_{ChecksumType::Crc32};
+
+  // Size of the pool encrypting device IOs; 0 means inline
+  uint32_t encryptionThreads_{0};
+
+  // Whether reclaimed ranges are discarded, and the cap in bytes per second
+  bool discardEnabled_{false};
+  uint64_t maxDiscardRate_{0};
+
+  // Latency model applied on top of the device when set
+  std::optional<EmulatedSsdConfig> emulatedSsdConfig_;
+
   // ============ Engines settings =============
   // Currently we support one pair of engines.
   std::vector<EnginesConfig> enginesConfigs_{1};
   // Function to map each item to a pair of engine.
   EnginesSelector selector_{};
+  // Whether the first engine pair is a hot tier over the second one.
+  bool tieredEngines_{false};
 
   // ============ Job scheduler settings =============
   // Number of asynchronous worker thread for read operation.
@@ -20,8 +20,11 @@
 #include <folly/logging/xlog.h>
 #include <gmock/gmock.h>
 
+#include <algorithm>
+
 #include "cachelib/allocator/nvmcache/NavyConfig.h"
 #include "cachelib/navy/Factory.h"
+#include "cachelib/navy/common/EmulatedSsdDevice.h"
 #include "cachelib/navy/scheduler/JobScheduler.h"
 #include "cachelib/navy/testing/MockDevice.h"
 
@@ -63,17 +66,23 @@ uint64_t getRegionSize(const navy::NavyConfig& config) {
 // @param ioAlignSize alignment size
 // @param bigHashReservedSize Size reserved for bighash. Actual big hash size
 // could be different due to alignment to bucket size.
+// @param bigHashActiveSize Size bighash starts with if it is resizable, at
+// the end of the reserved space. 0 if it always uses the reserved space.
 // @param bigHashEndOffset The offset where this bighash ends.
 // @param bigHashStartOffsetLimit The start offset of this bighash can not be
 // smaller than or equal to this limit.
+// @param checksumType checksum used for bucket contents.
 // @param proto The proto of engine pair that this bighash will be set into.
 //
-// @return the starting offset of the setup bighash (inclusive)
+// @return the starting offset of the space the setup bighash uses
+// (inclusive)
 uint64_t setupBigHash(const navy::BigHashConfig& bigHashConfig,
                       uint32_t ioAlignSize,
                       uint64_t bigHashReservedSize,
+                      uint64_t bigHashActiveSize,
                       uint64_t bigHashEndOffset,
                       uint64_t bigHashStartOffsetLimit,
+                      navy::ChecksumType checksumType,
                       cachelib::navy::EnginePairProto& proto) {
   auto bucketSize = bigHashConfig.getBucketSize();
   if (bucketSize != alignUp(bucketSize, ioAlignSize)) {
@@ -89,6 +98,14 @@ uint64_t setupBigHash(const navy::BigHashConfig& bigHashConfig,
 
   auto bigHash = cachelib::navy::createBigHashProto();
   bigHash->setLayout(bigHashCacheOffset, bigHashCacheSize, bucketSize);
+  bigHash->setChecksumType(checksumType);
+  uint64_t bigHashActiveOffset = bigHashCacheOffset;
+  if (bigHashActiveSize > 0) {
+    bigHashActiveSize =
+        alignDown(std::min(bigHashActiveSize, bigHashCacheSize), bucketSize);
+    bigHash->setActiveSize(bigHashActiveSize);
+    bigHashActiveOffset = bigHashEndOffset - bigHashActiveSize;
+  }
 
   // Bucket Bloom filter size, bytes
   //
@@ -112,29 +129,35 @@ uint64_t setupBigHash(const navy::BigHashConfig& bigHashConfig,
   }
   XLOG(INFO) << "bighashStartingLimit: " << bigHashStartOffsetLimit
              << " bigHashCacheOffset: " << bigHashCacheOffset
-             << " bigHashCacheSize: " << bigHashCacheSize;
-  return bigHashCacheOffset;
+             << " bigHashCacheSize: " << bigHashCacheSize
+             << " bigHashActiveOffset: " << bigHashActiveOffset;
+  return bigHashActiveOffset;
 }
 
 // Setup a block cache from blockCacheOffset.
 //
 // @param blockCacheConfig
 // @param blockCacheSize size of this block cache.
+// @param blockCacheActiveSize size this block cache starts with if it can be
+// resized, at the start of its space. 0 if it always uses all of it.
 // @param ioAlignSize alignment size
 // @param blockCacheOffset this block cache starts from this address (inclusive)
 // @param useRaidFiles if set to true, the device will setup using raid.
 // @param itemDestructorEnabled
 // @param stackSize size of the stack used by the region_manager thread
+// @param checksumType checksum used for entries when checksumming is enabled
 // @param proto
 //
-// @return The end offset (exclusive) of the setup blockcache.
+// @return The end offset (exclusive) of the space the setup blockcache uses.
 uint64_t setupBlockCache(const navy::BlockCacheConfig& blockCacheConfig,
                          uint64_t blockCacheSize,
+                         uint64_t blockCacheActiveSize,
                          uint32_t ioAlignSize,
                          uint64_t blockCacheOffset,
                          bool usesRaidFiles,
                          bool itemDestructorEnabled,
                          uint32_t stackSize,
+                         navy::ChecksumType checksumType,
                          cachelib::navy::EnginePairProto& proto) {
   auto regionSize = blockCacheConfig.getRegionSize();
   if (regionSize != alignUp(regionSize, ioAlignSize)) {
@@ -151,16 +174,24 @@ uint64_t setupBlockCache(const navy::BlockCacheConfig& blockCacheConfig,
     auto cacheSizeAdjustment = adjustedBlockCacheOffset - blockCacheOffset;
     XDCHECK_LT(cacheSizeAdjustment, blockCacheSize);
     blockCacheSize -= cacheSizeAdjustment;
+    blockCacheActiveSize -=
+        std::min(blockCacheActiveSize, cacheSizeAdjustment);
     blockCacheOffset = adjustedBlockCacheOffset;
   }
   blockCacheSize = alignDown(blockCacheSize, regionSize);
+  blockCacheActiveSize = alignDown(blockCacheActiveSize, regionSize);
 
   XLOG(INFO) << "blockcache: starting offset: " << blockCacheOffset
-             << ", block cache size: " << blockCacheSize;
+             << ", block cache size: " << blockCacheSize
+             << ", active size: " << blockCacheActiveSize;
 
   auto blockCache = cachelib::navy::createBlockCacheProto();
   blockCache->setLayout(blockCacheOffset, blockCacheSize, regionSize);
+  if (blockCacheActiveSize > 0) {
+    blockCache->setActiveSize(blockCacheActiveSize);
+  }
   blockCache->setChecksum(blockCacheConfig.getDataChecksum());
+  blockCache->setChecksumType(checksumType);
 
   // set eviction policy
   auto segmentRatio = blockCacheConfig.getSFifoSegmentRatio();
@@ -168,6 +199,8 @@ uint64_t setupBlockCache(const navy::BlockCacheConfig& blockCacheConfig,
     blockCache->setSegmentedFifoEvictionPolicy(std::move(segmentRatio));
   } else if (blockCacheConfig.isLruEnabled()) {
     blockCache->setLruEvictionPolicy();
+  } else if (blockCacheConfig.isCostBenefitEnabled()) {
+    blockCache->setCostBenefitEvictionPolicy();
   } else {
     blockCache->setFifoEvictionPolicy();
   }
@@ -180,9 +213,22 @@ uint64_t setupBlockCache(const navy::BlockCacheConfig& blockCacheConfig,
   blockCache->setItemDestructorEnabled(itemDestructorEnabled);
   blockCache->setStackSize(stackSize);
   blockCache->setPreciseRemove(blockCacheConfig.isPreciseRemove());
+  if (!blockCacheConfig.getExpiryBuckets().empty()) {
+    blockCache->setExpiryBuckets(blockCacheConfig.getExpiryBuckets());
+  }
+  blockCache->setSparseReclaimThreshold(
+      blockCacheConfig.getSparseReclaimThreshold());
+  blockCache->setReclaimDeadWithoutRead(
+      blockCacheConfig.isReclaimDeadWithoutRead());
+  blockCache->setScanRecovery(blockCacheConfig.isScanRecoveryEnabled());
+  blockCache->setFlushedRegionCacheSize(
+      megabytesToBytes(blockCacheConfig.getFlushedRegionCacheSizeMB()));
+  blockCache->setReclaimChunkSize(blockCacheConfig.getReclaimChunkSize());
+  blockCache->setMaxChunkedItemSize(blockCacheConfig.getMaxChunkedItemSize());
 
   proto.setBlockCache(std::move(blockCache));
-  return blockCacheOffset + blockCacheSize;
+  return blockCacheOffset +
+         (blockCacheActiveSize > 0 ? blockCacheActiveSize : blockCacheSize);
 }
 
 // Setup the CacheProto, includes BigHashProto and BlockCacheProto,
@@ -198,6 +244,10 @@ uint64_t setupBlockCache(const navy::BlockCacheConfig& blockCacheConfig,
 // on the device address space.
 // |--------------------------------- Device -------------------------------|
 // |--- Metadata ---|--- BC-0 ---|--- BC-1 ---|...|--- BH-1 ---|--- BH-0 ---|
+// If the bighash of the last pair is resizable, the boundary between BC-n
+// and BH-n moves at runtime. BC-n is laid out over all the space up to the
+// end of BH-n and BH-n over all the space it can grow to, but each engine
+// only uses its active part.
 
 void setupCacheProtos(const navy::NavyConfig& config,
                       const navy::Device& device,
@@ -247,17 +297,42 @@ void setupCacheProtos(const navy::NavyConfig& config,
     XLOG(INFO) << "Setting up engine pair " << idx;
     const auto& enginesConfig = config.enginesConfigs()[idx];
     uint64_t blockCacheSize = enginesConfig.blockCache().getSize();
+    uint64_t blockCacheActiveSize = 0;
     auto enginePairProto = cachelib::navy::createEnginePairProto();
 
     if (enginesConfig.isBigHashEnabled()) {
+      const auto& bigHashConfig = enginesConfig.bigHash();
       uint64_t bigHashSize =
-          totalCacheSize * enginesConfig.bigHash().getSizePct() / 100ul;
+          totalCacheSize * bigHashConfig.getSizePct() / 100ul;
+      uint64_t bigHashReservedSize = bigHashSize;
+      uint64_t bigHashActiveSize = 0;
+      if (bigHashConfig.isResizable()) {
+        if (idx != config.enginesConfigs().size() - 1) {
+          throw std::invalid_argument(
+              "Only the last pair of engines can have a resizable bighash");
+        }
+        if (bigHashConfig.getMaxSizePct() < bigHashConfig.getSizePct()) {
+          throw std::invalid_argument(folly::sformat(
+              "BigHash max size pct {} is smaller than its size pct {}",
+              bigHashConfig.getMaxSizePct(), bigHashConfig.getSizePct()));
+        }
+        bigHashReservedSize =
+            totalCacheSize * bigHashConfig.getMaxSizePct() / 100ul;
+        bigHashActiveSize = bigHashSize;
+      }
       bigHashStartOffset = setupBigHash(
-          enginesConfig.bigHash(), ioAlignSize, bigHashSize, bigHashEndOffset,
-          blockCacheStartOffset, *enginePairProto);
-      blockCacheSize = blockCacheSize == 0
-                           ? bigHashStartOffset - blockCacheStartOffset
-                           : blockCacheSize;
+          bigHashConfig, ioAlignSize, bigHashReservedSize, bigHashActiveSize,
+          bigHashEndOffset, blockCacheStartOffset, config.getChecksumType(),
+          *enginePairProto);
+      if (bigHashConfig.isResizable()) {
+        // Block cache can grow into whatever bighash gives up
+        blockCacheSize = bigHashEndOffset - blockCacheStartOffset;
+        blockCacheActiveSize = bigHashStartOffset - blockCacheStartOffset;
+      } else {
+        blockCacheSize = blockCacheSize == 0
+                             ? bigHashStartOffset - blockCacheStartOffset
+                             : blockCacheSize;
+      }
       XLOG(INFO) << "blockCacheSize " << blockCacheSize;
     } else {
       bigHashStartOffset = bigHashEndOffset;
@@ -270,9 +345,10 @@ void setupCacheProtos(const navy::NavyConfig& config,
     // Set up BlockCache if enabled
     if (blockCacheSize > 0) {
       blockCacheEndOffset = setupBlockCache(
-          enginesConfig.blockCache(), blockCacheSize, ioAlignSize,
-          blockCacheStartOffset, config.usesRaidFiles(), itemDestructorEnabled,
-          config.getStackSize(), *enginePairProto);
+          enginesConfig.blockCache(), blockCacheSize, blockCacheActiveSize,
+          ioAlignSize, blockCacheStartOffset, config.usesRaidFiles(),
+          itemDestructorEnabled, config.getStackSize(),
+          config.getChecksumType(), *enginePairProto);
     }
     if (blockCacheEndOffset > bigHashStartOffset) {
       throw std::invalid_argument(folly::sformat(
@@ -285,6 +361,7 @@ void setupCacheProtos(const navy::NavyConfig& config,
     blockCacheStartOffset = blockCacheEndOffset;
   }
   proto.setEnginesSelector(config.getEnginesSelector());
+  proto.setTieredEngines(config.isTieredEnginesEnabled());
 }
 
 void setAdmissionPolicy(const cachelib::navy::NavyConfig& config,
@@ -330,6 +407,10 @@ std::unique_ptr<cachelib::navy::Device> createDevice(
     std::shared_ptr<navy::DeviceEncryptor> encryptor) {
   auto blockSize = config.getBlockSize();
   auto maxDeviceWriteSize = config.getDeviceMaxWriteSize();
+  // The emulated SSD in front encrypts, the device holding the data doesn't
+  std::shared_ptr<navy::DeviceEncryptor> backingEncryptor =
+      config.usesEmulatedSsd() ? nullptr : std::move(encryptor);
+  std::unique_ptr<cachelib::navy::Device> device;
   if (config.usesRaidFiles() || config.usesSimpleFile()) {
     auto stripeSize = 0;
     auto fileSize = config.getFileSize();
@@ -342,7 +423,7 @@ std::unique_ptr<cachelib::navy::Device> createDevice(
       fileSize = alignDown(fileSize, stripeSize);
     }
 
-    return cachelib::navy::createFileDevice(
+    device = cachelib::navy::createFileDevice(
         filePaths,
         fileSize,
         config.getTruncateFile(),
@@ -352,12 +433,33 @@ std::unique_ptr<cachelib::navy::Device> createDevice(
         config.getIoEngine(),
         config.getQDepth(),
         config.isFDPEnabled(),
-        std::move(encryptor),
-        config.getExclusiveOwner());
+        std::move(backingEncryptor),
+        config.getExclusiveOwner(),
+        config.isIoUringRegisterBuffersEnabled(),
+        config.isIoUringBatchSubmitEnabled());
   } else {
-    return cachelib::navy::createMemoryDevice(config.getFileSize(),
-                                              std::move(encryptor), blockSize);
+    device = cachelib::navy::createMemoryDevice(
+        config.getFileSize(), std::move(backingEncryptor), blockSize);
+  }
+
+  if (config.usesEmulatedSsd()) {
+    device = cachelib::navy::createEmulatedSsdDevice(
+        std::move(device),
+        config.getEmulatedSsdConfig(),
+        maxDeviceWriteSize > 0 ? alignDown(maxDeviceWriteSize, blockSize) : 0,
+        std::move(encryptor));
+  }
+
+  for (size_t i = 0; i < navy::kNumIoClasses; i++) {
+    auto ioClass = static_cast<navy::IoClass>(i);
+    device->setIoClassInflightLimit(ioClass,
+                                    config.getIoClassInflightLimit(ioClass));
+  }
+  device->setEncryptionThreads(config.getEncryptionThreads());
+  if (config.isDiscardEnabled()) {
+    device->setDiscard(true, config.getMaxDiscardRate());
   }
+  return device;
 }
 
 std::unique_ptr<navy::AbstractCache> createNavyCache(
@@ -366,7 +468,8 @@ std::unique_ptr<navy::AbstractCache> createNavyCache(
     navy::DestructorCallback destructorCb,
     bool truncate,
     std::shared_ptr<navy::DeviceEncryptor> encryptor,
-    bool itemDestructorEnabled) {
+    bool itemDestructorEnabled,
+    navy::ExpiryTimeGetter getExpiryTime) {
   auto device = createDevice(config, std::move(encryptor));
 
   if (config.hasDeviceDataCorruptionForTesting()) {
@@ -402,6 +505,7 @@ std::unique_ptr<navy::AbstractCache> createNavyCache(
   proto->setUseEstimatedWriteSize(config.getUseEstimatedWriteSize());
   setAdmissionPolicy(config, *proto);
   proto->setExpiredCheck(checkExpired);
+  proto->setExpiryTimeGetter(std::move(getExpiryTime));
   proto->setDestructorCallback(destructorCb);
 
   setupCacheProtos(config, *devicePtr, *proto, itemDestructorEnabled);
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <folly/File.h>
 #include <folly/container/F14Map.h>
 #include <folly/container/F14Set.h>
 #include <folly/fibers/TimedMutex.h>
@@ -32,6 +33,7 @@
 #include "cachelib/allocator/nvmcache/NavyConfig.h"
 #include "cachelib/allocator/nvmcache/NavySetup.h"
 #include "cachelib/allocator/nvmcache/NvmItem.h"
+#include "cachelib/allocator/nvmcache/NvmPoolQuotas.h"
 #include "cachelib/allocator/nvmcache/ReqContexts.h"
 #include "cachelib/allocator/nvmcache/TombStones.h"
 #include "cachelib/allocator/nvmcache/WaitContext.h"
@@ -167,8 +169,18 @@ class NvmCache {
 
   // Look up item by key
   // @param key         key to lookup
+  // @param toWrite     the item is looked up to be mutated. A hit is then
+  //                    always inserted into DRAM, whatever the promotion
+  //                    policy says, so that the mutations are not lost.
   // @return            WriteHandle
-  WriteHandle find(HashedKey key);
+  WriteHandle find(HashedKey key, bool toWrite = false);
+
+  // Look up items by key at once. Keys that miss DRAM are looked up in Navy
+  // with one batch request, which lets Navy read neighbouring items with
+  // shared IOs.
+  // @param keys        keys to lookup
+  // @return            WriteHandle for every key, in the order of @keys
+  std::vector<WriteHandle> findBatch(const std::vector<HashedKey>& keys);
 
   // Returns true if a key is potentially in cache. There is a non-zero chance
   // the key does not exist in cache (e.g. hash collision in NvmCache). This
@@ -259,6 +271,37 @@ class NvmCache {
     return navyCache_->updateMaxRateForDynamicRandomAP(maxRate);
   }
 
+  // moves NVM space between BigHash and BlockCache. See
+  // navy::AbstractCache::resizeSmallItemCache
+  uint64_t resizeSmallItemCache(uint64_t size) {
+    return navyCache_->resizeSmallItemCache(size);
+  }
+
+  // writes every item in nvm to @file, e.g. a pipe to a cache being warmed
+  // up. See navy::AbstractCache::exportEntries
+  uint64_t exportItems(folly::File file) {
+    auto rw = navy::createStreamRecordWriter(std::move(file));
+    return navyCache_->exportEntries(*rw);
+  }
+
+  // inserts the items written by exportItems from @file. See
+  // navy::AbstractCache::importEntries
+  uint64_t importItems(folly::File file) {
+    auto rr = navy::createStreamRecordReader(std::move(file));
+    return navyCache_->importEntries(*rr);
+  }
+
+  // limits the nvm bytes of the items of pool @pid to @quota. Items of a
+  // pool over its quota are not written to nvm. 0 means unlimited.
+  void setPoolQuota(PoolId pid, uint64_t quota) {
+    poolQuotas_->setQuota(pid, quota);
+  }
+
+  // returns the estimated nvm bytes the items of pool @pid hold
+  uint64_t getPoolUsage(PoolId pid) const {
+    return poolQuotas_->getUsage(pid);
+  }
+
   // This lock is to protect concurrent NvmCache evictCB and CacheAllocator
   // remove/insertOrReplace/invalidateNvm.
   // This lock scope within the above functions is
@@ -351,6 +394,8 @@ class NvmCache {
     WriteHandle it; // will be set when Context is being filled
     util::LatencyTracker tracker_;
     bool valid_;
+    // a waiter mutates the item, so a hit has to be inserted into DRAM
+    bool toWrite_{false};
 
     GetCtx(NvmCache& c,
            folly::StringPiece k,
@@ -475,6 +520,11 @@ class NvmCache {
                      HashedKey key,
                      navy::BufferView value);
 
+  // Common part of find() and findBatch(): returns the handle to give out
+  // for @hk and sets @ctx to a new fill context if the caller has to start
+  // a Navy lookup for it. @toWrite is as for find().
+  WriteHandle findOrCreateFill(HashedKey hk, GetCtx*& ctx, bool toWrite);
+
   void evictCB(HashedKey hk, navy::BufferView val, navy::DestructorEvent e);
 
   static navy::BufferView makeBufferView(folly::ByteRange b) {
@@ -507,9 +557,10 @@ class NvmCache {
   std::array<DelContexts, kShards> delContexts_;
 
   // co-ordination between in-flight evictions from cache that are not queued
-  // to navy and in-flight gets into nvmcache that are not yet queued.
-  std::array<InFlightPuts, kShards> inflightPuts_;
-  std::array<TombStones, kShards> tombstones_;
+  // to navy and in-flight gets into nvmcache that are not yet queued. Both
+  // are concurrent maps and need no sharding.
+  InFlightPuts inflightPuts_;
+  TombStones tombstones_;
 
   const ItemDestructor itemDestructor_;
 
@@ -524,6 +575,9 @@ class NvmCache {
 
   std::unique_ptr<cachelib::navy::AbstractCache> navyCache_;
 
+  // per pool nvm quotas, sized by the usable space of navyCache_
+  std::unique_ptr<NvmPoolQuotas> poolQuotas_;
+
   friend class tests::NvmCacheTest;
   FRIEND_TEST(CachelibAdminTest, WorkingSetAnalysisLoggingTest);
 };
@@ -585,7 +639,7 @@ typename NvmCache<C>::DeleteTombStoneGuard NvmCache<C>::createDeleteTombStone(
     HashedKey hk) {
   // lower bits for shard and higher bits for key.
   const auto shard = hk.keyHash() % kShards;
-  auto guard = tombstones_[shard].add(hk.key());
+  auto guard = tombstones_.add(hk.key());
 
   // need to synchronize tombstone creations with fill lock to serialize
   // async fills with deletes
@@ -604,27 +658,100 @@ typename NvmCache<C>::DeleteTombStoneGuard NvmCache<C>::createDeleteTombStone(
 
 template <typename C>
 bool NvmCache<C>::hasTombStone(HashedKey hk) {
-  // lower bits for shard and higher bits for key.
-  const auto shard = hk.keyHash() % kShards;
-  return tombstones_[shard].isPresent(hk.key());
+  return tombstones_.isPresent(hk.key());
 }
 
 template <typename C>
-typename NvmCache<C>::WriteHandle NvmCache<C>::find(HashedKey hk) {
+typename NvmCache<C>::WriteHandle NvmCache<C>::find(HashedKey hk,
+                                                    bool toWrite) {
   if (!isEnabled()) {
     return WriteHandle{};
   }
 
+  GetCtx* ctx{nullptr};
+  auto hdl = findOrCreateFill(hk, ctx, toWrite);
+  if (!ctx) {
+    return hdl;
+  }
+  auto guard = folly::makeGuard([hk, this]() { removeFromFillMap(hk); });
+
+  // onGetComplete copies the value into the DRAM item right away, so a view
+  // is enough and lets Navy skip an intermediate copy when it can.
+  navyCache_->lookupViewAsync(
+      HashedKey::precomputed(ctx->getKey(), hk.keyHash()),
+      [this, ctx](navy::Status s, HashedKey k, navy::BufferView v) {
+        this->onGetComplete(*ctx, s, k, v);
+      });
+  guard.dismiss();
+  return hdl;
+}
+
+template <typename C>
+std::vector<typename NvmCache<C>::WriteHandle> NvmCache<C>::findBatch(
+    const std::vector<HashedKey>& keys) {
+  std::vector<WriteHandle> hdls(keys.size());
+  if (!isEnabled()) {
+    return hdls;
+  }
+
+  std::vector<HashedKey> navyKeys;
+  std::vector<GetCtx*> ctxs;
+  for (size_t i = 0; i < keys.size(); i++) {
+    const auto hk = keys[i];
+    GetCtx* ctx{nullptr};
+    hdls[i] = findOrCreateFill(hk, ctx, false /* toWrite */);
+    if (!ctx) {
+      continue;
+    }
+    if (putContexts_[getShardForKey(hk)].hasContexts()) {
+      // A batch job is ordered with requests for its first key only. Keep
+      // the per-key ordering with enqueued puts to read the latest value.
+      auto guard = folly::makeGuard([hk, this]() { removeFromFillMap(hk); });
+      navyCache_->lookupViewAsync(
+          HashedKey::precomputed(ctx->getKey(), hk.keyHash()),
+          [this, ctx](navy::Status s, HashedKey k, navy::BufferView v) {
+            this->onGetComplete(*ctx, s, k, v);
+          });
+      guard.dismiss();
+      continue;
+    }
+    navyKeys.push_back(HashedKey::precomputed(ctx->getKey(), hk.keyHash()));
+    ctxs.push_back(ctx);
+  }
+  if (navyKeys.empty()) {
+    return hdls;
+  }
+
+  auto guard = folly::makeGuard([&navyKeys, this]() {
+    for (const auto& hk : navyKeys) {
+      removeFromFillMap(hk);
+    }
+  });
+  // The keys point into the fill contexts, which stay alive until their
+  // lookup completes
+  auto batchKeys = navyKeys;
+  navyCache_->lookupBatchAsync(
+      std::move(batchKeys),
+      [this, ctxs = std::move(ctxs)](size_t idx, navy::Status s, HashedKey k,
+                                     navy::Buffer v) {
+        this->onGetComplete(*ctxs[idx], s, k, v.view());
+      });
+  guard.dismiss();
+  return hdls;
+}
+
+template <typename C>
+typename NvmCache<C>::WriteHandle NvmCache<C>::findOrCreateFill(
+    HashedKey hk, GetCtx*& ctx, bool toWrite) {
   util::LatencyTracker tracker(stats().nvmLookupLatency_);
 
   auto shard = getShardForKey(hk);
   // invalidateToken any inflight puts for the same key since we are filling
   // from nvmcache.
-  inflightPuts_[shard].invalidateToken(hk.key());
+  inflightPuts_.invalidateToken(hk.key());
 
   stats().numNvmGets.inc();
 
-  GetCtx* ctx{nullptr};
   WriteHandle hdl{nullptr};
   {
     auto lock = getFillLockForShard(shard);
@@ -677,8 +804,9 @@ typename NvmCache<C>::WriteHandle NvmCache<C>::find(HashedKey hk) {
     XDCHECK(waitContext);
 
     if (it != fillMap.end()) {
-      ctx = it->second.get();
-      ctx->addWaiter(std::move(waitContext));
+      // The lookup already in flight fills this handle too
+      it->second->addWaiter(std::move(waitContext));
+      it->second->toWrite_ |= toWrite;
       stats().numNvmGetCoalesced.inc();
       return hdl;
     }
@@ -686,6 +814,7 @@ typename NvmCache<C>::WriteHandle NvmCache<C>::find(HashedKey hk) {
     // create a context
     auto newCtx = std::make_unique<GetCtx>(
         *this, hk.key(), std::move(waitContext), std::move(tracker));
+    newCtx->toWrite_ = toWrite;
     auto res =
         fillMap.emplace(std::make_pair(newCtx->getKey(), std::move(newCtx)));
     XDCHECK(res.second);
@@ -693,14 +822,6 @@ typename NvmCache<C>::WriteHandle NvmCache<C>::find(HashedKey hk) {
   } // scope for fill lock
 
   XDCHECK(ctx);
-  auto guard = folly::makeGuard([hk, this]() { removeFromFillMap(hk); });
-
-  navyCache_->lookupAsync(
-      HashedKey::precomputed(ctx->getKey(), hk.keyHash()),
-      [this, ctx](navy::Status s, HashedKey k, navy::Buffer v) {
-        this->onGetComplete(*ctx, s, k, v.view());
-      });
-  guard.dismiss();
   return hdl;
 }
 
@@ -713,7 +834,7 @@ bool NvmCache<C>::couldExistFast(HashedKey hk) {
   auto shard = getShardForKey(hk);
   // invalidateToken any inflight puts for the same key since we are filling
   // from nvmcache.
-  inflightPuts_[shard].invalidateToken(hk.key());
+  inflightPuts_.invalidateToken(hk.key());
 
   auto lock = getFillLockForShard(shard);
   // do not use the Cache::find() since that will call back into us.
@@ -956,7 +1077,12 @@ NvmCache<C>::NvmCache(C& c,
       },
       truncate,
       std::move(config.deviceEncryptor),
-      itemDestructor_ ? true : false);
+      itemDestructor_ ? true : false,
+      [](navy::BufferView v) -> uint32_t {
+        const auto& nvmItem = *reinterpret_cast<const NvmItem*>(v.data());
+        return nvmItem.getExpiryTime();
+      });
+  poolQuotas_ = std::make_unique<NvmPoolQuotas>(navyCache_->getUsableSize());
 }
 
 template <typename C>
@@ -1063,6 +1189,15 @@ void NvmCache<C>::put(Item& item, PutToken token) {
     return;
   }
 
+  // The encoded size is not known before encoding. The size the item takes
+  // in nvm without its header and chained items is a lower bound of it.
+  const auto poolId =
+      cache_.getAllocInfo(static_cast<const void*>(&item)).poolId;
+  if (!poolQuotas_->canAdmit(poolId, getStorageSizeInNvm(item))) {
+    stats().numNvmAbortedPutOnPoolQuota.inc();
+    return;
+  }
+
   auto nvmItem = makeNvmItem(item);
   if (!nvmItem) {
     stats().numNvmPutEncodeFailure.inc();
@@ -1092,9 +1227,11 @@ void NvmCache<C>::put(Item& item, PutToken token) {
   const bool executed = token.executeIfValid([&]() {
     auto status = navyCache_->insertAsync(
         HashedKey::precomputed(ctx.key(), hk.keyHash()), makeBufferView(val),
-        [this, putCleanup, valSize, val](navy::Status st, HashedKey key) {
+        [this, putCleanup, poolId, valSize, val](navy::Status st,
+                                                 HashedKey key) {
           if (st == navy::Status::Ok) {
             stats().nvmPutSize_.trackValue(valSize);
+            poolQuotas_->charge(poolId, valSize);
           } else if (st == navy::Status::BadState) {
             // we set disable navy since we got a BadState from navy
             disableNavy("Insert Failure. BadState");
@@ -1131,8 +1268,7 @@ template <typename F>
 typename folly::Expected<typename NvmCache<C>::PutToken,
                          InFlightPuts::PutTokenError>
 NvmCache<C>::createPutToken(folly::StringPiece key, F&& fn) {
-  return inflightPuts_[getShardForKey(key)].tryAcquireToken(
-      key, std::forward<F>(fn));
+  return inflightPuts_.tryAcquireToken(key, std::forward<F>(fn));
 }
 
 template <typename C>
@@ -1183,6 +1319,8 @@ void NvmCache<C>::onGetComplete(GetCtx& ctx,
 
   XDCHECK(it->isNvmClean());
 
+  // Destroyed after the fill lock is released, which wakes up the waiters
+  std::unique_ptr<GetCtx> filledCtx;
   auto lock = getFillLock(hk);
   if (hasTombStone(hk) || !ctx.isValid()) {
     // a racing remove or evict while we were filling
@@ -1191,6 +1329,27 @@ void NvmCache<C>::onGetComplete(GetCtx& ctx,
     return;
   }
 
+  // Waiters join under the fill lock, so toWrite_ is final here
+  if (!ctx.toWrite_ && !CacheAPIWrapperForNvm<C>::shouldPromoteFromNvm(
+                           cache_, hk.key(), nvmItem->poolId())) {
+    // serve the hit without inserting into RAM. The item stays nascent and
+    // is freed when the last handle to it is released, while the copy in
+    // nvm remains the one in cache.
+    it.markWentToNvm();
+    ctx.setWriteHandle(std::move(it));
+    // A lookup to write that comes after this point must not get the item.
+    // The fill ends now so that such a lookup starts its own, which the
+    // guard must then leave alone.
+    guard.dismiss();
+    auto& fillMap = getFillMap(hk);
+    auto fillIt = fillMap.find(hk.key());
+    if (fillIt != fillMap.end()) {
+      filledCtx = std::move(fillIt->second);
+      fillMap.erase(fillIt);
+    }
+    return;
+  }
+
   // by the time we filled from navy, another thread inserted in RAM. We
   // disregard.
   if (CacheAPIWrapperForNvm<C>::insertFromNvm(cache_, it)) {
@@ -1384,7 +1543,7 @@ void NvmCache<C>::remove(HashedKey hk, DeleteTombStoneGuard tombstone) {
   //
   // invalidate any inflight put that is on flight since we are queueing up a
   // deletion.
-  inflightPuts_[shard].invalidateToken(hk.key());
+  inflightPuts_.invalidateToken(hk.key());
 
   // Skip scheduling async job to remove the key if the key couldn't exist,
   // if there are no put requests for the key shard.
@@ -1480,6 +1639,7 @@ util::StatsMap NvmCache<C>::getStatsMap() const {
   util::StatsMap statsMap;
   navyCache_->getCounters(statsMap.createCountVisitor());
   statsMap.insertCount("items_tracked_for_destructor", getNvmItemRemovedSize());
+  statsMap.insertCount("pool_quota_rejects", poolQuotas_->getNumRejected());
   return statsMap;
 }
 
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/Format.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+#include "cachelib/allocator/memory/MemoryPoolManager.h"
+#include "cachelib/allocator/memory/Slab.h"
+#include "cachelib/common/AtomicCounter.h"
+
+namespace facebook {
+namespace cachelib {
+
+// Limits how many bytes of the nvm cache each DRAM pool can hold. Quotas are
+// enforced when items are admitted into nvm, and pools are charged once their
+// items are written.
+//
+// The engines do not report every entry they drop (an overwritten or removed
+// entry in BlockCache only turns into a hole), so the bytes a pool holds are
+// estimated from the bytes it was admitted with. Navy evicts roughly in
+// insertion order, so what was admitted during the last window of
+// windowBytes (the nvm cache size) is what the cache holds. Two windows are
+// kept: all of the current one and the part of the previous one that has
+// not been pushed out yet count towards the usage of a pool.
+class NvmPoolQuotas {
+ public:
+  // @param windowBytes   bytes admitted to turn over the nvm cache once
+  explicit NvmPoolQuotas(uint64_t windowBytes)
+      : windowBytes_{std::max<uint64_t>(windowBytes, 1)} {}
+
+  // Limits the nvm bytes of @pid to @quota. 0 means unlimited.
+  // @throw std::invalid_argument if @pid is not a valid pool id
+  void setQuota(PoolId pid, uint64_t quota) {
+    pools_[checkPoolId(pid)].quota.store(quota, std::memory_order_relaxed);
+  }
+
+  // Returns the quota of @pid, 0 if it is unlimited
+  uint64_t getQuota(PoolId pid) const {
+    return pools_[checkPoolId(pid)].quota.load(std::memory_order_relaxed);
+  }
+
+  // Returns the estimated number of nvm bytes @pid holds
+  uint64_t getUsage(PoolId pid) const {
+    const auto& pool = pools_[checkPoolId(pid)];
+    const auto windowUsed =
+        std::min(windowBytes_, currentBytes_.load(std::memory_order_relaxed));
+    const auto previous = pool.previous.load(std::memory_order_relaxed);
+    return pool.current.load(std::memory_order_relaxed) +
+           static_cast<uint64_t>(static_cast<double>(previous) *
+                                 (windowBytes_ - windowUsed) / windowBytes_);
+  }
+
+  // Returns whether @size more bytes keep @pid within its quota. Concurrent
+  // admissions are only charged once written, so they can overshoot the
+  // quota a little.
+  bool canAdmit(PoolId pid, uint64_t size) {
+    const auto quota =
+        pools_[checkPoolId(pid)].quota.load(std::memory_order_relaxed);
+    if (quota != 0 && getUsage(pid) + size > quota) {
+      rejected_.inc();
+      return false;
+    }
+    return true;
+  }
+
+  // Accounts for @size bytes of @pid written into nvm
+  void charge(PoolId pid, uint64_t size) {
+    auto& pool = pools_[checkPoolId(pid)];
+    pool.current.fetch_add(size, std::memory_order_relaxed);
+    if (currentBytes_.fetch_add(size, std::memory_order_relaxed) + size >=
+        windowBytes_) {
+      rotate();
+    }
+  }
+
+  // Number of admissions rejected because of a quota
+  uint64_t getNumRejected() const { return rejected_.get(); }
+
+ private:
+  struct Pool {
+    std::atomic<uint64_t> quota{0};
+    // bytes admitted in the current window
+    std::atomic<uint64_t> current{0};
+    // bytes admitted in the previous window
+    std::atomic<uint64_t> previous{0};
+  };
+
+  static PoolId checkPoolId(PoolId pid) {
+    if (pid < 0 || pid >= static_cast<PoolId>(MemoryPoolManager::kMaxPools)) {
+      throw std::invalid_argument(folly::sformat("Invalid pool id {}", pid));
+    }
+    return pid;
+  }
+
+  // Starts a new window. Bytes admitted while the window turns over may be
+  // accounted to either one, which is fine for an estimate.
+  void rotate() {
+    std::lock_guard<std::mutex> l{rotateMutex_};
+    if (currentBytes_.load(std::memory_order_relaxed) < windowBytes_) {
+      return;
+    }
+    for (auto& pool : pools_) {
+      pool.previous.store(pool.current.exchange(0, std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    }
+    currentBytes_.store(0, std::memory_order_relaxed);
+  }
+
+  const uint64_t windowBytes_;
+  std::array<Pool, MemoryPoolManager::kMaxPools> pools_;
+  // bytes admitted in the current window by all pools
+  std::atomic<uint64_t> currentBytes_{0};
+  std::mutex rotateMutex_;
+  AtomicCounter rejected_;
+};
+
+} // namespace cachelib
+} // namespace facebook
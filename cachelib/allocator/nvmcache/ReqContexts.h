@@ -34,6 +34,8 @@
 namespace facebook {
 namespace cachelib {
 
+using folly::fibers::TimedMutex;
+
 // Holds all necessary data to do an async nvm put that is queued to nvm
 class PutCtx {
  public:
@@ -15,11 +15,12 @@
  */
 
 #pragma once
-#include <folly/container/F14Map.h>
-#include <folly/fibers/TimedMutex.h>
-#include <folly/lang/Align.h>
-#include <glog/logging.h>
+#include <fmt/format.h>
+#include <folly/concurrency/ConcurrentHashMap.h>
+#include <folly/hash/SpookyHashV2.h>
 
+#include <stdexcept>
+#include <string>
 #include <utility>
 
 #include "folly/Range.h"
@@ -27,12 +28,14 @@
 namespace facebook {
 namespace cachelib {
 
-using folly::fibers::TimedMutex;
-
 // Utility that helps us track in flight deletes. We maintain a count per key
 // and check for presence against the count to resolve multiple concurrent
 // deletes for the same key in flight.
-class alignas(folly::hardware_destructive_interference_size) TombStones {
+//
+// Counts are kept by the hash of the key in a concurrent hash map so that
+// the presence check on the lookup path does not take a lock. Two keys with
+// the same 64-bit hash share a count, which can only turn a fill into a miss.
+class TombStones {
  public:
   class Guard;
 
@@ -40,21 +43,23 @@ class alignas(folly::hardware_destructive_interference_size) TombStones {
   // @param key  key for the record
   // @return a valid Guard representing the tombstone
   Guard add(folly::StringPiece key) {
-    std::lock_guard<TimedMutex> l(mutex_);
-    auto it = keys_.find(key);
-
-    if (it == keys_.end()) {
-      it = keys_.insert(std::make_pair(key.toString(), 0)).first;
+    const auto hash = hashKey(key);
+    while (true) {
+      auto ret = keys_.try_emplace(hash, 1);
+      if (ret.second) {
+        break;
+      }
+      const auto count = ret.first->second;
+      if (keys_.assign_if_equal(hash, count, count + 1)) {
+        break;
+      }
     }
-
-    ++it->second;
-    return Guard(it->first, *this);
+    return Guard(key, hash, *this);
   }
 
   // checks if there is a key present and returns true if so.
-  bool isPresent(folly::StringPiece key) {
-    std::lock_guard<TimedMutex> l(mutex_);
-    return keys_.count(key) != 0;
+  bool isPresent(folly::StringPiece key) const {
+    return keys_.find(hashKey(key)) != keys_.cend();
   }
 
   // Guard that wraps around the tombstone record. Removes the key from the
@@ -65,7 +70,7 @@ class alignas(folly::hardware_destructive_interference_size) TombStones {
     Guard() {}
     ~Guard() {
       if (tombstones_) {
-        tombstones_->remove(key_);
+        tombstones_->remove(key_, hash_);
         tombstones_ = nullptr;
       }
     }
@@ -76,7 +81,9 @@ class alignas(folly::hardware_destructive_interference_size) TombStones {
 
     // allow moving
     Guard(Guard&& other) noexcept
-        : key_{std::move(other.key_)}, tombstones_(other.tombstones_) {
+        : key_{std::move(other.key_)},
+          hash_{other.hash_},
+          tombstones_(other.tombstones_) {
       other.tombstones_ = nullptr;
     }
     Guard& operator=(Guard&& other) noexcept {
@@ -94,36 +101,48 @@ class alignas(folly::hardware_destructive_interference_size) TombStones {
    private:
     // only tombstone can create a guard.
     friend TombStones;
-    Guard(folly::StringPiece key, TombStones& t) noexcept
-        : key_(key), tombstones_(&t) {}
+    Guard(folly::StringPiece key, uint64_t hash, TombStones& t)
+        : key_(key.str()), hash_(hash), tombstones_(&t) {}
 
     // key for the tombstone
-    folly::StringPiece key_;
+    std::string key_;
+
+    // hash of the key the record is kept under
+    uint64_t hash_{0};
 
     // tombstone record
     TombStones* tombstones_{nullptr};
   };
 
  private:
+  static uint64_t hashKey(folly::StringPiece key) {
+    return folly::hash::SpookyHashV2::Hash64(key.data(), key.size(), 0);
+  }
+
   // removes an instance of key. if the count drops to 0, we remove the key
-  void remove(folly::StringPiece key) {
-    std::lock_guard<TimedMutex> l(mutex_);
-    auto it = keys_.find(key);
-    if (it == keys_.end() || it->second == 0) {
-      // this is not supposed to happen if guards are destroyed appropriately
-      throw std::runtime_error(fmt::format(
-          "Invalid state. Key: {}. State: {}", key,
-          it == keys_.end() ? "does not exist" : "exists, but count is 0"));
-    }
+  void remove(folly::StringPiece key, uint64_t hash) {
+    while (true) {
+      auto it = keys_.find(hash);
+      if (it == keys_.cend() || it->second == 0) {
+        // this is not supposed to happen if guards are destroyed appropriately
+        throw std::runtime_error(fmt::format(
+            "Invalid state. Key: {}. State: {}", key,
+            it == keys_.cend() ? "does not exist" : "exists, but count is 0"));
+      }
 
-    if (--(it->second) == 0) {
-      keys_.erase(it);
+      const auto count = it->second;
+      if (count == 1) {
+        if (keys_.erase_if_equal(hash, 1) == 1) {
+          return;
+        }
+      } else if (keys_.assign_if_equal(hash, count, count - 1)) {
+        return;
+      }
     }
   }
 
-  // mutex protecting the map below
-  TimedMutex mutex_;
-  folly::F14NodeMap<std::string, uint64_t> keys_;
+  // number of outstanding guards by key hash
+  folly::ConcurrentHashMap<uint64_t, uint64_t> keys_;
 };
 
 } // namespace cachelib
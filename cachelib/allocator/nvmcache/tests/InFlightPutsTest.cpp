@@ -17,6 +17,8 @@
 #include <folly/Random.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <vector>
 
@@ -158,6 +160,35 @@ TEST(InFlightPutsTest, InvalidationAndCreate) {
   ASSERT_TRUE(token.executeIfValid(fn));
   ASSERT_TRUE(executed);
 }
+
+// invalidating a token waits for a function that is executing on it
+TEST(InFlightPutsTest, InvalidationWaitsForExecution) {
+  InFlightPuts p;
+  folly::StringPiece key = "foobar";
+  auto token = *p.tryAcquireToken(key, []() { return true; });
+  ASSERT_TRUE(token.isValid());
+
+  std::atomic<bool> started{false};
+  std::atomic<bool> done{false};
+  std::thread putThread([&]() {
+    ASSERT_TRUE(token.executeIfValid([&]() {
+      started = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds{100});
+      done = true;
+    }));
+  });
+
+  while (!started) {
+    std::this_thread::yield();
+  }
+  p.invalidateToken(key);
+  ASSERT_TRUE(done);
+  putThread.join();
+
+  // the executed token was released
+  auto newToken = *p.tryAcquireToken(key, []() { return true; });
+  ASSERT_TRUE(newToken.isValid());
+}
 } // namespace tests
 } // namespace cachelib
 } // namespace facebook
@@ -94,6 +94,7 @@ void setDeviceTestSettings(NavyConfig& config) {
   config.setDeviceMetadataSize(deviceMetadataSize);
   config.setDeviceMaxWriteSize(deviceMaxWriteSize);
   config.enableAsyncIo(qDepth, ioEngine == navy::IoEngine::IoUring);
+  config.setIoClassInflightLimit(navy::IoClass::Reclaim, 8);
 }
 
 void setBlockCacheTestSettings(NavyConfig& config) {
@@ -193,9 +194,18 @@ TEST(NavyConfigTest, Serialization) {
   expectedConfigMap["navyConfig::deviceMaxWriteSize"] = "4194304";
   expectedConfigMap["navyConfig::ioEngine"] = "io_uring";
   expectedConfigMap["navyConfig::QDepth"] = "64";
+  expectedConfigMap["navyConfig::ioUringRegisterBuffers"] = "false";
+  expectedConfigMap["navyConfig::ioUringBatchSubmit"] = "false";
+  expectedConfigMap["navyConfig::ioClassInflightLimits"] = "0,0,0,8";
   expectedConfigMap["navyConfig::enableFDP"] = "0";
+  expectedConfigMap["navyConfig::checksumType"] = "crc32";
+  expectedConfigMap["navyConfig::encryptionThreads"] = "0";
+  expectedConfigMap["navyConfig::discard"] = "false";
+  expectedConfigMap["navyConfig::maxDiscardRate"] = "0";
+  expectedConfigMap["navyConfig::emulatedSsd"] = "none";
 
   expectedConfigMap["navyConfig::blockCacheLru"] = "false";
+  expectedConfigMap["navyConfig::blockCacheCostBenefit"] = "false";
   expectedConfigMap["navyConfig::blockCacheRegionSize"] = "16777216";
   expectedConfigMap["navyConfig::blockCacheCleanRegions"] = "4";
   expectedConfigMap["navyConfig::blockCacheCleanRegionThreads"] = "1";
@@ -207,12 +217,14 @@ TEST(NavyConfigTest, Serialization) {
       "111,222,333";
 
   expectedConfigMap["navyConfig::bigHashSizePct"] = "50";
+  expectedConfigMap["navyConfig::bigHashMaxSizePct"] = "0";
   expectedConfigMap["navyConfig::bigHashBucketSize"] = "1024";
   expectedConfigMap["navyConfig::bigHashBucketBfSize"] = "4";
   expectedConfigMap["navyConfig::bigHashSmallItemMaxSize"] = "512";
 
   expectedConfigMap["navyConfig::maxConcurrentInserts"] = "50000";
   expectedConfigMap["navyConfig::maxParcelMemoryMB"] = "512";
+  expectedConfigMap["navyConfig::tieredEngines"] = "false";
 
   expectedConfigMap["navyConfig::readerThreads"] = "40";
   expectedConfigMap["navyConfig::writerThreads"] = "40";
@@ -295,6 +307,39 @@ TEST(NavyConfigTest, Device) {
     config.enableAsyncIo(64, true);
     EXPECT_EQ(config.getIoEngine(), navy::IoEngine::IoUring);
     EXPECT_EQ(config.getQDepth(), 64);
+    EXPECT_FALSE(config.isIoUringRegisterBuffersEnabled());
+    EXPECT_THROW(config.enableAsyncIo(64, false, true),
+                 std::invalid_argument);
+    config.enableAsyncIo(64, true, true);
+    EXPECT_TRUE(config.isIoUringRegisterBuffersEnabled());
+    EXPECT_FALSE(config.isIoUringBatchSubmitEnabled());
+    EXPECT_THROW(config.enableAsyncIo(64, false, false, true),
+                 std::invalid_argument);
+    config.enableAsyncIo(64, true, false, true);
+    EXPECT_TRUE(config.isIoUringBatchSubmitEnabled());
+    EXPECT_FALSE(config.isIoUringRegisterBuffersEnabled());
+  }
+  {
+    // cap background io classes
+    NavyConfig config{};
+    EXPECT_EQ(config.getIoClassInflightLimit(navy::IoClass::Flush), 0);
+    config.setIoClassInflightLimit(navy::IoClass::Flush, 4);
+    EXPECT_EQ(config.getIoClassInflightLimit(navy::IoClass::Flush), 4);
+    EXPECT_EQ(config.getIoClassInflightLimit(navy::IoClass::UserRead), 0);
+  }
+  {
+    // emulated ssd
+    NavyConfig config{};
+    EXPECT_FALSE(config.usesEmulatedSsd());
+    navy::EmulatedSsdConfig ssdConfig;
+    ssdConfig.numChannels = 0;
+    EXPECT_THROW(config.setEmulatedSsd(ssdConfig), std::invalid_argument);
+    ssdConfig.numChannels = 4;
+    ssdConfig.readLatencyUs = 100;
+    config.setEmulatedSsd(ssdConfig);
+    EXPECT_TRUE(config.usesEmulatedSsd());
+    EXPECT_EQ(config.getEmulatedSsdConfig().numChannels, 4);
+    EXPECT_EQ(config.getEmulatedSsdConfig().readLatencyUs, 100);
   }
   {
     // set async io via job scheduler settings
@@ -333,6 +378,13 @@ TEST(NavyConfigTest, BlockCache) {
   EXPECT_EQ(config.blockCache().isLruEnabled(), false);
   EXPECT_EQ(config.blockCache().getSFifoSegmentRatio(),
             blockCacheSegmentedFifoSegmentRatio);
+  // test cost-benefit eviction policy
+  config.blockCache().enableCostBenefit();
+  EXPECT_EQ(config.blockCache().isLruEnabled(), false);
+  EXPECT_EQ(config.blockCache().isCostBenefitEnabled(), true);
+  EXPECT_TRUE(config.blockCache().getSFifoSegmentRatio().empty());
+  config.blockCache().enableFifo();
+  EXPECT_EQ(config.blockCache().isCostBenefitEnabled(), false);
 
   auto customPolicy = std::make_shared<DummyReinsertionPolicy>();
 
@@ -383,6 +435,32 @@ TEST(NavyConfigTest, BlockCache) {
   EXPECT_EQ(config.blockCache().getReinsertionConfig().getHitsThreshold(), 0);
   EXPECT_EQ(config.blockCache().getReinsertionConfig().getCustomPolicy(index),
             customPolicy);
+
+  // test sparse reclaim threshold
+  config = NavyConfig{};
+  EXPECT_EQ(config.blockCache().getSparseReclaimThreshold(), 0);
+  config.blockCache().setSparseReclaimThreshold(0.25);
+  EXPECT_EQ(config.blockCache().getSparseReclaimThreshold(), 0.25);
+  EXPECT_THROW(config.blockCache().setSparseReclaimThreshold(1.5),
+               std::invalid_argument);
+  EXPECT_THROW(config.blockCache().setSparseReclaimThreshold(-0.1),
+               std::invalid_argument);
+
+  // test reclaiming dead regions without reads
+  EXPECT_FALSE(config.blockCache().isReclaimDeadWithoutRead());
+  config.blockCache().setReclaimDeadWithoutRead(true);
+  EXPECT_TRUE(config.blockCache().isReclaimDeadWithoutRead());
+
+  // test expiry buckets
+  config = NavyConfig{};
+  EXPECT_TRUE(config.blockCache().getExpiryBuckets().empty());
+  config.blockCache().setExpiryBuckets({60, 3600});
+  EXPECT_EQ(config.blockCache().getExpiryBuckets(),
+            (std::vector<uint32_t>{60, 3600}));
+  EXPECT_THROW(config.blockCache().setExpiryBuckets({3600, 60}),
+               std::invalid_argument);
+  EXPECT_THROW(config.blockCache().setExpiryBuckets({0, 60}),
+               std::invalid_argument);
 }
 
 TEST(NavyConfigTest, BigHash) {
@@ -399,6 +477,12 @@ TEST(NavyConfigTest, BigHash) {
   EXPECT_EQ(config.bigHash().getBucketSize(), bigHashBucketSize);
   EXPECT_EQ(config.bigHash().getBucketBfSize(), bigHashBucketBfSize);
   EXPECT_EQ(config.bigHash().getSmallItemMaxSize(), bigHashSmallItemMaxSize);
+  EXPECT_FALSE(config.bigHash().isResizable());
+
+  EXPECT_THROW(config.bigHash().setMaxSizePct(101), std::invalid_argument);
+  config.bigHash().setMaxSizePct(80);
+  EXPECT_TRUE(config.bigHash().isResizable());
+  EXPECT_EQ(config.bigHash().getMaxSizePct(), 80);
 }
 
 TEST(NavyConfigTest, JobScheduler) {
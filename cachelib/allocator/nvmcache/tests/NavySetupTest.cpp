@@ -17,12 +17,15 @@
 #include <folly/File.h>
 #include <gtest/gtest.h>
 
+#include <string>
 #include <system_error>
 
 #include "cachelib/allocator/nvmcache/NavyConfig.h"
 #include "cachelib/allocator/nvmcache/NavySetup.h"
 #include "cachelib/allocator/tests/NvmTestUtils.h"
 #include "cachelib/common/Utils.h"
+#include "cachelib/navy/common/Buffer.h"
+#include "cachelib/navy/common/Hash.h"
 
 namespace facebook {
 namespace cachelib {
@@ -304,6 +307,122 @@ TEST(NavySetupTest, EnginesSetup) {
         std::invalid_argument);
   }
 }
+
+TEST(NavySetupTest, ResizableBigHash) {
+  constexpr uint64_t kMB = 1024 * 1024;
+  {
+    // 200MB device: bighash starts at 100MB and can grow to 180MB
+    navy::NavyConfig cfg = utils::getNvmTestConfig("/tmp");
+    cfg.bigHash().setMaxSizePct(90);
+
+    auto navyCache = createNavyCache(cfg, {}, {}, true, nullptr, false);
+    ASSERT_NE(nullptr, navyCache);
+    // 4MB metadata and 96MB block cache
+    EXPECT_EQ(196 * kMB, navyCache->getUsableSize());
+
+    EXPECT_EQ(148 * kMB, navyCache->resizeSmallItemCache(148 * kMB));
+    EXPECT_EQ(196 * kMB, navyCache->getUsableSize());
+    // Capped by the space bighash reserved
+    EXPECT_EQ(180 * kMB, navyCache->resizeSmallItemCache(188 * kMB));
+    EXPECT_EQ(20 * kMB, navyCache->resizeSmallItemCache(20 * kMB));
+    EXPECT_EQ(196 * kMB, navyCache->getUsableSize());
+  }
+
+  {
+    navy::NavyConfig cfg = utils::getNvmTestConfig("/tmp");
+    // Exception. Max size is smaller than the initial size.
+    cfg.bigHash().setMaxSizePct(40);
+    EXPECT_THROW(
+        { createNavyCache(cfg, {}, {}, true, nullptr, false); },
+        std::invalid_argument);
+  }
+
+  {
+    navy::NavyConfig cfg = utils::getNvmTestConfig("/tmp");
+    cfg.blockCache().setSize(20 * kMB);
+    cfg.bigHash().setMaxSizePct(60);
+    navy::EnginesConfig pair1;
+    pair1.blockCache().setRegionSize(4 * kMB);
+    pair1.bigHash().setSizePctAndMaxItemSize(5, 640);
+    cfg.addEnginePair(std::move(pair1));
+    cfg.setEnginesSelector([](HashedKey hk) { return hk.key().size() % 2; });
+
+    // Exception. Only the last pair can be resized.
+    EXPECT_THROW(
+        { createNavyCache(cfg, {}, {}, true, nullptr, false); },
+        std::invalid_argument);
+  }
+}
+
+TEST(NavySetupTest, ResizableBigHashWithData) {
+  constexpr uint64_t kMB = 1024 * 1024;
+  constexpr size_t kNumItems = 1000;
+  navy::NavyConfig cfg = utils::getNvmTestConfig("/tmp");
+  cfg.bigHash().setMaxSizePct(90);
+  auto navyCache = createNavyCache(cfg, {}, {}, true, nullptr, false);
+  ASSERT_NE(nullptr, navyCache);
+
+  // Values up to 100 bytes go to bighash, larger ones to block cache
+  auto makeKey = [](const char* prefix, size_t i) {
+    return folly::sformat("{}_{}", prefix, i);
+  };
+  auto makeValue = [](size_t size, size_t i) {
+    return std::string(size, static_cast<char>('a' + i % 26));
+  };
+  auto insertAll = [&](const char* prefix, size_t size) {
+    for (size_t i = 0; i < kNumItems; i++) {
+      auto key = makeKey(prefix, i);
+      auto value = makeValue(size, i);
+      EXPECT_EQ(navy::Status::Ok,
+                navyCache->insert(navy::makeHK(key.c_str()),
+                                  navy::makeView(value)));
+    }
+  };
+  // Returns the number of items found
+  auto lookupAll = [&](const char* prefix, size_t size) {
+    size_t numFound = 0;
+    for (size_t i = 0; i < kNumItems; i++) {
+      auto key = makeKey(prefix, i);
+      navy::Buffer value;
+      auto status = navyCache->lookup(navy::makeHK(key.c_str()), value);
+      if (status == navy::Status::Ok) {
+        EXPECT_EQ(navy::makeView(makeValue(size, i)), value.view());
+        numFound++;
+      } else {
+        EXPECT_EQ(navy::Status::NotFound, status);
+      }
+    }
+    return numFound;
+  };
+
+  insertAll("small", 50);
+  insertAll("large", 1000);
+  navyCache->flush();
+  EXPECT_EQ(kNumItems, lookupAll("small", 50));
+  EXPECT_EQ(kNumItems, lookupAll("large", 1000));
+
+  // Block cache gives up its last regions, which hold nothing yet. Bighash
+  // keeps its buckets and gains the space.
+  EXPECT_EQ(148 * kMB, navyCache->resizeSmallItemCache(148 * kMB));
+  EXPECT_EQ(kNumItems, lookupAll("small", 50));
+  EXPECT_EQ(kNumItems, lookupAll("large", 1000));
+  insertAll("large2", 1000);
+  insertAll("small2", 50);
+  navyCache->flush();
+  EXPECT_EQ(kNumItems, lookupAll("large2", 1000));
+  EXPECT_EQ(kNumItems, lookupAll("small2", 50));
+
+  // Bighash gives up its first buckets and evicts what they held. Keys that
+  // map to them are taken by block cache instead.
+  EXPECT_EQ(96 * kMB, navyCache->resizeSmallItemCache(96 * kMB));
+  EXPECT_GT(kNumItems, lookupAll("small", 50));
+  EXPECT_EQ(kNumItems, lookupAll("large", 1000));
+  insertAll("small", 50);
+  navyCache->flush();
+  EXPECT_EQ(kNumItems, lookupAll("small", 50));
+  EXPECT_EQ(kNumItems, lookupAll("large2", 1000));
+  EXPECT_EQ(196 * kMB, navyCache->getUsableSize());
+}
 } // namespace tests
 } // namespace cachelib
 } // namespace facebook
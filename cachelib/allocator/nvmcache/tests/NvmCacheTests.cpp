@@ -18,6 +18,7 @@
 #include <gtest/gtest.h>
 
 #include <climits>
+#include <cstring>
 #include <set>
 #include <thread>
 
@@ -230,6 +231,202 @@ TEST_F(NvmCacheTest, EvictToNvmGet) {
   ASSERT_EQ(0, nvm.getHandleCountForThread());
 }
 
+TEST_F(NvmCacheTest, FindBatch) {
+  this->config_.bigHash().setSizePctAndMaxItemSize(0, 100);
+  LruAllocator::NvmCacheConfig nvmConfig;
+  nvmConfig.navyConfig = config_;
+  this->allocConfig_.enableNvmCache(nvmConfig);
+  this->makeCache();
+
+  auto& nvm = this->cache();
+  auto pid = this->poolId();
+
+  const auto evictBefore = this->evictionCount();
+  const int nKeys = 1024;
+  for (unsigned int i = 0; i < nKeys; i++) {
+    auto key = folly::sformat("key{}", i);
+    auto it = nvm.allocate(pid, key, 15 * 1024);
+    ASSERT_NE(nullptr, it);
+    nvm.insertOrReplace(it);
+    if (i % 100 == 0) {
+      nvm.flushNvmCache();
+    }
+  }
+  nvm.flushNvmCache();
+
+  const auto nEvictions = this->evictionCount() - evictBefore;
+  ASSERT_LE(16, nEvictions);
+
+  // The oldest keys were evicted to nvm and are looked up in one batch
+  std::vector<std::string> keyStrs;
+  for (unsigned int i = 0; i < 16; i++) {
+    keyStrs.push_back(folly::sformat("key{}", i));
+  }
+  keyStrs.push_back("missing");
+  std::vector<LruAllocator::Key> keys(keyStrs.begin(), keyStrs.end());
+
+  auto hdls = nvm.findBatch(keys);
+  ASSERT_EQ(keys.size(), hdls.size());
+  for (size_t i = 0; i < hdls.size(); i++) {
+    hdls[i].wait();
+    if (keyStrs[i] == "missing") {
+      ASSERT_EQ(nullptr, hdls[i]);
+      continue;
+    }
+    ASSERT_NE(nullptr, hdls[i]) << keyStrs[i];
+    EXPECT_EQ(keyStrs[i], hdls[i]->getKey());
+    EXPECT_TRUE(hdls[i].wentToNvm());
+    EXPECT_TRUE(hdls[i]->isNvmClean());
+  }
+}
+
+TEST_F(NvmCacheTest, SecondHitPromotion) {
+  this->config_.bigHash().setSizePctAndMaxItemSize(0, 100);
+  LruAllocator::NvmCacheConfig nvmConfig;
+  nvmConfig.navyConfig = config_;
+  this->allocConfig_.enableNvmCache(nvmConfig);
+  auto policy =
+      std::make_shared<SecondHitPromotionPolicy<LruAllocator>>(1000, 10);
+  this->allocConfig_.setNvmPromotionPolicy(policy);
+  this->makeCache();
+
+  auto& nvm = this->cache();
+  auto pid = this->poolId();
+
+  const auto evictBefore = this->evictionCount();
+  const int nKeys = 1024;
+  for (unsigned int i = 0; i < nKeys; i++) {
+    auto key = folly::sformat("key{}", i);
+    auto it = nvm.allocate(pid, key, 15 * 1024);
+    ASSERT_NE(nullptr, it);
+    nvm.insertOrReplace(it);
+    if (i % 100 == 0) {
+      nvm.flushNvmCache();
+    }
+  }
+  nvm.flushNvmCache();
+  ASSERT_LT(0, this->evictionCount() - evictBefore);
+
+  // key0 was evicted to nvm. The first hit is served without inserting the
+  // item into RAM.
+  {
+    auto hdl = this->fetch("key0", false /* ramOnly */);
+    hdl.wait();
+    ASSERT_NE(nullptr, hdl);
+    EXPECT_TRUE(hdl.wentToNvm());
+    EXPECT_EQ("key0", hdl->getKey());
+  }
+  EXPECT_EQ(nullptr, this->fetch("key0", true /* ramOnly */));
+
+  // The second hit promotes it
+  {
+    auto hdl = this->fetch("key0", false /* ramOnly */);
+    hdl.wait();
+    ASSERT_NE(nullptr, hdl);
+    EXPECT_TRUE(hdl.wentToNvm());
+  }
+  EXPECT_NE(nullptr, this->fetch("key0", true /* ramOnly */));
+
+  auto counters = nvm.getNvmCacheStatsMap().toMap();
+  EXPECT_EQ(2, counters["promotion.called"]);
+  EXPECT_EQ(1, counters["promotion.promoted"]);
+  EXPECT_EQ(1, counters["promotion.rejected"]);
+
+  ASSERT_EQ(0, nvm.getNumActiveHandles());
+  ASSERT_EQ(0, nvm.getHandleCountForThread());
+}
+
+TEST_F(NvmCacheTest, PromotionFindToWrite) {
+  this->config_.bigHash().setSizePctAndMaxItemSize(0, 100);
+  LruAllocator::NvmCacheConfig nvmConfig;
+  nvmConfig.navyConfig = config_;
+  this->allocConfig_.enableNvmCache(nvmConfig);
+  auto policy =
+      std::make_shared<SecondHitPromotionPolicy<LruAllocator>>(1000, 10);
+  this->allocConfig_.setNvmPromotionPolicy(policy);
+  this->makeCache();
+
+  auto& nvm = this->cache();
+  auto pid = this->poolId();
+
+  const auto evictBefore = this->evictionCount();
+  const int nKeys = 1024;
+  for (unsigned int i = 0; i < nKeys; i++) {
+    auto key = folly::sformat("key{}", i);
+    auto it = nvm.allocate(pid, key, 15 * 1024);
+    ASSERT_NE(nullptr, it);
+    nvm.insertOrReplace(it);
+    if (i % 100 == 0) {
+      nvm.flushNvmCache();
+    }
+  }
+  nvm.flushNvmCache();
+  ASSERT_LT(0, this->evictionCount() - evictBefore);
+
+  // key0 was evicted to nvm. A lookup to write inserts it into RAM on its
+  // first hit, so that the mutation is kept.
+  {
+    auto hdl = nvm.findToWrite("key0");
+    hdl.wait();
+    ASSERT_NE(nullptr, hdl);
+    EXPECT_TRUE(hdl.wentToNvm());
+    std::memset(hdl->getMemory(), 'x', hdl->getSize());
+  }
+  {
+    auto hdl = this->fetch("key0", true /* ramOnly */);
+    ASSERT_NE(nullptr, hdl);
+    const std::string expected(hdl->getSize(), 'x');
+    EXPECT_EQ(expected,
+              folly::StringPiece(reinterpret_cast<const char*>(
+                                     hdl->getMemory()),
+                                 hdl->getSize()));
+  }
+
+  // The promotion policy is not consulted
+  auto counters = nvm.getNvmCacheStatsMap().toMap();
+  EXPECT_EQ(0, counters["promotion.called"]);
+
+  ASSERT_EQ(0, nvm.getNumActiveHandles());
+  ASSERT_EQ(0, nvm.getHandleCountForThread());
+}
+
+TEST_F(NvmCacheTest, PoolQuota) {
+  auto& nvm = this->cache();
+  auto pid = this->poolId();
+
+  // An item of the pool is bigger than its quota
+  ASSERT_TRUE(nvm.setNvmPoolQuota(pid, 50));
+  {
+    auto it = nvm.allocate(pid, "rejected", 100);
+    ASSERT_NE(nullptr, it);
+    nvm.insertOrReplace(it);
+  }
+  ASSERT_TRUE(this->pushToNvmCacheFromRamForTesting("rejected"));
+  nvm.flushNvmCache();
+  this->removeFromRamForTesting("rejected");
+  EXPECT_FALSE(this->checkKeyExists("rejected", false /* ramOnly */));
+  EXPECT_EQ(0, nvm.getNvmPoolUsage(pid));
+  EXPECT_EQ(1, nvm.getGlobalCacheStats().numNvmAbortedPutOnPoolQuota);
+
+  // Without a quota it is admitted and accounted for
+  ASSERT_TRUE(nvm.setNvmPoolQuota(pid, 0));
+  {
+    auto it = nvm.allocate(pid, "admitted", 100);
+    ASSERT_NE(nullptr, it);
+    nvm.insertOrReplace(it);
+  }
+  ASSERT_TRUE(this->pushToNvmCacheFromRamForTesting("admitted"));
+  nvm.flushNvmCache();
+  this->removeFromRamForTesting("admitted");
+  EXPECT_TRUE(this->checkKeyExists("admitted", false /* ramOnly */));
+  EXPECT_LT(100, nvm.getNvmPoolUsage(pid));
+
+  auto counters = nvm.getNvmCacheStatsMap().toMap();
+  EXPECT_EQ(1, counters["pool_quota_rejects"]);
+
+  EXPECT_THROW(nvm.setNvmPoolQuota(-1, 50), std::invalid_argument);
+}
+
 TEST_F(NvmCacheTest, EvictToNvmGetCheckCtime) {
   auto& nvm = this->cache();
   auto pid = this->poolId();
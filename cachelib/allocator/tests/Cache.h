@@ -58,8 +58,14 @@ struct Cache {
       return std::chrono::seconds(ttl_);
     }
 
+    uint32_t getCreationTime() const noexcept { return creationTime_; }
+
+    uint32_t getLastAccessTime() const noexcept { return lastAccessTime_; }
+
     std::string key_;
     uint64_t ttl_{0};
+    uint32_t creationTime_{0};
+    uint32_t lastAccessTime_{0};
   };
 
   using ChainedItemIter = std::vector<Item>::iterator;
@@ -157,6 +157,100 @@ TEST_F(NvmAdmissionPolicyTest, MemOnlyTTLTests) {
   EXPECT_THROW({ ap.initMinTTL(12); }, std::invalid_argument);
 }
 
+// The history based policy learns to admit items that are read back and to
+// reject the ones that are not.
+TEST_F(NvmAdmissionPolicyTest, HistoryBasedAPLearns) {
+  HistoryBasedAP<Cache>::Config apConfig;
+  apConfig.numHistoryEntries = 1024;
+  apConfig.numShards = 4;
+  apConfig.warmupLabels = 0;
+  apConfig.learningRate = 0.5;
+  HistoryBasedAP<Cache> ap{apConfig};
+  folly::Range<Cache::ChainedItemIter> dummyChainedItem;
+
+  const auto now = util::getCurrentTimeSec();
+  // Hit in DRAM recently and then looked up again after eviction.
+  auto makeHotItem = [now](int i) {
+    Cache::Item item{folly::sformat("hot_{}", i)};
+    item.creationTime_ = now - 100;
+    item.lastAccessTime_ = now - 1;
+    return item;
+  };
+  // Never hit in DRAM and evicted again without being looked up.
+  auto makeColdItem = [now](int i) {
+    Cache::Item item{folly::sformat("cold_{}", i)};
+    item.creationTime_ = now - 100;
+    item.lastAccessTime_ = now - 100;
+    return item;
+  };
+
+  for (int i = 0; i < 200; i++) {
+    auto hot = makeHotItem(i);
+    ap.accept(hot, dummyChainedItem);
+    ap.trackAccess(hot.getKey());
+
+    auto cold = makeColdItem(i);
+    ap.accept(cold, dummyChainedItem);
+    ap.accept(cold, dummyChainedItem);
+  }
+
+  EXPECT_GT(ap.predict(makeHotItem(1000)), 0.5);
+  EXPECT_LT(ap.predict(makeColdItem(1000)), 0.5);
+  EXPECT_TRUE(ap.accept(makeHotItem(1001), dummyChainedItem));
+  EXPECT_FALSE(ap.accept(makeColdItem(1001), dummyChainedItem));
+
+  auto ctrs = ap.getCounters();
+  EXPECT_GT(ctrs["ap.history_true_positives"], 0);
+  EXPECT_GT(ctrs["ap.history_true_negatives"], 0);
+  EXPECT_GT(ctrs["ap.history_precision"], 0);
+  EXPECT_GT(ctrs["ap.history_recall"], 0.9);
+  EXPECT_EQ(ctrs["ap.history_warming_up"], 0);
+
+  // Bad configs
+  apConfig.numShards = 2048;
+  EXPECT_THROW(HistoryBasedAP<Cache>{apConfig}, std::invalid_argument);
+  apConfig.numShards = 4;
+  apConfig.admitThreshold = 2;
+  EXPECT_THROW(HistoryBasedAP<Cache>{apConfig}, std::invalid_argument);
+}
+
+// Only policies that learn from accesses are reported DRAM misses.
+TEST_F(NvmAdmissionPolicyTest, TracksAccess) {
+  NvmAdmissionPolicy<Cache> baseAp;
+  EXPECT_FALSE(baseAp.tracksAccess());
+  RejectFirstAP<Cache> rejectFirstAp{100, 2, 0, true};
+  EXPECT_FALSE(rejectFirstAp.tracksAccess());
+  HistoryBasedAP<Cache> historyAp{HistoryBasedAPConfig{}};
+  EXPECT_TRUE(historyAp.tracksAccess());
+}
+
+// The history based policy is created from CacheAllocatorConfig.
+TEST_F(NvmAdmissionPolicyTest, CacheAllocatorConfigHistoryBasedAP) {
+  using CacheT = CacheAllocator<Cache>;
+  using Config = CacheAllocatorConfig<CacheT>;
+
+  Config config;
+  this->enableNvmConfig(config);
+  HistoryBasedAPConfig apConfig;
+  apConfig.numHistoryEntries = 1024;
+  apConfig.numShards = 4;
+  config.enableHistoryBasedAPForNvm(apConfig);
+  EXPECT_EQ(config.serialize()["nvmAPHistoryBased"], "set");
+  CacheT cache{config};
+  auto ap = this->getNvmAdmissionPolicy(cache);
+  ASSERT_NE(ap, nullptr);
+  EXPECT_TRUE(ap->tracksAccess());
+
+  // Bad configs
+  apConfig.numShards = 2048;
+  EXPECT_THROW(config.enableHistoryBasedAPForNvm(apConfig),
+               std::invalid_argument);
+  apConfig.numShards = 4;
+  apConfig.admitThreshold = -1;
+  EXPECT_THROW(config.enableHistoryBasedAPForNvm(apConfig),
+               std::invalid_argument);
+}
+
 // Test the initialization of nvm admission policy with TTL.
 TEST_F(NvmAdmissionPolicyTest, CacheAllocatorConfigInitTest) {
   using CacheT = CacheAllocator<Cache>;
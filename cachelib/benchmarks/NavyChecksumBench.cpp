@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/Random.h>
+#include <folly/init/Init.h>
+
+#include <vector>
+
+#include "cachelib/navy/common/Hash.h"
+
+namespace facebook {
+namespace cachelib {
+namespace navy {
+
+/**
+ * Compares the checksum functions Navy can use for BlockCache values and
+ * BigHash buckets. Sizes cover small items, a default 4KB bucket and large
+ * BlockCache values, where the value checksum dominates the insert and
+ * lookup CPU cost.
+ *
+ * $ ./navy_checksum_bench --bm_min_iters=100000
+ */
+
+namespace {
+void runChecksum(std::size_t iters, uint64_t bytes, ChecksumType type) {
+  auto suspender = folly::BenchmarkSuspender{};
+  std::vector<uint8_t> data(bytes);
+  for (auto& b : data) {
+    b = static_cast<uint8_t>(folly::Random::rand32(0, 256));
+  }
+  BufferView view{data.size(), data.data()};
+
+  suspender.dismissing([&] {
+    for (std::size_t i = 0; i < iters; ++i) {
+      folly::makeUnpredictable(view);
+      folly::doNotOptimizeAway(checksum(view, type));
+    }
+  });
+}
+
+void runCrc32(std::size_t iters, uint64_t bytes) {
+  runChecksum(iters, bytes, ChecksumType::Crc32);
+}
+
+void runCrc32c(std::size_t iters, uint64_t bytes) {
+  runChecksum(iters, bytes, ChecksumType::Crc32c);
+}
+
+#define BENCH_BASE(...) FB_VA_GLUE(BENCHMARK_NAMED_PARAM, (__VA_ARGS__))
+#define BENCH_REL(...) FB_VA_GLUE(BENCHMARK_RELATIVE_NAMED_PARAM, (__VA_ARGS__))
+
+BENCH_BASE(runCrc32, 64bytes, 64)
+BENCH_REL(runCrc32c, 64bytes, 64)
+BENCHMARK_DRAW_LINE();
+BENCH_BASE(runCrc32, 512bytes, 512)
+BENCH_REL(runCrc32c, 512bytes, 512)
+BENCHMARK_DRAW_LINE();
+BENCH_BASE(runCrc32, 4KB, 4096)
+BENCH_REL(runCrc32c, 4KB, 4096)
+BENCHMARK_DRAW_LINE();
+BENCH_BASE(runCrc32, 64KB, 64 * 1024)
+BENCH_REL(runCrc32c, 64KB, 64 * 1024)
+BENCHMARK_DRAW_LINE();
+BENCH_BASE(runCrc32, 1MB, 1024 * 1024)
+BENCH_REL(runCrc32c, 1MB, 1024 * 1024)
+} // namespace
+
+} // namespace navy
+} // namespace cachelib
+} // namespace facebook
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+}
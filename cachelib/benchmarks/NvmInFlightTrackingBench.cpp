@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <folly/Random.h>
+#include <folly/container/F14Map.h>
+#include <folly/fibers/TimedMutex.h>
+#include <folly/hash/Hash.h>
+#include <folly/init/Init.h>
+#include <gflags/gflags.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cachelib/allocator/nvmcache/InFlightPuts.h"
+#include "cachelib/allocator/nvmcache/TombStones.h"
+
+DEFINE_uint64(num_threads, 16, "Number of threads running operations");
+DEFINE_uint64(num_keys, 1'000'000, "Number of distinct keys accessed");
+DEFINE_uint64(write_pct, 5, "Percentage of operations that put or remove");
+
+namespace facebook {
+namespace cachelib {
+
+/**
+ * Compares the bookkeeping NvmCache does for every miss, put and remove.
+ * Every miss invalidates in-flight puts and checks for delete tombstones;
+ * puts acquire and execute a put token; removes add a tombstone. The
+ * baseline is the previous layout of 8192 shards of maps guarded by fiber
+ * mutexes; it is compared against InFlightPuts and TombStones, which are
+ * backed by concurrent hash maps.
+ *
+ * $ ./nvm_in_flight_tracking_bench --num_threads=32 --write_pct=5
+ */
+
+namespace {
+constexpr size_t kShards = 8192;
+
+// The previous sharded implementation of InFlightPuts and TombStones,
+// reduced to the operations used on the miss, put and remove paths.
+class ShardedLockedTracking {
+ public:
+  void onMiss(folly::StringPiece key) {
+    auto& shard = getShard(key);
+    {
+      std::lock_guard<folly::fibers::TimedMutex> l{shard.putsMutex};
+      auto it = shard.puts.find(key);
+      if (it != shard.puts.end()) {
+        it->second = false;
+      }
+    }
+    std::lock_guard<folly::fibers::TimedMutex> l{shard.tombStonesMutex};
+    folly::doNotOptimizeAway(shard.tombStones.count(key));
+  }
+
+  void onPut(folly::StringPiece key) {
+    auto& shard = getShard(key);
+    std::unique_lock<folly::fibers::TimedMutex> l{shard.putsMutex,
+                                                  std::try_to_lock};
+    if (!l.owns_lock() || !shard.puts.emplace(key, true).second) {
+      return;
+    }
+    l.unlock();
+    l.lock();
+    shard.puts.erase(key);
+  }
+
+  void onRemove(folly::StringPiece key) {
+    auto& shard = getShard(key);
+    {
+      std::lock_guard<folly::fibers::TimedMutex> l{shard.tombStonesMutex};
+      ++shard.tombStones[key.str()];
+    }
+    std::lock_guard<folly::fibers::TimedMutex> l{shard.tombStonesMutex};
+    auto it = shard.tombStones.find(key);
+    if (--it->second == 0) {
+      shard.tombStones.erase(it);
+    }
+  }
+
+ private:
+  struct alignas(folly::hardware_destructive_interference_size) Shard {
+    folly::fibers::TimedMutex putsMutex;
+    folly::F14FastMap<folly::StringPiece, bool, folly::Hash> puts;
+    folly::fibers::TimedMutex tombStonesMutex;
+    folly::F14NodeMap<std::string, uint64_t> tombStones;
+  };
+
+  Shard& getShard(folly::StringPiece key) {
+    return shards_[folly::Hash{}(key) % kShards];
+  }
+
+  std::array<Shard, kShards> shards_;
+};
+
+class ConcurrentMapTracking {
+ public:
+  void onMiss(folly::StringPiece key) {
+    puts_.invalidateToken(key);
+    folly::doNotOptimizeAway(tombStones_.isPresent(key));
+  }
+
+  void onPut(folly::StringPiece key) {
+    auto token = puts_.tryAcquireToken(key, []() { return true; });
+    if (token) {
+      token->executeIfValid([]() {});
+    }
+  }
+
+  void onRemove(folly::StringPiece key) { auto guard = tombStones_.add(key); }
+
+ private:
+  InFlightPuts puts_;
+  TombStones tombStones_;
+};
+
+template <typename Tracking>
+void runTracking(size_t iters) {
+  auto suspender = folly::BenchmarkSuspender{};
+  auto tracking = std::make_unique<Tracking>();
+  std::vector<std::string> keys;
+  keys.reserve(FLAGS_num_keys);
+  for (size_t i = 0; i < FLAGS_num_keys; i++) {
+    keys.push_back(folly::sformat("nvm_tracking_key_{}", i));
+  }
+
+  suspender.dismissing([&] {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < FLAGS_num_threads; t++) {
+      threads.emplace_back([&]() {
+        for (size_t i = 0; i < iters; i++) {
+          const auto& key = keys[folly::Random::rand32(keys.size())];
+          const auto op = folly::Random::rand32(100);
+          if (op < FLAGS_write_pct / 2) {
+            tracking->onPut(key);
+          } else if (op < FLAGS_write_pct) {
+            tracking->onRemove(key);
+          } else {
+            tracking->onMiss(key);
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  });
+}
+
+BENCHMARK(ShardedLocks, iters) { runTracking<ShardedLockedTracking>(iters); }
+BENCHMARK_RELATIVE(ConcurrentMaps, iters) {
+  runTracking<ConcurrentMapTracking>(iters);
+}
+} // namespace
+
+} // namespace cachelib
+} // namespace facebook
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+}
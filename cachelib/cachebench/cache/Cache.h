@@ -345,7 +345,7 @@ class Cache {
   // TODO(sathya) clean up this api by making this part of the find api
   // implementation.
   void recordAccess(folly::StringPiece key) {
-    if (nvmAdmissionPolicy_) {
+    if (nvmAdmissionPolicy_ && nvmAdmissionPolicy_->tracksAccess()) {
       nvmAdmissionPolicy_->trackAccess(key);
     }
   }
@@ -645,6 +645,20 @@ Cache<Allocator>::Cache(const CacheConfig& config,
           config_.navyReqOrderShardsPower);
     }
     nvmConfig.navyConfig.setBlockSize(config_.navyBlockSize);
+    if (config_.navyEmulatedSsdQueueDepth > 0) {
+      navy::EmulatedSsdConfig ssdConfig;
+      ssdConfig.queueDepth = config_.navyEmulatedSsdQueueDepth;
+      ssdConfig.numChannels = config_.navyEmulatedSsdChannels;
+      ssdConfig.readLatencyUs = config_.navyEmulatedSsdReadLatencyUs;
+      ssdConfig.writeLatencyUs = config_.navyEmulatedSsdWriteLatencyUs;
+      ssdConfig.eraseLatencyUs = config_.navyEmulatedSsdEraseLatencyUs;
+      ssdConfig.latencyJitterPct = config_.navyEmulatedSsdLatencyJitterPct;
+      ssdConfig.readBandwidthMBps = config_.navyEmulatedSsdReadBandwidthMB;
+      ssdConfig.writeBandwidthMBps = config_.navyEmulatedSsdWriteBandwidthMB;
+      ssdConfig.writeBufferSize = config_.navyEmulatedSsdWriteBufferMB * MB;
+      ssdConfig.gcThresholdPct = config_.navyEmulatedSsdGcThresholdPct;
+      nvmConfig.navyConfig.setEmulatedSsd(ssdConfig);
+    }
     nvmConfig.navyConfig.setEnableFDP(config_.deviceEnableFDP);
 
     // configure BlockCache
@@ -693,8 +707,10 @@ Cache<Allocator>::Cache(const CacheConfig& config,
     // Set enableIoUring (and override qDepth) if async io is enabled
     if (config_.navyMaxNumReads || config_.navyMaxNumWrites ||
         config_.navyQDepth) {
-      nvmConfig.navyConfig.enableAsyncIo(config_.navyQDepth,
-                                         config_.navyEnableIoUring);
+      nvmConfig.navyConfig.enableAsyncIo(
+          config_.navyQDepth, config_.navyEnableIoUring,
+          false /* registerBuffers */,
+          config_.navyEnableIoUring && config_.navyIoUringBatchSubmit);
     }
 
     if (config_.navyAdmissionWriteRateMB > 0) {
@@ -731,6 +747,18 @@ Cache<Allocator>::Cache(const CacheConfig& config,
       nvmAdmissionPolicy_ = std::make_shared<RetentionAP<Allocator>>(
           config_.nvmAdmissionRetentionTimeThreshold);
       allocatorConfig_.setNvmCacheAdmissionPolicy(nvmAdmissionPolicy_);
+    } else if (config_.nvmAdmissionHistoryEntries > 0) {
+      HistoryBasedAPConfig apConfig;
+      apConfig.numHistoryEntries = config_.nvmAdmissionHistoryEntries;
+      apConfig.admitThreshold = config_.nvmAdmissionHistoryThreshold;
+      apConfig.labelWindowSecs = config_.nvmAdmissionHistoryWindowSecs;
+      allocatorConfig_.enableHistoryBasedAPForNvm(apConfig);
+    }
+
+    if (config_.nvmPromotionSecondHitEntries > 0) {
+      allocatorConfig_.setNvmPromotionPolicy(
+          std::make_shared<SecondHitPromotionPolicy<Allocator>>(
+              config_.nvmPromotionSecondHitEntries, 20 /* numSplits */));
     }
 
     allocatorConfig_.setNvmAdmissionMinTTL(config_.memoryOnlyTTL);
@@ -1170,6 +1198,7 @@ Stats Cache<Allocator>::getStats() const {
   ret.numNvmPutErrs = cacheStats.numNvmPutErrs;
   ret.numNvmAbortedPutOnTombstone = cacheStats.numNvmAbortedPutOnTombstone;
   ret.numNvmAbortedPutOnInflightGet = cacheStats.numNvmAbortedPutOnInflightGet;
+  ret.numNvmAbortedPutOnPoolQuota = cacheStats.numNvmAbortedPutOnPoolQuota;
   ret.numNvmPutFromClean = cacheStats.numNvmPutFromClean;
   ret.numNvmUncleanEvict = cacheStats.numNvmUncleanEvict;
   ret.numNvmCleanEvict = cacheStats.numNvmCleanEvict;
@@ -1225,6 +1254,7 @@ Stats Cache<Allocator>::getStats() const {
     double bcLogicalBytes = lookup("navy_bc_logical_written");
     ret.numNvmLogicalBytesWritten =
         static_cast<size_t>(bhLogicalBytes + bcLogicalBytes);
+    ret.numNvmBytesDiscarded = lookup("navy_device_bytes_discarded");
     ret.nvmReadLatencyMicrosP50 = lookup("navy_device_read_latency_us_p50");
     ret.nvmReadLatencyMicrosP90 = lookup("navy_device_read_latency_us_p90");
     ret.nvmReadLatencyMicrosP99 = lookup("navy_device_read_latency_us_p99");
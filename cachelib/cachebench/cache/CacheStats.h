@@ -75,6 +75,7 @@ struct Stats {
   uint64_t numNvmPutErrs{0};
   uint64_t numNvmAbortedPutOnTombstone{0};
   uint64_t numNvmAbortedPutOnInflightGet{0};
+  uint64_t numNvmAbortedPutOnPoolQuota{0};
   uint64_t numNvmPutFromClean{0};
   uint64_t numNvmUncleanEvict{0};
   uint64_t numNvmCleanEvict{0};
@@ -84,6 +85,7 @@ struct Stats {
   uint64_t numNvmBytesWritten{0};
   uint64_t numNvmNandBytesWritten{0};
   uint64_t numNvmLogicalBytesWritten{0};
+  uint64_t numNvmBytesDiscarded{0};
 
   uint64_t numNvmItemRemovedSetSize{0};
 
@@ -340,6 +342,8 @@ struct Stats {
                             numNvmLogicalBytesWritten / GB);
       out << folly::sformat("NVM bytes written (nand)      : {:6.2f} GB\n",
                             numNvmNandBytesWritten / GB);
+      out << folly::sformat("NVM bytes discarded           : {:6.2f} GB\n",
+                            numNvmBytesDiscarded / GB);
       out << folly::sformat("NVM app write amplification   : {:6.2f}\n",
                             appWriteAmp);
       out << folly::sformat("NVM dev write amplification   : {:6.2f}\n",
@@ -347,7 +351,8 @@ struct Stats {
     }
     const double putSuccessPct =
         invertPctFn(numNvmPutErrs + numNvmAbortedPutOnInflightGet +
-                        numNvmAbortedPutOnTombstone,
+                        numNvmAbortedPutOnTombstone +
+                        numNvmAbortedPutOnPoolQuota,
                     numNvmPuts);
     const double cleanEvictPct = pctFn(numNvmCleanEvict, numNvmEvictions);
     const double getCoalescedPct = pctFn(numNvmGetCoalesced, numNvmGets);
@@ -511,6 +516,8 @@ struct Stats {
         static_cast<int64_t>(numNvmLogicalBytesWritten / MB);
     counters["nvm_bytes_written_nand_mb"] =
         static_cast<int64_t>(numNvmNandBytesWritten / MB);
+    counters["nvm_bytes_discarded_mb"] =
+        static_cast<int64_t>(numNvmBytesDiscarded / MB);
     counters["nvm_app_write_amp"] = static_cast<int64_t>(appWriteAmp);
     counters["nvm_dev_write_amp"] = static_cast<int64_t>(devWriteAmp);
   }
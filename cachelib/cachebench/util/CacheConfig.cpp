@@ -62,6 +62,16 @@ CacheConfig::CacheConfig(const folly::dynamic& configJson) {
   JSONSetVal(configJson, writeAmpDeviceList);
 
   JSONSetVal(configJson, navyBlockSize);
+  JSONSetVal(configJson, navyEmulatedSsdQueueDepth);
+  JSONSetVal(configJson, navyEmulatedSsdChannels);
+  JSONSetVal(configJson, navyEmulatedSsdReadLatencyUs);
+  JSONSetVal(configJson, navyEmulatedSsdWriteLatencyUs);
+  JSONSetVal(configJson, navyEmulatedSsdEraseLatencyUs);
+  JSONSetVal(configJson, navyEmulatedSsdLatencyJitterPct);
+  JSONSetVal(configJson, navyEmulatedSsdReadBandwidthMB);
+  JSONSetVal(configJson, navyEmulatedSsdWriteBandwidthMB);
+  JSONSetVal(configJson, navyEmulatedSsdWriteBufferMB);
+  JSONSetVal(configJson, navyEmulatedSsdGcThresholdPct);
   JSONSetVal(configJson, navyRegionSizeMB);
   JSONSetVal(configJson, navySegmentedFifoSegmentRatio);
   JSONSetVal(configJson, navyReqOrderShardsPower);
@@ -79,6 +89,7 @@ CacheConfig::CacheConfig(const folly::dynamic& configJson) {
   JSONSetVal(configJson, navyStackSizeKB);
   JSONSetVal(configJson, navyQDepth);
   JSONSetVal(configJson, navyEnableIoUring);
+  JSONSetVal(configJson, navyIoUringBatchSubmit);
   JSONSetVal(configJson, navyCleanRegions);
   JSONSetVal(configJson, navyCleanRegionThreads);
   JSONSetVal(configJson, navyAdmissionWriteRateMB);
@@ -107,12 +118,16 @@ CacheConfig::CacheConfig(const folly::dynamic& configJson) {
   JSONSetVal(configJson, enableItemDestructorCheck);
   JSONSetVal(configJson, enableItemDestructor);
   JSONSetVal(configJson, nvmAdmissionRetentionTimeThreshold);
+  JSONSetVal(configJson, nvmPromotionSecondHitEntries);
+  JSONSetVal(configJson, nvmAdmissionHistoryEntries);
+  JSONSetVal(configJson, nvmAdmissionHistoryWindowSecs);
+  JSONSetVal(configJson, nvmAdmissionHistoryThreshold);
 
   JSONSetVal(configJson, customConfigJson);
   // if you added new fields to the configuration, update the JSONSetVal
   // to make them available for the json configs and increment the size
   // below
-  checkCorrectSize<CacheConfig, 760>();
+  checkCorrectSize<CacheConfig, 824>();
 
   if (numPools != poolSizes.size()) {
     throw std::invalid_argument(folly::sformat(
@@ -139,6 +139,21 @@ struct CacheConfig : public JSONConfig {
   // Navy specific: block size in bytes
   uint64_t navyBlockSize{512};
 
+  // Navy specific: emulate an SSD in front of the nvm cache (memory or
+  // files) for benchmarking without NVMe drives. A non-zero queue depth
+  // enables it; see navy::EmulatedSsdConfig for the model. Latencies are in
+  // microseconds, bandwidths in MB/s (0 is unlimited).
+  uint32_t navyEmulatedSsdQueueDepth{0};
+  uint32_t navyEmulatedSsdChannels{8};
+  uint32_t navyEmulatedSsdReadLatencyUs{80};
+  uint32_t navyEmulatedSsdWriteLatencyUs{20};
+  uint32_t navyEmulatedSsdEraseLatencyUs{3000};
+  uint32_t navyEmulatedSsdLatencyJitterPct{10};
+  uint32_t navyEmulatedSsdReadBandwidthMB{3000};
+  uint32_t navyEmulatedSsdWriteBandwidthMB{1500};
+  uint32_t navyEmulatedSsdWriteBufferMB{64};
+  uint32_t navyEmulatedSsdGcThresholdPct{90};
+
   // Navy specific: region size in MB
   uint64_t navyRegionSizeMB{16};
 
@@ -196,6 +211,8 @@ struct CacheConfig : public JSONConfig {
   uint32_t navyQDepth{0};
   // Use either io_uring or libaio for async IO
   bool navyEnableIoUring{true};
+  // Submit the io_uring IOs of a Navy thread once per event loop iteration
+  bool navyIoUringBatchSubmit{false};
 
   // buffer of clean regions to be maintained free to ensure writes
   // into navy don't queue behind a reclaim of region.
@@ -271,6 +288,23 @@ struct CacheConfig : public JSONConfig {
   // eviction-age is more than this threshold. 0 means no threshold
   uint32_t nvmAdmissionRetentionTimeThreshold{0};
 
+  // If specified, an nvm hit is only inserted into RAM if its key was hit in
+  // nvm before, among the last this many keys hit in nvm. 0 promotes every
+  // hit.
+  uint64_t nvmPromotionSecondHitEntries{0};
+
+  // If specified, items are admitted into NvmCache by HistoryBasedAP, which
+  // remembers this many recently offered keys to learn from. 0 disables it.
+  uint32_t nvmAdmissionHistoryEntries{0};
+
+  // Window in which a lookup of an offered key counts as a read back from
+  // flash for HistoryBasedAP.
+  uint32_t nvmAdmissionHistoryWindowSecs{3600};
+
+  // Minimum predicted probability of being read back from flash for
+  // HistoryBasedAP to admit an item.
+  double nvmAdmissionHistoryThreshold{0.5};
+
   //
   // Options below are not to be populated with JSON
   //
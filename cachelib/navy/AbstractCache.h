@@ -23,6 +23,7 @@
 #include <functional>
 #include <memory>
 #include <stdexcept>
+#include <vector>
 
 #include "cachelib/navy/common/Buffer.h"
 #include "cachelib/navy/common/Hash.h"
@@ -42,6 +43,15 @@ using InsertCallback = folly::Function<void(Status status, HashedKey key)>;
 using LookupCallback =
     folly::Function<void(Status status, HashedKey key, Buffer value)>;
 
+// @value is only valid for the duration of the callback.
+using LookupViewCallback =
+    folly::Function<void(Status status, HashedKey key, BufferView value)>;
+
+// Called once per key of a batch lookup; @idx is the position of @key in
+// the batch.
+using LookupBatchCallback = folly::Function<void(
+    size_t idx, Status status, HashedKey key, Buffer value)>;
+
 using RemoveCallback = folly::Function<void(Status status, HashedKey key)>;
 
 // Generic cache interface.
@@ -87,6 +97,21 @@ class AbstractCache {
   // is user responsibility to make a copy if needed (capture in callback).
   virtual void lookupAsync(HashedKey key, LookupCallback cb) = 0;
 
+  // Same as lookupAsync, but @cb receives a view of the value that is only
+  // valid during the callback. This saves copying values that the engine
+  // already holds in memory into a Buffer before handing them out, e.g.
+  // when the caller copies the value into its own memory right away.
+  virtual void lookupViewAsync(HashedKey key, LookupViewCallback cb) = 0;
+
+  // Asynchronously looks up all of @keys. Keys stored close to each other
+  // on the device are served with shared reads. @cb is invoked on worker
+  // threads once for every key, possibly concurrently. The lookup of one
+  // key is not ordered with requests for other keys of the batch.
+  //
+  // See @lookupAsync about @keys lifetime.
+  virtual void lookupBatchAsync(std::vector<HashedKey> keys,
+                                LookupBatchCallback cb) = 0;
+
   // Removes from the index, space reused after reclamation.
   // Returns: Ok, NotFound
   virtual Status remove(HashedKey key) = 0;
@@ -130,9 +155,31 @@ class AbstractCache {
   //         false if AdissionPolicy is not set or not DynamicRandom.
   virtual bool updateMaxRateForDynamicRandomAP(uint64_t) = 0;
 
+  // Moves device space between the small and the large item engine of the
+  // last engine pair, whose small item engine has to be set up resizable.
+  // Resizes the small item engine to @size bytes and the large item engine
+  // to the rest. Blocks until the entries in the space given up are evicted.
+  // Returns the new size of the small item engine.
+  virtual uint64_t resizeSmallItemCache(uint64_t size) = 0;
+
   // Get key and Buffer for a random sample
   virtual std::pair<Status, std::string /* key */> getRandomAlloc(
       Buffer& value) = 0;
+
+  // Writes every valid entry of the cache to @rw, so that another cache can
+  // be warmed up with importEntries. Runs on the calling thread and reads
+  // the device in large sequential IOs while the cache keeps serving
+  // traffic; entries inserted or removed meanwhile may or may not be
+  // exported. Returns the number of entries exported.
+  // @throw std::runtime_error if writing to @rw fails
+  virtual uint64_t exportEntries(RecordWriter& rw) = 0;
+
+  // Inserts the entries written by exportEntries from @rr, bypassing
+  // admission. Entries that expired since the export are skipped. Meant to
+  // run on a fresh cache before it takes traffic. Returns the number of
+  // entries inserted.
+  // @throw std::invalid_argument if @rr is not an export stream
+  virtual uint64_t importEntries(RecordReader& rr) = 0;
 };
 } // namespace navy
 } // namespace cachelib
@@ -25,6 +25,7 @@
 #include "cachelib/navy/admission_policy/RejectRandomAP.h"
 #include "cachelib/navy/bighash/BigHash.h"
 #include "cachelib/navy/block_cache/BlockCache.h"
+#include "cachelib/navy/block_cache/CostBenefitPolicy.h"
 #include "cachelib/navy/block_cache/FifoPolicy.h"
 #include "cachelib/navy/block_cache/LruPolicy.h"
 #include "cachelib/navy/common/Device.h"
@@ -57,6 +58,10 @@ class BlockCacheProtoImpl final : public BlockCacheProto {
 
   void setChecksum(bool enable) override { config_.checksum = enable; }
 
+  void setChecksumType(ChecksumType type) override {
+    config_.checksumType = type;
+  }
+
   void setLruEvictionPolicy() override {
     if (!(config_.cacheSize > 0 && config_.regionSize > 0)) {
       throw std::logic_error("layout is not set");
@@ -75,6 +80,17 @@ class BlockCacheProtoImpl final : public BlockCacheProto {
     config_.evictionPolicy = std::make_unique<FifoPolicy>();
   }
 
+  void setCostBenefitEvictionPolicy() override {
+    if (!(config_.cacheSize > 0 && config_.regionSize > 0)) {
+      throw std::logic_error("layout is not set");
+    }
+    if (config_.evictionPolicy) {
+      throw std::invalid_argument("There's already an eviction policy set");
+    }
+    config_.evictionPolicy =
+        std::make_unique<CostBenefitPolicy>(config_.regionSize);
+  }
+
   void setSegmentedFifoEvictionPolicy(
       std::vector<unsigned int> segmentRatio) override {
     if (config_.evictionPolicy) {
@@ -102,6 +118,10 @@ class BlockCacheProtoImpl final : public BlockCacheProto {
 
   void setDevice(Device* device) { config_.device = device; }
 
+  void setExpiryTimeGetter(ExpiryTimeGetter getExpiryTime) {
+    config_.getExpiryTime = std::move(getExpiryTime);
+  }
+
   void setNumInMemBuffers(uint32_t numInMemBuffers) override {
     config_.numInMemBuffers = numInMemBuffers;
   }
@@ -118,6 +138,36 @@ class BlockCacheProtoImpl final : public BlockCacheProto {
     config_.preciseRemove = preciseRemove;
   }
 
+  void setSparseReclaimThreshold(double threshold) override {
+    config_.sparseReclaimThreshold = threshold;
+  }
+
+  void setReclaimDeadWithoutRead(bool enable) override {
+    config_.reclaimDeadWithoutRead = enable;
+  }
+
+  void setExpiryBuckets(std::vector<uint32_t> expiryBuckets) override {
+    config_.expiryBuckets = std::move(expiryBuckets);
+  }
+
+  void setScanRecovery(bool scanRecovery) override {
+    config_.scanRecovery = scanRecovery;
+  }
+
+  void setFlushedRegionCacheSize(uint64_t size) override {
+    config_.flushedRegionCacheSize = size;
+  }
+
+  void setReclaimChunkSize(uint32_t size) override {
+    config_.reclaimChunkSize = size;
+  }
+
+  void setMaxChunkedItemSize(uint64_t size) override {
+    config_.maxChunkedItemSize = size;
+  }
+
+  void setActiveSize(uint64_t size) override { config_.activeCacheSize = size; }
+
   std::unique_ptr<Engine> create(JobScheduler& scheduler,
                                  ExpiredCheck checkExpired,
                                  DestructorCallback cb) && {
@@ -145,6 +195,10 @@ class BigHashProtoImpl final : public BigHashProto {
     config_.bucketSize = bucketSize;
   }
 
+  void setChecksumType(ChecksumType type) override {
+    config_.checksumType = type;
+  }
+
   // BigHash uses bloom filters (BF) to reduce number of IO. We want to maintain
   // BF for every bucket, because we want to rebuild it on every remove to keep
   // its filtering properties.
@@ -155,14 +209,18 @@ class BigHashProtoImpl final : public BigHashProto {
     hashTableBitSize_ = hashTableBitSize;
   }
 
+  void setActiveSize(uint64_t size) override { config_.activeCacheSize = size; }
+
   void setDevice(Device* device) { config_.device = device; }
 
   void setDestructorCb(DestructorCallback cb) {
     config_.destructorCb = std::move(cb);
   }
 
-  std::unique_ptr<Engine> create(ExpiredCheck checkExpired) && {
+  std::unique_ptr<Engine> create(ExpiredCheck checkExpired,
+                                 ExpiryTimeGetter getExpiryTime) && {
     config_.checkExpired = std::move(checkExpired);
+    config_.getExpiryTime = std::move(getExpiryTime);
     if (bloomFilterEnabled_) {
       if (config_.bucketSize == 0) {
         throw std::invalid_argument{"invalid bucket size"};
@@ -202,6 +260,7 @@ class EnginePairProtoImpl final : public EnginePairProto {
 
   EnginePair create(Device* device,
                     ExpiredCheck checkExpired,
+                    ExpiryTimeGetter getExpiryTime,
                     DestructorCallback destructorCb,
                     JobScheduler& scheduler) {
     std::unique_ptr<Engine> bh;
@@ -211,7 +270,7 @@ class EnginePairProtoImpl final : public EnginePairProto {
       if (bhProto != nullptr) {
         bhProto->setDevice(device);
         bhProto->setDestructorCb(destructorCb);
-        bh = std::move(*bhProto).create(checkExpired);
+        bh = std::move(*bhProto).create(checkExpired, getExpiryTime);
       }
     }
 
@@ -220,6 +279,7 @@ class EnginePairProtoImpl final : public EnginePairProto {
       auto bcProto = dynamic_cast<BlockCacheProtoImpl*>(blockCacheProto_.get());
       if (bcProto != nullptr) {
         bcProto->setDevice(device);
+        bcProto->setExpiryTimeGetter(std::move(getExpiryTime));
         bc = std::move(*bcProto).create(scheduler, checkExpired, destructorCb);
       }
     }
@@ -261,6 +321,10 @@ class CacheProtoImpl final : public CacheProto {
     checkExpired_ = std::move(checkExpired);
   }
 
+  void setExpiryTimeGetter(ExpiryTimeGetter getExpiryTime) override {
+    getExpiryTime_ = std::move(getExpiryTime);
+  }
+
   void setDestructorCallback(DestructorCallback cb) override {
     destructorCb_ = std::move(cb);
   }
@@ -273,6 +337,8 @@ class CacheProtoImpl final : public CacheProto {
     config_.selector = std::move(selector);
   }
 
+  void setTieredEngines(bool tiered) override { config_.tiered = tiered; }
+
   void setRejectRandomAdmissionPolicy(const RandomAPConfig& config) override {
     RejectRandomAP::Config apConfig;
     apConfig.probability = config.getAdmProbability();
@@ -322,18 +388,48 @@ class CacheProtoImpl final : public CacheProto {
       throw std::invalid_argument("scheduler is not set");
     }
 
-    for (auto& p : enginePairsProto_) {
+    // The hot tier demotes its evictions through the driver, which can only
+    // be created once its engines exist
+    auto driverRef = std::make_shared<Driver*>(nullptr);
+    for (size_t idx = 0; idx < enginePairsProto_.size(); idx++) {
+      auto destructorCb = destructorCb_;
+      if (config_.tiered && idx == 0) {
+        destructorCb = makeDemotingDestructorCb(driverRef);
+      }
       config_.enginePairs.push_back(
-          dynamic_cast<EnginePairProtoImpl*>(p.get())->create(
-              config_.device.get(), checkExpired_, destructorCb_,
-              *config_.scheduler));
+          dynamic_cast<EnginePairProtoImpl*>(enginePairsProto_[idx].get())
+              ->create(config_.device.get(), checkExpired_, getExpiryTime_,
+                       std::move(destructorCb), *config_.scheduler));
     }
 
-    return std::make_unique<Driver>(std::move(config_));
+    auto driver = std::make_unique<Driver>(std::move(config_));
+    *driverRef = driver.get();
+    return driver;
   }
 
  private:
+  // Wraps the user destructor callback so that live entries recycled by the
+  // hot tier are handed to the cold tier. The user callback only runs once
+  // an entry leaves the cache for good.
+  DestructorCallback makeDemotingDestructorCb(
+      std::shared_ptr<Driver*> driverRef) const {
+    return [driverRef = std::move(driverRef), checkExpired = checkExpired_,
+            cb = destructorCb_](HashedKey hk, BufferView value,
+                                DestructorEvent event) {
+      Driver* driver = *driverRef;
+      if (event == DestructorEvent::Recycled && !value.isNull() &&
+          driver != nullptr && !(checkExpired && checkExpired(value)) &&
+          driver->demote(hk, value, cb)) {
+        return;
+      }
+      if (cb) {
+        cb(hk, value, event);
+      }
+    };
+  }
+
   ExpiredCheck checkExpired_;
+  ExpiryTimeGetter getExpiryTime_;
   DestructorCallback destructorCb_;
   std::vector<std::unique_ptr<EnginePairProto>> enginePairsProto_;
   Driver::Config config_;
@@ -48,8 +48,12 @@ class BlockCacheProto {
   // Enable data checksumming (default: disabled)
   virtual void setChecksum(bool enable) = 0;
 
+  // Set the checksum used for entries when checksumming is enabled
+  // (default: Crc32).
+  virtual void setChecksumType(ChecksumType type) = 0;
+
   // set*EvictionPolicy function family: sets eviction policy. Supports LRU,
-  // LRU with deferred insert and FIFO. Must set up one of them.
+  // LRU with deferred insert, FIFO and cost-benefit. Must set up one of them.
 
   // Sets LRU eviction policy.
   virtual void setLruEvictionPolicy() = 0;
@@ -57,6 +61,10 @@ class BlockCacheProto {
   // Sets FIFO eviction policy.
   virtual void setFifoEvictionPolicy() = 0;
 
+  // Sets cost-benefit eviction policy, which prefers regions with little live
+  // data. Layout must be set first.
+  virtual void setCostBenefitEvictionPolicy() = 0;
+
   // Sets SegmentedFIFO eviction policy.
   // @segmentRatio  ratio of the size of each segment.
   virtual void setSegmentedFifoEvictionPolicy(
@@ -86,6 +94,38 @@ class BlockCacheProto {
 
   // (Optional) Set if the preciseRemove flag.
   virtual void setPreciseRemove(bool preciseRemove) = 0;
+
+  // (Optional) Set the fraction of live bytes below which region reclaim reads
+  // only the live entries. 0 disables sparse reclaim.
+  virtual void setSparseReclaimThreshold(double threshold) = 0;
+
+  // (Optional) Set if regions without live entries are reclaimed without
+  // reading them.
+  virtual void setReclaimDeadWithoutRead(bool enable) = 0;
+
+  // (Optional) Set ascending TTL boundaries (in seconds) used to group writes
+  // into separate regions by expiry. Requires CacheProto::setExpiryTimeGetter.
+  virtual void setExpiryBuckets(std::vector<uint32_t> expiryBuckets) = 0;
+
+  // (Optional) Write a footer into every region so that the cache can be
+  // rebuilt by scanning the device after an unclean shutdown.
+  virtual void setScanRecovery(bool scanRecovery) = 0;
+
+  // (Optional) Set the memory (in bytes) for recently flushed region buffers
+  // that serve reads before the device. 0 disables it.
+  virtual void setFlushedRegionCacheSize(uint64_t size) = 0;
+
+  // (Optional) Set the size (in bytes) of the chunks regions are read in
+  // during reclaim. 0 reads whole regions.
+  virtual void setReclaimChunkSize(uint32_t size) = 0;
+
+  // (Optional) Set the largest value (in bytes) stored split into chunks
+  // across regions when it does not fit in one. 0 disables it.
+  virtual void setMaxChunkedItemSize(uint64_t size) = 0;
+
+  // (Optional) Only use the first @size bytes of the layout until the engine
+  // pair is resized. Default: the whole layout.
+  virtual void setActiveSize(uint64_t size) = 0;
 };
 
 // BigHash engine proto. BigHash is used to cache small objects (under 2KB)
@@ -102,10 +142,17 @@ class BigHashProto {
                          uint64_t size,
                          uint32_t bucketSize) = 0;
 
+  // Set the checksum used for bucket contents (default: Crc32).
+  virtual void setChecksumType(ChecksumType type) = 0;
+
   // Enable Bloom filter with @numHashes hash functions, each mapped into an
   // bit array of @hashTableBitSize bits.
   virtual void setBloomFilter(uint32_t numHashes,
                               uint32_t hashTableBitSize) = 0;
+
+  // (Optional) Only use the last @size bytes of the layout until the engine
+  // pair is resized. Default: the whole layout.
+  virtual void setActiveSize(uint64_t size) = 0;
 };
 
 class EnginePairProto {
@@ -153,9 +200,18 @@ class CacheProto {
 
   virtual void setEnginesSelector(NavyConfig::EnginesSelector selector) = 0;
 
+  // (Optional) Stack the first engine pair as a hot tier on top of the
+  // second one. Items evicted from the hot pair are demoted to the cold
+  // pair instead of being dropped.
+  virtual void setTieredEngines(bool tiered) = 0;
+
   // Set callback used to if the passed NvmItem is expired
   virtual void setExpiredCheck(ExpiredCheck checkExpired) = 0;
 
+  // (Optional) Set callback used to get the expiry time of the passed NvmItem.
+  // Engines store it with every entry to drop expired entries early.
+  virtual void setExpiryTimeGetter(ExpiryTimeGetter getExpiryTime) = 0;
+
   // (Optional) Set destructor callback.
   //   - Callback invoked exactly once for every insert, even if it was removed
   //     manually from the cache with @AbstractCache::remove.
@@ -19,9 +19,12 @@
 #include <folly/Format.h>
 #include <folly/Random.h>
 
+#include <algorithm>
 #include <chrono>
+#include <numeric>
 
 #include "cachelib/common/Hash.h"
+#include "cachelib/common/Time.h"
 #include "cachelib/navy/bighash/Bucket.h"
 #include "cachelib/navy/common/Hash.h"
 #include "cachelib/navy/common/Utils.h"
@@ -60,6 +63,15 @@ BigHash::Config& BigHash::Config::validate() {
         bucketSize));
   }
 
+  if (activeCacheSize > cacheSize || activeCacheSize % bucketSize != 0) {
+    throw std::invalid_argument(folly::sformat(
+        "active cache size: {} needs to be a multiple of bucketSize: {} and no "
+        "larger than cacheSize: {}",
+        activeCacheSize,
+        bucketSize,
+        cacheSize));
+  }
+
   if (device == nullptr) {
     throw std::invalid_argument("device cannot be null");
   }
@@ -78,6 +90,7 @@ BigHash::BigHash(Config&& config)
 
 BigHash::BigHash(Config&& config, ValidConfigTag)
     : checkExpired_(std::move(config.checkExpired)),
+      getExpiryTime_(std::move(config.getExpiryTime)),
       destructorCb_{[cb = std::move(config.destructorCb)](
                         HashedKey hk, BufferView value, DestructorEvent event) {
         if (cb) {
@@ -87,6 +100,11 @@ BigHash::BigHash(Config&& config, ValidConfigTag)
       bucketSize_{config.bucketSize},
       cacheBaseOffset_{config.cacheBaseOffset},
       numBuckets_{config.numBuckets()},
+      initialFirstActiveBucket_{static_cast<uint32_t>(
+          config.activeCacheSize == 0
+              ? 0
+              : numBuckets_ - config.activeCacheSize / bucketSize_)},
+      checksumType_{config.checksumType},
       bloomFilter_{std::move(config.bloomFilter)},
       device_{*config.device},
       placementHandle_{device_.allocatePlacementHandle()} {
@@ -101,6 +119,7 @@ BigHash::BigHash(Config&& config, ValidConfigTag)
 void BigHash::reset() {
   XLOG(INFO, "Reset BigHash");
   generationTime_ = getSteadyClock();
+  firstActiveBucket_.store(initialFirstActiveBucket_);
 
   if (bloomFilter_) {
     bloomFilter_->reset();
@@ -118,6 +137,8 @@ void BigHash::reset() {
   succRemoveCount_.set(0);
   evictionCount_.set(0);
   evictionExpiredCount_.set(0);
+  expiredBytes_.set(0);
+  lookupExpiredCount_.set(0);
   logicalWrittenCount_.set(0);
   physicalWrittenCount_.set(0);
   ioErrorCount_.set(0);
@@ -142,7 +163,7 @@ uint64_t BigHash::getMaxItemSize() const {
 }
 
 std::pair<Status, std::string> BigHash::getRandomAlloc(Buffer& value) {
-  BucketId bid(folly::Random::rand64(0, numBuckets_));
+  BucketId bid(folly::Random::rand64(firstActiveBucket_.load(), numBuckets_));
 
   Bucket* bucket{nullptr};
   Buffer buffer;
@@ -166,6 +187,48 @@ std::pair<Status, std::string> BigHash::getRandomAlloc(Buffer& value) {
   return std::make_pair(Status::Ok, key);
 }
 
+uint64_t BigHash::forEachEntry(EntryVisitor visitor) {
+  const uint64_t bucketsPerRead =
+      std::max<uint64_t>(1, kMaxIterateReadSize / bucketSize_);
+  auto buffer = device_.makeIOBuffer(bucketsPerRead * bucketSize_);
+  uint64_t numVisited = 0;
+  for (uint64_t first = firstActiveBucket_.load(); first < numBuckets_;
+       first += bucketsPerRead) {
+    const auto count = std::min(bucketsPerRead, numBuckets_ - first);
+    if (!device_.read(getBucketOffset(BucketId{static_cast<uint32_t>(first)}),
+                      count * bucketSize_, buffer.data())) {
+      ioErrorCount_.inc();
+      continue;
+    }
+    const uint32_t currentTime = util::getCurrentTimeSec();
+    for (uint64_t i = 0; i < count; i++) {
+      if (!validBucketChecker_->isBucketValid(first + i)) {
+        continue;
+      }
+      auto view = buffer.view().slice(i * bucketSize_, bucketSize_);
+      if (!isBucketIntact(view)) {
+        // Never written since the last reset, or torn by a concurrent write
+        continue;
+      }
+      const auto* bucket = reinterpret_cast<const Bucket*>(view.data());
+      for (auto itr = bucket->getFirst(); !itr.done();
+           itr = bucket->getNext(itr)) {
+        const auto expiryTime = itr.expiryTime();
+        if (expiryTime > 0 && expiryTime < currentTime) {
+          continue;
+        }
+        numVisited++;
+        if (!visitor(HashedKey::precomputed(toStringPiece(itr.key()),
+                                            itr.keyHash()),
+                     itr.value(), expiryTime)) {
+          return numVisited;
+        }
+      }
+    }
+  }
+  return numVisited;
+}
+
 void BigHash::getCounters(const CounterVisitor& visitor) const {
   visitor("navy_bh_size", getSize());
   visitor("navy_bh_items", itemCount_.get());
@@ -190,6 +253,10 @@ void BigHash::getCounters(const CounterVisitor& visitor) const {
   visitor("navy_bh_evictions_expired",
           evictionExpiredCount_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bh_expired_bytes", expiredBytes_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bh_lookup_expired", lookupExpiredCount_.get(),
+          CounterVisitor::CounterType::RATE);
   visitor("navy_bh_logical_written",
           logicalWrittenCount_.get(),
           CounterVisitor::CounterType::RATE);
@@ -212,10 +279,14 @@ void BigHash::getCounters(const CounterVisitor& visitor) const {
   visitor("navy_bh_used_size_bytes", usedSizeBytes_.get());
   visitor("navy_bh_disabled_bucket_lookup", disabledBucketLookup_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bh_batch_bucket_reads_saved", batchBucketReadsSaved_.get(),
+          CounterVisitor::CounterType::RATE);
   visitor("navy_bh_disabled_bucket_insert", disabledBucketInsert_.get(),
           CounterVisitor::CounterType::RATE);
   visitor("navy_bh_disabled_bucket_remove", disabledBucketRemove_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bh_inactive_bucket_insert", inactiveBucketInsert_.get(),
+          CounterVisitor::CounterType::RATE);
   visitor("navy_bh_disabled_buckets",
           validBucketChecker_->numDisabledBuckets());
   bucketExpirationsDist_x100_.visitQuantileEstimator(
@@ -231,7 +302,9 @@ void BigHash::persist(RecordWriter& rw) {
   *pd.bucketSize() = bucketSize_;
   *pd.cacheBaseOffset() = cacheBaseOffset_;
   *pd.numBuckets() = numBuckets_;
+  *pd.checksumType() = static_cast<int32_t>(checksumType_);
   *pd.usedSizeBytes() = usedSizeBytes_.get();
+  *pd.firstActiveBucket() = firstActiveBucket_.load();
   *pd.validBucketCheckerState() = validBucketChecker_->persist();
   serializeProto(pd, rw);
 
@@ -257,8 +330,10 @@ bool BigHash::recover(RecordReader& rr) {
     auto configEquals =
         static_cast<uint64_t>(*pd.bucketSize()) == bucketSize_ &&
         static_cast<uint64_t>(*pd.cacheBaseOffset()) == cacheBaseOffset_ &&
-        static_cast<uint64_t>(*pd.numBuckets()) == numBuckets_;
-    if (!configEquals) {
+        static_cast<uint64_t>(*pd.numBuckets()) == numBuckets_ &&
+        static_cast<ChecksumType>(*pd.checksumType()) == checksumType_;
+    if (!configEquals ||
+        static_cast<uint64_t>(*pd.firstActiveBucket()) >= numBuckets_) {
       auto configStr = serializeToJson(pd);
       XLOGF(ERR, "Recovery config: {}", configStr.c_str());
       throw std::logic_error{"config mismatch"};
@@ -267,6 +342,7 @@ bool BigHash::recover(RecordReader& rr) {
     generationTime_ = std::chrono::nanoseconds{*pd.generationTime()};
     itemCount_.set(*pd.itemCount());
     usedSizeBytes_.set(*pd.usedSizeBytes());
+    firstActiveBucket_.store(static_cast<uint32_t>(*pd.firstActiveBucket()));
     if (bloomFilter_) {
       bloomFilter_->recover<ProtoSerializer>(rr);
       XLOG(INFO, "Recovered bloom filter");
@@ -297,9 +373,12 @@ Status BigHash::insert(HashedKey hk, BufferView value) {
     return Status::Rejected;
   }
 
+  const uint32_t expiryTime = getExpiryTime_ ? getExpiryTime_(value) : 0;
   uint32_t removed{0};
   uint32_t evicted{0};
   uint32_t evictExpired{0};
+  uint32_t expired{0};
+  uint32_t expiredBytes{0};
 
   uint32_t oldRemainingBytes = 0;
   uint32_t newRemainingBytes = 0;
@@ -315,6 +394,12 @@ Status BigHash::insert(HashedKey hk, BufferView value) {
 
   {
     std::unique_lock<SharedMutex> lock{getMutex(bid)};
+    // Checked under the lock so that nothing is written to a bucket after
+    // resize() drained it
+    if (!isBucketActive(bid)) {
+      inactiveBucketInsert_.inc();
+      return Status::Rejected;
+    }
     auto buffer = readBucket(bid);
     if (buffer.isNull()) {
       ioErrorCount_.inc();
@@ -323,14 +408,17 @@ Status BigHash::insert(HashedKey hk, BufferView value) {
 
     auto* bucket = reinterpret_cast<Bucket*>(buffer.data());
     oldRemainingBytes = bucket->remainingBytes();
+    // Expired entries go first, so that they never push out live ones
+    std::tie(expired, expiredBytes) =
+        bucket->removeExpired(util::getCurrentTimeSec(), cb);
     removed = bucket->remove(hk, cb);
     std::tie(evicted, evictExpired) =
-        bucket->insert(hk, value, checkExpired_, cb);
+        bucket->insert(hk, value, checkExpired_, cb, expiryTime);
     newRemainingBytes = bucket->remainingBytes();
 
     // rebuild / fix the bloom filter before we move the buffer to do the
     // actual write
-    if (removed + evicted == 0) {
+    if (removed + evicted + expired == 0) {
       // In case nothing was removed or evicted, we can just add
       bfSet(bid, hk.keyHash());
     } else {
@@ -357,11 +445,12 @@ Status BigHash::insert(HashedKey hk, BufferView value) {
     usedSizeBytes_.add(oldRemainingBytes - newRemainingBytes);
   }
   itemCount_.add(1);
-  itemCount_.sub(evicted + removed);
-  evictionCount_.add(evicted);
-  evictionExpiredCount_.add(evictExpired);
-  if (evictExpired > 0) {
-    bucketExpirationsDist_x100_.trackValue(evictExpired * 100);
+  itemCount_.sub(evicted + removed + expired);
+  evictionCount_.add(evicted + expired);
+  evictionExpiredCount_.add(evictExpired + expired);
+  expiredBytes_.add(expiredBytes);
+  if (evictExpired + expired > 0) {
+    bucketExpirationsDist_x100_.trackValue((evictExpired + expired) * 100);
   }
   logicalWrittenCount_.add(hk.key().size() + value.size());
   physicalWrittenCount_.add(bucketSize_);
@@ -371,7 +460,7 @@ Status BigHash::insert(HashedKey hk, BufferView value) {
 
 bool BigHash::couldExist(HashedKey hk) {
   const auto bid = getBucketId(hk);
-  bool canExist = !bfReject(bid, hk.keyHash());
+  bool canExist = isBucketActive(bid) && !bfReject(bid, hk.keyHash());
 
   // the caller is not likely to issue a subsequent lookup when we return
   // false. hence tag this as a lookup. If we return the key can exist, the
@@ -387,6 +476,11 @@ uint64_t BigHash::estimateWriteSize(HashedKey, BufferView) const {
 }
 
 Status BigHash::lookup(HashedKey hk, Buffer& value) {
+  return lookupView(hk, [&value](BufferView view) { value = Buffer{view}; });
+}
+
+Status BigHash::lookupView(HashedKey hk,
+                           folly::FunctionRef<void(BufferView)> visitor) {
   const auto bid = getBucketId(hk);
   lookupCount_.inc();
 
@@ -403,7 +497,7 @@ Status BigHash::lookup(HashedKey hk, Buffer& value) {
   // without holding the lock.
   {
     std::shared_lock<SharedMutex> lock{getMutex(bid)};
-    if (bfReject(bid, hk.keyHash())) {
+    if (!isBucketActive(bid) || bfReject(bid, hk.keyHash())) {
       return Status::NotFound;
     }
 
@@ -416,16 +510,106 @@ Status BigHash::lookup(HashedKey hk, Buffer& value) {
     bucket = reinterpret_cast<Bucket*>(buffer.data());
   }
 
-  auto valueView = bucket->find(hk);
+  bool expired = false;
+  auto valueView = bucket->find(hk, &expired);
   if (valueView.isNull()) {
-    bfFalsePositiveCount_.inc();
+    if (expired) {
+      lookupExpiredCount_.inc();
+    } else {
+      bfFalsePositiveCount_.inc();
+    }
     return Status::NotFound;
   }
-  value = Buffer{valueView};
+  visitor(valueView);
   succLookupCount_.inc();
   return Status::Ok;
 }
 
+void BigHash::lookupBatch(folly::Range<const HashedKey*> keys,
+                          folly::Range<Status*> statuses,
+                          folly::Range<Buffer*> values) {
+  XDCHECK_EQ(keys.size(), statuses.size());
+  XDCHECK_EQ(keys.size(), values.size());
+  lookupCount_.add(keys.size());
+
+  std::vector<uint32_t> bids(keys.size());
+  std::vector<uint32_t> order(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    bids[i] = getBucketId(keys[i]).index();
+  }
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&bids](uint32_t a, uint32_t b) { return bids[a] < bids[b]; });
+
+  for (size_t begin = 0; begin < order.size();) {
+    const BucketId bid{bids[order[begin]]};
+    size_t end = begin + 1;
+    while (end < order.size() && bids[order[end]] == bid.index()) {
+      end++;
+    }
+    if (!validBucketChecker_->isBucketValid(bid.index())) {
+      disabledBucketLookup_.add(end - begin);
+      for (size_t i = begin; i < end; i++) {
+        statuses[order[i]] = Status::NotFound;
+      }
+      begin = end;
+      continue;
+    }
+
+    // Keys that pass the bloom filter share one read of the bucket
+    Buffer buffer;
+    uint32_t numToFind = 0;
+    {
+      std::shared_lock<SharedMutex> lock{getMutex(bid)};
+      const bool active = isBucketActive(bid);
+      for (size_t i = begin; i < end; i++) {
+        const auto idx = order[i];
+        if (!active || bfReject(bid, keys[idx].keyHash())) {
+          statuses[idx] = Status::NotFound;
+        } else {
+          statuses[idx] = Status::Ok;
+          numToFind++;
+        }
+      }
+      if (numToFind > 0) {
+        buffer = readBucket(bid);
+        if (buffer.isNull()) {
+          ioErrorCount_.inc();
+        }
+      }
+    }
+    if (numToFind > 1) {
+      batchBucketReadsSaved_.add(numToFind - 1);
+    }
+
+    for (size_t i = begin; i < end; i++) {
+      const auto idx = order[i];
+      if (statuses[idx] != Status::Ok) {
+        continue;
+      }
+      if (buffer.isNull()) {
+        statuses[idx] = Status::DeviceError;
+        continue;
+      }
+      auto* bucket = reinterpret_cast<Bucket*>(buffer.data());
+      bool expired = false;
+      auto valueView = bucket->find(keys[idx], &expired);
+      if (valueView.isNull()) {
+        if (expired) {
+          lookupExpiredCount_.inc();
+        } else {
+          bfFalsePositiveCount_.inc();
+        }
+        statuses[idx] = Status::NotFound;
+        continue;
+      }
+      values[idx] = Buffer{valueView};
+      succLookupCount_.inc();
+    }
+    begin = end;
+  }
+}
+
 Status BigHash::remove(HashedKey hk) {
   const auto bid = getBucketId(hk);
   removeCount_.inc();
@@ -452,6 +636,9 @@ Status BigHash::remove(HashedKey hk) {
 
   {
     std::unique_lock<SharedMutex> lock{getMutex(bid)};
+    if (!isBucketActive(bid)) {
+      return Status::NotFound;
+    }
 
     auto buffer = readBucket(bid);
     if (buffer.isNull()) {
@@ -543,6 +730,64 @@ void BigHash::bfRebuild(BucketId bid, const Bucket* bucket) {
   }
 }
 
+uint64_t BigHash::resize(uint64_t size) {
+  const auto numActive = std::min<uint64_t>(size / bucketSize_, numBuckets_);
+  if (numActive == 0) {
+    throw std::invalid_argument(
+        folly::sformat("cannot resize to {} bytes, smaller than a bucket of {}",
+                       size,
+                       bucketSize_));
+  }
+  XLOGF(INFO, "Resize BigHash from {} to {} bytes", getSize(),
+        numActive * bucketSize_);
+  const auto firstActive = static_cast<uint32_t>(numBuckets_ - numActive);
+  const auto oldFirstActive = firstActiveBucket_.exchange(firstActive);
+  // Buckets that become active again were drained when they were given up.
+  // Whatever the other engine wrote to them fails the generation and checksum
+  // checks and is read as an empty bucket.
+  for (uint32_t i = oldFirstActive; i < firstActive; i++) {
+    drainBucket(BucketId{i});
+  }
+  return getSize();
+}
+
+void BigHash::drainBucket(BucketId bid) {
+  std::vector<std::pair<Buffer, Buffer>> evictedItems;
+  uint32_t oldRemainingBytes = 0;
+  uint32_t newRemainingBytes = 0;
+  {
+    std::unique_lock<SharedMutex> lock{getMutex(bid)};
+    auto buffer = readBucket(bid);
+    if (buffer.isNull()) {
+      ioErrorCount_.inc();
+      return;
+    }
+    auto* bucket = reinterpret_cast<Bucket*>(buffer.data());
+    bfClear(bid);
+    if (bucket->size() == 0) {
+      return;
+    }
+    for (auto itr = bucket->getFirst(); !itr.done();
+         itr = bucket->getNext(itr)) {
+      evictedItems.emplace_back(Buffer{itr.key()}, Buffer{itr.value()});
+    }
+    oldRemainingBytes = bucket->remainingBytes();
+    bucket = &Bucket::initNew(buffer.mutableView(), generationTime_.count());
+    newRemainingBytes = bucket->remainingBytes();
+    if (!writeBucket(bid, std::move(buffer))) {
+      ioErrorCount_.inc();
+    }
+  }
+
+  for (const auto& [key, value] : evictedItems) {
+    destructorCb_(makeHK(key.view()), value.view(), DestructorEvent::Recycled);
+  }
+  usedSizeBytes_.sub(newRemainingBytes - oldRemainingBytes);
+  itemCount_.sub(evictedItems.size());
+  evictionCount_.add(evictedItems.size());
+  physicalWrittenCount_.add(bucketSize_);
+}
+
 void BigHash::flush() {
   XLOG(INFO, "Flush big hash");
   device_.flush();
@@ -559,11 +804,18 @@ Buffer BigHash::readBucket(BucketId bid) {
     return {};
   }
 
-  auto* bucket = reinterpret_cast<Bucket*>(buffer.data());
+  if (!isBucketIntact(buffer.view())) {
+    Bucket::initNew(buffer.mutableView(), generationTime_.count());
+  }
+  return buffer;
+}
 
-  auto checksumCheck = [](auto* b, auto bufferView) {
+bool BigHash::isBucketIntact(BufferView view) const {
+  const auto* bucket = reinterpret_cast<const Bucket*>(view.data());
+
+  auto checksumCheck = [this](auto* b, auto bufferView) {
     const bool checksumSuccess =
-        Bucket::computeChecksum(bufferView) == b->getChecksum();
+        Bucket::computeChecksum(bufferView, checksumType_) == b->getChecksum();
     // TODO (T93631284) we only read a bucket if the bloom filter indicates that
     // the bucket could have the element. Hence, if check sum errors out and
     // bloom filter is enable, we could record the checksum error. However,
@@ -579,17 +831,14 @@ Buffer BigHash::readBucket(BucketId bid) {
     return checksumSuccess;
   };
 
-  if (static_cast<uint64_t>(generationTime_.count()) !=
-          bucket->generationTime() ||
-      !checksumCheck(bucket, buffer.view())) {
-    Bucket::initNew(buffer.mutableView(), generationTime_.count());
-  }
-  return buffer;
+  return static_cast<uint64_t>(generationTime_.count()) ==
+             bucket->generationTime() &&
+         checksumCheck(bucket, view);
 }
 
 bool BigHash::writeBucket(BucketId bid, Buffer buffer) {
   auto* bucket = reinterpret_cast<Bucket*>(buffer.data());
-  bucket->setChecksum(Bucket::computeChecksum(buffer.view()));
+  bucket->setChecksum(Bucket::computeChecksum(buffer.view(), checksumType_));
   const bool res =
       device_.write(getBucketOffset(bid), std::move(buffer), placementHandle_);
   if (!res) {
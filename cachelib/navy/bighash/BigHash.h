@@ -18,6 +18,7 @@
 
 #include <folly/fibers/TimedMutex.h>
 
+#include <atomic>
 #include <chrono>
 #include <stdexcept>
 
@@ -71,11 +72,22 @@ class BigHash final : public Engine {
     Device* device{nullptr};
 
     ExpiredCheck checkExpired;
+    // Optional. Expiry times are stored with the entries so that expired
+    // entries are dropped on bucket rewrites and filtered on lookups.
+    ExpiryTimeGetter getExpiryTime;
     DestructorCallback destructorCb;
 
     // Optional bloom filter to reduce IO
     std::unique_ptr<BloomFilter> bloomFilter;
 
+    // Checksum function protecting bucket contents
+    ChecksumType checksumType{ChecksumType::Crc32};
+
+    // Bytes at the end of the cache that hold data until the cache is
+    // resized. The buckets before may be used by the large item engine of the
+    // same engine pair. Multiple of bucketSize; 0 means all of cacheSize.
+    uint64_t activeCacheSize{};
+
     uint64_t numBuckets() const { return cacheSize / bucketSize; }
 
     Config& validate();
@@ -92,7 +104,9 @@ class BigHash final : public Engine {
   ~BigHash() override = default;
 
   // Return the size of usable space
-  uint64_t getSize() const override { return bucketSize_ * numBuckets_; }
+  uint64_t getSize() const override {
+    return bucketSize_ * (numBuckets_ - firstActiveBucket_.load());
+  }
 
   // Check if the key could exist in bighash. This can be used as a pre-check
   // to optimize cache lookups to avoid calling lookups in an async IO
@@ -112,6 +126,17 @@ class BigHash final : public Engine {
   // DeviceError.
   Status lookup(HashedKey hk, Buffer& value) override;
 
+  // Same as lookup(), but passes the value to @visitor straight from the
+  // bucket read buffer instead of copying it out.
+  Status lookupView(HashedKey hk,
+                    folly::FunctionRef<void(BufferView)> visitor) override;
+
+  // Looks up keys bucket by bucket so that each bucket is read only once
+  // no matter how many of the keys hash to it.
+  void lookupBatch(folly::Range<const HashedKey*> keys,
+                   folly::Range<Status*> statuses,
+                   folly::Range<Buffer*> values) override;
+
   // Inserts key and value into BigHash. This will replace an existing
   // key if found. If it failed to write, it will return DeviceError.
   Status insert(HashedKey hk, BufferView value) override;
@@ -120,6 +145,16 @@ class BigHash final : public Engine {
   // and DeviceError on error.
   Status remove(HashedKey hk) override;
 
+  // Returns false if @hk maps to a bucket given up by resize().
+  bool acceptsKey(HashedKey hk) const override {
+    return isBucketActive(getBucketId(hk));
+  }
+
+  // Grows or shrinks the cache to the last @size bytes of its device range.
+  // Entries of the buckets given up are evicted. Keys that map to them are
+  // rejected by inserts and not found by lookups until the cache grows again.
+  uint64_t resize(uint64_t size) override;
+
   // flush the device file
   void flush() override;
 
@@ -147,6 +182,12 @@ class BigHash final : public Engine {
   std::pair<Status, std::string /* key */> getRandomAlloc(
       Buffer& value) override;
 
+  // Visits the entries of the active buckets, reading up to
+  // kMaxIterateReadSize bytes of buckets with one device IO. Buckets are
+  // read without their locks; one that is torn by a concurrent write fails
+  // its checksum and is skipped.
+  uint64_t forEachEntry(EntryVisitor visitor) override;
+
  private:
   class BucketId {
    public:
@@ -169,6 +210,9 @@ class BigHash final : public Engine {
   BigHash(Config&& config, ValidConfigTag);
 
   Buffer readBucket(BucketId bid);
+  // Returns true if @view holds a bucket written in the current generation
+  // that passes its checksum
+  bool isBucketIntact(BufferView view) const;
   bool writeBucket(BucketId bid, Buffer buffer);
 
   // Initialize the SharedMutexes.
@@ -204,6 +248,15 @@ class BigHash final : public Engine {
     return cacheBaseOffset_ + bucketSize_ * bid.index();
   }
 
+  // Buckets before the first active one hold no data
+  bool isBucketActive(BucketId bid) const {
+    return bid.index() >= firstActiveBucket_.load(std::memory_order_acquire);
+  }
+
+  // Evicts all entries of @bid and writes it back empty, so that none of
+  // them comes back if the bucket is used again
+  void drainBucket(BucketId bid);
+
   double bfFalsePositivePct() const;
   void bfSet(BucketId bid, uint64_t bucket);
   void bfClear(BucketId bid);
@@ -215,13 +268,21 @@ class BigHash final : public Engine {
   static constexpr size_t kNumMutexes = 16 * 1024;
 
   // Serialization format version. Never 0. Versions < 10 reserved for testing.
-  static constexpr uint32_t kFormatVersion = 10;
+  static constexpr uint32_t kFormatVersion = 11;
+
+  // Max size of a device read of forEachEntry()
+  static constexpr uint64_t kMaxIterateReadSize = 1024 * 1024;
 
   const ExpiredCheck checkExpired_{};
+  const ExpiryTimeGetter getExpiryTime_{};
   const DestructorCallback destructorCb_{};
   const uint64_t bucketSize_{};
   const uint64_t cacheBaseOffset_{};
   const uint64_t numBuckets_{};
+  // First active bucket after a reset
+  const uint32_t initialFirstActiveBucket_{};
+  std::atomic<uint32_t> firstActiveBucket_{0};
+  const ChecksumType checksumType_{};
   std::unique_ptr<BloomFilter> bloomFilter_;
   std::unique_ptr<ValidBucketChecker> validBucketChecker_;
   std::chrono::nanoseconds generationTime_{};
@@ -252,6 +313,9 @@ class BigHash final : public Engine {
   mutable AtomicCounter succRemoveCount_;
   mutable AtomicCounter evictionCount_;
   mutable AtomicCounter evictionExpiredCount_;
+  // Bucket bytes freed by dropping expired entries on inserts
+  mutable AtomicCounter expiredBytes_;
+  mutable AtomicCounter lookupExpiredCount_;
   mutable AtomicCounter logicalWrittenCount_;
   mutable AtomicCounter physicalWrittenCount_;
   mutable AtomicCounter ioErrorCount_;
@@ -262,6 +326,10 @@ class BigHash final : public Engine {
   mutable AtomicCounter disabledBucketLookup_;
   mutable AtomicCounter disabledBucketInsert_;
   mutable AtomicCounter disabledBucketRemove_;
+  // Inserts rejected because the key maps to a bucket given up by resize()
+  mutable AtomicCounter inactiveBucketInsert_;
+  // Bucket reads avoided by batch lookups of keys in the same bucket
+  mutable AtomicCounter batchBucketReadsSaved_;
   // counters to quantify the expired eviction overhead (temporary)
   // PercentileStats generates outputs in integers, so amplify by 100x
   mutable util::PercentileStats bucketExpirationsDist_x100_;
@@ -18,6 +18,7 @@
 
 #include <folly/Random.h>
 
+#include "cachelib/common/Time.h"
 #include "cachelib/navy/common/Hash.h"
 
 namespace facebook::cachelib::navy {
@@ -43,14 +44,18 @@ BufferView Bucket::Iterator::value() const {
   return getIteratorEntry(itr_)->value();
 }
 
+uint32_t Bucket::Iterator::expiryTime() const {
+  return getIteratorEntry(itr_)->expiryTime();
+}
+
 bool Bucket::Iterator::keyEqualsTo(HashedKey hk) const {
   return getIteratorEntry(itr_)->keyEqualsTo(hk);
 }
 
-uint32_t Bucket::computeChecksum(BufferView view) {
+uint32_t Bucket::computeChecksum(BufferView view, ChecksumType type) {
   constexpr auto kChecksumStart = sizeof(checksum_);
   auto data = view.slice(kChecksumStart, view.size() - kChecksumStart);
-  return navy::checksum(data);
+  return navy::checksum(data, type);
 }
 
 Bucket& Bucket::initNew(MutableBufferView view, uint64_t generationTime) {
@@ -58,11 +63,17 @@ Bucket& Bucket::initNew(MutableBufferView view, uint64_t generationTime) {
       Bucket(generationTime, view.size() - sizeof(Bucket));
 }
 
-BufferView Bucket::find(HashedKey hk) const {
+BufferView Bucket::find(HashedKey hk, bool* expired) const {
   auto itr = storage_.getFirst();
   while (!itr.done()) {
     auto* entry = getIteratorEntry(itr);
     if (entry->keyEqualsTo(hk)) {
+      if (entry->isExpired(util::getCurrentTimeSec())) {
+        if (expired) {
+          *expired = true;
+        }
+        return {};
+      }
       return entry->value();
     }
     itr = storage_.getNext(itr);
@@ -74,7 +85,8 @@ std::pair<uint32_t, uint32_t> Bucket::insert(
     HashedKey hk,
     BufferView value,
     const ExpiredCheck& checkExpired,
-    const DestructorCallback& destructorCb) {
+    const DestructorCallback& destructorCb,
+    uint32_t expiryTime) {
   const auto size =
       details::BucketEntry::computeSize(hk.key().size(), value.size());
   XDCHECK_LE(size, storage_.capacity());
@@ -82,7 +94,7 @@ std::pair<uint32_t, uint32_t> Bucket::insert(
   auto ret = makeSpace(size, checkExpired, destructorCb);
   auto alloc = storage_.allocate(size);
   XDCHECK(!alloc.done());
-  details::BucketEntry::create(alloc.view(), hk, value);
+  details::BucketEntry::create(alloc.view(), hk, value, expiryTime);
 
   return ret;
 }
@@ -157,6 +169,31 @@ uint32_t Bucket::removeExpired(BucketStorage::Allocation itr,
   return evictions;
 }
 
+std::pair<uint32_t, uint32_t> Bucket::removeExpired(
+    uint32_t currentTime, const DestructorCallback& destructorCb) {
+  uint32_t expirations = 0;
+  uint32_t bytes = 0;
+  std::vector<BucketStorage::Allocation> removed;
+  for (auto itr = storage_.getFirst(); !itr.done();
+       itr = storage_.getNext(itr)) {
+    auto* entry = getIteratorEntry(itr);
+    if (!entry->isExpired(currentTime)) {
+      continue;
+    }
+    if (destructorCb) {
+      destructorCb(entry->hashedKey(), entry->value(),
+                   DestructorEvent::Recycled);
+    }
+    removed.emplace_back(itr);
+    expirations++;
+    bytes += BucketStorage::slotSize(itr.view().size());
+  }
+  if (!removed.empty()) {
+    storage_.remove(removed);
+  }
+  return std::make_pair(expirations, bytes);
+}
+
 uint32_t Bucket::remove(HashedKey hk, const DestructorCallback& destructorCb) {
   auto itr = storage_.getFirst();
   while (!itr.done()) {
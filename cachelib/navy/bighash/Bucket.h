@@ -55,6 +55,8 @@ class FOLLY_PACK_ATTR Bucket {
     BufferView key() const;
     uint64_t keyHash() const;
     BufferView value() const;
+    // absolute expiry time of the entry, 0 if it never expires
+    uint32_t expiryTime() const;
 
     bool keyEqualsTo(HashedKey hk) const;
 
@@ -68,7 +70,8 @@ class FOLLY_PACK_ATTR Bucket {
   };
 
   // User will pass in a view that contains the memory that is a Bucket
-  static uint32_t computeChecksum(BufferView view);
+  static uint32_t computeChecksum(BufferView view,
+                                  ChecksumType type = ChecksumType::Crc32);
 
   // Initialize a brand new Bucket given a piece of memory in the case
   // that the existing bucket is invalid. (I.e. checksum or generation
@@ -88,19 +91,28 @@ class FOLLY_PACK_ATTR Bucket {
   uint32_t remainingBytes() const { return storage_.remainingCapacity(); }
 
   // Look up for the value corresponding to a key.
-  // BufferView::isNull() == true if not found.
-  BufferView find(HashedKey hk) const;
+  // BufferView::isNull() == true if not found. An entry whose expiry time has
+  // passed is not returned; @expired is set to true for it if not null.
+  BufferView find(HashedKey hk, bool* expired = nullptr) const;
 
   // Note: this does *not* replace an existing key! User must make sure to
   //       remove an existing key before calling insert.
   //
   // Insert into the bucket. Trigger eviction and invoke @destructorCb if
-  // not enough space.
+  // not enough space. @expiryTime is stored with the entry, 0 means the
+  // entry never expires.
   // Return <number of entries evicted, number of entries expired> pair
   std::pair<uint32_t, uint32_t> insert(HashedKey hk,
                                        BufferView value,
                                        const ExpiredCheck& checkExpired,
-                                       const DestructorCallback& destructorCb);
+                                       const DestructorCallback& destructorCb,
+                                       uint32_t expiryTime = 0);
+
+  // Remove all entries whose stored expiry time is before @currentTime and
+  // invoke @destructorCb for each of them.
+  // Return <number of entries removed, bytes freed> pair
+  std::pair<uint32_t, uint32_t> removeExpired(
+      uint32_t currentTime, const DestructorCallback& destructorCb);
 
   // Remove an entry corresponding to the key. If found, invoke @destructorCb
   // before returning true. Return number of entries removed.
@@ -145,10 +157,12 @@ class FOLLY_PACK_ATTR BucketEntry {
   // @param storage  the mutable memory used to create BucketEntry
   // @param hk       the item's key and its hash
   // @param value    the item's value
+  // @param expiryTime  absolute expiry time in seconds, 0 if none
   static BucketEntry& create(MutableBufferView storage,
                              HashedKey hk,
-                             BufferView value) {
-    new (storage.data()) BucketEntry{hk, value};
+                             BufferView value,
+                             uint32_t expiryTime) {
+    new (storage.data()) BucketEntry{hk, value, expiryTime};
     return reinterpret_cast<BucketEntry&>(*storage.data());
   }
 
@@ -164,12 +178,19 @@ class FOLLY_PACK_ATTR BucketEntry {
 
   BufferView value() const { return {valueSize_, data_ + keySize_}; }
 
+  uint32_t expiryTime() const { return expiryTime_; }
+
+  bool isExpired(uint32_t currentTime) const {
+    return expiryTime_ > 0 && expiryTime_ < currentTime;
+  }
+
  private:
-  BucketEntry(HashedKey hk, BufferView value)
+  BucketEntry(HashedKey hk, BufferView value, uint32_t expiryTime)
       : keySize_{static_cast<uint32_t>(hk.key().size())},
         valueSize_{static_cast<uint32_t>(value.size())},
-        keyHash_{hk.keyHash()} {
-    static_assert(sizeof(BucketEntry) == 16, "BucketEntry overhead");
+        keyHash_{hk.keyHash()},
+        expiryTime_{expiryTime} {
+    static_assert(sizeof(BucketEntry) == 20, "BucketEntry overhead");
     makeView(hk.key()).copyTo(data_);
     value.copyTo(data_ + keySize_);
   }
@@ -177,6 +198,7 @@ class FOLLY_PACK_ATTR BucketEntry {
   const uint32_t keySize_{};
   const uint32_t valueSize_{};
   const uint64_t keyHash_{};
+  const uint32_t expiryTime_{};
   uint8_t data_[];
 };
 } // namespace details
@@ -18,9 +18,11 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <cstring>
 #include <map>
 
 #include "cachelib/common/Hash.h"
+#include "cachelib/common/Time.h"
 #include "cachelib/common/Utils.h"
 #include "cachelib/navy/bighash/BigHash.h"
 #include "cachelib/navy/driver/Driver.h"
@@ -78,6 +80,44 @@ TEST(BigHash, InsertAndRemove) {
   EXPECT_EQ(Status::NotFound, bh.remove(makeHK("key")));
 }
 
+TEST(BigHash, LookupBatch) {
+  BigHash::Config config;
+  setLayout(config, 256, 2);
+  auto device = std::make_unique<NiceMock<MockDevice>>(config.cacheSize, 128);
+  config.device = device.get();
+
+  BigHash bh(std::move(config));
+
+  // Two keys in bucket 0, one present and one missing key in bucket 1
+  std::vector<std::string> keyStrs{genKey(2, 0), genKey(2, 0), genKey(2, 1),
+                                   genKey(2, 1)};
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_EQ(Status::Ok,
+              bh.insert(makeHK(keyStrs[i].c_str()), makeView("12345")));
+  }
+
+  std::vector<HashedKey> keys;
+  for (const auto& key : keyStrs) {
+    keys.push_back(makeHK(key.c_str()));
+  }
+  std::vector<Status> statuses(keys.size());
+  std::vector<Buffer> values(keys.size());
+  bh.lookupBatch(folly::range(keys), folly::range(statuses),
+                 folly::range(values));
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_EQ(Status::Ok, statuses[i]);
+    EXPECT_EQ(makeView("12345"), values[i].view());
+  }
+  EXPECT_EQ(Status::NotFound, statuses[3]);
+
+  // One read per bucket
+  bh.getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bh_batch_bucket_reads_saved") {
+      EXPECT_EQ(2, count);
+    }
+  }});
+}
+
 // without bloom filters, could exist always returns true.
 TEST(BigHash, CouldExistWithoutBF) {
   BigHash::Config config;
@@ -148,7 +188,7 @@ TEST(BigHash, SimpleStats) {
     EXPECT_CALL(helper, call(strPiece("navy_bh_io_errors"), 0));
     EXPECT_CALL(helper, call(strPiece("navy_bh_bf_false_positive_pct"), 0));
     EXPECT_CALL(helper, call(strPiece("navy_bh_checksum_errors"), 0));
-    EXPECT_CALL(helper, call(strPiece("navy_bh_used_size_bytes"), 28));
+    EXPECT_CALL(helper, call(strPiece("navy_bh_used_size_bytes"), 32));
     bh.getCounters({toCallback(helper)});
   }
 
@@ -204,6 +244,54 @@ TEST(BigHash, EvictionStats) {
   }
 }
 
+TEST(BigHash, ExpiredEntries) {
+  BigHash::Config config;
+  setLayout(config, 256, 1);
+  auto device = std::make_unique<NiceMock<MockDevice>>(config.cacheSize, 256);
+  config.device = device.get();
+  // Values are just their expiry time
+  config.getExpiryTime = [](BufferView value) {
+    uint32_t expiryTime{};
+    std::memcpy(&expiryTime, value.data(), sizeof(expiryTime));
+    return expiryTime;
+  };
+  MockDestructor helper;
+  EXPECT_CALL(helper, call(makeHK("expired"), _, DestructorEvent::Recycled));
+  config.destructorCb = toCallback(helper);
+
+  BigHash bh(std::move(config));
+
+  auto makeValue = [](uint32_t expiryTime) {
+    Buffer buf{sizeof(expiryTime)};
+    std::memcpy(buf.data(), &expiryTime, sizeof(expiryTime));
+    return buf;
+  };
+  const uint32_t now = util::getCurrentTimeSec();
+  EXPECT_EQ(Status::Ok,
+            bh.insert(makeHK("live"), makeValue(now + 3600).view()));
+  EXPECT_EQ(Status::Ok, bh.insert(makeHK("no_ttl"), makeValue(0).view()));
+  EXPECT_EQ(Status::Ok, bh.insert(makeHK("expired"), makeValue(1).view()));
+
+  // Expired entry is filtered on lookup
+  Buffer value;
+  EXPECT_EQ(Status::NotFound, bh.lookup(makeHK("expired"), value));
+  EXPECT_EQ(Status::Ok, bh.lookup(makeHK("live"), value));
+  EXPECT_EQ(Status::Ok, bh.lookup(makeHK("no_ttl"), value));
+
+  // Next rewrite of the bucket drops it even though there is enough space
+  EXPECT_EQ(Status::Ok, bh.insert(makeHK("other"), makeValue(0).view()));
+  {
+    MockCounterVisitor counters;
+    EXPECT_CALL(counters, call(_, _)).Times(AtLeast(0));
+    EXPECT_CALL(counters, call(strPiece("navy_bh_items"), 3));
+    EXPECT_CALL(counters, call(strPiece("navy_bh_evictions_expired"), 1));
+    // "expired" + 4 byte value + entry header + slot header
+    EXPECT_CALL(counters, call(strPiece("navy_bh_expired_bytes"), 35));
+    EXPECT_CALL(counters, call(strPiece("navy_bh_lookup_expired"), 1));
+    bh.getCounters({toCallback(counters)});
+  }
+}
+
 TEST(BigHash, DeviceErrorStats) {
   BigHash::Config config;
   setLayout(config, 64, 1);
@@ -766,6 +854,134 @@ TEST(BigHash, RandomAlloc) {
   EXPECT_LT(stddev, avg * 0.2);
 }
 
+TEST(BigHash, Resize) {
+  BigHash::Config config;
+  setLayout(config, 128, 4);
+  config.activeCacheSize = 128 * 3;
+  auto device = std::make_unique<NiceMock<MockDevice>>(config.cacheSize, 128);
+  config.device = device.get();
+  MockDestructor helper;
+  config.destructorCb = toCallback(helper);
+
+  BigHash bh(std::move(config));
+  EXPECT_EQ(128 * 3, bh.getSize());
+
+  // The first bucket is given up at start
+  auto inactiveKey = genKey(4, 0);
+  EXPECT_FALSE(bh.acceptsKey(makeHK(inactiveKey.c_str())));
+  EXPECT_EQ(Status::Rejected,
+            bh.insert(makeHK(inactiveKey.c_str()), makeView("12345")));
+
+  auto drainedKey = genKey(4, 1);
+  auto keptKey = genKey(4, 3);
+  EXPECT_EQ(Status::Ok,
+            bh.insert(makeHK(drainedKey.c_str()), makeView("12345")));
+  EXPECT_EQ(Status::Ok, bh.insert(makeHK(keptKey.c_str()), makeView("12345")));
+
+  // Entries of the buckets given up are evicted
+  EXPECT_CALL(helper, call(makeHK(drainedKey.c_str()), makeView("12345"),
+                           DestructorEvent::Recycled));
+  EXPECT_EQ(128, bh.resize(128 + 100));
+  EXPECT_EQ(128, bh.getSize());
+  Buffer value;
+  EXPECT_EQ(Status::NotFound, bh.lookup(makeHK(drainedKey.c_str()), value));
+  EXPECT_FALSE(bh.acceptsKey(makeHK(drainedKey.c_str())));
+  EXPECT_EQ(Status::Ok, bh.lookup(makeHK(keptKey.c_str()), value));
+  EXPECT_EQ(makeView("12345"), value.view());
+
+  EXPECT_EQ(128 * 4, bh.resize(128 * 8));
+  EXPECT_TRUE(bh.acceptsKey(makeHK(inactiveKey.c_str())));
+  EXPECT_EQ(Status::Ok,
+            bh.insert(makeHK(inactiveKey.c_str()), makeView("12345")));
+  EXPECT_EQ(Status::Ok, bh.lookup(makeHK(inactiveKey.c_str()), value));
+
+  EXPECT_THROW(bh.resize(100), std::invalid_argument);
+}
+
+TEST(BigHash, ExportImport) {
+  auto makeBigHash = [](std::unique_ptr<Device>& device) {
+    BigHash::Config config;
+    setLayout(config, 256, 4);
+    device = std::make_unique<NiceMock<MockDevice>>(config.cacheSize, 256);
+    config.device = device.get();
+    // The expiry time is stored in the first 4 bytes of the value
+    config.getExpiryTime = [](BufferView value) {
+      uint32_t expiryTime{};
+      std::memcpy(&expiryTime, value.data(), sizeof(expiryTime));
+      return expiryTime;
+    };
+    return std::make_unique<BigHash>(std::move(config));
+  };
+  auto makeValue = [](uint32_t expiryTime, uint32_t version) {
+    Buffer buf{sizeof(expiryTime) + sizeof(version)};
+    std::memcpy(buf.data(), &expiryTime, sizeof(expiryTime));
+    std::memcpy(buf.data() + sizeof(expiryTime), &version, sizeof(version));
+    return buf;
+  };
+
+  std::unique_ptr<Device> device;
+  auto bh = makeBigHash(device);
+
+  // Live entries in every bucket, one of them overwritten and one removed,
+  // and an expired entry
+  const uint32_t now = util::getCurrentTimeSec();
+  std::map<std::string, std::string> live;
+  for (uint32_t bid = 0; bid < 4; bid++) {
+    for (uint32_t i = 0; i < 3; i++) {
+      auto key = genKey(4, bid);
+      auto value = makeValue(i == 0 ? 0 : now + 3600, 0);
+      EXPECT_EQ(Status::Ok, bh->insert(makeHK(key.c_str()), value.view()));
+      live[key] = toStringPiece(value.view()).str();
+    }
+  }
+  const auto overwritten = live.begin()->first;
+  auto value = makeValue(0, 1);
+  EXPECT_EQ(Status::Ok, bh->insert(makeHK(overwritten.c_str()), value.view()));
+  live[overwritten] = toStringPiece(value.view()).str();
+  const auto removed = live.rbegin()->first;
+  EXPECT_EQ(Status::Ok, bh->remove(makeHK(removed.c_str())));
+  live.erase(removed);
+  const auto expired = genKey(4, 0);
+  EXPECT_EQ(Status::Ok,
+            bh->insert(makeHK(expired.c_str()), makeValue(1, 0).view()));
+
+  // Export everything the engine visits, then insert it into a new one
+  std::map<std::string, std::string> exported;
+  EXPECT_EQ(live.size(),
+            bh->forEachEntry([&](HashedKey hk, BufferView v,
+                                 uint32_t expiryTime) {
+              std::string key = hk.key().str();
+              EXPECT_EQ(0, exported.count(key));
+              uint32_t storedExpiryTime{};
+              std::memcpy(&storedExpiryTime, v.data(),
+                          sizeof(storedExpiryTime));
+              EXPECT_EQ(storedExpiryTime, expiryTime);
+              exported[key] = toStringPiece(v).str();
+              return true;
+            }));
+  EXPECT_EQ(live, exported);
+
+  std::unique_ptr<Device> newDevice;
+  auto newBh = makeBigHash(newDevice);
+  for (const auto& [key, v] : exported) {
+    EXPECT_EQ(Status::Ok, newBh->insert(makeHK(key.c_str()), makeView(v)));
+  }
+  Buffer lookupValue;
+  for (const auto& [key, v] : live) {
+    EXPECT_EQ(Status::Ok, newBh->lookup(makeHK(key.c_str()), lookupValue));
+    EXPECT_EQ(makeView(v), lookupValue.view());
+  }
+  EXPECT_EQ(Status::NotFound,
+            newBh->lookup(makeHK(removed.c_str()), lookupValue));
+  EXPECT_EQ(Status::NotFound,
+            newBh->lookup(makeHK(expired.c_str()), lookupValue));
+
+  // The visitor stops the iteration
+  EXPECT_EQ(1, bh->forEachEntry([](HashedKey, BufferView, uint32_t) {
+    return false;
+  }));
+}
+
 // Make sure estimate write size always returns the bucket size.
 // Modify this test if we change the implementation.
 TEST(BigHash, EstimateWriteSize) {
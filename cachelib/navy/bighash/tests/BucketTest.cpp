@@ -17,6 +17,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "cachelib/common/Time.h"
 #include "cachelib/navy/bighash/Bucket.h"
 #include "cachelib/navy/testing/BufferGen.h"
 #include "cachelib/navy/testing/Callbacks.h"
@@ -25,7 +26,7 @@ using testing::_;
 
 namespace facebook::cachelib::navy::tests {
 TEST(Bucket, SingleKey) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk = makeHK("key");
@@ -51,7 +52,7 @@ TEST(Bucket, SingleKey) {
 }
 
 TEST(Bucket, CollisionKeys) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk = makeHK("key 1");
@@ -74,7 +75,7 @@ TEST(Bucket, CollisionKeys) {
 }
 
 TEST(Bucket, MultipleKeys) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk1 = makeHK("key 1");
@@ -116,7 +117,7 @@ TEST(Bucket, MultipleKeys) {
 }
 
 TEST(Bucket, DuplicateKeys) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk = makeHK("key");
@@ -161,7 +162,7 @@ TEST(Bucket, DuplicateKeys) {
 }
 
 TEST(Bucket, EvictionNone) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   // Insert 3 small key/value just enough not to trigger
@@ -190,7 +191,7 @@ TEST(Bucket, EvictionNone) {
 }
 
 TEST(Bucket, EvictionOne) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk1 = makeHK("key 1");
@@ -216,7 +217,7 @@ TEST(Bucket, EvictionOne) {
 }
 
 TEST(Bucket, EvictionAll) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk1 = makeHK("key 1");
@@ -250,7 +251,7 @@ TEST(Bucket, EvictionAll) {
 }
 
 TEST(Bucket, Checksum) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk = makeHK("key");
@@ -280,7 +281,7 @@ TEST(Bucket, Checksum) {
 }
 
 TEST(Bucket, Iteration) {
-  Buffer buf(96 + sizeof(Bucket));
+  Buffer buf(108 + sizeof(Bucket));
   auto& bucket = Bucket::initNew(buf.mutableView(), 0);
 
   const auto hk1 = makeHK("key 1");
@@ -331,6 +332,47 @@ TEST(Bucket, Iteration) {
   }
 }
 
+TEST(Bucket, RemoveExpired) {
+  Buffer buf(108 + sizeof(Bucket));
+  auto& bucket = Bucket::initNew(buf.mutableView(), 0);
+  const uint32_t now = util::getCurrentTimeSec();
+
+  const auto hk1 = makeHK("key 1");
+  const auto hk2 = makeHK("key 2");
+  const auto hk3 = makeHK("key 3");
+
+  // "key 1" has expired long ago, "key 2" never expires
+  bucket.insert(hk1, makeView("value 1"), nullptr, nullptr, 1);
+  bucket.insert(hk2, makeView("value 2"), nullptr, nullptr);
+  bucket.insert(hk3, makeView("value 3"), nullptr, nullptr, now + 3600);
+  EXPECT_EQ(3, bucket.size());
+
+  // Expired entries are not found even before they are removed
+  bool expired = false;
+  EXPECT_TRUE(bucket.find(hk1, &expired).isNull());
+  EXPECT_TRUE(expired);
+  expired = false;
+  EXPECT_EQ(makeView("value 2"), bucket.find(hk2, &expired));
+  EXPECT_EQ(makeView("value 3"), bucket.find(hk3, &expired));
+  EXPECT_FALSE(expired);
+
+  MockDestructor helper;
+  EXPECT_CALL(
+      helper,
+      call(makeHK("key 1"), makeView("value 1"), DestructorEvent::Recycled));
+  auto cb = toCallback(helper);
+  const auto [removed, bytes] = bucket.removeExpired(now, cb);
+  EXPECT_EQ(1, removed);
+  EXPECT_EQ(BucketStorage::slotSize(details::BucketEntry::computeSize(
+                hk1.key().size(), makeView("value 1").size())),
+            bytes);
+  EXPECT_EQ(2, bucket.size());
+
+  EXPECT_EQ(1, bucket.removeExpired(now + 7200, nullptr).first);
+  EXPECT_EQ(1, bucket.size());
+  EXPECT_EQ(makeView("value 2"), bucket.find(hk2));
+}
+
 TEST(Bucket, EvictionExpired) {
   constexpr uint32_t bucketSize = 1024;
   const uint32_t itemMinSize =
@@ -32,22 +32,34 @@ void RegionAllocator::setAllocationRegion(RegionId rid) {
 
 void RegionAllocator::reset() { rid_ = RegionId{}; }
 
-Allocator::Allocator(RegionManager& regionManager, uint16_t numPriorities)
-    : regionManager_{regionManager} {
+Allocator::Allocator(RegionManager& regionManager,
+                     uint16_t numPriorities,
+                     uint16_t numExpiryClasses)
+    : regionManager_{regionManager}, numExpiryClasses_{numExpiryClasses} {
+  if (numExpiryClasses_ == 0) {
+    throw std::invalid_argument(
+        "allocator must have at least one expiry class");
+  }
   XLOGF(INFO,
         "Enable priority-based allocation for Allocator. Number of "
-        "priorities: {}",
-        numPriorities);
+        "priorities: {}, number of expiry classes: {}",
+        numPriorities,
+        numExpiryClasses_);
   for (uint16_t i = 0; i < numPriorities; i++) {
-    allocators_.emplace_back(i /* priority */);
+    for (uint16_t j = 0; j < numExpiryClasses_; j++) {
+      allocators_.emplace_back(i /* priority */);
+    }
   }
 }
 
 std::tuple<RegionDescriptor, uint32_t, RelAddress> Allocator::allocate(
-    uint32_t size, uint16_t priority, bool canWait) {
-  XDCHECK_LT(priority, allocators_.size());
-  RegionAllocator* ra = &allocators_[priority];
-  if (size == 0 || size > regionManager_.regionSize()) {
+    uint32_t size, uint16_t priority, bool canWait, uint16_t expiryClass) {
+  XDCHECK_LT(expiryClass, numExpiryClasses_);
+  const size_t idx =
+      static_cast<size_t>(priority) * numExpiryClasses_ + expiryClass;
+  XDCHECK_LT(idx, allocators_.size());
+  RegionAllocator* ra = &allocators_[idx];
+  if (size == 0 || size > regionManager_.regionDataSize()) {
     return std::make_tuple(RegionDescriptor{OpenStatus::Error}, size,
                            RelAddress());
   }
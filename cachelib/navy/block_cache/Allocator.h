@@ -81,14 +81,20 @@ class Allocator {
   //                          locking regions
   // @param numPriorities     Specifies how many priorities this allocator
   //                          supports
+  // @param numExpiryClasses  Specifies how many expiry classes this allocator
+  //                          supports. Each (priority, expiry class) pair
+  //                          allocates from its own region.
   // Throws std::exception if invalid arguments
-  explicit Allocator(RegionManager& regionManager, uint16_t numPriorities);
+  Allocator(RegionManager& regionManager,
+            uint16_t numPriorities,
+            uint16_t numExpiryClasses = 1);
 
   // Allocates and opens for writing.
   //
   // @param size          Allocation size
   // @param priority      Specifies how important this allocation is
   // @param canWait       If true, wait until allocation can be retried
+  // @param expiryClass   Groups allocations expiring around the same time
   //
   // Returns a tuple containing region descriptor, allocated slotSize and
   // allocated address
@@ -99,10 +105,12 @@ class Allocator {
   //  - Error   Can't allocate this size even later (hard failure)
   // When allocating with a priority, the priority must NOT exceed the
   // max priority which is (@numPriorities - 1) specified when constructing
-  // this allocator.
-  std::tuple<RegionDescriptor, uint32_t, RelAddress> allocate(uint32_t size,
-                                                              uint16_t priority,
-                                                              bool canWait);
+  // this allocator. Same goes for the expiry class.
+  std::tuple<RegionDescriptor, uint32_t, RelAddress> allocate(
+      uint32_t size,
+      uint16_t priority,
+      bool canWait,
+      uint16_t expiryClass = 0);
 
   // Closes the region.
   void close(RegionDescriptor&& rid);
@@ -131,7 +139,9 @@ class Allocator {
       RegionAllocator& ra, uint32_t size, bool wait);
 
   RegionManager& regionManager_;
-  // Multiple allocators when we use priority-based allocation
+  const uint16_t numExpiryClasses_{};
+  // Multiple allocators when we use priority-based or expiry-based
+  // allocation, indexed by priority * numExpiryClasses_ + expiryClass
   std::vector<RegionAllocator> allocators_;
 
   mutable AtomicCounter allocRetryWaits_;
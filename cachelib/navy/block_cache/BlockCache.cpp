@@ -16,17 +16,27 @@
 
 #include "cachelib/navy/block_cache/BlockCache.h"
 
+#include <folly/Random.h>
 #include <folly/ScopeGuard.h>
+#include <folly/String.h>
+#include <folly/fibers/Baton.h>
+#include <folly/fibers/FiberManager.h>
 #include <folly/logging/xlog.h>
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
 #include <numeric>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
+#include "cachelib/common/Time.h"
 #include "cachelib/common/inject_pause.h"
 #include "cachelib/navy/common/Hash.h"
 #include "cachelib/navy/common/Types.h"
+#include "cachelib/navy/common/Utils.h"
 #include "folly/Range.h"
 
 namespace facebook::cachelib::navy {
@@ -36,6 +46,9 @@ constexpr uint32_t BlockCache::kMaxItemSize;
 constexpr uint32_t BlockCache::kFormatVersion;
 constexpr uint32_t BlockCache::kDefReadBufferSize;
 constexpr uint16_t BlockCache::kDefaultItemPriority;
+constexpr uint16_t BlockCache::kManifestSizeHint;
+constexpr std::chrono::milliseconds BlockCache::kResizePollInterval;
+constexpr std::chrono::seconds BlockCache::kResizeTimeout;
 
 BlockCache::Config& BlockCache::Config::validate() {
   XDCHECK_NE(scheduler, nullptr);
@@ -60,12 +73,54 @@ BlockCache::Config& BlockCache::Config::validate() {
   if (getNumRegions() < cleanRegionsPool) {
     throw std::invalid_argument("not enough space on device");
   }
+  if (activeCacheSize > cacheSize || activeCacheSize % regionSize != 0 ||
+      (activeCacheSize > 0 &&
+       activeCacheSize / regionSize < cleanRegionsPool)) {
+    throw std::invalid_argument(
+        folly::sformat("invalid active cache size: {}", activeCacheSize));
+  }
   if (numInMemBuffers == 0) {
     throw std::invalid_argument("there must be at least one in-mem buffers");
   }
   if (numPriorities == 0) {
     throw std::invalid_argument("allocator must have at least one priority");
   }
+  if (sparseReclaimThreshold < 0 || sparseReclaimThreshold > 1) {
+    throw std::invalid_argument(
+        folly::sformat("sparse reclaim threshold must be in [0, 1], but is {}",
+                       sparseReclaimThreshold));
+  }
+  if (!expiryBuckets.empty()) {
+    if (!getExpiryTime) {
+      throw std::invalid_argument(
+          "expiry buckets require an expiry time getter");
+    }
+    for (size_t i = 0; i < expiryBuckets.size(); i++) {
+      if (expiryBuckets[i] == 0 ||
+          (i > 0 && expiryBuckets[i] <= expiryBuckets[i - 1])) {
+        throw std::invalid_argument(folly::sformat(
+            "expiry buckets must be positive and ascending, but got [{}]",
+            folly::join(", ", expiryBuckets)));
+      }
+    }
+    if (expiryBuckets.size() >= std::numeric_limits<uint16_t>::max()) {
+      throw std::invalid_argument("too many expiry buckets");
+    }
+    const uint64_t numOpenRegions =
+        static_cast<uint64_t>(numPriorities) * (expiryBuckets.size() + 1);
+    if (numInMemBuffers < numOpenRegions) {
+      throw std::invalid_argument(folly::sformat(
+          "{} in-mem buffers cannot serve {} open regions (priorities * "
+          "expiry buckets)",
+          numInMemBuffers,
+          numOpenRegions));
+    }
+  }
+
+  if (maxChunkedItemSize > 0 && itemDestructorEnabled) {
+    throw std::invalid_argument(
+        "chunked items can't be used with item destructor");
+  }
 
   reinsertionConfig.validate();
 
@@ -116,8 +171,10 @@ BlockCache::BlockCache(Config&& config, ValidConfigTag)
     : config_{serializeConfig(config)},
       numPriorities_{config.numPriorities},
       checkExpired_{std::move(config.checkExpired)},
+      getExpiryTime_{std::move(config.getExpiryTime)},
       destructorCb_{std::move(config.destructorCb)},
       checksumData_{config.checksum},
+      checksumType_{config.checksumType},
       device_{*config.device},
       allocAlignSize_{calcAllocAlignSize()},
       readBufferSize_{config.readBufferSize < kDefReadBufferSize
@@ -126,6 +183,13 @@ BlockCache::BlockCache(Config&& config, ValidConfigTag)
       regionSize_{config.regionSize},
       itemDestructorEnabled_{config.itemDestructorEnabled},
       preciseRemove_{config.preciseRemove},
+      recordSlots_{config.sparseReclaimThreshold > 0 ||
+                   !config.expiryBuckets.empty()},
+      expiryBuckets_{config.expiryBuckets},
+      reclaimExpiredWithoutRead_{!config.expiryBuckets.empty() &&
+                                 !config.itemDestructorEnabled},
+      reclaimDeadWithoutRead_{config.reclaimDeadWithoutRead},
+      maxChunkedItemSize_{config.maxChunkedItemSize},
       regionManager_{config.getNumRegions(),
                      config.regionSize,
                      config.cacheBaseOffset,
@@ -138,8 +202,22 @@ BlockCache::BlockCache(Config&& config, ValidConfigTag)
                      std::move(config.evictionPolicy),
                      config.numInMemBuffers,
                      config.numPriorities,
-                     config.inMemBufFlushRetryLimit},
-      allocator_{regionManager_, config.numPriorities},
+                     config.inMemBufFlushRetryLimit,
+                     config.sparseReclaimThreshold,
+                     reclaimExpiredWithoutRead_,
+                     reclaimDeadWithoutRead_,
+                     config.scanRecovery
+                         ? std::max(allocAlignSize_,
+                                    config.device->getIOAlignmentSize())
+                         : 0,
+                     static_cast<uint32_t>(config.flushedRegionCacheSize /
+                                           config.regionSize),
+                     static_cast<uint32_t>(config.activeCacheSize /
+                                           config.regionSize),
+                     config.reclaimChunkSize},
+      allocator_{regionManager_,
+                 config.numPriorities,
+                 static_cast<uint16_t>(config.expiryBuckets.size() + 1)},
       reinsertionPolicy_{makeReinsertionPolicy(config.reinsertionConfig)} {
   validate(config);
   XLOG(INFO, "Block cache created");
@@ -165,27 +243,82 @@ uint32_t BlockCache::serializedSize(uint32_t keySize,
   return powTwoAlign(size, allocAlignSize_);
 }
 
+uint32_t BlockCache::maxEntrySize() const {
+  const uint64_t regionDataSize = regionManager_.regionDataSize();
+  return static_cast<uint32_t>(std::min<uint64_t>(
+      kMaxItemSize, regionDataSize - regionDataSize % allocAlignSize_));
+}
+
+uint16_t BlockCache::getExpiryClass(uint32_t expiryTime) const {
+  if (expiryBuckets_.empty()) {
+    return 0;
+  }
+  if (expiryTime == 0) {
+    return static_cast<uint16_t>(expiryBuckets_.size());
+  }
+  const uint32_t currentTime = util::getCurrentTimeSec();
+  const uint32_t ttl = expiryTime > currentTime ? expiryTime - currentTime : 0;
+  return static_cast<uint16_t>(
+      std::upper_bound(expiryBuckets_.begin(), expiryBuckets_.end(), ttl) -
+      expiryBuckets_.begin());
+}
+
 Status BlockCache::insert(HashedKey hk, BufferView value) {
   INJECT_PAUSE(pause_blockcache_insert_entry);
 
+  const uint32_t expiryTime = getExpiryTime_ ? getExpiryTime_(value) : 0;
+  // The chunks of a chunked item being replaced are only reachable through
+  // its manifest
+  ChunkManifest oldManifest;
+  const bool replacesChunked =
+      maxChunkedItemSize_ > 0 && readManifest(hk, oldManifest);
+  Status status;
+  if (maxChunkedItemSize_ > 0 &&
+      sizeof(EntryDesc) + hk.key().size() + value.size() > maxEntrySize()) {
+    if (value.size() > maxChunkedItemSize_) {
+      allocErrorCount_.inc();
+      status = Status::Rejected;
+    } else {
+      status = insertChunked(hk, value, expiryTime);
+    }
+  } else {
+    status = insertEntry(hk, value, expiryTime, 0 /* flags */);
+  }
+
+  if (status != Status::Retry) {
+    insertCount_.inc();
+  }
+  if (status == Status::Ok) {
+    succInsertCount_.inc();
+    if (replacesChunked) {
+      removeChunks(hk.key(), oldManifest.objectId, oldManifest.numChunks, 0,
+                   oldManifest.numChunks);
+    }
+  }
+  INJECT_PAUSE(pause_blockcache_insert_done);
+  return status;
+}
+
+Status BlockCache::insertEntry(HashedKey hk,
+                               BufferView value,
+                               uint32_t expiryTime,
+                               uint32_t flags) {
   uint32_t size = serializedSize(hk.key().size(), value.size());
   if (size > kMaxItemSize) {
     allocErrorCount_.inc();
-    insertCount_.inc();
     return Status::Rejected;
   }
 
   // All newly inserted items are assigned with the lowest priority
   auto [desc, slotSize, addr] =
-      allocator_.allocate(size, kDefaultItemPriority, true /* canWait */);
+      allocator_.allocate(size, kDefaultItemPriority, true /* canWait */,
+                          getExpiryClass(expiryTime));
 
   switch (desc.status()) {
   case OpenStatus::Error:
     allocErrorCount_.inc();
-    insertCount_.inc();
     return Status::Rejected;
   case OpenStatus::Ready:
-    insertCount_.inc();
     break;
   case OpenStatus::Retry:
     allocRetryCount_.inc();
@@ -194,21 +327,30 @@ Status BlockCache::insert(HashedKey hk, BufferView value) {
 
   // After allocation a region is opened for writing. Until we close it, the
   // region would not be reclaimed and index never gets an invalid entry.
-  const auto status = writeEntry(addr, slotSize, hk, value);
+  const auto status = writeEntry(addr, slotSize, hk, value, expiryTime, flags);
   auto newObjSizeHint = encodeSizeHint(slotSize);
+  if (flags == kManifestEntry) {
+    XDCHECK_EQ(slotSize, allocAlignSize_);
+    newObjSizeHint = kManifestSizeHint;
+  }
   if (status == Status::Ok) {
+    uint64_t newObjSize = decodeSizeHint(newObjSizeHint);
+    // Account the entry as live before it becomes visible, so a concurrent
+    // overwrite never subtracts bytes that were not added yet.
+    regionManager_.getRegion(addr.rid()).addLiveBytes(newObjSize);
+    const auto seqNumber = regionManager_.getSeqNumber();
     const auto lr = index_.insert(
         hk.keyHash(), encodeRelAddress(addr.add(slotSize)), newObjSizeHint);
     // We replaced an existing key in the index
-    uint64_t newObjSize = decodeSizeHint(newObjSizeHint);
     uint64_t oldObjSize = 0;
     if (lr.found()) {
       oldObjSize = decodeSizeHint(lr.sizeHint());
       holeSizeTotal_.add(oldObjSize);
       holeCount_.inc();
       insertHashCollisionCount_.inc();
+      regionManager_.removeLiveBytes(
+          decodeRelAddress(lr.address()).rid(), oldObjSize, seqNumber);
     }
-    succInsertCount_.inc();
     if (newObjSize < oldObjSize) {
       usedSizeBytes_.sub(oldObjSize - newObjSize);
     } else {
@@ -216,7 +358,68 @@ Status BlockCache::insert(HashedKey hk, BufferView value) {
     }
   }
   allocator_.close(std::move(desc));
-  INJECT_PAUSE(pause_blockcache_insert_done);
+  return status;
+}
+
+std::string BlockCache::makeChunkKey(folly::StringPiece key,
+                                     uint64_t objectId,
+                                     uint32_t index,
+                                     uint32_t numChunks) {
+  const ChunkKeySuffix suffix{objectId, index, numChunks};
+  std::string chunkKey;
+  chunkKey.reserve(key.size() + sizeof(suffix));
+  chunkKey.append(key.data(), key.size());
+  chunkKey.append(reinterpret_cast<const char*>(&suffix), sizeof(suffix));
+  return chunkKey;
+}
+
+Status BlockCache::insertChunked(HashedKey hk,
+                                 BufferView value,
+                                 uint32_t expiryTime) {
+  const uint64_t chunkOverhead =
+      sizeof(EntryDesc) + hk.key().size() + sizeof(ChunkKeySuffix);
+  // The manifest has to fit a single slot, see kManifestSizeHint
+  if (chunkOverhead >= maxEntrySize() ||
+      serializedSize(hk.key().size(), sizeof(ChunkManifest)) !=
+          allocAlignSize_) {
+    allocErrorCount_.inc();
+    return Status::Rejected;
+  }
+
+  // Every chunk but the last takes a whole region
+  ChunkManifest manifest;
+  manifest.objectId = folly::Random::rand64();
+  manifest.valueSize = value.size();
+  manifest.chunkSize = static_cast<uint32_t>(maxEntrySize() - chunkOverhead);
+  manifest.numChunks = static_cast<uint32_t>(
+      (value.size() + manifest.chunkSize - 1) / manifest.chunkSize);
+
+  for (uint32_t i = 0; i < manifest.numChunks; i++) {
+    const auto chunkKey =
+        makeChunkKey(hk.key(), manifest.objectId, i, manifest.numChunks);
+    const size_t offset = static_cast<size_t>(i) * manifest.chunkSize;
+    const auto status = insertEntry(
+        makeHK(chunkKey.data(), chunkKey.size()),
+        value.slice(offset, std::min<size_t>(manifest.chunkSize,
+                                             value.size() - offset)),
+        expiryTime, kChunkEntry);
+    if (status != Status::Ok) {
+      removeChunks(hk.key(), manifest.objectId, manifest.numChunks, 0, i);
+      return status;
+    }
+  }
+
+  // The manifest goes last, so the item is only visible once whole
+  const auto status = insertEntry(
+      hk,
+      BufferView{sizeof(manifest), reinterpret_cast<const uint8_t*>(&manifest)},
+      expiryTime, kManifestEntry);
+  if (status != Status::Ok) {
+    removeChunks(hk.key(), manifest.objectId, manifest.numChunks, 0,
+                 manifest.numChunks);
+    return status;
+  }
+  chunkedInsertCount_.inc();
   return status;
 }
 
@@ -234,6 +437,48 @@ uint64_t BlockCache::estimateWriteSize(HashedKey hk, BufferView value) const {
 }
 
 Status BlockCache::lookup(HashedKey hk, Buffer& value) {
+  return lookupInternal(
+      hk, [this, hk, &value](const RegionDescriptor& desc, RelAddress addrEnd,
+                             uint32_t approxSize) {
+        return readValue(desc, addrEnd, approxSize, hk, value);
+      });
+}
+
+Status BlockCache::lookupView(HashedKey hk,
+                              folly::FunctionRef<void(BufferView)> visitor) {
+  return lookupInternal(
+      hk, [this, hk, &visitor](const RegionDescriptor& desc,
+                               RelAddress addrEnd, uint32_t approxSize) {
+        if (!desc.isPhysReadMode()) {
+          // Serve straight from the in-mem buffer; the region stays open
+          // for read until the visitor returns.
+          BufferView value;
+          uint32_t flags = 0;
+          auto status = readEntryInMem(desc, addrEnd, hk, value, &flags);
+          if (status == Status::Ok && flags == kManifestEntry) {
+            // Chunks live in other regions and are copied anyway
+            Buffer chunkedValue{value};
+            status = readChunkedValue(hk, addrEnd, chunkedValue);
+            if (status == Status::Ok) {
+              visitor(chunkedValue.view());
+            }
+            return status;
+          }
+          if (status == Status::Ok) {
+            visitor(value);
+          }
+          return status;
+        }
+        Buffer value;
+        auto status = readValue(desc, addrEnd, approxSize, hk, value);
+        if (status == Status::Ok) {
+          visitor(value.view());
+        }
+        return status;
+      });
+}
+
+Status BlockCache::lookupInternal(HashedKey hk, ReadEntryFn readFn) {
   const auto seqNumber = regionManager_.getSeqNumber();
   const auto lr = index_.lookup(hk.keyHash());
   if (!lr.found()) {
@@ -254,35 +499,10 @@ Status BlockCache::lookup(HashedKey hk, Buffer& value) {
   RegionDescriptor desc = regionManager_.openForRead(addrEnd.rid(), seqNumber);
   switch (desc.status()) {
   case OpenStatus::Ready: {
-    auto status =
-        readEntry(desc, addrEnd, decodeSizeHint(lr.sizeHint()), hk, value);
-
-    if (FOLLY_UNLIKELY(status == Status::DeviceError)) {
-      // In case we are getting transient checksum error, we will retry to read
-      // the entry (S421120)
-      status =
-          readEntry(desc, addrEnd, decodeSizeHint(lr.sizeHint()), hk, value);
-      XLOGF(ERR,
-            "Retry reading an entry after checksum error. Return code: "
-            "{}",
-            status);
-      retryReadCount_.inc();
-
-      if (status != Status::Ok) {
-        // Still failing. Remove this item from index so no future lookup will
-        // ever attempt to read this key. Reclaim will also not be
-        // able to re-insert this item as it does not exist in index.
-        index_.remove(hk.keyHash());
-      }
-    }
-
-    if (status == Status::Ok) {
-      regionManager_.touch(addrEnd.rid());
-      succLookupCount_.inc();
-    }
-    regionManager_.close(std::move(desc));
-    lookupCount_.inc();
-    return status;
+    const auto approxSize = decodeSizeHint(lr.sizeHint());
+    auto status = readFn(desc, addrEnd, approxSize);
+    return completeLookup(hk, std::move(desc), addrEnd, approxSize, seqNumber,
+                          status, readFn);
   }
   case OpenStatus::Retry:
     return Status::Retry;
@@ -293,6 +513,308 @@ Status BlockCache::lookup(HashedKey hk, Buffer& value) {
   }
 }
 
+Status BlockCache::completeLookup(HashedKey hk,
+                                  RegionDescriptor desc,
+                                  RelAddress addrEnd,
+                                  uint32_t approxSize,
+                                  uint64_t seqNumber,
+                                  Status status,
+                                  ReadEntryFn readFn) {
+  if (FOLLY_UNLIKELY(status == Status::DeviceError)) {
+    // In case we are getting transient checksum error, we will retry to read
+    // the entry (S421120)
+    status = readFn(desc, addrEnd, approxSize);
+    XLOGF(ERR,
+          "Retry reading an entry after checksum error. Return code: "
+          "{}",
+          status);
+    retryReadCount_.inc();
+
+    if (status != Status::Ok) {
+      // Still failing. Remove this item from index so no future lookup will
+      // ever attempt to read this key. Reclaim will also not be
+      // able to re-insert this item as it does not exist in index.
+      const auto removed = index_.remove(hk.keyHash());
+      if (removed.found()) {
+        regionManager_.removeLiveBytes(
+            decodeRelAddress(removed.address()).rid(),
+            decodeSizeHint(removed.sizeHint()),
+            seqNumber);
+      }
+    }
+  }
+
+  if (status == Status::Ok) {
+    regionManager_.touch(addrEnd.rid());
+    succLookupCount_.inc();
+  }
+  regionManager_.close(std::move(desc));
+  lookupCount_.inc();
+  return status;
+}
+
+Status BlockCache::readValue(const RegionDescriptor& readDesc,
+                             RelAddress addrEnd,
+                             uint32_t approxSize,
+                             HashedKey hk,
+                             Buffer& value) {
+  uint32_t flags = 0;
+  auto status = readEntry(readDesc, addrEnd, approxSize, hk, value,
+                          true /* skipExpired */, &flags);
+  if (status == Status::Ok && flags == kManifestEntry) {
+    status = readChunkedValue(hk, addrEnd, value);
+  }
+  return status;
+}
+
+Status BlockCache::readChunkedValue(HashedKey hk,
+                                    RelAddress manifestEnd,
+                                    Buffer& value) {
+  if (value.size() != sizeof(ChunkManifest)) {
+    value.reset();
+    return Status::DeviceError;
+  }
+  ChunkManifest manifest;
+  std::memcpy(&manifest, value.data(), sizeof(manifest));
+  if (manifest.numChunks == 0 ||
+      static_cast<uint64_t>(manifest.chunkSize) * manifest.numChunks <
+          manifest.valueSize) {
+    value.reset();
+    return Status::DeviceError;
+  }
+
+  Buffer chunkedValue{manifest.valueSize};
+  std::vector<Status> statuses(manifest.numChunks, Status::Ok);
+  auto readOne = [&](uint32_t i) {
+    const auto chunkKey =
+        makeChunkKey(hk.key(), manifest.objectId, i, manifest.numChunks);
+    const size_t offset = static_cast<size_t>(i) * manifest.chunkSize;
+    const size_t size =
+        std::min<size_t>(manifest.chunkSize, manifest.valueSize - offset);
+    Buffer chunk;
+    statuses[i] = readChunk(makeHK(chunkKey.data(), chunkKey.size()), chunk);
+    if (statuses[i] != Status::Ok) {
+      return;
+    }
+    if (chunk.size() != size) {
+      statuses[i] = Status::DeviceError;
+      return;
+    }
+    chunkedValue.copyFrom(offset, chunk.view());
+  };
+
+  if (folly::fibers::onFiber() && manifest.numChunks > 1) {
+    // Each chunk is in a region of its own and is read on its own fiber
+    std::vector<folly::fibers::Baton> batons(manifest.numChunks);
+    for (uint32_t i = 1; i < manifest.numChunks; i++) {
+      folly::fibers::addTask([&readOne, &batons, i]() {
+        readOne(i);
+        batons[i].post();
+      });
+    }
+    readOne(0);
+    for (uint32_t i = 1; i < manifest.numChunks; i++) {
+      batons[i].wait();
+    }
+  } else {
+    for (uint32_t i = 0; i < manifest.numChunks; i++) {
+      readOne(i);
+    }
+  }
+
+  value.reset();
+  if (std::find(statuses.begin(), statuses.end(), Status::NotFound) !=
+      statuses.end()) {
+    // A chunk was evicted, which leaves the manifest useless
+    const auto seqNumber = regionManager_.getSeqNumber();
+    const auto lr = index_.peek(hk.keyHash());
+    if (lr.found() && decodeRelAddress(lr.address()) == manifestEnd &&
+        index_.removeIfMatch(hk.keyHash(), lr.address())) {
+      onEntryRemoved(manifestEnd.rid(), decodeSizeHint(lr.sizeHint()),
+                     seqNumber);
+      releaseChunks(hk.key(), manifest.objectId, manifest.numChunks);
+    }
+    return Status::NotFound;
+  }
+  for (auto status : statuses) {
+    if (status != Status::Ok) {
+      return status;
+    }
+  }
+  chunkedLookupCount_.inc();
+  value = std::move(chunkedValue);
+  return Status::Ok;
+}
+
+Status BlockCache::readChunk(HashedKey hk, Buffer& value) {
+  const auto seqNumber = regionManager_.getSeqNumber();
+  const auto lr = index_.lookup(hk.keyHash());
+  if (!lr.found()) {
+    return Status::NotFound;
+  }
+  // See lookupInternal() about the address and the sequence number
+  const auto addrEnd = decodeRelAddress(lr.address());
+  RegionDescriptor desc = regionManager_.openForRead(addrEnd.rid(), seqNumber);
+  if (desc.status() != OpenStatus::Ready) {
+    return Status::Retry;
+  }
+  uint32_t flags = 0;
+  // The manifest decides whether the item is expired
+  auto status = readEntry(desc, addrEnd, decodeSizeHint(lr.sizeHint()), hk,
+                          value, false /* skipExpired */, &flags);
+  if (status == Status::Ok && flags != kChunkEntry) {
+    status = Status::NotFound;
+  }
+  if (status == Status::Ok) {
+    regionManager_.touch(addrEnd.rid());
+  }
+  regionManager_.close(std::move(desc));
+  return status;
+}
+
+bool BlockCache::readManifest(HashedKey hk, ChunkManifest& manifest) {
+  const auto seqNumber = regionManager_.getSeqNumber();
+  const auto lr = index_.peek(hk.keyHash());
+  if (!lr.found() || lr.sizeHint() != kManifestSizeHint) {
+    return false;
+  }
+  const auto addrEnd = decodeRelAddress(lr.address());
+  RegionDescriptor desc = regionManager_.openForRead(addrEnd.rid(), seqNumber);
+  if (desc.status() != OpenStatus::Ready) {
+    return false;
+  }
+  Buffer value;
+  uint32_t flags = 0;
+  const auto status = readEntry(desc, addrEnd, decodeSizeHint(lr.sizeHint()),
+                                hk, value, false /* skipExpired */, &flags);
+  regionManager_.close(std::move(desc));
+  if (status != Status::Ok || flags != kManifestEntry ||
+      value.size() != sizeof(ChunkManifest)) {
+    return false;
+  }
+  std::memcpy(&manifest, value.data(), sizeof(manifest));
+  return true;
+}
+
+void BlockCache::lookupBatch(folly::Range<const HashedKey*> keys,
+                             folly::Range<Status*> statuses,
+                             folly::Range<Buffer*> values) {
+  XDCHECK_EQ(keys.size(), statuses.size());
+  XDCHECK_EQ(keys.size(), values.size());
+
+  // Entry of a key whose region is open for read and has to be read from
+  // the device
+  struct PendingRead {
+    uint32_t idx;
+    RegionDescriptor desc;
+    RelAddress addrEnd;
+    uint32_t approxSize;
+  };
+
+  const auto seqNumber = regionManager_.getSeqNumber();
+  std::vector<PendingRead> reads;
+  reads.reserve(keys.size());
+  for (uint32_t i = 0; i < keys.size(); i++) {
+    const auto hk = keys[i];
+    auto readFn = [this, hk, &values, i](const RegionDescriptor& desc,
+                                         RelAddress addrEnd,
+                                         uint32_t approxSize) {
+      return readValue(desc, addrEnd, approxSize, hk, values[i]);
+    };
+    const auto lr = index_.lookup(hk.keyHash());
+    if (!lr.found()) {
+      lookupCount_.inc();
+      statuses[i] = Status::NotFound;
+      continue;
+    }
+    // See lookupInternal() about the address and the sequence number
+    auto addrEnd = decodeRelAddress(lr.address());
+    RegionDescriptor desc =
+        regionManager_.openForRead(addrEnd.rid(), seqNumber);
+    if (desc.status() != OpenStatus::Ready) {
+      statuses[i] = Status::Retry;
+      continue;
+    }
+    const auto approxSize = decodeSizeHint(lr.sizeHint());
+    if (!desc.isPhysReadMode()) {
+      // In-mem buffers need no IO to share
+      auto status = readFn(desc, addrEnd, approxSize);
+      statuses[i] = completeLookup(hk, std::move(desc), addrEnd, approxSize,
+                                   seqNumber, status, readFn);
+      continue;
+    }
+    reads.push_back(PendingRead{
+        i, std::move(desc), addrEnd, std::min(approxSize, addrEnd.offset())});
+  }
+
+  std::sort(reads.begin(), reads.end(),
+            [](const PendingRead& a, const PendingRead& b) {
+              return a.addrEnd.rid() != b.addrEnd.rid()
+                         ? a.addrEnd.rid().index() < b.addrEnd.rid().index()
+                         : a.addrEnd.offset() < b.addrEnd.offset();
+            });
+
+  const uint32_t maxReadSize =
+      device_.getMaxIOSize() > 0
+          ? std::min(kMaxBatchReadSize, device_.getMaxIOSize())
+          : kMaxBatchReadSize;
+  for (size_t begin = 0; begin < reads.size();) {
+    // Extend the group while the next entry starts before the group ends
+    const auto rid = reads[begin].addrEnd.rid();
+    const uint32_t groupBegin =
+        reads[begin].addrEnd.offset() - reads[begin].approxSize;
+    uint32_t groupEnd = reads[begin].addrEnd.offset();
+    size_t end = begin + 1;
+    while (end < reads.size() && reads[end].addrEnd.rid() == rid) {
+      const uint32_t entryBegin =
+          reads[end].addrEnd.offset() - reads[end].approxSize;
+      const uint32_t entryEnd = reads[end].addrEnd.offset();
+      if (entryBegin > groupEnd || entryEnd - groupBegin > maxReadSize) {
+        break;
+      }
+      groupEnd = std::max(groupEnd, entryEnd);
+      end++;
+    }
+
+    Buffer groupBuffer;
+    if (end - begin > 1) {
+      groupBuffer = regionManager_.read(reads[begin].desc,
+                                        RelAddress{rid, groupBegin},
+                                        groupEnd - groupBegin);
+      batchReadsCoalesced_.add(end - begin - 1);
+    }
+    for (size_t j = begin; j < end; j++) {
+      auto& read = reads[j];
+      const auto hk = keys[read.idx];
+      auto readFn = [this, hk, &values, idx = read.idx](
+                        const RegionDescriptor& desc, RelAddress addrEnd,
+                        uint32_t approxSize) {
+        return readValue(desc, addrEnd, approxSize, hk, values[idx]);
+      };
+      Status status;
+      if (groupBuffer.isNull()) {
+        // Lone entry, or the shared read failed and each entry is read again
+        status = readFn(read.desc, read.addrEnd, read.approxSize);
+      } else {
+        const uint32_t entryBegin = read.addrEnd.offset() - read.approxSize;
+        uint32_t flags = 0;
+        status = readEntryFromBuffer(
+            read.desc, read.addrEnd,
+            Buffer{groupBuffer.view().slice(entryBegin - groupBegin,
+                                            read.approxSize)},
+            hk, values[read.idx], true /* skipExpired */, &flags);
+        if (status == Status::Ok && flags == kManifestEntry) {
+          status = readChunkedValue(hk, read.addrEnd, values[read.idx]);
+        }
+      }
+      statuses[read.idx] =
+          completeLookup(hk, std::move(read.desc), read.addrEnd,
+                         read.approxSize, seqNumber, status, readFn);
+    }
+    begin = end;
+  }
+}
+
 std::pair<Status, std::string> BlockCache::getRandomAlloc(Buffer& value) {
   // Get rendom region and offset within the region
   auto rid = regionManager_.getRandomRegion();
@@ -346,16 +868,20 @@ std::pair<Status, std::string> BlockCache::getRandomAlloc(Buffer& value) {
     if (randOffset < offset) {
       continue;
     }
+    if (desc.flags != 0) {
+      // Parts of a chunked item are not items on their own
+      break;
+    }
 
     BufferView valueView{desc.valueSize, entryEnd - entrySize};
-    if (checksumData_ && desc.cs != checksum(valueView)) {
+    if (checksumData_ && desc.cs != checksum(valueView, checksumType_)) {
       XLOGF(ERR,
             "Item value checksum mismatch in getRandomAlloc(). Region {} is "
             "likely corrupted. Expected: {}, Actual: {}, Offset: {}, "
             "Physical-offset: {}, Value-size: {}, Payload (hex): {}",
             rid.index(),
             desc.cs,
-            checksum(valueView),
+            checksum(valueView, checksumType_),
             addrEnd.offset() - entrySize,
             regionManager_.physicalOffset(addrEnd) - entrySize,
             desc.valueSize,
@@ -382,12 +908,124 @@ std::pair<Status, std::string> BlockCache::getRandomAlloc(Buffer& value) {
   return std::make_pair(Status::NotFound, "");
 }
 
+uint64_t BlockCache::forEachEntry(EntryVisitor visitor) {
+  allocator_.flush();
+
+  uint64_t numVisited = 0;
+  std::vector<uint32_t> entryEnds;
+  for (uint32_t i = 0; i < regionManager_.getNumRegions(); i++) {
+    const RegionId rid{i};
+    const auto endOffset =
+        regionManager_.getRegion(rid).getLastEntryEndOffset();
+    if (endOffset == 0) {
+      continue;
+    }
+    const auto seqNumber = regionManager_.getSeqNumber();
+    RegionDescriptor rdesc = regionManager_.openForRead(rid, seqNumber);
+    if (rdesc.status() != OpenStatus::Ready) {
+      // The region is being reclaimed, which evicts its entries anyway
+      continue;
+    }
+    auto buffer = regionManager_.read(rdesc, RelAddress{rid, 0}, endOffset);
+    regionManager_.close(std::move(rdesc));
+    if (buffer.size() != endOffset) {
+      XLOGF(ERR, "Failed to read region {} for iteration", rid.index());
+      continue;
+    }
+
+    // Entries are found walking back from the end of the region. Collect
+    // them first so that they are visited in device order.
+    entryEnds.clear();
+    uint32_t offset = endOffset;
+    while (offset > 0) {
+      auto desc = *reinterpret_cast<const EntryDesc*>(
+          buffer.data() + offset - sizeof(EntryDesc));
+      if (desc.csSelf != desc.computeChecksum()) {
+        XLOGF(ERR,
+              "Item header checksum mismatch in forEachEntry(). Region {} is "
+              "likely corrupted. Skipping its remaining items. Offset-end: {}",
+              rid.index(),
+              offset);
+        break;
+      }
+      const auto entrySize = serializedSize(desc.keySize, desc.valueSize);
+      if (entrySize > offset) {
+        break;
+      }
+      entryEnds.push_back(offset);
+      offset -= entrySize;
+    }
+
+    const uint32_t currentTime = util::getCurrentTimeSec();
+    for (auto it = entryEnds.rbegin(); it != entryEnds.rend(); ++it) {
+      const RelAddress addrEnd{rid, *it};
+      auto entryEnd = buffer.data() + *it;
+      auto desc =
+          *reinterpret_cast<const EntryDesc*>(entryEnd - sizeof(EntryDesc));
+      if (desc.flags == kChunkEntry || desc.isExpired(currentTime)) {
+        // Chunks are visited as part of their item
+        continue;
+      }
+      HashedKey hk =
+          makeHK(entryEnd - sizeof(EntryDesc) - desc.keySize, desc.keySize);
+      // Skip entries that were overwritten or removed
+      const auto lr = index_.peek(hk.keyHash());
+      if (!lr.found() || addrEnd != decodeRelAddress(lr.address())) {
+        continue;
+      }
+      const auto entrySize = serializedSize(desc.keySize, desc.valueSize);
+      BufferView valueView{desc.valueSize, entryEnd - entrySize};
+      if (checksumData_ && desc.cs != checksum(valueView, checksumType_)) {
+        continue;
+      }
+
+      bool more = true;
+      if (desc.flags == kManifestEntry) {
+        Buffer value{valueView};
+        if (readChunkedValue(hk, addrEnd, value) != Status::Ok) {
+          continue;
+        }
+        more = visitor(hk, value.view(), desc.expiryTime);
+      } else {
+        more = visitor(hk, valueView, desc.expiryTime);
+      }
+      numVisited++;
+      if (!more) {
+        return numVisited;
+      }
+    }
+  }
+  return numVisited;
+}
+
 Status BlockCache::remove(HashedKey hk) {
   removeCount_.inc();
 
   Buffer value;
+  // Head of the value of a chunked item, for its destructor
+  Buffer firstChunk;
+  uint32_t flags = 0;
   if ((itemDestructorEnabled_ && destructorCb_) || preciseRemove_) {
-    Status status = lookup(hk, value);
+    // Expired entries are still read so that their destructor is invoked
+    Status status = lookupInternal(
+        hk, [this, hk, &value, &firstChunk, &flags](
+                const RegionDescriptor& desc, RelAddress addrEnd,
+                uint32_t approxSize) {
+          auto status = readEntry(desc, addrEnd, approxSize, hk, value,
+                                  false /* skipExpired */, &flags);
+          if (status == Status::Ok && flags == kManifestEntry &&
+              destructorCb_ && value.size() == sizeof(ChunkManifest)) {
+            ChunkManifest manifest;
+            std::memcpy(&manifest, value.data(), sizeof(manifest));
+            const auto chunkKey = makeChunkKey(hk.key(), manifest.objectId, 0,
+                                               manifest.numChunks);
+            if (readChunk(makeHK(chunkKey.data(), chunkKey.size()),
+                          firstChunk) != Status::Ok) {
+              firstChunk.reset();
+            }
+          }
+          return status;
+        });
 
     if (status != Status::Ok) {
       // device error, or region reclaimed, or item not found
@@ -408,14 +1046,26 @@ Status BlockCache::remove(HashedKey hk) {
     }
   }
 
+  const auto seqNumber = regionManager_.getSeqNumber();
   auto lr = index_.remove(hk.keyHash());
   if (lr.found()) {
-    uint64_t removedObjectSize = decodeSizeHint(lr.sizeHint());
-    holeSizeTotal_.add(removedObjectSize);
-    holeCount_.inc();
-    usedSizeBytes_.sub(removedObjectSize);
+    onEntryRemoved(decodeRelAddress(lr.address()).rid(),
+                   decodeSizeHint(lr.sizeHint()), seqNumber);
     succRemoveCount_.inc();
-    if (!value.isNull() && destructorCb_) {
+    if (flags == kManifestEntry) {
+      // Without a read, the chunks are left to be evicted with their regions
+      if (value.size() == sizeof(ChunkManifest)) {
+        const auto& manifest =
+            *reinterpret_cast<const ChunkManifest*>(value.data());
+        if (firstChunk.isNull()) {
+          releaseChunks(hk.key(), manifest.objectId, manifest.numChunks);
+        } else {
+          removeChunks(hk.key(), manifest.objectId, manifest.numChunks, 0,
+                       manifest.numChunks);
+          destructorCb_(hk, firstChunk.view(), DestructorEvent::Removed);
+        }
+      }
+    } else if (!value.isNull() && destructorCb_) {
       destructorCb_(hk, value.view(), DestructorEvent::Removed);
     }
     return Status::Ok;
@@ -423,6 +1073,15 @@ Status BlockCache::remove(HashedKey hk) {
   return Status::NotFound;
 }
 
+void BlockCache::onEntryRemoved(RegionId rid,
+                                uint32_t size,
+                                uint64_t seqNumber) {
+  regionManager_.removeLiveBytes(rid, size, seqNumber);
+  holeSizeTotal_.add(size);
+  holeCount_.inc();
+  usedSizeBytes_.sub(size);
+}
+
 // Remove all region entries from index and invoke callback
 // See @RegionEvictCallback for details
 uint32_t BlockCache::onRegionReclaim(RegionId rid, BufferView buffer) {
@@ -434,12 +1093,21 @@ uint32_t BlockCache::onRegionReclaim(RegionId rid, BufferView buffer) {
   // We do not guarantee time between remove and callback invocation. If a
   // value v1 was replaced with v2 user will get callbacks for both v1 and
   // v2 when they are evicted (in no particular order).
-  uint32_t evictionCount = 0; // item that was evicted during reclaim
   auto& region = regionManager_.getRegion(rid);
-  auto offset = region.getLastEntryEndOffset();
-  while (offset > 0) {
+  uint32_t evictionCount = buffer.isNull() ? reclaimLiveEntries(rid)
+                                           : reclaimEntries(rid, buffer, 0);
+  XDCHECK_GE(region.getNumItems(), evictionCount);
+  return evictionCount;
+}
+
+uint32_t BlockCache::reclaimEntries(RegionId rid,
+                                    BufferView buffer,
+                                    uint32_t beginOffset) {
+  uint32_t evictionCount = 0; // item that was evicted during reclaim
+  uint32_t offset = beginOffset + buffer.size();
+  while (offset > beginOffset) {
     RelAddress addrEnd(rid, offset);
-    auto entryEnd = buffer.data() + offset;
+    auto entryEnd = buffer.data() + (offset - beginOffset);
     auto desc =
         *reinterpret_cast<const EntryDesc*>(entryEnd - sizeof(EntryDesc));
     if (desc.csSelf != desc.computeChecksum()) {
@@ -467,7 +1135,7 @@ uint32_t BlockCache::onRegionReclaim(RegionId rid, BufferView buffer) {
     BufferView value{desc.valueSize, entryEnd - entrySize};
 
     BlockCache::ReinsertionRes reinsertionRes = ReinsertionRes::kRemoved;
-    if (checksumData_ && desc.cs != checksum(value)) {
+    if (checksumData_ && desc.cs != checksum(value, checksumType_)) {
       // We do not need to abort here since the EntryDesc checksum was good, so
       // we can safely proceed to read the next entry.
       XLOGF(ERR,
@@ -478,7 +1146,7 @@ uint32_t BlockCache::onRegionReclaim(RegionId rid, BufferView buffer) {
             "Value-size: {}, Payload (hex): {}",
             rid.index(),
             desc.cs,
-            checksum(value),
+            checksum(value, checksumType_),
             addrEnd.offset() - entrySize,
             regionManager_.physicalOffset(addrEnd) - entrySize,
             desc.valueSize,
@@ -491,7 +1159,10 @@ uint32_t BlockCache::onRegionReclaim(RegionId rid, BufferView buffer) {
       value = BufferView();
     } else {
       reinsertionRes =
-          reinsertOrRemoveItem(hk, value, entrySize, RelAddress{rid, offset});
+          desc.flags != 0
+              ? evictChunkedEntry(hk, desc, value, RelAddress{rid, offset})
+              : reinsertOrRemoveItem(hk, value, entrySize,
+                                     RelAddress{rid, offset});
       switch (reinsertionRes) {
       case ReinsertionRes::kEvicted:
         evictionCount++;
@@ -506,14 +1177,180 @@ uint32_t BlockCache::onRegionReclaim(RegionId rid, BufferView buffer) {
       }
     }
 
-    if (destructorCb_ && reinsertionRes == ReinsertionRes::kEvicted) {
+    if (destructorCb_ && reinsertionRes == ReinsertionRes::kEvicted &&
+        desc.flags == 0) {
       destructorCb_(hk, value, DestructorEvent::Recycled);
     }
-    XDCHECK_GE(offset, entrySize);
+    XDCHECK_GE(offset - beginOffset, entrySize);
     offset -= entrySize;
   }
+  return evictionCount;
+}
 
-  XDCHECK_GE(region.getNumItems(), evictionCount);
+uint32_t BlockCache::reclaimLiveEntries(RegionId rid) {
+  auto& region = regionManager_.getRegion(rid);
+  if (reclaimDeadWithoutRead_ && region.getLiveBytes() == 0) {
+    // No entry of this region is referenced by the index. All of its slots
+    // are holes that go away with the region, accounted like the removed
+    // entries of a region that is read.
+    evictionLookupMissCounter_.add(region.getNumItems());
+    holeCount_.sub(region.getNumItems());
+    holeSizeTotal_.sub(region.getLastEntryEndOffset());
+    return 0;
+  }
+  if (!region.hasAllSlots()) {
+    return reclaimEntriesInChunks(rid);
+  }
+  if (reclaimExpiredWithoutRead_ &&
+      region.isExpired(util::getCurrentTimeSec())) {
+    return removeExpiredEntries(rid);
+  }
+  return reclaimRanges(rid, getLiveRanges(rid));
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> BlockCache::getLiveRanges(
+    RegionId rid) {
+  auto& region = regionManager_.getRegion(rid);
+  // Find runs of adjacent live slots and read each run with a single IO. A
+  // run is cut at a slot boundary before it grows past the reclaim chunk
+  // size. Liveness is checked again when an entry is evicted or reinserted,
+  // so an entry removed after this point is handled like in a full region
+  // reclaim.
+  const uint32_t chunkSize = regionManager_.getReclaimChunkSize();
+  std::vector<std::pair<uint32_t, uint32_t>> runs;
+  uint32_t runBegin = 0;
+  uint32_t runEnd = 0;
+  auto addRun = [&]() {
+    if (runEnd != runBegin) {
+      runs.emplace_back(runBegin, runEnd);
+    }
+  };
+
+  uint32_t slotBegin = 0;
+  for (const auto& slot : region.getSortedSlots()) {
+    const uint32_t slotEnd = slot.endOffset;
+    const auto lr = index_.peek(slot.keyHash);
+    if (lr.found() &&
+        decodeRelAddress(lr.address()) == RelAddress{rid, slotEnd}) {
+      if (runEnd != slotBegin ||
+          (chunkSize > 0 && slotEnd - runBegin > chunkSize)) {
+        addRun();
+        runBegin = slotBegin;
+      }
+      runEnd = slotEnd;
+    } else {
+      // Same accounting as a removed entry found in a full region read
+      evictionLookupMissCounter_.inc();
+      holeCount_.sub(1);
+      holeSizeTotal_.sub(slotEnd - slotBegin);
+    }
+    slotBegin = slotEnd;
+  }
+  addRun();
+  return runs;
+}
+
+uint32_t BlockCache::reclaimRanges(
+    RegionId rid, const std::vector<std::pair<uint32_t, uint32_t>>& ranges) {
+  auto readRange = [this, rid](const std::pair<uint32_t, uint32_t>& range) {
+    return regionManager_.reclaimReadAhead(RelAddress{rid, range.first},
+                                           range.second - range.first);
+  };
+
+  uint32_t evictionCount = 0;
+  std::unique_ptr<PendingReclaimRead> next;
+  if (!ranges.empty()) {
+    next = readRange(ranges.front());
+  }
+  for (size_t i = 0; i < ranges.size(); i++) {
+    auto buffer = next->get();
+    next.reset();
+    if (i + 1 < ranges.size()) {
+      next = readRange(ranges[i + 1]);
+    }
+    if (!buffer.isNull()) {
+      evictionCount += reclaimEntries(rid, buffer.view(), ranges[i].first);
+    }
+  }
+  return evictionCount;
+}
+
+uint32_t BlockCache::reclaimEntriesInChunks(RegionId rid) {
+  const uint32_t chunkSize = regionManager_.getReclaimChunkSize();
+  XDCHECK_GT(chunkSize, 0u);
+  uint32_t evictionCount = 0;
+  uint32_t end = regionManager_.getRegion(rid).getLastEntryEndOffset();
+  uint32_t begin = end - std::min(end, chunkSize);
+  auto next =
+      regionManager_.reclaimReadAhead(RelAddress{rid, begin}, end - begin);
+  while (next) {
+    auto buffer = next->get();
+    next.reset();
+    if (buffer.isNull()) {
+      break;
+    }
+
+    // Walk the entry headers of the chunk down to the first entry that
+    // starts before it. Its size is known if its header is in the chunk.
+    uint32_t split = end;
+    uint32_t straddlingSize = 0;
+    bool corrupted = false;
+    while (split > begin && split - begin >= sizeof(EntryDesc)) {
+      const auto& desc = *reinterpret_cast<const EntryDesc*>(
+          buffer.data() + (split - begin) - sizeof(EntryDesc));
+      const auto entrySize = serializedSize(desc.keySize, desc.valueSize);
+      if (desc.csSelf != desc.computeChecksum() || entrySize > split) {
+        corrupted = true;
+        break;
+      }
+      if (split - entrySize < begin) {
+        straddlingSize = entrySize;
+        break;
+      }
+      split -= entrySize;
+    }
+
+    uint32_t nextBegin = 0;
+    if (corrupted) {
+      // reclaimEntries reports the corrupted header and stops there
+      split = begin;
+    } else if (split > 0) {
+      nextBegin = split - std::max(std::min(split, chunkSize), straddlingSize);
+      next = regionManager_.reclaimReadAhead(RelAddress{rid, nextBegin},
+                                             split - nextBegin);
+    }
+    evictionCount += reclaimEntries(
+        rid, buffer.view().slice(split - begin, end - split), split);
+    end = split;
+    begin = nextBegin;
+  }
+  return evictionCount;
+}
+
+uint32_t BlockCache::removeExpiredEntries(RegionId rid) {
+  if (destructorCb_) {
+    // The destructor is invoked with the values, so the live entries are
+    // read. They have all expired, so none of them is reinserted.
+    return reclaimRanges(rid, getLiveRanges(rid));
+  }
+  auto& region = regionManager_.getRegion(rid);
+  uint32_t evictionCount = 0;
+  uint32_t slotBegin = 0;
+  for (const auto& slot : region.getSortedSlots()) {
+    const uint32_t slotSize = slot.endOffset - slotBegin;
+    const RelAddress addrEnd{rid, slot.endOffset};
+    if (index_.removeIfMatch(slot.keyHash, encodeRelAddress(addrEnd))) {
+      evictionCount++;
+      evictionExpiredCount_.inc();
+      expiredBytes_.add(slotSize);
+      usedSizeBytes_.sub(slotSize);
+    } else {
+      evictionLookupMissCounter_.inc();
+      holeCount_.sub(1);
+      holeSizeTotal_.sub(slotSize);
+    }
+    slotBegin = slot.endOffset;
+  }
   return evictionCount;
 }
 
@@ -547,14 +1384,18 @@ void BlockCache::onRegionCleanup(RegionId rid, BufferView buffer) {
     HashedKey hk =
         makeHK(entryEnd - sizeof(EntryDesc) - desc.keySize, desc.keySize);
     BufferView value{desc.valueSize, entryEnd - entrySize};
-    if (checksumData_ && desc.cs != checksum(value)) {
+    if (checksumData_ && desc.cs != checksum(value, checksumType_)) {
       // We do not need to abort here since the EntryDesc checksum was good, so
       // we can safely proceed to read the next entry.
       cleanupValueChecksumErrorCount_.inc();
     }
 
     // remove the item
-    auto removeRes = removeItem(hk, RelAddress{rid, offset});
+    auto removeRes =
+        desc.flags != 0
+            ? evictChunkedEntry(hk, desc, value, RelAddress{rid, offset}) ==
+                  ReinsertionRes::kEvicted
+            : removeItem(hk, RelAddress{rid, offset});
     if (removeRes) {
       evictionCount++;
       usedSizeBytes_.sub(decodeSizeHint(encodeSizeHint(entrySize)));
@@ -562,7 +1403,7 @@ void BlockCache::onRegionCleanup(RegionId rid, BufferView buffer) {
       holeCount_.sub(1);
       holeSizeTotal_.sub(decodeSizeHint(encodeSizeHint(entrySize)));
     }
-    if (destructorCb_ && removeRes) {
+    if (destructorCb_ && removeRes && desc.flags == 0) {
       destructorCb_(hk, value, DestructorEvent::Recycled);
     }
     XDCHECK_GE(offset, entrySize);
@@ -580,12 +1421,68 @@ bool BlockCache::removeItem(HashedKey hk, RelAddress currAddr) {
   return false;
 }
 
+BlockCache::ReinsertionRes BlockCache::evictChunkedEntry(HashedKey hk,
+                                                         const EntryDesc& desc,
+                                                         BufferView value,
+                                                         RelAddress currAddr) {
+  if (!removeItem(hk, currAddr)) {
+    return ReinsertionRes::kRemoved;
+  }
+  if (desc.flags == kChunkEntry) {
+    // The manifest is dropped by the next lookup that misses this chunk
+    XDCHECK_GE(hk.key().size(), sizeof(ChunkKeySuffix));
+    ChunkKeySuffix suffix;
+    std::memcpy(&suffix, hk.key().end() - sizeof(suffix), sizeof(suffix));
+    const auto key = hk.key().subpiece(0, hk.key().size() - sizeof(suffix));
+    if (suffix.index == 0) {
+      removeChunks(key, suffix.objectId, suffix.numChunks, 1,
+                   suffix.numChunks);
+      if (destructorCb_) {
+        destructorCb_(makeHK(key.data(), key.size()), value,
+                      DestructorEvent::Recycled);
+      }
+    } else {
+      releaseChunks(key, suffix.objectId, suffix.numChunks);
+    }
+  } else if (value.size() == sizeof(ChunkManifest)) {
+    ChunkManifest manifest;
+    std::memcpy(&manifest, value.data(), sizeof(manifest));
+    releaseChunks(hk.key(), manifest.objectId, manifest.numChunks);
+  }
+  chunkedEvictionCount_.inc();
+  return ReinsertionRes::kEvicted;
+}
+
+void BlockCache::removeChunks(folly::StringPiece key,
+                              uint64_t objectId,
+                              uint32_t numChunks,
+                              uint32_t begin,
+                              uint32_t end) {
+  for (uint32_t i = begin; i < end; i++) {
+    const auto chunkKey = makeChunkKey(key, objectId, i, numChunks);
+    const auto seqNumber = regionManager_.getSeqNumber();
+    const auto lr =
+        index_.remove(makeHK(chunkKey.data(), chunkKey.size()).keyHash());
+    if (lr.found()) {
+      onEntryRemoved(decodeRelAddress(lr.address()).rid(),
+                     decodeSizeHint(lr.sizeHint()), seqNumber);
+    }
+  }
+}
+
+void BlockCache::releaseChunks(folly::StringPiece key,
+                               uint64_t objectId,
+                               uint32_t numChunks) {
+  removeChunks(key, objectId, numChunks, destructorCb_ ? 1 : 0, numChunks);
+}
+
 BlockCache::ReinsertionRes BlockCache::reinsertOrRemoveItem(
     HashedKey hk, BufferView value, uint32_t entrySize, RelAddress currAddr) {
-  auto removeItem = [this, hk, currAddr](bool expired) {
+  auto removeItem = [this, hk, entrySize, currAddr](bool expired) {
     if (index_.removeIfMatch(hk.keyHash(), encodeRelAddress(currAddr))) {
       if (expired) {
         evictionExpiredCount_.inc();
+        expiredBytes_.add(entrySize);
       }
       return ReinsertionRes::kEvicted;
     }
@@ -598,7 +1495,10 @@ BlockCache::ReinsertionRes BlockCache::reinsertOrRemoveItem(
     return ReinsertionRes::kRemoved;
   }
 
-  if (checkExpired_ && checkExpired_(value)) {
+  // An entry past the expiry time it was written with is never reinserted
+  const uint32_t expiryTime = getExpiryTime_ ? getExpiryTime_(value) : 0;
+  if ((checkExpired_ && checkExpired_(value)) ||
+      (expiryTime > 0 && expiryTime < util::getCurrentTimeSec())) {
     return removeItem(true);
   }
 
@@ -617,8 +1517,8 @@ BlockCache::ReinsertionRes BlockCache::reinsertOrRemoveItem(
           : std::min<uint16_t>(lr.currentHits(), numPriorities_ - 1);
 
   uint32_t size = serializedSize(hk.key().size(), value.size());
-  auto [desc, slotSize, addr] =
-      allocator_.allocate(size, priority, false /* canWait */);
+  auto [desc, slotSize, addr] = allocator_.allocate(
+      size, priority, false /* canWait */, getExpiryClass(expiryTime));
 
   switch (desc.status()) {
   case OpenStatus::Ready:
@@ -638,17 +1538,22 @@ BlockCache::ReinsertionRes BlockCache::reinsertOrRemoveItem(
 
   // After allocation a region is opened for writing. Until we close it, the
   // region would not be reclaimed and index never gets an invalid entry.
-  const auto status = writeEntry(addr, slotSize, hk, value);
+  const auto status = writeEntry(addr, slotSize, hk, value, expiryTime);
   if (status != Status::Ok) {
     reinsertionErrorCount_.inc();
     return removeItem(false);
   }
 
+  auto& newRegion = regionManager_.getRegion(addr.rid());
+  const auto liveBytes = decodeSizeHint(encodeSizeHint(slotSize));
+  newRegion.addLiveBytes(liveBytes);
   const auto replaced =
       index_.replaceIfMatch(hk.keyHash(),
                             encodeRelAddress(addr.add(slotSize)),
                             encodeRelAddress(currAddr));
   if (!replaced) {
+    // The new region is still open for write and cannot have been reclaimed
+    newRegion.removeLiveBytes(liveBytes, []() { return true; });
     reinsertionErrorCount_.inc();
     return removeItem(false);
   }
@@ -660,7 +1565,9 @@ BlockCache::ReinsertionRes BlockCache::reinsertOrRemoveItem(
 Status BlockCache::writeEntry(RelAddress addr,
                               uint32_t slotSize,
                               HashedKey hk,
-                              BufferView value) {
+                              BufferView value,
+                              uint32_t expiryTime,
+                              uint32_t flags) {
   XDCHECK_LE(addr.offset() + slotSize, regionManager_.regionSize());
   XDCHECK_EQ(slotSize % allocAlignSize_, 0ULL)
       << folly::sformat(" alignSize={}, size={}", allocAlignSize_, slotSize);
@@ -668,16 +1575,23 @@ Status BlockCache::writeEntry(RelAddress addr,
 
   // Copy descriptor and the key to the end
   size_t descOffset = buffer.size() - sizeof(EntryDesc);
-  auto desc = new (buffer.data() + descOffset)
-      EntryDesc(hk.key().size(), value.size(), hk.keyHash());
+  auto desc = new (buffer.data() + descOffset) EntryDesc(
+      hk.key().size(), value.size(), hk.keyHash(), expiryTime, flags);
   if (checksumData_) {
-    desc->cs = checksum(value);
+    desc->cs = checksum(value, checksumType_);
   }
 
   buffer.copyFrom(descOffset - hk.key().size(), makeView(hk.key()));
   buffer.copyFrom(0, value);
 
   regionManager_.write(addr, std::move(buffer));
+  auto& region = regionManager_.getRegion(addr.rid());
+  if (recordSlots_) {
+    region.addSlot(addr.add(slotSize).offset(), hk.keyHash());
+  }
+  if (getExpiryTime_) {
+    region.updateMaxExpiryTime(expiryTime);
+  }
   logicalWrittenCount_.add(hk.key().size() + value.size());
   return Status::Ok;
 }
@@ -686,7 +1600,9 @@ Status BlockCache::readEntry(const RegionDescriptor& readDesc,
                              RelAddress addrEnd,
                              uint32_t approxSize,
                              HashedKey expected,
-                             Buffer& value) {
+                             Buffer& value,
+                             bool skipExpired,
+                             uint32_t* entryFlags) {
   // Because region opened for read, nobody will reclaim it or modify. Safe
   // without locks.
 
@@ -712,9 +1628,101 @@ Status BlockCache::readEntry(const RegionDescriptor& readDesc,
   if (buffer.isNull()) {
     return Status::DeviceError;
   }
+  return readEntryFromBuffer(readDesc, addrEnd, std::move(buffer), expected,
+                             value, skipExpired, entryFlags);
+}
 
+Status BlockCache::readEntryFromBuffer(const RegionDescriptor& readDesc,
+                                       RelAddress addrEnd,
+                                       Buffer buffer,
+                                       HashedKey expected,
+                                       Buffer& value,
+                                       bool skipExpired,
+                                       uint32_t* entryFlags) {
   auto entryEnd = buffer.data() + buffer.size();
   auto desc = *reinterpret_cast<EntryDesc*>(entryEnd - sizeof(EntryDesc));
+  auto status = checkEntryHeader(desc, entryEnd, addrEnd, expected);
+  if (status != Status::Ok) {
+    return status;
+  }
+  if (entryFlags) {
+    *entryFlags = desc.flags;
+  }
+  if (skipExpired && desc.isExpired(util::getCurrentTimeSec())) {
+    lookupExpiredCount_.inc();
+    return Status::NotFound;
+  }
+
+  // Update slot size to actual, defined by key and value size
+  uint32_t size = serializedSize(desc.keySize, desc.valueSize);
+  if (buffer.size() > size) {
+    // Read more than actual size. Trim the invalid data in the beginning
+    buffer.trimStart(buffer.size() - size);
+  } else if (buffer.size() < size) {
+    // Read less than actual size. Read again with proper buffer.
+    buffer = regionManager_.read(readDesc, addrEnd.sub(size), size);
+    if (buffer.isNull()) {
+      return Status::DeviceError;
+    }
+  }
+
+  value = std::move(buffer);
+  value.shrink(desc.valueSize);
+  if (!checkEntryValue(value.view(), desc, addrEnd, expected)) {
+    value.reset();
+    return Status::DeviceError;
+  }
+  return Status::Ok;
+}
+
+Status BlockCache::readEntryInMem(const RegionDescriptor& readDesc,
+                                  RelAddress addrEnd,
+                                  HashedKey expected,
+                                  BufferView& value,
+                                  uint32_t* entryFlags) {
+  // The whole region is in memory, so there is no need to guess the size:
+  // look at the header first and then view exactly the entry.
+  if (addrEnd.offset() < sizeof(EntryDesc)) {
+    return Status::DeviceError;
+  }
+  auto header = regionManager_.readView(
+      readDesc, addrEnd.sub(sizeof(EntryDesc)), sizeof(EntryDesc));
+  XDCHECK(!header.isNull());
+  auto desc = *reinterpret_cast<const EntryDesc*>(header.data());
+  if (desc.csSelf != desc.computeChecksum()) {
+    // Corrupted header; don't trust its sizes. Let checkEntryHeader() log it
+    return checkEntryHeader(desc, header.dataEnd(), addrEnd, expected);
+  }
+
+  uint32_t size = serializedSize(desc.keySize, desc.valueSize);
+  if (size > addrEnd.offset()) {
+    return Status::DeviceError;
+  }
+  auto entry = regionManager_.readView(readDesc, addrEnd.sub(size), size);
+  auto status = checkEntryHeader(desc, entry.dataEnd(), addrEnd, expected);
+  if (status != Status::Ok) {
+    return status;
+  }
+  if (desc.isExpired(util::getCurrentTimeSec())) {
+    lookupExpiredCount_.inc();
+    return Status::NotFound;
+  }
+  if (entryFlags) {
+    *entryFlags = desc.flags;
+  }
+
+  value = entry.slice(0, desc.valueSize);
+  if (!checkEntryValue(value, desc, addrEnd, expected)) {
+    value = {};
+    return Status::DeviceError;
+  }
+  return Status::Ok;
+}
+
+Status BlockCache::checkEntryHeader(const EntryDesc& desc,
+                                    const uint8_t* entryEnd,
+                                    RelAddress addrEnd,
+                                    HashedKey expected) const {
   if (desc.csSelf != desc.computeChecksum()) {
     lookupEntryHeaderChecksumErrorCount_.inc();
     XLOG_N_PER_MS(ERR, 10, 10'000) << folly::sformat(
@@ -736,41 +1744,56 @@ Status BlockCache::readEntry(const RegionDescriptor& readDesc,
     lookupFalsePositiveCount_.inc();
     return Status::NotFound;
   }
+  return Status::Ok;
+}
 
-  // Update slot size to actual, defined by key and value size
-  uint32_t size = serializedSize(desc.keySize, desc.valueSize);
-  if (buffer.size() > size) {
-    // Read more than actual size. Trim the invalid data in the beginning
-    buffer.trimStart(buffer.size() - size);
-  } else if (buffer.size() < size) {
-    // Read less than actual size. Read again with proper buffer.
-    buffer = regionManager_.read(readDesc, addrEnd.sub(size), size);
-    if (buffer.isNull()) {
-      return Status::DeviceError;
-    }
-  }
-
-  value = std::move(buffer);
-  value.shrink(desc.valueSize);
-  if (checksumData_ && desc.cs != checksum(value.view())) {
+bool BlockCache::checkEntryValue(BufferView value,
+                                 const EntryDesc& desc,
+                                 RelAddress addrEnd,
+                                 HashedKey expected) const {
+  if (checksumData_ && desc.cs != checksum(value, checksumType_)) {
+    const uint32_t size = serializedSize(desc.keySize, desc.valueSize);
     XLOG_N_PER_MS(ERR, 10, 10'000) << folly::sformat(
         "Item value checksum mismatch in readEntry() looking up key {} in "
         "Region {}. Expected: {}, Actual: {}, Offset: {}, Physical-offset: {}, "
         "Value-size: {} Payload (hex): {}",
-        key, addrEnd.rid().index(), desc.cs, checksum(value.view()),
+        expected.key(), addrEnd.rid().index(), desc.cs,
+        checksum(value, checksumType_),
         addrEnd.offset() - size, regionManager_.physicalOffset(addrEnd) - size,
         value.size(),
         folly::hexlify(
             folly::ByteRange(value.data(), value.data() + value.size())));
-    value.reset();
     lookupValueChecksumErrorCount_.inc();
-    return Status::DeviceError;
+    return false;
   }
-  return Status::Ok;
+  return true;
 }
 
 void BlockCache::drain() { regionManager_.drain(); }
 
+uint64_t BlockCache::resize(uint64_t size) {
+  XLOGF(INFO, "Resize block cache from {} to {} bytes", getSize(), size);
+  const auto oldNumActive = regionManager_.getNumActiveRegions();
+  regionManager_.setNumActiveRegions(static_cast<uint32_t>(std::min<uint64_t>(
+      size / regionSize_, regionManager_.getNumRegions())));
+  const auto deadline = getSteadyClock() + kResizeTimeout;
+  while (!regionManager_.retireInactiveRegions()) {
+    if (getSteadyClock() >= deadline) {
+      // A region given up is stuck in a flush or a reclaim. Take the space
+      // back, so that the caller does not hand it to someone else.
+      XLOGF(ERR, "Timed out resizing block cache to {} bytes, keeping {}",
+            size, static_cast<uint64_t>(oldNumActive) * regionSize_);
+      regionManager_.setNumActiveRegions(oldNumActive);
+      resizeTimeoutCount_.inc();
+      break;
+    }
+    // Regions that are open for writes are retired once they are flushed
+    allocator_.flush();
+    std::this_thread::sleep_for(kResizePollInterval);
+  }
+  return getSize();
+}
+
 void BlockCache::flush() {
   XLOG(INFO, "Flush block cache");
   allocator_.flush();
@@ -814,12 +1837,16 @@ void BlockCache::getCounters(const CounterVisitor& visitor) const {
   visitor("navy_bc_lookup_value_checksum_errors",
           lookupValueChecksumErrorCount_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_batch_reads_coalesced", batchReadsCoalesced_.get(),
+          CounterVisitor::CounterType::RATE);
   visitor("navy_bc_reclaim_entry_header_checksum_errors",
           reclaimEntryHeaderChecksumErrorCount_.get(),
           CounterVisitor::CounterType::RATE);
   visitor("navy_bc_reclaim_value_checksum_errors",
           reclaimValueChecksumErrorCount_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_rebuild_entries", rebuildEntryCount_.get());
+  visitor("navy_bc_rebuild_checksum_errors", rebuildChecksumErrorCount_.get());
   visitor("navy_bc_cleanup_entry_header_checksum_errors",
           cleanupEntryHeaderChecksumErrorCount_.get(),
           CounterVisitor::CounterType::RATE);
@@ -838,6 +1865,10 @@ void BlockCache::getCounters(const CounterVisitor& visitor) const {
           CounterVisitor::CounterType::RATE);
   visitor("navy_bc_evictions_expired", evictionExpiredCount_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_expired_bytes", expiredBytes_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_lookup_expired", lookupExpiredCount_.get(),
+          CounterVisitor::CounterType::RATE);
   visitor("navy_bc_alloc_errors", allocErrorCount_.get(),
           CounterVisitor::CounterType::RATE);
   visitor("navy_bc_alloc_retries", allocRetryCount_.get(),
@@ -858,6 +1889,14 @@ void BlockCache::getCounters(const CounterVisitor& visitor) const {
           CounterVisitor::CounterType::RATE);
   visitor("navy_bc_remove_attempt_collisions", removeAttemptCollisions_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_chunked_inserts", chunkedInsertCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_chunked_lookups", chunkedLookupCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_chunked_evictions", chunkedEvictionCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_resize_timeouts", resizeTimeoutCount_.get(),
+          CounterVisitor::CounterType::RATE);
   // Allocator visits region manager
   allocator_.getCounters(visitor);
   index_.getCounters(visitor);
@@ -875,6 +1914,8 @@ void BlockCache::persist(RecordWriter& rw) {
   config.holeSizeTotal() = holeSizeTotal_.get();
   *config.usedSizeBytes() = usedSizeBytes_.get();
   *config.reinsertionPolicyEnabled() = (reinsertionPolicy_ != nullptr);
+  *config.regionFooterSize() = static_cast<int32_t>(
+      regionManager_.regionSize() - regionManager_.regionDataSize());
   serializeProto(config, rw);
   regionManager_.persist(rw);
   index_.persist(rw);
@@ -911,6 +1952,99 @@ void BlockCache::tryRecover(RecordReader& rr) {
   index_.recover(rr);
 }
 
+bool BlockCache::rebuild() {
+  if (!regionManager_.hasFooters()) {
+    return false;
+  }
+  XLOG(INFO, "Starting block cache rebuild");
+  reset();
+  rebuildEntryCount_.set(0);
+  rebuildChecksumErrorCount_.set(0);
+  const auto numThreads = std::clamp(std::thread::hardware_concurrency(), 1u,
+                                     kMaxRebuildThreads);
+  auto numRegions = regionManager_.rebuild(
+      bindThis(&BlockCache::rebuildRegion, *this), numThreads);
+  XLOGF(INFO,
+        "Finished block cache rebuild: {} regions, {} entries scanned, {} in "
+        "index, {} checksum errors",
+        numRegions,
+        rebuildEntryCount_.get(),
+        index_.computeSize(),
+        rebuildChecksumErrorCount_.get());
+  return true;
+}
+
+void BlockCache::rebuildRegion(RegionId rid, BufferView buffer) {
+  const auto seqNumber = regionManager_.getFooterSeqNumber(rid);
+  const uint32_t currentTime = util::getCurrentTimeSec();
+  // Entries are walked from the end of the region like in reclaimEntries
+  uint32_t offset = buffer.size();
+  while (offset > 0) {
+    auto entryEnd = buffer.data() + offset;
+    auto desc =
+        *reinterpret_cast<const EntryDesc*>(entryEnd - sizeof(EntryDesc));
+    if (desc.csSelf != desc.computeChecksum()) {
+      rebuildChecksumErrorCount_.inc();
+      XLOGF(ERR,
+            "Item header checksum mismatch in rebuild. Region {} is likely "
+            "corrupted. Skipping its remaining items. Offset-end: {}",
+            rid.index(),
+            offset);
+      break;
+    }
+    const auto entrySize = serializedSize(desc.keySize, desc.valueSize);
+    if (entrySize > offset) {
+      rebuildChecksumErrorCount_.inc();
+      break;
+    }
+    rebuildEntryCount_.inc();
+
+    const RelAddress addrEnd{rid, offset};
+    BufferView value{desc.valueSize, entryEnd - entrySize};
+    bool inserted = false;
+    if (checksumData_ && desc.cs != checksum(value, checksumType_)) {
+      // The header is good, so the next entry can still be found
+      rebuildChecksumErrorCount_.inc();
+    } else if (desc.flags == 0 && !desc.isExpired(currentTime) &&
+               (!checkExpired_ || !checkExpired_(value))) {
+      // Chunked items are not rebuilt. Their chunks and manifest may be in
+      // different regions, and chunks of dropped items can't be told apart
+      // from live ones.
+      uint32_t replacedSize = 0;
+      // Within a region, entries at higher offsets were written later
+      auto isNewer = [&](const Index::ItemRecord& existing) {
+        const auto existingAddr = decodeRelAddress(existing.address);
+        const auto existingSeqNumber =
+            regionManager_.getFooterSeqNumber(existingAddr.rid());
+        if (existingSeqNumber > seqNumber ||
+            (existingSeqNumber == seqNumber &&
+             existingAddr.offset() > offset)) {
+          return false;
+        }
+        replacedSize = decodeSizeHint(existing.sizeHint);
+        return true;
+      };
+      inserted = index_.insertIfNewer(desc.keyHash,
+                                      encodeRelAddress(addrEnd),
+                                      encodeSizeHint(entrySize),
+                                      isNewer);
+      if (inserted) {
+        usedSizeBytes_.add(decodeSizeHint(encodeSizeHint(entrySize)));
+      }
+      if (replacedSize > 0) {
+        usedSizeBytes_.sub(replacedSize);
+        holeCount_.inc();
+        holeSizeTotal_.add(replacedSize);
+      }
+    }
+    if (!inserted) {
+      holeCount_.inc();
+      holeSizeTotal_.add(decodeSizeHint(encodeSizeHint(entrySize)));
+    }
+    offset -= entrySize;
+  }
+}
+
 bool BlockCache::isValidRecoveryData(
     const serialization::BlockCacheConfig& recoveredConfig) const {
   return *config_.cacheBaseOffset_ref() ==
@@ -919,7 +2053,11 @@ bool BlockCache::isValidRecoveryData(
          static_cast<int32_t>(allocAlignSize_) ==
              *recoveredConfig.allocAlignSize_ref() &&
          *config_.checksum_ref() == *recoveredConfig.checksum_ref() &&
-         *config_.version_ref() == *recoveredConfig.version_ref();
+         *config_.checksumType_ref() == *recoveredConfig.checksumType_ref() &&
+         *config_.version_ref() == *recoveredConfig.version_ref() &&
+         static_cast<int32_t>(regionManager_.regionSize() -
+                              regionManager_.regionDataSize()) ==
+             *recoveredConfig.regionFooterSize_ref();
 }
 
 serialization::BlockCacheConfig BlockCache::serializeConfig(
@@ -928,6 +2066,7 @@ serialization::BlockCacheConfig BlockCache::serializeConfig(
   *serializedConfig.cacheBaseOffset() = config.cacheBaseOffset;
   *serializedConfig.cacheSize() = config.cacheSize;
   *serializedConfig.checksum() = config.checksum;
+  *serializedConfig.checksumType() = static_cast<int32_t>(config.checksumType);
   *serializedConfig.version() = kFormatVersion;
   return serializedConfig;
 }
@@ -16,10 +16,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "cachelib/allocator/nvmcache/NavyConfig.h"
@@ -49,12 +52,21 @@ class BlockCache final : public Engine {
   struct Config {
     Device* device{};
     ExpiredCheck checkExpired;
+    // (Optional) Extracts the expiry time from a value. Required when
+    // expiryBuckets is set.
+    ExpiryTimeGetter getExpiryTime;
     DestructorCallback destructorCb;
     // Checksum data read/written
     bool checksum{};
+    // Checksum function used for values when @checksum is set
+    ChecksumType checksumType{ChecksumType::Crc32};
     // Base offset and size (in bytes) of cache on the device
     uint64_t cacheBaseOffset{};
     uint64_t cacheSize{};
+    // Bytes at the start of the cache that hold data until the cache is
+    // resized. The rest may be used by the small item engine of the same
+    // engine pair. Multiple of regionSize; 0 means all of cacheSize.
+    uint64_t activeCacheSize{};
     // Eviction policy
     std::unique_ptr<EvictionPolicy> evictionPolicy;
     BlockCacheReinsertionConfig reinsertionConfig{};
@@ -89,6 +101,53 @@ class BlockCache final : public Engine {
     // whether to remove an item by checking the full key.
     bool preciseRemove{false};
 
+    // Fraction of a region's written bytes below which reclaim reads only
+    // the live entries instead of the whole region. Enabling it costs 12
+    // bytes of DRAM per entry to remember the slots of each region.
+    // 0 disables it.
+    double sparseReclaimThreshold{0};
+
+    // Whether a region none of whose entries are referenced by the index is
+    // reclaimed without reading it back.
+    bool reclaimDeadWithoutRead{false};
+
+    // Ascending TTL boundaries (in seconds) that group writes into separate
+    // regions by remaining lifetime. An item goes to the first bucket whose
+    // boundary is above its TTL, items past the last boundary or without
+    // expiry go to an extra last bucket. This makes whole regions expire at
+    // once: unless item destructor is enabled, such a region is reclaimed
+    // without being read (no destructor callback is invoked for its entries).
+    // Every bucket keeps its own open region per priority, so
+    // numInMemBuffers must be at least numPriorities * (buckets + 1).
+    // Empty disables it.
+    std::vector<uint32_t> expiryBuckets;
+
+    // Whether every region is written with a footer that lets the cache be
+    // rebuilt by scanning the device when no metadata was persisted, e.g.
+    // after a crash. Entries removed or replaced since they were written may
+    // come back with such a rebuild. Costs one IO block per region.
+    bool scanRecovery{false};
+
+    // Memory (in bytes) for the most recently flushed region buffers, which
+    // serve reads of their regions until reclaimed or replaced. Rounded down
+    // to whole regions. 0 disables it.
+    uint64_t flushedRegionCacheSize{0};
+
+    // Size of the chunks regions are read in during reclaim. The next chunk
+    // is read while the entries of the current one are processed, so a
+    // reclaim holds two chunks instead of a whole region in memory. Multiple
+    // of the device IO alignment. 0 reads whole regions.
+    uint32_t reclaimChunkSize{0};
+
+    // Largest value stored split into chunks across regions when it does not
+    // fit in one region. Each chunk is an entry of its own, and the key
+    // points to a manifest entry listing them. The chunks are read in
+    // parallel on lookup, and evicting any part of a chunked item drops all
+    // of it. Chunks of a replaced item stay until their regions are
+    // reclaimed. No destructor callback is invoked for chunked items, so
+    // this can't be combined with item destructor. 0 disables it.
+    uint64_t maxChunkedItemSize{0};
+
     // Calculates the total region number.
     uint32_t getNumRegions() const {
       XDCHECK_EQ(0ul, cacheSize % regionSize);
@@ -145,6 +204,20 @@ class BlockCache final : public Engine {
   //          Status::DeviceError otherwise.
   Status lookup(HashedKey hk, Buffer& value) override;
 
+  // Same as lookup(), but hands the value to @visitor instead of returning
+  // a Buffer. Entries in regions still held in in-mem buffers are passed
+  // without being copied; the region stays open for read until @visitor
+  // returns.
+  Status lookupView(HashedKey hk,
+                    folly::FunctionRef<void(BufferView)> visitor) override;
+
+  // Looks up @keys, reading entries that sit next to or overlap each other
+  // in the same region with one device IO of at most kMaxBatchReadSize (or
+  // the device max IO size if smaller).
+  void lookupBatch(folly::Range<const HashedKey*> keys,
+                   folly::Range<Status*> statuses,
+                   folly::Range<Buffer*> values) override;
+
   // Removes a key from BlockCache.
   //
   // @param hk           key to be removed
@@ -155,6 +228,12 @@ class BlockCache final : public Engine {
   // Finish all pending jobs
   void drain() override;
 
+  // Grows or shrinks the cache to the first @size bytes of its device range.
+  // Regions beyond are reclaimed, evicting their entries, and are not used
+  // again until the cache grows. Throws std::invalid_argument if fewer
+  // regions than the clean region pool would be left.
+  uint64_t resize(uint64_t size) override;
+
   // Flushes all buffered (in flight) operations in BlockCache.
   void flush() override;
 
@@ -173,6 +252,13 @@ class BlockCache final : public Engine {
   // @return  true if recovery succeeds, false otherwise.
   bool recover(RecordReader& rr) override;
 
+  // Rebuilds the index and the regions from the region footers and entry
+  // headers on the device. Regions are scanned in parallel; a key found in
+  // several regions is resolved to the most recently flushed one.
+  //
+  // @return  true if rebuilt, false if scan recovery is not enabled.
+  bool rebuild() override;
+
   // Exports BlockCache stats via CounterVisitor.
   //
   // @param visitor   CounterVisitor to export stats
@@ -180,7 +266,9 @@ class BlockCache final : public Engine {
 
   // Gets the maximum item size that can be inserted into BlockCache.
   uint64_t getMaxItemSize() const override {
-    return regionSize_ - sizeof(EntryDesc);
+    return std::max<uint64_t>(maxChunkedItemSize_,
+                              regionManager_.regionDataSize() -
+                                  sizeof(EntryDesc));
   }
 
   // Gets the alloc alignment size (must be an integral power of two).
@@ -193,6 +281,12 @@ class BlockCache final : public Engine {
   std::pair<Status, std::string /* key */> getRandomAlloc(
       Buffer& value) override;
 
+  // Visits the entries region by region, reading each region with a single
+  // device IO. Regions still being filled are flushed first, so that entries
+  // inserted before the call are visited. The value of a chunked item is
+  // assembled from its chunks.
+  uint64_t forEachEntry(EntryVisitor visitor) override;
+
   // The minimum alloc alignment size can be as small as 1. Since the
   // test cases have very small device size, they will end up with alloc
   // alignment size of 1 (if determined as device_size >> 32 ) and we may
@@ -209,23 +303,36 @@ class BlockCache final : public Engine {
 
  private:
   // Serialization format version. Never 0. Versions < 10 reserved for testing.
-  static constexpr uint32_t kFormatVersion = 12;
+  static constexpr uint32_t kFormatVersion = 13;
   // This should be at least the nextTwoPow(sizeof(EntryDesc)).
   static constexpr uint32_t kDefReadBufferSize = 4096;
   // Default priority for an item inserted into block cache
   static constexpr uint16_t kDefaultItemPriority = 0;
+  // Max threads scanning regions in rebuild
+  static constexpr uint32_t kMaxRebuildThreads = 8;
+  // Max size of a device read shared by entries of a batch lookup
+  static constexpr uint32_t kMaxBatchReadSize = 1024 * 1024;
+  // How often resize() checks whether the regions given up are retired
+  static constexpr std::chrono::milliseconds kResizePollInterval{10};
+  // How long resize() waits for the regions given up to be retired before
+  // it gives up and keeps the old size
+  static constexpr std::chrono::seconds kResizeTimeout{60};
 
   // When modify @EntryDesc layout, don't forget to bump @kFormatVersion!
   struct EntryDesc {
     uint32_t keySize{};
     uint32_t valueSize{};
     uint64_t keyHash{};
+    // Absolute expiry time in seconds, 0 if the entry never expires
+    uint32_t expiryTime{};
+    // EntryFlags of the entry, 0 for a plain key-value entry
+    uint32_t flags{};
     uint32_t csSelf{};
     uint32_t cs{};
 
     EntryDesc() = default;
-    EntryDesc(uint32_t ks, uint32_t vs, uint64_t kh)
-        : keySize{ks}, valueSize{vs}, keyHash{kh} {
+    EntryDesc(uint32_t ks, uint32_t vs, uint64_t kh, uint32_t et, uint32_t fl)
+        : keySize{ks}, valueSize{vs}, keyHash{kh}, expiryTime{et}, flags{fl} {
       csSelf = computeChecksum();
     }
 
@@ -233,11 +340,42 @@ class BlockCache final : public Engine {
       return checksum(BufferView{offsetof(EntryDesc, csSelf),
                                  reinterpret_cast<const uint8_t*>(this)});
     }
+
+    bool isExpired(uint32_t currentTime) const {
+      return expiryTime > 0 && expiryTime < currentTime;
+    }
   };
 
   // Instead of unportable packing, we make sure that struct size is equal to
   // the size of its members.
-  static_assert(sizeof(EntryDesc) == 24, "packed struct required");
+  static_assert(sizeof(EntryDesc) == 32, "packed struct required");
+
+  // Kinds of entries that hold parts of a chunked item
+  enum EntryFlags : uint32_t {
+    // A slice of the value. Its key is the item key followed by a
+    // ChunkKeySuffix.
+    kChunkEntry = 1,
+    // Stored under the item key. Its value is a ChunkManifest.
+    kManifestEntry = 2,
+  };
+
+  // Appended to the item key to make the key of each chunk. The object id
+  // tells apart the chunks of different insertions of the same key.
+  struct ChunkKeySuffix {
+    uint64_t objectId{};
+    uint32_t index{};
+    uint32_t numChunks{};
+  };
+  static_assert(sizeof(ChunkKeySuffix) == 16, "packed struct required");
+
+  struct ChunkManifest {
+    uint64_t objectId{};
+    uint64_t valueSize{};
+    // Value bytes in every chunk but the last
+    uint32_t chunkSize{};
+    uint32_t numChunks{};
+  };
+  static_assert(sizeof(ChunkManifest) == 24, "packed struct required");
 
   struct ValidConfigTag {};
   BlockCache(Config&& config, ValidConfigTag);
@@ -245,6 +383,66 @@ class BlockCache final : public Engine {
   // Entry disk size (with aux data and aligned)
   uint32_t serializedSize(uint32_t keySize, uint32_t valueSize) const;
 
+  // Largest entry that fits in a region
+  uint32_t maxEntrySize() const;
+
+  // Allocates, writes and indexes one entry. Returns the insert() status.
+  Status insertEntry(HashedKey hk,
+                     BufferView value,
+                     uint32_t expiryTime,
+                     uint32_t flags);
+
+  // Writes @value as chunks followed by a manifest under @hk. Chunks
+  // written before a failure are dropped from the index.
+  Status insertChunked(HashedKey hk, BufferView value, uint32_t expiryTime);
+
+  // Returns the key of chunk @index of a chunked item of @key
+  static std::string makeChunkKey(folly::StringPiece key,
+                                  uint64_t objectId,
+                                  uint32_t index,
+                                  uint32_t numChunks);
+
+  // Replaces the manifest in @value, which ends at @manifestEnd, with the
+  // value of the chunked item @hk. Chunks are read in parallel when on a
+  // fiber. If a chunk is missing, the item is dropped and NotFound returned.
+  Status readChunkedValue(HashedKey hk,
+                          RelAddress manifestEnd,
+                          Buffer& value);
+
+  // Looks up and reads one chunk of a chunked item
+  Status readChunk(HashedKey hk, Buffer& value);
+
+  // Reads the manifest @hk is mapped to. Returns false if @hk is not a
+  // chunked item or the manifest can't be read right now. Only entries of
+  // the size of a manifest are read.
+  bool readManifest(HashedKey hk, ChunkManifest& manifest);
+
+  // Drops chunks [@begin, @end) of a chunked item of @key from the index
+  void removeChunks(folly::StringPiece key,
+                    uint64_t objectId,
+                    uint32_t numChunks,
+                    uint32_t begin,
+                    uint32_t end);
+
+  // Drops the chunks of a chunked item of @key that can't be served
+  // anymore. With a destructor, chunk 0 is kept: it starts with the head of
+  // the value, and the destructor of the item is invoked once it is evicted.
+  void releaseChunks(folly::StringPiece key,
+                     uint64_t objectId,
+                     uint32_t numChunks);
+
+  // Accounts for an entry of @size bytes in region @rid that was dropped
+  // from the index but is still on the device
+  void onEntryRemoved(RegionId rid, uint32_t size, uint64_t seqNumber);
+
+  // Reads the entry of a key looked up by the user. The value of a chunked
+  // item is assembled from its chunks.
+  Status readValue(const RegionDescriptor& readDesc,
+                   RelAddress addrEnd,
+                   uint32_t approxSize,
+                   HashedKey hk,
+                   Buffer& value);
+
   // Read and write are time consuming. It doesn't worth inlining them from
   // the performance point of view, but makes sense to track them for perf:
   // especially portion on CPU time spent in std::memcpy.
@@ -252,25 +450,127 @@ class BlockCache final : public Engine {
   // @param slotSize    Number of bytes this entry will take up on the device
   // @param hk          Key of the entry
   // @param value       Payload of the entry
+  // @param expiryTime  Absolute expiry time of the entry, 0 if none
+  // @param flags       EntryFlags of the entry
   Status writeEntry(RelAddress addr,
                     uint32_t slotSize,
                     HashedKey hk,
-                    BufferView value);
+                    BufferView value,
+                    uint32_t expiryTime,
+                    uint32_t flags = 0);
   // @param readDesc      Descriptor for reading. This must be valid
   // @param addrEnd       End of the entry since the item layout is backward
   // @param approxSize    Approximate size since we got this size from index
   // @param expected      We expect the entry's key to match with our key
   // @param value         We will write the payload into this buffer
+  // @param skipExpired   Return NotFound for an entry past its expiry time
+  // @param entryFlags    If set, receives the EntryFlags of the entry read
   Status readEntry(const RegionDescriptor& readDesc,
                    RelAddress addrEnd,
                    uint32_t approxSize,
                    HashedKey expected,
-                   Buffer& value);
+                   Buffer& value,
+                   bool skipExpired = true,
+                   uint32_t* entryFlags = nullptr);
+
+  // Same as readEntry() for a region served from its in-mem buffer. @value
+  // points into the buffer and is valid while @readDesc is open.
+  Status readEntryInMem(const RegionDescriptor& readDesc,
+                        RelAddress addrEnd,
+                        HashedKey expected,
+                        BufferView& value,
+                        uint32_t* entryFlags = nullptr);
+
+  // Validates the entry header ending at @entryEnd and that its key is
+  // @expected. Returns Ok, NotFound (key mismatch) or DeviceError.
+  Status checkEntryHeader(const EntryDesc& desc,
+                          const uint8_t* entryEnd,
+                          RelAddress addrEnd,
+                          HashedKey expected) const;
+
+  // Validates the value checksum if data checksumming is enabled
+  bool checkEntryValue(BufferView value,
+                       const EntryDesc& desc,
+                       RelAddress addrEnd,
+                       HashedKey expected) const;
+
+  // Reads the entry of a found key from an open region: (desc, addrEnd,
+  // approxSize) -> status
+  using ReadEntryFn = folly::FunctionRef<Status(
+      const RegionDescriptor&, RelAddress, uint32_t)>;
+
+  // Common lookup path: finds @hk in the index, opens its region and calls
+  // @readFn (retrying once on DeviceError) while the region is open.
+  Status lookupInternal(HashedKey hk, ReadEntryFn readFn);
+
+  // Finishes a lookup whose read from the open region @desc returned
+  // @status: retries a DeviceError once with @readFn, drops the entry from
+  // the index if it keeps failing, updates stats and closes the region.
+  Status completeLookup(HashedKey hk,
+                        RegionDescriptor desc,
+                        RelAddress addrEnd,
+                        uint32_t approxSize,
+                        uint64_t seqNumber,
+                        Status status,
+                        ReadEntryFn readFn);
+
+  // Extracts the entry ending at @addrEnd from @buffer, which holds the
+  // bytes right before @addrEnd. Reads again if @buffer is too short.
+  Status readEntryFromBuffer(const RegionDescriptor& readDesc,
+                             RelAddress addrEnd,
+                             Buffer buffer,
+                             HashedKey expected,
+                             Buffer& value,
+                             bool skipExpired = true,
+                             uint32_t* entryFlags = nullptr);
 
   // Allocator reclaim callback
   // Returns number of slots that were successfully evicted
   uint32_t onRegionReclaim(RegionId rid, BufferView buffer);
 
+  // Evicts, removes or reinserts entries of a region being reclaimed.
+  // @buffer holds the region data starting at @beginOffset and must end at
+  // an entry boundary. Returns number of slots that were evicted.
+  uint32_t reclaimEntries(RegionId rid,
+                          BufferView buffer,
+                          uint32_t beginOffset);
+
+  // Reclaims a region that was not read by RegionManager. Only the extents
+  // of live entries are read from the device, unless the region has expired
+  // in which case nothing is read. A region whose slots are not recorded is
+  // read a chunk at a time with reclaimEntriesInChunks().
+  // Returns number of slots that were evicted.
+  uint32_t reclaimLiveEntries(RegionId rid);
+
+  // Returns the byte ranges of the runs of adjacent live slots of region
+  // @rid, each cut before it grows past the reclaim chunk size. Dead slots
+  // are accounted as removed entries.
+  std::vector<std::pair<uint32_t, uint32_t>> getLiveRanges(RegionId rid);
+
+  // Reclaims the byte ranges of region @rid given by @ranges, each of which
+  // has to start and end at an entry boundary. The next range is read while
+  // the entries of the current one are processed.
+  // Returns number of slots that were evicted.
+  uint32_t reclaimRanges(
+      RegionId rid, const std::vector<std::pair<uint32_t, uint32_t>>& ranges);
+
+  // Reclaims region @rid reading it from its end a reclaim chunk at a time.
+  // Entries are processed as chunks arrive. An entry that starts before its
+  // chunk is left for the next chunk, which ends where that entry ends and
+  // is read while the entries of the current chunk are processed.
+  // Returns number of slots that were evicted.
+  uint32_t reclaimEntriesInChunks(RegionId rid);
+
+  // Removes the entries of an expired region from the index based on the
+  // recorded slots. With a destructor callback, the live entries are read
+  // so that it is invoked for them. Returns number of slots that were
+  // evicted.
+  uint32_t removeExpiredEntries(RegionId rid);
+
+  // Returns the expiry class an entry expiring at @expiryTime should be
+  // allocated from.
+  uint16_t getExpiryClass(uint32_t expiryTime) const;
+
   // Allocator cleanup callback
   void onRegionCleanup(RegionId rid, BufferView buffer);
 
@@ -282,11 +582,21 @@ class BlockCache final : public Engine {
   // Tries to recover cache. Throws std::exception on failure.
   void tryRecover(RecordReader& rr);
 
+  // Rebuild scan callback: adds the entries of region @rid to the index
+  // unless a newer copy of the key is already there.
+  void rebuildRegion(RegionId rid, BufferView buffer);
+
   // The alloc alignment indicates the granularity of read/write. This
   // granuality is less than the device io alignment size because we buffer
   // writes in memory until we fill up a region.
   uint32_t calcAllocAlignSize() const;
 
+  // Size hint of manifests in the index, so that telling whether a key is a
+  // chunked item takes no read. Other entries take at least
+  // kMinAllocAlignSize and never encode to it. A manifest takes exactly one
+  // allocAlignSize_ slot.
+  static constexpr uint16_t kManifestSizeHint = 0;
+
   // Size hint is computed by aligning size up to kMinAllocAlignSize,
   // and then divide by it. It is loosely compressing the size as
   // we may decode into a bigger size later.
@@ -296,7 +606,8 @@ class BlockCache final : public Engine {
   }
 
   uint32_t decodeSizeHint(uint16_t sizeHint) const {
-    return sizeHint * kMinAllocAlignSize;
+    return sizeHint == kManifestSizeHint ? allocAlignSize_
+                                         : sizeHint * kMinAllocAlignSize;
   }
 
   uint32_t encodeRelAddress(RelAddress addr) const {
@@ -332,6 +643,15 @@ class BlockCache final : public Engine {
   //         be found or was removed earlier.
   bool removeItem(HashedKey hk, RelAddress currAddr);
 
+  // Evicts a chunk or manifest entry being reclaimed together with the rest
+  // of its chunked item, which can't be served without it. Chunked items are
+  // never reinserted. The destructor of the item is invoked with chunk 0
+  // (see releaseChunks).
+  ReinsertionRes evictChunkedEntry(HashedKey hk,
+                                   const EntryDesc& desc,
+                                   BufferView value,
+                                   RelAddress currAddr);
+
   void validate(Config& config) const;
 
   // Create the reinsertion policy from config.
@@ -343,8 +663,10 @@ class BlockCache final : public Engine {
   const serialization::BlockCacheConfig config_;
   const uint16_t numPriorities_{};
   const ExpiredCheck checkExpired_;
+  const ExpiryTimeGetter getExpiryTime_;
   const DestructorCallback destructorCb_;
   const bool checksumData_{};
+  const ChecksumType checksumType_{};
   // reference to the under-lying device.
   const Device& device_;
   // alloc alignment size indicates the granularity of entry sizes on device.
@@ -358,6 +680,16 @@ class BlockCache final : public Engine {
   const bool itemDestructorEnabled_{false};
   // whether preciseRemove is enabled
   const bool preciseRemove_{false};
+  // whether slots are recorded per region for sparse or expired reclaim
+  const bool recordSlots_{false};
+  // TTL boundaries of the expiry classes
+  const std::vector<uint32_t> expiryBuckets_;
+  // whether an expired region is reclaimed without reading it
+  const bool reclaimExpiredWithoutRead_{false};
+  // whether a region without live entries is reclaimed without reading it
+  const bool reclaimDeadWithoutRead_{false};
+  // largest value stored in chunks, 0 if chunking is disabled
+  const uint64_t maxChunkedItemSize_{0};
 
   // Index stores offset of the slot *end*. This enables efficient paradigm
   // "buffer pointer is value pointer", which means value has to be at offset 0
@@ -388,10 +720,15 @@ class BlockCache final : public Engine {
   mutable AtomicCounter lookupFalsePositiveCount_;
   mutable AtomicCounter lookupEntryHeaderChecksumErrorCount_;
   mutable AtomicCounter lookupValueChecksumErrorCount_;
+  // Device reads avoided by coalescing entries of batch lookups
+  mutable AtomicCounter batchReadsCoalesced_;
   mutable AtomicCounter removeCount_;
   mutable AtomicCounter succRemoveCount_;
   mutable AtomicCounter evictionLookupMissCounter_;
   mutable AtomicCounter evictionExpiredCount_;
+  // Bytes of expired entries dropped by reclaim
+  mutable AtomicCounter expiredBytes_;
+  mutable AtomicCounter lookupExpiredCount_;
   mutable AtomicCounter allocErrorCount_;
   mutable AtomicCounter allocRetryCount_;
   mutable AtomicCounter logicalWrittenCount_;
@@ -409,6 +746,15 @@ class BlockCache final : public Engine {
   mutable AtomicCounter cleanupEntryHeaderChecksumErrorCount_;
   mutable AtomicCounter cleanupValueChecksumErrorCount_;
   mutable AtomicCounter lookupForItemDestructorErrorCount_;
+  // Entries restored and entries dropped for a bad checksum by rebuild()
+  mutable AtomicCounter rebuildEntryCount_;
+  mutable AtomicCounter rebuildChecksumErrorCount_;
+  // Chunked items inserted, read and evicted
+  mutable AtomicCounter chunkedInsertCount_;
+  mutable AtomicCounter chunkedLookupCount_;
+  mutable AtomicCounter chunkedEvictionCount_;
+  // Resizes that gave up waiting for the regions given up to be retired
+  mutable AtomicCounter resizeTimeoutCount_;
 };
 } // namespace navy
 } // namespace cachelib
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cachelib/navy/block_cache/CostBenefitPolicy.h"
+
+#include <folly/Format.h>
+#include <folly/Random.h>
+#include <folly/logging/xlog.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "cachelib/common/Time.h"
+
+namespace facebook::cachelib::navy {
+
+constexpr std::chrono::seconds CostBenefitPolicy::kEstimatorWindow;
+constexpr size_t CostBenefitPolicy::kMaxEvictionCandidates;
+
+CostBenefitPolicy::CostBenefitPolicy(uint64_t regionSize)
+    : regionSize_{regionSize},
+      utilizationEstimator_{kEstimatorWindow},
+      secSinceInsertionEstimator_{kEstimatorWindow} {
+  if (regionSize_ == 0) {
+    throw std::invalid_argument("region size must be non-zero");
+  }
+  XLOGF(INFO, "Cost-benefit policy: region size {}", regionSize_);
+}
+
+void CostBenefitPolicy::track(const Region& region) {
+  const auto rid = region.id();
+  XDCHECK(rid.valid());
+  std::lock_guard<TimedMutex> lock{mutex_};
+  if (rid.index() >= nodes_.size()) {
+    nodes_.resize(rid.index() + 1);
+  }
+  auto& node = nodes_[rid.index()];
+  if (node.pos == kInvalidIndex) {
+    node.pos = static_cast<uint32_t>(tracked_.size());
+    tracked_.push_back(rid.index());
+  }
+  node.region = &region;
+  node.trackTime = getSteadyClockSeconds();
+  node.trackSeq = nextTrackSeq_++;
+}
+
+void CostBenefitPolicy::untrack(uint32_t index) {
+  auto& node = nodes_[index];
+  XDCHECK_NE(node.pos, kInvalidIndex);
+  const auto last = tracked_.back();
+  tracked_[node.pos] = last;
+  nodes_[last].pos = node.pos;
+  tracked_.pop_back();
+  node.pos = kInvalidIndex;
+}
+
+RegionId CostBenefitPolicy::evict() {
+  return evictSkipping([](RegionId) { return false; }, 0);
+}
+
+RegionId CostBenefitPolicy::evictSkipping(
+    folly::FunctionRef<bool(RegionId)> skip, uint32_t maxSkips) {
+  struct Candidate {
+    uint32_t index{};
+    double score{};
+    uint64_t trackSeq{};
+    bool expired{};
+    double utilization{};
+    uint64_t age{};
+  };
+
+  RegionId rid;
+  double utilization{0};
+  uint64_t age{0};
+  bool victimExpired{false};
+  {
+    std::lock_guard<TimedMutex> lock{mutex_};
+    if (tracked_.empty()) {
+      return RegionId{};
+    }
+    // Sample the candidates without replacement by moving them to the front
+    const size_t numCandidates =
+        std::min(tracked_.size(), kMaxEvictionCandidates);
+    if (numCandidates < tracked_.size()) {
+      for (size_t i = 0; i < numCandidates; i++) {
+        const size_t j = i + folly::Random::rand64(tracked_.size() - i);
+        std::swap(tracked_[i], tracked_[j]);
+        nodes_[tracked_[i]].pos = static_cast<uint32_t>(i);
+        nodes_[tracked_[j]].pos = static_cast<uint32_t>(j);
+      }
+    }
+
+    const auto now = getSteadyClockSeconds();
+    const uint32_t currentTime = util::getCurrentTimeSec();
+    std::vector<Candidate> candidates;
+    candidates.reserve(numCandidates);
+    for (size_t i = 0; i < numCandidates; i++) {
+      const auto& node = nodes_[tracked_[i]];
+      // A region whose entries have all expired holds no useful data,
+      // whatever its live bytes say
+      const bool isExpired = node.region->isExpired(currentTime);
+      const double liveBytes =
+          isExpired ? 0 : static_cast<double>(node.region->getLiveBytes());
+      const double u =
+          std::min(1.0, liveBytes / static_cast<double>(regionSize_));
+      // Regions tracked in the same second still differ by utilization
+      const auto secs = static_cast<uint64_t>((now - node.trackTime).count());
+      const double score = isExpired ? std::numeric_limits<double>::max()
+                                     : (secs + 1) * (1 - u) / (1 + u);
+      candidates.push_back(
+          Candidate{tracked_[i], score, node.trackSeq, isExpired, u, secs});
+    }
+    // Only the ones that may be passed over and the victim need ordering
+    const size_t numOrdered =
+        std::min(candidates.size(), static_cast<size_t>(maxSkips) + 1);
+    std::partial_sort(candidates.begin(), candidates.begin() + numOrdered,
+                      candidates.end(),
+                      [](const Candidate& a, const Candidate& b) {
+                        return a.score > b.score ||
+                               (a.score == b.score && a.trackSeq < b.trackSeq);
+                      });
+    size_t pick = 0;
+    while (pick < numOrdered && pick < maxSkips &&
+           skip(RegionId{candidates[pick].index})) {
+      pick++;
+    }
+    if (pick == numOrdered) {
+      pick = 0;
+    }
+    const auto& victim = candidates[pick];
+    rid = RegionId{victim.index};
+    victimExpired = victim.expired;
+    utilization = victim.utilization;
+    age = victim.age;
+    untrack(victim.index);
+  }
+
+  if (victimExpired) {
+    expiredEvictions_.inc();
+  }
+
+  utilizationEstimator_.trackValue(utilization * 100);
+  secSinceInsertionEstimator_.trackValue(age);
+  return rid;
+}
+
+bool CostBenefitPolicy::remove(RegionId rid) {
+  std::lock_guard<TimedMutex> lock{mutex_};
+  if (rid.index() >= nodes_.size() ||
+      nodes_[rid.index()].pos == kInvalidIndex) {
+    return false;
+  }
+  untrack(rid.index());
+  return true;
+}
+
+void CostBenefitPolicy::reset() {
+  std::lock_guard<TimedMutex> lock{mutex_};
+  nodes_.clear();
+  tracked_.clear();
+}
+
+void CostBenefitPolicy::getCounters(const CounterVisitor& v) const {
+  {
+    std::lock_guard<TimedMutex> lock{mutex_};
+    v("navy_bc_cb_size", tracked_.size());
+  }
+  v("navy_bc_cb_expired_evictions", expiredEvictions_.get(),
+    CounterVisitor::CounterType::RATE);
+  utilizationEstimator_.visitQuantileEstimator(
+      v, "navy_bc_cb_evicted_region_utilization_pct");
+  secSinceInsertionEstimator_.visitQuantileEstimator(
+      v, "navy_bc_cb_secs_since_insertion");
+}
+
+void CostBenefitPolicy::persist(RecordWriter& rw) const {
+  std::ignore = rw;
+  throw std::runtime_error("Not Implemented.");
+}
+
+void CostBenefitPolicy::recover(RecordReader& rr) {
+  std::ignore = rr;
+  throw std::runtime_error("Not Implemented.");
+}
+
+} // namespace facebook::cachelib::navy
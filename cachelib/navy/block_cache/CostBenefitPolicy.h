@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/fibers/TimedMutex.h>
+
+#include <chrono>
+#include <vector>
+
+#include "cachelib/common/AtomicCounter.h"
+#include "cachelib/common/PercentileStats.h"
+#include "cachelib/navy/block_cache/EvictionPolicy.h"
+#include "cachelib/navy/common/Utils.h"
+
+namespace facebook {
+namespace cachelib {
+namespace navy {
+using folly::fibers::TimedMutex;
+
+// Cost-benefit policy, as used by log-structured file system cleaners.
+//
+// Every tracked region is scored with
+//   age * (1 - u) / (1 + u)
+// where u is the fraction of the region still referenced by the index and age
+// is the time since the region was tracked. The region with the highest score
+// is evicted, so regions that are mostly dead are reclaimed first while old
+// regions eventually get evicted even if they are still full. Ties go to the
+// region tracked first, which makes the policy FIFO on a fully live cache,
+// or close to it once eviction samples.
+// Regions whose entries have all expired are evicted before any other.
+//
+// Eviction scores at most kMaxEvictionCandidates regions, sampled at random
+// when more are tracked, so the victim is the best of the sample. Tracking
+// and removing a region are O(1).
+class CostBenefitPolicy final : public EvictionPolicy {
+ public:
+  // @regionSize  size of a region, used to compute the utilization.
+  explicit CostBenefitPolicy(uint64_t regionSize);
+  CostBenefitPolicy(const CostBenefitPolicy&) = delete;
+  CostBenefitPolicy& operator=(const CostBenefitPolicy&) = delete;
+  ~CostBenefitPolicy() override = default;
+
+  void touch(RegionId /* rid */) override {}
+
+  // Adds a new region for tracking.
+  void track(const Region& region) override;
+
+  // Evicts the candidate with the highest cost-benefit score and stops
+  // tracking it.
+  RegionId evict() override;
+
+  // Evicts the candidate with the highest score that is not skipped.
+  RegionId evictSkipping(folly::FunctionRef<bool(RegionId)> skip,
+                         uint32_t maxSkips) override;
+
+  // Stops tracking the region.
+  bool remove(RegionId rid) override;
+
+  // Resets cost-benefit policy to the initial state.
+  void reset() override;
+
+  // Gets memory used by cost-benefit policy.
+  size_t memorySize() const override {
+    std::lock_guard<TimedMutex> lock{mutex_};
+    return sizeof(*this) + sizeof(Node) * nodes_.capacity() +
+           sizeof(uint32_t) * tracked_.capacity();
+  }
+
+  // Exports cost-benefit policy stats via CounterVisitor.
+  void getCounters(const CounterVisitor& v) const override;
+
+  // Persists metadata associated with cost-benefit policy.
+  void persist(RecordWriter& rw) const override;
+
+  // Recovers from previously persisted metadata associated with cost-benefit
+  // policy.
+  void recover(RecordReader& rr) override;
+
+ private:
+  static constexpr uint32_t kInvalidIndex = 0xffffffffu;
+
+  struct Node {
+    // Regions are owned by RegionManager and outlive the policy's tracking
+    const Region* region{};
+    std::chrono::seconds trackTime{};
+    // Breaks ties in favour of the region tracked first
+    uint64_t trackSeq{};
+    // Position in tracked_, kInvalidIndex if the region is not tracked
+    uint32_t pos{kInvalidIndex};
+  };
+
+  // Stops tracking the region at @index. Must hold the lock.
+  void untrack(uint32_t index);
+
+  static constexpr std::chrono::seconds kEstimatorWindow{5};
+  static constexpr size_t kMaxEvictionCandidates{64};
+
+  const uint64_t regionSize_{};
+
+  // Indexed by region id
+  std::vector<Node> nodes_;
+  // Ids of the tracked regions, in no particular order
+  std::vector<uint32_t> tracked_;
+  uint64_t nextTrackSeq_{0};
+  mutable TimedMutex mutex_;
+
+  mutable AtomicCounter expiredEvictions_;
+  // utilization (in percent) and age of the evicted regions
+  mutable util::PercentileStats utilizationEstimator_;
+  mutable util::PercentileStats secSinceInsertionEstimator_;
+};
+} // namespace navy
+} // namespace cachelib
+} // namespace facebook
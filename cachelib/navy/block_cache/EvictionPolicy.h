@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <folly/Function.h>
+
 #include <chrono>
 #include <memory>
 
@@ -41,6 +43,19 @@ class EvictionPolicy {
   // Evicts a region and stops tracking.
   virtual RegionId evict() = 0;
 
+  // Evicts like evict(), but passes over the candidates for which @skip
+  // returns true, up to @maxSkips of them. Candidates passed over stay
+  // tracked as they are. If only such candidates are left, the first of them
+  // is evicted. Policies that cannot pass over candidates just evict().
+  virtual RegionId evictSkipping(folly::FunctionRef<bool(RegionId)> /* skip */,
+                                 uint32_t /* maxSkips */) {
+    return evict();
+  }
+
+  // Stops tracking @rid, e.g. when the region is taken out of the cache.
+  // Returns false if the region was not tracked.
+  virtual bool remove(RegionId rid) = 0;
+
   // Resets policy to the initial state.
   virtual void reset() = 0;
 
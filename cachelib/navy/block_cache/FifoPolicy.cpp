@@ -18,6 +18,7 @@
 
 #include <folly/Format.h>
 
+#include <algorithm>
 #include <numeric>
 
 namespace facebook::cachelib::navy {
@@ -32,6 +33,26 @@ unsigned int accumulate(const std::vector<unsigned int> nums) {
         return a + b;
       });
 }
+
+RegionId eraseFirstNotSkipped(std::deque<Node>& queue,
+                              folly::FunctionRef<bool(RegionId)> skip,
+                              uint32_t maxSkips) {
+  if (queue.empty()) {
+    return RegionId{};
+  }
+  auto it = queue.begin();
+  for (uint32_t skips = 0;
+       it != queue.end() && skips < maxSkips && skip(it->rid);
+       skips++) {
+    ++it;
+  }
+  if (it == queue.end()) {
+    it = queue.begin();
+  }
+  auto rid = it->rid;
+  queue.erase(it);
+  return rid;
+}
 } // namespace detail
 
 FifoPolicy::FifoPolicy() { XLOG(INFO, "FIFO policy"); }
@@ -51,6 +72,23 @@ RegionId FifoPolicy::evict() {
   return rid;
 }
 
+RegionId FifoPolicy::evictSkipping(folly::FunctionRef<bool(RegionId)> skip,
+                                   uint32_t maxSkips) {
+  std::lock_guard<TimedMutex> lock{mutex_};
+  return detail::eraseFirstNotSkipped(queue_, skip, maxSkips);
+}
+
+bool FifoPolicy::remove(RegionId rid) {
+  std::lock_guard<TimedMutex> lock{mutex_};
+  auto it = std::find_if(queue_.begin(), queue_.end(),
+                         [rid](const detail::Node& n) { return n.rid == rid; });
+  if (it == queue_.end()) {
+    return false;
+  }
+  queue_.erase(it);
+  return true;
+}
+
 void FifoPolicy::reset() {
   std::lock_guard<TimedMutex> lock{mutex_};
   queue_.clear();
@@ -119,6 +157,33 @@ RegionId SegmentedFifoPolicy::evict() {
   return rid;
 }
 
+RegionId SegmentedFifoPolicy::evictSkipping(
+    folly::FunctionRef<bool(RegionId)> skip, uint32_t maxSkips) {
+  std::lock_guard<TimedMutex> lock{mutex_};
+  auto rid = detail::eraseFirstNotSkipped(segments_.front(), skip, maxSkips);
+  if (!rid.valid()) {
+    XDCHECK_EQ(0ul, numElementsLocked());
+    return RegionId{};
+  }
+  rebalanceLocked();
+  return rid;
+}
+
+bool SegmentedFifoPolicy::remove(RegionId rid) {
+  std::lock_guard<TimedMutex> lock{mutex_};
+  for (auto& segment : segments_) {
+    auto it =
+        std::find_if(segment.begin(), segment.end(),
+                     [rid](const detail::Node& n) { return n.rid == rid; });
+    if (it != segment.end()) {
+      segment.erase(it);
+      rebalanceLocked();
+      return true;
+    }
+  }
+  return false;
+}
+
 void SegmentedFifoPolicy::rebalanceLocked() {
   auto regionsTracked = numElementsLocked();
 
@@ -38,6 +38,13 @@ struct Node {
     return getSteadyClockSeconds() - trackTime;
   }
 };
+
+// Erases the first node of @queue that is not skipped, passing over at most
+// @maxSkips nodes, or the front node if only skipped nodes are left. Returns
+// the region of the node erased, or an invalid region if @queue is empty.
+RegionId eraseFirstNotSkipped(std::deque<Node>& queue,
+                              folly::FunctionRef<bool(RegionId)> skip,
+                              uint32_t maxSkips);
 } // namespace detail
 
 // Simple FIFO policy
@@ -56,6 +63,13 @@ class FifoPolicy final : public EvictionPolicy {
   // Evicts the first added region and stops tracking.
   RegionId evict() override;
 
+  // Evicts the first added region that is not skipped.
+  RegionId evictSkipping(folly::FunctionRef<bool(RegionId)> skip,
+                         uint32_t maxSkips) override;
+
+  // Removes the region from the queue.
+  bool remove(RegionId rid) override;
+
   // Resets FIFO policy to the initial state.
   void reset() override;
 
@@ -128,6 +142,14 @@ class SegmentedFifoPolicy final : public EvictionPolicy {
   // Evicts the region with the lowest priority and stops tracking.
   RegionId evict() override;
 
+  // Evicts the first added region of the lowest priority segment that is not
+  // skipped.
+  RegionId evictSkipping(folly::FunctionRef<bool(RegionId)> skip,
+                         uint32_t maxSkips) override;
+
+  // Removes the region from its segment.
+  bool remove(RegionId rid) override;
+
   // Resets Segmented FIFO policy to the initial state.
   void reset() override;
 
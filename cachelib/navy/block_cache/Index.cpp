@@ -18,6 +18,14 @@
 
 #include <folly/Format.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "cachelib/navy/serialization/Serialization.h"
 
 namespace facebook::cachelib::navy {
@@ -94,6 +102,24 @@ Index::LookupResult Index::insert(uint64_t key,
   return lr;
 }
 
+bool Index::insertIfNewer(uint64_t key,
+                          uint32_t address,
+                          uint16_t sizeHint,
+                          folly::FunctionRef<bool(const ItemRecord&)> isNewer) {
+  auto& map = getMap(key);
+  auto lock = std::lock_guard{getMutex(key)};
+  auto it = map.find(subkey(key));
+  if (it != map.end()) {
+    if (!isNewer(it->second)) {
+      return false;
+    }
+    it.value() = ItemRecord{address, sizeHint};
+  } else {
+    map.try_emplace(key, address, sizeHint);
+  }
+  return true;
+}
+
 bool Index::replaceIfMatch(uint64_t key,
                            uint32_t newAddress,
                            uint32_t oldAddress) {
@@ -163,43 +189,196 @@ size_t Index::computeSize() const {
   return size;
 }
 
-void Index::persist(RecordWriter& rw) const {
+uint32_t Index::getNumPersistThreads() {
+  return std::clamp(std::thread::hardware_concurrency(), 1u,
+                    kMaxPersistThreads);
+}
+
+std::unique_ptr<folly::IOBuf> Index::serializeBucket(uint32_t bucketId) const {
   serialization::IndexBucket bucket;
-  for (uint32_t i = 0; i < kNumBuckets; i++) {
-    *bucket.bucketId() = i;
-    // Convert index entries to thrift objects
-    for (const auto& [key, record] : buckets_[i]) {
-      serialization::IndexEntry entry;
-      entry.key() = key;
-      entry.address() = record.address;
-      entry.sizeHint() = record.sizeHint;
-      entry.totalHits() = record.totalHits;
-      entry.currentHits() = record.currentHits;
-      bucket.entries()->push_back(entry);
+  *bucket.bucketId() = bucketId;
+  // Convert index entries to thrift objects
+  bucket.entries()->reserve(buckets_[bucketId].size());
+  for (const auto& [key, record] : buckets_[bucketId]) {
+    serialization::IndexEntry entry;
+    entry.key() = key;
+    entry.address() = record.address;
+    entry.sizeHint() = record.sizeHint;
+    entry.totalHits() = record.totalHits;
+    entry.currentHits() = record.currentHits;
+    bucket.entries()->push_back(entry);
+  }
+  folly::IOBufQueue queue;
+  ProtoSerializer::serialize(bucket, &queue);
+  return queue.move();
+}
+
+void Index::persist(RecordWriter& rw) const {
+  const uint32_t numThreads = getNumPersistThreads();
+  // Serialized buckets not yet written, at index bucket id % window
+  const uint32_t window = numThreads * kPersistBucketsPerThread;
+  std::vector<std::unique_ptr<folly::IOBuf>> pending(window);
+  uint32_t numWritten = 0;
+  bool aborted = false;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  auto abort = [&](std::exception_ptr e) {
+    std::lock_guard<std::mutex> l{mutex};
+    if (!error) {
+      error = std::move(e);
     }
-    // Serialize bucket then clear contents to reuse memory.
-    serializeProto(bucket, rw);
-    bucket.entries()->clear();
+    aborted = true;
+    cv.notify_all();
+  };
+
+  std::vector<std::thread> workers;
+  for (uint32_t t = 0; t < numThreads; t++) {
+    workers.emplace_back([&, t] {
+      try {
+        for (uint32_t i = t; i < kNumBuckets; i += numThreads) {
+          auto buf = serializeBucket(i);
+          std::unique_lock<std::mutex> l{mutex};
+          cv.wait(l, [&] { return aborted || i < numWritten + window; });
+          if (aborted) {
+            return;
+          }
+          pending[i % window] = std::move(buf);
+          cv.notify_all();
+        }
+      } catch (...) {
+        abort(std::current_exception());
+      }
+    });
+  }
+
+  try {
+    // Records must be written in bucket order
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+      std::unique_ptr<folly::IOBuf> buf;
+      {
+        std::unique_lock<std::mutex> l{mutex};
+        cv.wait(l, [&] { return aborted || pending[i % window] != nullptr; });
+        if (aborted) {
+          break;
+        }
+        buf = std::move(pending[i % window]);
+        numWritten++;
+        cv.notify_all();
+      }
+      rw.writeRecord(std::move(buf));
+      if ((i + 1) % (kNumBuckets / 8) == 0) {
+        XLOGF(INFO, "Index persist: {}% done", (i + 1) * 100ull / kNumBuckets);
+      }
+    }
+  } catch (...) {
+    abort(std::current_exception());
+  }
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void Index::recoverBucket(const folly::IOBuf& buf) {
+  serialization::IndexBucket bucket;
+  ProtoSerializer::deserialize<serialization::IndexBucket>(&buf, bucket);
+  uint32_t id = *bucket.bucketId();
+  if (id >= kNumBuckets) {
+    throw std::invalid_argument{
+        folly::sformat("Invalid bucket id. Max buckets: {}, bucket id: {}",
+                       kNumBuckets,
+                       id)};
+  }
+  auto lock = std::lock_guard{getMutexOfBucket(id)};
+  for (auto& entry : *bucket.entries()) {
+    buckets_[id].try_emplace(*entry.key(),
+                             *entry.address(),
+                             *entry.sizeHint(),
+                             *entry.totalHits(),
+                             *entry.currentHits());
   }
 }
 
 void Index::recover(RecordReader& rr) {
-  for (uint32_t i = 0; i < kNumBuckets; i++) {
-    auto bucket = deserializeProto<serialization::IndexBucket>(rr);
-    uint32_t id = *bucket.bucketId();
-    if (id >= kNumBuckets) {
-      throw std::invalid_argument{
-          folly::sformat("Invalid bucket id. Max buckets: {}, bucket id: {}",
-                         kNumBuckets,
-                         id)};
+  const uint32_t numThreads = getNumPersistThreads();
+  // Records read but not yet parsed
+  const uint32_t window = numThreads * kPersistBucketsPerThread;
+  std::deque<std::unique_ptr<folly::IOBuf>> pending;
+  bool doneReading = false;
+  bool aborted = false;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  auto abort = [&](std::exception_ptr e) {
+    std::lock_guard<std::mutex> l{mutex};
+    if (!error) {
+      error = std::move(e);
     }
-    for (auto& entry : *bucket.entries()) {
-      buckets_[id].try_emplace(*entry.key(),
-                               *entry.address(),
-                               *entry.sizeHint(),
-                               *entry.totalHits(),
-                               *entry.currentHits());
+    aborted = true;
+    cv.notify_all();
+  };
+
+  std::vector<std::thread> workers;
+  for (uint32_t t = 0; t < numThreads; t++) {
+    workers.emplace_back([&] {
+      try {
+        while (true) {
+          std::unique_ptr<folly::IOBuf> buf;
+          {
+            std::unique_lock<std::mutex> l{mutex};
+            cv.wait(l, [&] {
+              return aborted || doneReading || !pending.empty();
+            });
+            if (aborted || pending.empty()) {
+              return;
+            }
+            buf = std::move(pending.front());
+            pending.pop_front();
+            cv.notify_all();
+          }
+          recoverBucket(*buf);
+        }
+      } catch (...) {
+        abort(std::current_exception());
+      }
+    });
+  }
+
+  try {
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+      auto buf = rr.readRecord();
+      std::unique_lock<std::mutex> l{mutex};
+      cv.wait(l, [&] { return aborted || pending.size() < window; });
+      if (aborted) {
+        break;
+      }
+      pending.push_back(std::move(buf));
+      cv.notify_all();
+      l.unlock();
+      if ((i + 1) % (kNumBuckets / 8) == 0) {
+        XLOGF(INFO, "Index recovery: {}% read", (i + 1) * 100ull / kNumBuckets);
+      }
     }
+  } catch (...) {
+    abort(std::current_exception());
+  }
+
+  {
+    std::lock_guard<std::mutex> l{mutex};
+    doneReading = true;
+    cv.notify_all();
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
   }
 }
 
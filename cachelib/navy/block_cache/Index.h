@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <folly/Function.h>
 #include <folly/Portability.h>
 #include <folly/fibers/TimedMutex.h>
+#include <folly/io/IOBuf.h>
 #include <folly/stats/QuantileEstimator.h>
 #include <tsl/sparse_map.h>
 
@@ -52,10 +54,13 @@ class Index {
 
   // Writes index to a Thrift object one bucket at a time and passes each bucket
   // to @persistCb. The reason for this is because the index can be very large
-  // and serializing everything at once uses a lot of RAM.
+  // and serializing everything at once uses a lot of RAM. Buckets are
+  // serialized on several threads, a bounded window of them ahead of the
+  // writer.
   void persist(RecordWriter& rw) const;
 
-  // Resets index then inserts entries read from @deserializer. Throws
+  // Resets index then inserts entries read from @deserializer. Records are
+  // read on the calling thread and parsed on several threads. Throws
   // std::exception on failure.
   void recover(RecordReader& rr);
 
@@ -128,6 +133,16 @@ class Index {
   // record.
   LookupResult insert(uint64_t key, uint32_t address, uint16_t sizeHint);
 
+  // Inserts @key unless it exists and @isNewer returns false for its record.
+  // @isNewer is called under the bucket lock. Used to resolve duplicates when
+  // the index is rebuilt from the device.
+  //
+  // @return true if inserted.
+  bool insertIfNewer(uint64_t key,
+                     uint32_t address,
+                     uint16_t sizeHint,
+                     folly::FunctionRef<bool(const ItemRecord&)> isNewer);
+
   // Replaces old address with new address if there exists the key with the
   // identical old address. Current hits will be reset after successful replace.
   // All other fields in the record is retained.
@@ -160,6 +175,10 @@ class Index {
  private:
   static constexpr uint32_t kNumBuckets{64 * 1024};
   static constexpr uint32_t kNumMutexes{1024};
+  // Max threads used to serialize or parse buckets in persist and recover
+  static constexpr uint32_t kMaxPersistThreads{8};
+  // Serialized buckets each persist thread may have in flight
+  static constexpr uint32_t kPersistBucketsPerThread{4};
 
   using Map = tsl::sparse_map<uint32_t, ItemRecord>;
 
@@ -186,6 +205,14 @@ class Index {
 
   void trackRemove(uint8_t totalHits);
 
+  // Serializes bucket @bucketId into a record
+  std::unique_ptr<folly::IOBuf> serializeBucket(uint32_t bucketId) const;
+
+  // Parses a record written by serializeBucket and inserts its entries
+  void recoverBucket(const folly::IOBuf& buf);
+
+  static uint32_t getNumPersistThreads();
+
   // Experiments with 64 byte alignment didn't show any throughput test
   // performance improvement.
   std::unique_ptr<SharedMutex[]> mutex_{new SharedMutex[kNumMutexes]};
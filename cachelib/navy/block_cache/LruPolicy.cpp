@@ -66,6 +66,11 @@ void LruPolicy::track(const Region& region) {
 }
 
 RegionId LruPolicy::evict() {
+  return evictSkipping([](RegionId) { return false; }, 0);
+}
+
+RegionId LruPolicy::evictSkipping(folly::FunctionRef<bool(RegionId)> skip,
+                                  uint32_t maxSkips) {
   uint32_t retRegion{kInvalidIndex};
   uint32_t secsSinceAccess{0};
   uint32_t secsSinceCreate{0};
@@ -77,10 +82,19 @@ RegionId LruPolicy::evict() {
       return RegionId{};
     }
     retRegion = tail_;
-    secsSinceCreate = array_[tail_].secondsSinceCreation().count();
-    secsSinceAccess = array_[tail_].secondsSinceAccess().count();
-    hits = array_[tail_].hits;
-    unlink(tail_);
+    for (uint32_t skips = 0;
+         retRegion != kInvalidIndex && skips < maxSkips &&
+         skip(RegionId{retRegion});
+         skips++) {
+      retRegion = array_[retRegion].prev;
+    }
+    if (retRegion == kInvalidIndex) {
+      retRegion = tail_;
+    }
+    secsSinceCreate = array_[retRegion].secondsSinceCreation().count();
+    secsSinceAccess = array_[retRegion].secondsSinceAccess().count();
+    hits = array_[retRegion].hits;
+    unlink(retRegion);
   }
 
   secSinceInsertionEstimator_.trackValue(secsSinceCreate);
@@ -89,6 +103,18 @@ RegionId LruPolicy::evict() {
   return RegionId{retRegion};
 }
 
+bool LruPolicy::remove(RegionId rid) {
+  XDCHECK(rid.valid());
+  auto i = rid.index();
+  std::lock_guard<TimedMutex> lock{mutex_};
+  // The only region in the list has no neighbours
+  if (i >= array_.size() || (!array_[i].inList() && head_ != i)) {
+    return false;
+  }
+  unlink(i);
+  return true;
+}
+
 void LruPolicy::reset() {
   std::lock_guard<TimedMutex> lock{mutex_};
   array_.clear();
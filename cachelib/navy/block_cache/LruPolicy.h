@@ -51,6 +51,13 @@ class LruPolicy final : public EvictionPolicy {
   // Evicts the least recently used region and stops tracking.
   RegionId evict() override;
 
+  // Evicts the least recently used region that is not skipped.
+  RegionId evictSkipping(folly::FunctionRef<bool(RegionId)> skip,
+                         uint32_t maxSkips) override;
+
+  // Unlinks the region from the list.
+  bool remove(RegionId rid) override;
+
   // Resets LRU policy to the initial state.
   void reset() override;
 
@@ -16,6 +16,8 @@
 
 #include "cachelib/navy/block_cache/Region.h"
 
+#include <algorithm>
+
 #include "cachelib/navy/common/NavyThread.h"
 
 namespace facebook::cachelib::navy {
@@ -127,9 +129,25 @@ void Region::reset() {
   activeInMemReaders_ = 0;
   lastEntryEndOffset_ = 0;
   numItems_ = 0;
+  liveBytes_ = 0;
+  maxExpiryTime_ = 0;
+  slots_.clear();
   cond_.notifyAll();
 }
 
+std::vector<Region::Slot> Region::getSortedSlots() const {
+  std::vector<Slot> slots;
+  {
+    std::lock_guard<TimedMutex> l{lock_};
+    slots = slots_;
+  }
+  // Concurrent writers may record their slots out of allocation order
+  std::sort(slots.begin(), slots.end(), [](const Slot& a, const Slot& b) {
+    return a.endOffset < b.endOffset;
+  });
+  return slots;
+}
+
 void Region::close(RegionDescriptor&& desc) {
   std::lock_guard<TimedMutex> l{lock_};
   switch (desc.mode()) {
@@ -181,4 +199,12 @@ void Region::readFromBuffer(uint32_t fromOffset,
   memcpy(outBuf.data(), buffer_->data() + fromOffset, outBuf.size());
 }
 
+BufferView Region::viewFromBuffer(uint32_t fromOffset, uint32_t size) const {
+  std::lock_guard l{lock_};
+  XDCHECK_NE(buffer_, nullptr);
+  XDCHECK_GT(activeInMemReaders_, 0u);
+  XDCHECK_LE(fromOffset + size, buffer_->size());
+  return buffer_->view().slice(fromOffset, size);
+}
+
 } // namespace facebook::cachelib::navy
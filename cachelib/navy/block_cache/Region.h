@@ -16,8 +16,14 @@
 
 #pragma once
 
+#include <folly/Function.h>
+#include <folly/Portability.h>
 #include <folly/fibers/TimedMutex.h>
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include "cachelib/common/ConditionVariable.h"
 #include "cachelib/navy/block_cache/Types.h"
 #include "cachelib/navy/common/Types.h"
@@ -68,7 +74,13 @@ class Region {
         regionSize_{regionSize},
         priority_{static_cast<uint16_t>(*d.priority())},
         lastEntryEndOffset_{static_cast<uint32_t>(*d.lastEntryEndOffset())},
-        numItems_{static_cast<uint32_t>(*d.numItems())} {}
+        numItems_{static_cast<uint32_t>(*d.numItems())},
+        // Metadata written before live bytes were tracked has no value for
+        // it. Assume everything is live, which at worst costs a full read.
+        liveBytes_{*d.liveBytes() < 0
+                       ? lastEntryEndOffset_
+                       : static_cast<uint32_t>(*d.liveBytes())},
+        maxExpiryTime_{static_cast<uint32_t>(*d.maxExpiryTime())} {}
 
   // Disable copy constructor to avoid mistakes like below:
   //   auto r = RegionManager.getRegion(rid);
@@ -122,6 +134,77 @@ class Region {
     return numItems_;
   }
 
+  // Gets the number of bytes in this region that are still referenced by the
+  // index. Removed and overwritten entries do not count.
+  uint32_t getLiveBytes() const {
+    std::lock_guard<TimedMutex> l{lock_};
+    return liveBytes_;
+  }
+
+  // Accounts @bytes of a newly written entry as live. Must be called while
+  // the region is open for write.
+  void addLiveBytes(uint32_t bytes) {
+    std::lock_guard<TimedMutex> l{lock_};
+    liveBytes_ += bytes;
+  }
+
+  // Accounts @bytes of an entry as no longer live if @isCurrent returns
+  // true. @isCurrent is evaluated under the region lock so that the caller
+  // can make sure the region has not been reclaimed (and reset) since the
+  // entry was unlinked from the index.
+  void removeLiveBytes(uint32_t bytes, folly::FunctionRef<bool()> isCurrent) {
+    std::lock_guard<TimedMutex> l{lock_};
+    if (isCurrent()) {
+      liveBytes_ -= std::min(bytes, liveBytes_);
+    }
+  }
+
+  // Gets the latest expiry time (seconds since epoch) of the entries written to
+  // this region. 0 if unknown, UINT32_MAX if any entry never expires.
+  uint32_t getMaxExpiryTime() const {
+    std::lock_guard<TimedMutex> l{lock_};
+    return maxExpiryTime_;
+  }
+
+  // Accounts an entry expiring at @expiryTime. 0 means never expires.
+  void updateMaxExpiryTime(uint32_t expiryTime) {
+    std::lock_guard<TimedMutex> l{lock_};
+    maxExpiryTime_ = std::max(
+        maxExpiryTime_,
+        expiryTime == 0 ? std::numeric_limits<uint32_t>::max() : expiryTime);
+  }
+
+  // Checks whether every entry of this region has expired at @currentTime.
+  // Regions whose entries' expiry is unknown never expire.
+  bool isExpired(uint32_t currentTime) const {
+    std::lock_guard<TimedMutex> l{lock_};
+    return maxExpiryTime_ != 0 && maxExpiryTime_ < currentTime;
+  }
+
+  // A slot written to this region, identified by the key hash of its entry.
+  struct FOLLY_PACK_ATTR Slot {
+    uint32_t endOffset{};
+    uint64_t keyHash{};
+  };
+
+  // Records the slot ending at @endOffset. This allows reclaim to tell live
+  // slots from dead ones without reading the region from the device.
+  void addSlot(uint32_t endOffset, uint64_t keyHash) {
+    std::lock_guard<TimedMutex> l{lock_};
+    slots_.push_back(Slot{endOffset, keyHash});
+  }
+
+  // Checks whether every slot allocated in this region has been recorded with
+  // addSlot. This is not the case for regions recovered from a previous run.
+  bool hasAllSlots() const {
+    std::lock_guard<TimedMutex> l{lock_};
+    return numItems_ != 0 && slots_.size() == numItems_;
+  }
+
+  // Returns the recorded slots sorted by their end offsets. Only meant to be
+  // called when the region is blocked for reclaim.
+  std::vector<Slot> getSortedSlots() const;
+
   // If this region is actively used, then the fragmentation
   // is the bytes at the end of the region that's not used.
   uint32_t getFragmentationSize() const {
@@ -138,6 +221,11 @@ class Region {
   // Reads from attached buffer from 'fromOffset' into 'outBuf'.
   void readFromBuffer(uint32_t fromOffset, MutableBufferView outBuf) const;
 
+  // Returns a view of 'size' bytes of the attached buffer at 'fromOffset'.
+  // The caller must hold the region open for read: this keeps the buffer
+  // from being detached while the view is in use.
+  BufferView viewFromBuffer(uint32_t fromOffset, uint32_t size) const;
+
   // Attaches buffer 'buf' to the region.
   void attachBuffer(std::unique_ptr<Buffer>&& buf) {
     std::lock_guard l{lock_};
@@ -229,6 +317,11 @@ class Region {
   // End offset of last slot added to region
   uint32_t lastEntryEndOffset_{0};
   uint32_t numItems_{0};
+  // Bytes of the entries that are still referenced by the index
+  uint32_t liveBytes_{0};
+  // Latest expiry time of the entries written to this region
+  uint32_t maxExpiryTime_{0};
+  std::vector<Slot> slots_;
   std::unique_ptr<Buffer> buffer_{nullptr};
 
   mutable TimedMutex lock_{TimedMutex::Options(false)};
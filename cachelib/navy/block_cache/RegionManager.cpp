@@ -16,6 +16,14 @@
 
 #include "cachelib/navy/block_cache/RegionManager.h"
 
+#include <folly/fibers/FiberManager.h>
+
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+#include "cachelib/common/Time.h"
 #include "cachelib/common/inject_pause.h"
 #include "cachelib/navy/common/Utils.h"
 
@@ -32,31 +40,87 @@ RegionManager::RegionManager(uint32_t numRegions,
                              std::unique_ptr<EvictionPolicy> policy,
                              uint32_t numInMemBuffers,
                              uint16_t numPriorities,
-                             uint16_t inMemBufFlushRetryLimit)
+                             uint16_t inMemBufFlushRetryLimit,
+                             double sparseReclaimThreshold,
+                             bool reclaimExpiredWithoutRead,
+                             bool reclaimDeadWithoutRead,
+                             uint32_t footerSize,
+                             uint32_t numFlushedBuffers,
+                             uint32_t numActiveRegions,
+                             uint32_t reclaimChunkSize)
     : numPriorities_{numPriorities},
       inMemBufFlushRetryLimit_{inMemBufFlushRetryLimit},
       numRegions_{numRegions},
       regionSize_{regionSize},
       baseOffset_{baseOffset},
+      sparseReclaimThreshold_{sparseReclaimThreshold},
+      reclaimExpiredWithoutRead_{reclaimExpiredWithoutRead},
+      reclaimDeadWithoutRead_{reclaimDeadWithoutRead},
+      footerSize_{footerSize},
+      reclaimChunkSize_{reclaimChunkSize},
       device_{device},
       policy_{std::move(policy)},
       regions_{std::make_unique<std::unique_ptr<Region>[]>(numRegions)},
       numCleanRegions_{numCleanRegions},
+      initialNumActiveRegions_{numActiveRegions == 0 ? numRegions
+                                                     : numActiveRegions},
+      numActiveRegions_{initialNumActiveRegions_},
+      retired_(numRegions),
       evictCb_{evictCb},
       cleanupCb_{cleanupCb},
       numInMemBuffers_{numInMemBuffers},
+      numFlushedBuffers_{numFlushedBuffers},
       placementHandle_{device_.allocatePlacementHandle()} {
   XLOGF(INFO, "{} regions, {} bytes each", numRegions_, regionSize_);
+  if (footerSize_ > 0 && (footerSize_ < sizeof(RegionFooter) ||
+                          footerSize_ % device_.getIOAlignmentSize() != 0 ||
+                          footerSize_ >= regionSize_)) {
+    throw std::invalid_argument(
+        fmt::format("invalid region footer size: {}", footerSize_));
+  }
+  if (initialNumActiveRegions_ > numRegions_ ||
+      initialNumActiveRegions_ < numCleanRegions_) {
+    throw std::invalid_argument(
+        fmt::format("{} active regions out of {}", initialNumActiveRegions_,
+                    numRegions_));
+  }
+  if (reclaimChunkSize_ % device_.getIOAlignmentSize() != 0) {
+    throw std::invalid_argument(
+        fmt::format("invalid reclaim chunk size: {}", reclaimChunkSize_));
+  }
+  footerSeqNumber_.store(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count(),
+      std::memory_order_relaxed);
   for (uint32_t i = 0; i < numRegions; i++) {
-    regions_[i] = std::make_unique<Region>(RegionId{i}, regionSize_);
+    regions_[i] = std::make_unique<Region>(RegionId{i}, regionDataSize());
+  }
+  if (footerSize_ > 0) {
+    footerSeqNumbers_.resize(numRegions_);
   }
 
   XDCHECK_LT(0u, numInMemBuffers_);
 
+  std::vector<MutableBufferView> bufferViews;
   for (uint32_t i = 0; i < numInMemBuffers_; i++) {
     buffers_.push_back(
         std::make_unique<Buffer>(device.makeIOBuffer(regionSize_)));
+    bufferViews.push_back(buffers_.back()->mutableView());
   }
+  if (numFlushedBuffers_ > 0) {
+    XLOGF(INFO, "Keeping up to {} flushed region buffers for reads",
+          numFlushedBuffers_);
+    hasFlushedBuffer_ = std::make_unique<std::atomic<bool>[]>(numRegions_);
+    for (uint32_t i = 0; i < numFlushedBuffers_; i++) {
+      spareFlushedBuffers_.push_back(
+          std::make_unique<Buffer>(device.makeIOBuffer(regionSize_)));
+      bufferViews.push_back(spareFlushedBuffers_.back()->mutableView());
+    }
+  }
+  // In-mem buffers live as long as the region manager, so the device may
+  // pin them once instead of on every flush
+  device_.registerIOBuffers(bufferViews);
 
   for (uint32_t i = 0; i < numWorkers; i++) {
     auto name = fmt::format("region_manager_{}", i);
@@ -66,11 +130,29 @@ RegionManager::RegionManager(uint32_t numRegions,
     workers_.back()->addTaskRemote(
         [name]() { XLOGF(INFO, "{} started", name); });
   }
+  if (device_.isDiscardEnabled()) {
+    discardWorker_ = std::make_unique<NavyThread>(
+        "region_discard", NavyThread::Options(stackSize));
+  }
   resetEvictionPolicy();
 }
 
 RegionId RegionManager::evict() {
-  auto rid = policy_->evict();
+  // Keep regions on a degraded device out of the write rotation: pass over
+  // them, a bounded number of times. They stay tracked as they are, so their
+  // age still counts for the policy, and their data remains readable.
+  uint32_t numSkipped = 0;
+  auto rid = policy_->evictSkipping(
+      [this, &numSkipped](RegionId candidate) {
+        if (device_.isDegraded(physicalOffset(RelAddress{candidate, 0}))) {
+          numSkipped++;
+          return true;
+        }
+        return false;
+      },
+      kMaxDegradedEvictSkips);
+  degradedEvictSkips_.add(numSkipped);
+
   if (!rid.valid()) {
     XLOG(ERR, "Eviction failed");
   } else {
@@ -97,12 +179,19 @@ void RegionManager::reset() {
   for (uint32_t i = 0; i < numRegions_; i++) {
     regions_[i]->reset();
   }
+  if (numFlushedBuffers_ > 0) {
+    for (uint32_t i = 0; i < numRegions_; i++) {
+      dropFlushedBuffer(RegionId{i});
+    }
+  }
   {
     std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
     // Reset is inherently single threaded. All pending jobs, including
     // reclaims, have to be finished first.
     XDCHECK_EQ(reclaimsOutstanding_, 0u);
     cleanRegions_.clear();
+    numActiveRegions_.store(initialNumActiveRegions_,
+                            std::memory_order_release);
     if (cleanRegionsCond_.numWaiters() > 0) {
       cleanRegionsCond_.notifyAll();
     }
@@ -115,10 +204,14 @@ void RegionManager::reset() {
 
 Region::FlushRes RegionManager::flushBuffer(const RegionId& rid) {
   auto& region = getRegion(rid);
-  auto callBack = [this](RelAddress addr, BufferView view) {
-    auto writeBuffer = device_.makeIOBuffer(view.size());
-    writeBuffer.copyFrom(0, view);
-    if (!deviceWrite(addr, std::move(writeBuffer))) {
+  auto callBack = [this, &region](RelAddress addr, BufferView view) {
+    // There are no writers left, so the footer describes the final content
+    if (hasFooters()) {
+      writeFooter(region);
+    }
+    // Write straight from the in-mem buffer; the device makes its own copy
+    // only when it needs to encrypt
+    if (!deviceWrite(addr, view)) {
       return false;
     }
     numInMemBufWaitingFlush_.dec();
@@ -134,9 +227,64 @@ void RegionManager::detachBuffer(const RegionId& rid) {
   // detach buffer can return nullptr if there are active readers
   auto buf = region.detachBuffer();
   XDCHECK(!!buf);
+  if (numFlushedBuffers_ > 0) {
+    buf = keepFlushedBuffer(rid, std::move(buf));
+  }
   returnBufferToPool(std::move(buf));
 }
 
+std::unique_ptr<Buffer> RegionManager::keepFlushedBuffer(
+    RegionId rid, std::unique_ptr<Buffer> buf) {
+  std::unique_ptr<Buffer> freed;
+  std::lock_guard<TimedMutex> lock{flushedBuffersMutex_};
+  if (!spareFlushedBuffers_.empty()) {
+    freed = std::move(spareFlushedBuffers_.back());
+    spareFlushedBuffers_.pop_back();
+  } else {
+    XDCHECK(!flushedBuffers_.empty());
+    auto& lru = flushedBuffers_.front();
+    hasFlushedBuffer_[lru.rid.index()].store(false, std::memory_order_release);
+    freed = std::move(lru.buffer);
+    flushedBuffers_.erase(flushedBuffers_.begin());
+  }
+  flushedBuffers_.push_back(FlushedBuffer{rid, std::move(buf)});
+  hasFlushedBuffer_[rid.index()].store(true, std::memory_order_release);
+  return freed;
+}
+
+Buffer RegionManager::readFlushedBuffer(RelAddress addr, size_t size) const {
+  if (!hasFlushedBuffer_[addr.rid().index()].load(std::memory_order_acquire)) {
+    return Buffer{};
+  }
+  std::lock_guard<TimedMutex> lock{flushedBuffersMutex_};
+  auto it = std::find_if(
+      flushedBuffers_.begin(), flushedBuffers_.end(),
+      [rid = addr.rid()](const FlushedBuffer& fb) { return fb.rid == rid; });
+  if (it == flushedBuffers_.end()) {
+    return Buffer{};
+  }
+  auto buffer = Buffer(size);
+  std::memcpy(buffer.data(), it->buffer->data() + addr.offset(), size);
+  // Move to the most recently used end
+  std::rotate(it, it + 1, flushedBuffers_.end());
+  return buffer;
+}
+
+void RegionManager::dropFlushedBuffer(RegionId rid) {
+  if (!hasFlushedBuffer_[rid.index()].load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<TimedMutex> lock{flushedBuffersMutex_};
+  auto it = std::find_if(
+      flushedBuffers_.begin(), flushedBuffers_.end(),
+      [rid](const FlushedBuffer& fb) { return fb.rid == rid; });
+  if (it != flushedBuffers_.end()) {
+    spareFlushedBuffers_.push_back(std::move(it->buffer));
+    flushedBuffers_.erase(it);
+  }
+  hasFlushedBuffer_[rid.index()].store(false, std::memory_order_release);
+}
+
 void RegionManager::cleanupBufferOnFlushFailure(const RegionId& regionId) {
   auto& region = getRegion(regionId);
   auto callBack = [this](RegionId rid, BufferView buffer) {
@@ -147,7 +295,10 @@ void RegionManager::cleanupBufferOnFlushFailure(const RegionId& regionId) {
 
   // This is no-op if the buffer is already cleaned up.
   region.cleanupBuffer(std::move(callBack));
-  detachBuffer(regionId);
+  // The buffer never made it to the device, so it is not kept for reads
+  auto buf = region.detachBuffer();
+  XDCHECK(!!buf);
+  returnBufferToPool(std::move(buf));
 }
 
 void RegionManager::releaseCleanedupRegion(RegionId rid) {
@@ -164,12 +315,73 @@ void RegionManager::releaseCleanedupRegion(RegionId rid) {
   region.reset();
   {
     std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
-    cleanRegions_.push_back(rid);
-    INJECT_PAUSE(pause_blockcache_clean_free_locked);
-    if (cleanRegionsCond_.numWaiters() > 0) {
-      cleanRegionsCond_.notifyAll();
+    releaseCleanRegionLocked(rid);
+  }
+}
+
+void RegionManager::releaseCleanRegionLocked(RegionId rid) {
+  if (rid.index() >= numActiveRegions_.load(std::memory_order_relaxed)) {
+    retired_[rid.index()] = true;
+    return;
+  }
+  cleanRegions_.push_back(rid);
+  INJECT_PAUSE(pause_blockcache_clean_free_locked);
+  if (cleanRegionsCond_.numWaiters() > 0) {
+    cleanRegionsCond_.notifyAll();
+  }
+}
+
+void RegionManager::setNumActiveRegions(uint32_t numActive) {
+  if (numActive == 0 || numActive < numCleanRegions_ ||
+      numActive > numRegions_) {
+    throw std::invalid_argument(fmt::format(
+        "cannot make {} out of {} regions active with {} clean regions",
+        numActive, numRegions_, numCleanRegions_));
+  }
+  std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
+  numActiveRegions_.store(numActive, std::memory_order_release);
+  for (uint32_t i = 0; i < numActive; i++) {
+    if (retired_[i]) {
+      retired_[i] = false;
+      cleanRegions_.push_back(RegionId{i});
     }
   }
+  // Clean regions hold no data and are retired right away
+  auto it = std::remove_if(
+      cleanRegions_.begin(), cleanRegions_.end(),
+      [numActive](RegionId rid) { return rid.index() >= numActive; });
+  for (auto cur = it; cur != cleanRegions_.end(); ++cur) {
+    retired_[cur->index()] = true;
+  }
+  cleanRegions_.erase(it, cleanRegions_.end());
+  if (cleanRegionsCond_.numWaiters() > 0) {
+    cleanRegionsCond_.notifyAll();
+  }
+}
+
+bool RegionManager::retireInactiveRegions() {
+  std::vector<RegionId> pending;
+  {
+    std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
+    for (uint32_t i = getNumActiveRegions(); i < numRegions_; i++) {
+      if (!retired_[i]) {
+        pending.push_back(RegionId{i});
+      }
+    }
+  }
+  for (auto rid : pending) {
+    // Only one of this and a reclaim takes a region off the policy
+    if (!policy_->remove(rid)) {
+      continue;
+    }
+    {
+      std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
+      // Accounted like any other reclaim until the region is released
+      reclaimsOutstanding_++;
+    }
+    getNextWorker().addTaskRemote([this, rid]() { reclaimRegion(rid); });
+  }
+  return pending.empty();
 }
 
 std::pair<OpenStatus, std::unique_ptr<CondWaiter>>
@@ -243,11 +455,7 @@ RegionManager::getCleanRegion(RegionId& rid, bool addWaiter) {
     std::tie(status, waiter) = assignBufferToRegion(rid, addWaiter);
     if (status != OpenStatus::Ready) {
       std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
-      cleanRegions_.push_back(rid);
-      INJECT_PAUSE(pause_blockcache_clean_free_locked);
-      if (cleanRegionsCond_.numWaiters() > 0) {
-        cleanRegionsCond_.notifyAll();
-      }
+      releaseCleanRegionLocked(rid);
     }
   } else if (status == OpenStatus::Retry) {
     cleanRegionRetries_.inc();
@@ -300,8 +508,12 @@ void RegionManager::doFlushInternal(RegionId rid) {
   INJECT_PAUSE(pause_flush_detach_buffer);
   detachBuffer(rid);
 
-  // Flush completed, track the region
+  // Flush completed, track the region. If it was deactivated while it was
+  // written, it is reclaimed and retired instead.
   track(rid);
+  if (rid.index() >= getNumActiveRegions()) {
+    retireInactiveRegions();
+  }
   INJECT_PAUSE(pause_flush_done);
   return;
 }
@@ -322,7 +534,11 @@ void RegionManager::doReclaim() {
     // This should never happen
     XDCHECK(false);
   }
+  reclaimRegion(rid);
+  INJECT_PAUSE(pause_reclaim_done);
+}
 
+void RegionManager::reclaimRegion(RegionId rid) {
   const auto startTime = getSteadyClock();
   auto& region = getRegion(rid);
   bool status = region.readyForReclaim(true);
@@ -332,25 +548,50 @@ void RegionManager::doReclaim() {
   // Hence, it's safe to access @Region without lock.
   if (region.getNumItems() != 0) {
     XDCHECK(!region.hasBuffer());
-    auto desc = RegionDescriptor::makeReadDescriptor(
-        OpenStatus::Ready, RegionId{rid}, true /* physRead */);
-    auto sizeToRead = region.getLastEntryEndOffset();
-    auto buffer = read(desc, RelAddress{rid, 0}, sizeToRead);
-    if (buffer.size() != sizeToRead) {
-      // TODO: remove when we fix T95777575
-      XLOGF(ERR,
-            "Failed to read region {} during reclaim. Region size to "
-            "read: {}, Actually read: {}",
-            rid.index(),
-            sizeToRead,
-            buffer.size());
-      reclaimRegionErrors_.inc();
+    if (reclaimDeadWithoutRead_ && region.getLiveBytes() == 0) {
+      // Every entry was removed or overwritten. There is nothing to read
+      // back, the callback only has to account for the dead slots.
+      reclaimNoReadCount_.inc();
+      doEviction(rid, BufferView{});
+    } else if (isExpired(region)) {
+      reclaimExpiredCount_.inc();
+      doEviction(rid, BufferView{});
+    } else if (isSparse(region)) {
+      reclaimSparseCount_.inc();
+      doEviction(rid, BufferView{});
+    } else if (reclaimChunkSize_ > 0 &&
+               region.getLastEntryEndOffset() > reclaimChunkSize_) {
+      // The evict callback reads the region a chunk at a time, so a reclaim
+      // never holds a whole region in memory
+      reclaimStreamedCount_.inc();
+      doEviction(rid, BufferView{});
     } else {
-      doEviction(rid, buffer.view());
+      auto sizeToRead = region.getLastEntryEndOffset();
+      auto buffer = reclaimRead(RelAddress{rid, 0}, sizeToRead);
+      if (!buffer.isNull()) {
+        doEviction(rid, buffer.view());
+      }
     }
   }
+  if (numFlushedBuffers_ > 0) {
+    dropFlushedBuffer(rid);
+  }
+  if (hasFooters()) {
+    invalidateFooter(rid);
+  }
+  if (discardWorker_) {
+    // Nothing writes the region until it is released to the clean list, so
+    // its old data can be discarded before that rather than kept alive by
+    // the SSD's garbage collection until the region is rewritten. Discards
+    // block, so they run on their own thread instead of holding up the
+    // reclaim workers.
+    discardWorker_->addTaskRemote([this, rid, startTime]() {
+      device_.discard(physicalOffset(RelAddress{rid, 0}), regionDataSize());
+      releaseEvictedRegion(rid, startTime);
+    });
+    return;
+  }
   releaseEvictedRegion(rid, startTime);
-  INJECT_PAUSE(pause_reclaim_done);
 }
 
 RegionDescriptor RegionManager::openForRead(RegionId rid, uint64_t seqNumber) {
@@ -424,36 +665,76 @@ void RegionManager::releaseEvictedRegion(RegionId rid,
   {
     std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
     reclaimsOutstanding_--;
-    cleanRegions_.push_back(rid);
-    INJECT_PAUSE(pause_blockcache_clean_free_locked);
-    if (cleanRegionsCond_.numWaiters() > 0) {
-      cleanRegionsCond_.notifyAll();
-    }
+    releaseCleanRegionLocked(rid);
   }
   reclaimTimeCountUs_.add(toMicros(getSteadyClock() - startTime).count());
   reclaimCount_.inc();
 }
 
+bool RegionManager::isExpired(const Region& region) const {
+  return reclaimExpiredWithoutRead_ && region.hasAllSlots() &&
+         region.isExpired(util::getCurrentTimeSec());
+}
+
+bool RegionManager::isSparse(const Region& region) const {
+  return sparseReclaimThreshold_ > 0 && region.hasAllSlots() &&
+         region.getLiveBytes() <=
+             region.getLastEntryEndOffset() * sparseReclaimThreshold_;
+}
+
+Buffer RegionManager::reclaimRead(RelAddress addr, size_t size) const {
+  auto desc = RegionDescriptor::makeReadDescriptor(
+      OpenStatus::Ready, addr.rid(), true /* physRead */);
+  auto buffer = read(desc, addr, size, IoClass::Reclaim);
+  if (buffer.size() != size) {
+    // TODO: remove when we fix T95777575
+    XLOGF(ERR,
+          "Failed to read region {} during reclaim. Offset: {}, size to read: "
+          "{}, Actually read: {}",
+          addr.rid().index(),
+          addr.offset(),
+          size,
+          buffer.size());
+    reclaimRegionErrors_.inc();
+    return Buffer{};
+  }
+  reclaimReadBytes_.add(size);
+  return buffer;
+}
+
+std::unique_ptr<PendingReclaimRead> RegionManager::reclaimReadAhead(
+    RelAddress addr, size_t size) const {
+  auto read = std::make_unique<PendingReclaimRead>();
+  if (!folly::fibers::onFiber()) {
+    read->buffer_ = reclaimRead(addr, size);
+    read->baton_.post();
+    return read;
+  }
+  // The read outlives neither @read nor this, since destroying @read waits
+  folly::fibers::addTask([this, addr, size, r = read.get()]() {
+    r->buffer_ = reclaimRead(addr, size);
+    r->baton_.post();
+  });
+  return read;
+}
+
 void RegionManager::doEviction(RegionId rid, BufferView buffer) const {
   INJECT_PAUSE(pause_do_eviction_start);
-  if (buffer.isNull()) {
-    XLOGF(ERR, "Error reading region {} on reclamation", rid.index());
-  } else {
-    const auto evictStartTime = getSteadyClock();
-    XLOGF(DBG, "Evict region {} entries", rid.index());
-    auto numEvicted = evictCb_(rid, buffer);
-    XLOGF(DBG,
-          "Evict region {} entries: {} us",
-          rid.index(),
-          toMicros(getSteadyClock() - evictStartTime).count());
-    evictedCount_.add(numEvicted);
-  }
+  const auto evictStartTime = getSteadyClock();
+  XLOGF(DBG, "Evict region {} entries", rid.index());
+  auto numEvicted = evictCb_(rid, buffer);
+  XLOGF(DBG,
+        "Evict region {} entries: {} us",
+        rid.index(),
+        toMicros(getSteadyClock() - evictStartTime).count());
+  evictedCount_.add(numEvicted);
   INJECT_PAUSE(pause_do_eviction_done);
 }
 
 void RegionManager::persist(RecordWriter& rw) const {
   serialization::RegionData regionData;
   *regionData.regionSize() = regionSize_;
+  *regionData.numActiveRegions() = getNumActiveRegions();
   regionData.regions()->resize(numRegions_);
   for (uint32_t i = 0; i < numRegions_; i++) {
     auto& regionProto = regionData.regions()[i];
@@ -461,6 +742,8 @@ void RegionManager::persist(RecordWriter& rw) const {
     *regionProto.lastEntryEndOffset() = regions_[i]->getLastEntryEndOffset();
     regionProto.priority() = regions_[i]->getPriority();
     *regionProto.numItems() = regions_[i]->getNumItems();
+    *regionProto.liveBytes() = regions_[i]->getLiveBytes();
+    *regionProto.maxExpiryTime() = regions_[i]->getMaxExpiryTime();
   }
   serializeProto(regionData, rw);
 }
@@ -468,10 +751,17 @@ void RegionManager::persist(RecordWriter& rw) const {
 void RegionManager::recover(RecordReader& rr) {
   auto regionData = deserializeProto<serialization::RegionData>(rr);
   if (regionData.regions()->size() != numRegions_ ||
-      static_cast<uint32_t>(*regionData.regionSize()) != regionSize_) {
+      static_cast<uint32_t>(*regionData.regionSize()) != regionSize_ ||
+      static_cast<uint32_t>(*regionData.numActiveRegions()) > numRegions_) {
     throw std::invalid_argument(
         "Could not recover RegionManager. Invalid RegionData.");
   }
+  {
+    std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
+    auto numActive = static_cast<uint32_t>(*regionData.numActiveRegions());
+    numActiveRegions_.store(numActive == 0 ? numRegions_ : numActive,
+                            std::memory_order_release);
+  }
 
   for (auto& regionProto : *regionData.regions()) {
     uint32_t index = *regionProto.regionId();
@@ -487,23 +777,159 @@ void RegionManager::recover(RecordReader& rr) {
     if (numPriorities_ > 0 && regionProto.priority() >= numPriorities_) {
       regionProto.priority() = numPriorities_ - 1;
     }
-    regions_[index] =
-        std::make_unique<Region>(regionProto, *regionData.regionSize());
+    regions_[index] = std::make_unique<Region>(regionProto, regionDataSize());
   }
 
   // Reset policy and reinitialize it per the recovered state
   resetEvictionPolicy();
 }
 
+void RegionManager::writeFooter(Region& region) {
+  RegionFooter footer;
+  footer.seqNumber = footerSeqNumber_.fetch_add(1, std::memory_order_relaxed);
+  footer.regionSize = static_cast<uint32_t>(regionSize_);
+  footer.lastEntryEndOffset = region.getLastEntryEndOffset();
+  footer.numItems = region.getNumItems();
+  footer.priority = region.getPriority();
+  footer.csSelf = footer.computeChecksum();
+  footerSeqNumbers_[region.id().index()] = footer.seqNumber;
+  region.writeToBuffer(regionSize_ - sizeof(RegionFooter),
+                       BufferView{sizeof(RegionFooter),
+                                  reinterpret_cast<const uint8_t*>(&footer)});
+}
+
+std::optional<RegionManager::RegionFooter> RegionManager::readFooter(
+    RegionId rid) const {
+  RelAddress addr{rid, static_cast<uint32_t>(regionDataSize())};
+  auto buffer = device_.read(physicalOffset(addr), footerSize_,
+                             IoClass::Reclaim);
+  if (buffer.size() != footerSize_) {
+    reclaimRegionErrors_.inc();
+    return std::nullopt;
+  }
+  RegionFooter footer;
+  memcpy(&footer,
+         buffer.data() + footerSize_ - sizeof(RegionFooter),
+         sizeof(RegionFooter));
+  if (footer.magic != kFooterMagic ||
+      footer.csSelf != footer.computeChecksum() ||
+      footer.regionSize != regionSize_ || footer.numItems == 0 ||
+      footer.lastEntryEndOffset > regionDataSize()) {
+    return std::nullopt;
+  }
+  return footer;
+}
+
+void RegionManager::invalidateFooter(RegionId rid) {
+  auto buffer = device_.makeIOBuffer(footerSize_);
+  memset(buffer.data(), 0, footerSize_);
+  RelAddress addr{rid, static_cast<uint32_t>(regionDataSize())};
+  footerSeqNumbers_[rid.index()] = 0;
+  if (!device_.write(physicalOffset(addr), std::move(buffer), placementHandle_,
+                     IoClass::Flush)) {
+    // The region may come back after a crash, with entries that were evicted
+    footerInvalidateErrors_.inc();
+    XLOG_EVERY_MS(ERR, 10'000)
+        << fmt::format("Failed to invalidate footer of region {}", rid.index());
+  }
+}
+
+uint32_t RegionManager::rebuild(const RegionScanCallback& scanCb,
+                                uint32_t numThreads) {
+  XDCHECK(hasFooters());
+  reset();
+
+  // Runs @fn for every region on @numThreads threads. Regions are handed out
+  // one at a time, so no more than @numThreads device reads are in flight.
+  auto forEachRegion = [this, numThreads](auto fn) {
+    std::atomic<uint32_t> next{0};
+    auto run = [&]() {
+      // Inactive regions may have been overwritten by another engine
+      for (uint32_t i = next++; i < getNumActiveRegions(); i = next++) {
+        fn(RegionId{i});
+      }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t t = 1; t < numThreads; t++) {
+      threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  };
+
+  // All footers are read first, so that the sequence numbers of every region
+  // are known while their entries are scanned.
+  std::vector<std::optional<RegionFooter>> footers(numRegions_);
+  forEachRegion([&](RegionId rid) {
+    footers[rid.index()] = readFooter(rid);
+    footerSeqNumbers_[rid.index()] =
+        footers[rid.index()] ? footers[rid.index()]->seqNumber : 0;
+  });
+
+  std::atomic<uint32_t> numRestored{0};
+  forEachRegion([&](RegionId rid) {
+    const auto& footer = footers[rid.index()];
+    if (!footer) {
+      return;
+    }
+    auto buffer = device_.read(physicalOffset(RelAddress{rid, 0}),
+                               footer->lastEntryEndOffset,
+                               IoClass::Reclaim);
+    if (buffer.size() != footer->lastEntryEndOffset) {
+      reclaimRegionErrors_.inc();
+      footerSeqNumbers_[rid.index()] = 0;
+      return;
+    }
+    serialization::Region regionProto;
+    *regionProto.regionId() = rid.index();
+    *regionProto.lastEntryEndOffset() = footer->lastEntryEndOffset;
+    regionProto.priority() =
+        numPriorities_ > 0
+            ? std::min<uint16_t>(footer->priority, numPriorities_ - 1)
+            : 0;
+    *regionProto.numItems() = footer->numItems;
+    // Entries superseded by a newer region are not known yet
+    *regionProto.liveBytes() = footer->lastEntryEndOffset;
+    regions_[rid.index()] =
+        std::make_unique<Region>(regionProto, regionDataSize());
+    scanCb(rid, buffer.view());
+    numRestored++;
+  });
+
+  // Keep footers written from now on newer than the restored ones, even if
+  // the clock went back
+  auto maxSeqNumber =
+      *std::max_element(footerSeqNumbers_.begin(), footerSeqNumbers_.end());
+  if (footerSeqNumber_.load() <= maxSeqNumber) {
+    footerSeqNumber_.store(maxSeqNumber + 1);
+  }
+
+  resetEvictionPolicy();
+  XLOGF(INFO, "Rebuilt {} out of {} regions", numRestored.load(),
+        getNumActiveRegions());
+  return numRestored.load();
+}
+
 void RegionManager::resetEvictionPolicy() {
   XDCHECK_GT(numRegions_, 0u);
 
   policy_->reset();
   externalFragmentation_.set(0);
 
+  // Inactive regions are not tracked
+  const auto numActive = getNumActiveRegions();
+  {
+    std::lock_guard<TimedMutex> lock{cleanRegionsMutex_};
+    for (uint32_t i = 0; i < numRegions_; i++) {
+      retired_[i] = i >= numActive;
+    }
+  }
+
   // Go through all the regions, restore fragmentation size, and track all empty
   // regions
-  for (uint32_t i = 0; i < numRegions_; i++) {
+  for (uint32_t i = 0; i < numActive; i++) {
     externalFragmentation_.add(regions_[i]->getFragmentationSize());
     if (regions_[i]->getNumItems() == 0) {
       track(RegionId{i});
@@ -512,7 +938,7 @@ void RegionManager::resetEvictionPolicy() {
 
   // Now track all non-empty regions. This should ensure empty regions are
   // pushed to the bottom for both LRU and FIFO policies.
-  for (uint32_t i = 0; i < numRegions_; i++) {
+  for (uint32_t i = 0; i < numActive; i++) {
     if (regions_[i]->getNumItems() != 0) {
       track(RegionId{i});
     }
@@ -527,7 +953,8 @@ bool RegionManager::deviceWrite(RelAddress addr, Buffer buf) {
   const auto bufSize = buf.size();
   XDCHECK(isValidIORange(addr.offset(), bufSize));
   auto physOffset = physicalOffset(addr);
-  if (!device_.write(physOffset, std::move(buf), placementHandle_)) {
+  if (!device_.write(physOffset, std::move(buf), placementHandle_,
+                     IoClass::Flush)) {
     return false;
   }
   physicalWrittenCount_.add(bufSize);
@@ -538,7 +965,7 @@ bool RegionManager::deviceWrite(RelAddress addr, BufferView view) {
   const auto bufSize = view.size();
   XDCHECK(isValidIORange(addr.offset(), bufSize));
   auto physOffset = physicalOffset(addr);
-  if (!device_.write(physOffset, view, placementHandle_)) {
+  if (!device_.write(physOffset, view, placementHandle_, IoClass::Flush)) {
     return false;
   }
   physicalWrittenCount_.add(bufSize);
@@ -553,7 +980,8 @@ void RegionManager::write(RelAddress addr, Buffer buf) {
 
 Buffer RegionManager::read(const RegionDescriptor& desc,
                            RelAddress addr,
-                           size_t size) const {
+                           size_t size,
+                           IoClass ioClass) const {
   auto rid = addr.rid();
   auto& region = getRegion(rid);
   // Do not expect to read beyond what was already written
@@ -566,13 +994,37 @@ Buffer RegionManager::read(const RegionDescriptor& desc,
   }
   XDCHECK(isValidIORange(addr.offset(), size));
 
-  return device_.read(physicalOffset(addr), size);
+  if (numFlushedBuffers_ > 0) {
+    auto buffer = readFlushedBuffer(addr, size);
+    if (!buffer.isNull()) {
+      flushedBufferHits_.inc();
+      return buffer;
+    }
+    flushedBufferMisses_.inc();
+  }
+  return device_.read(physicalOffset(addr), size, ioClass);
+}
+
+BufferView RegionManager::readView(const RegionDescriptor& desc,
+                                   RelAddress addr,
+                                   size_t size) const {
+  if (desc.isPhysReadMode()) {
+    return {};
+  }
+  auto& region = getRegion(addr.rid());
+  XDCHECK_LE(addr.offset() + size, region.getLastEntryEndOffset());
+  XDCHECK(region.hasBuffer());
+  return region.viewFromBuffer(addr.offset(), size);
 }
 
 void RegionManager::drain() {
   for (auto& worker : workers_) {
     worker->drain();
   }
+  // Reclaims drained above may have handed their regions over for discard
+  if (discardWorker_) {
+    discardWorker_->drain();
+  }
 }
 
 void RegionManager::flush() {
@@ -591,7 +1043,26 @@ void RegionManager::getCounters(const CounterVisitor& visitor) const {
   visitor("navy_bc_evictions",
           evictedCount_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_reclaim_no_read", reclaimNoReadCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_reclaim_sparse", reclaimSparseCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_reclaim_expired", reclaimExpiredCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_reclaim_streamed", reclaimStreamedCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_reclaim_read_bytes", reclaimReadBytes_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_degraded_evict_skips", degradedEvictSkips_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_footer_invalidate_errors", footerInvalidateErrors_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_flushed_buffer_hits", flushedBufferHits_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_bc_flushed_buffer_misses", flushedBufferMisses_.get(),
+          CounterVisitor::CounterType::RATE);
   visitor("navy_bc_num_regions", numRegions_);
+  visitor("navy_bc_num_active_regions", getNumActiveRegions());
   visitor("navy_bc_num_clean_regions", cleanRegions_.size());
   visitor("navy_bc_num_clean_region_retries", cleanRegionRetries_.get(),
           CounterVisitor::CounterType::RATE);
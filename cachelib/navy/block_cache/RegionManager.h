@@ -18,10 +18,12 @@
 
 #include <folly/Random.h>
 #include <folly/container/F14Map.h>
+#include <folly/fibers/Baton.h>
 #include <folly/fibers/TimedMutex.h>
 
 #include <cassert>
 #include <memory>
+#include <optional>
 #include <utility>
 
 #include "cachelib/common/AtomicCounter.h"
@@ -31,6 +33,7 @@
 #include "cachelib/navy/block_cache/Types.h"
 #include "cachelib/navy/common/Buffer.h"
 #include "cachelib/navy/common/Device.h"
+#include "cachelib/navy/common/Hash.h"
 #include "cachelib/navy/common/NavyThread.h"
 #include "cachelib/navy/common/Types.h"
 #include "cachelib/navy/serialization/RecordIO.h"
@@ -44,7 +47,12 @@ using CondWaiter = util::ConditionVariable::Waiter;
 
 // Callback that is used to clear index.
 //   @rid       Region ID
-//   @buffer    Buffer with region data, valid during callback invocation
+//   @buffer    Buffer with region data, valid during callback invocation.
+//              Empty if the region was not read because it holds no, only
+//              expired or only sparse live data, or because it is larger
+//              than the reclaim chunk size. The callback is then expected to
+//              read the entries itself if it needs them, at most a chunk at
+//              a time (see RegionManager::reclaimReadAhead).
 // Returns number of slots evicted
 using RegionEvictCallback =
     std::function<uint32_t(RegionId rid, BufferView buffer)>;
@@ -55,6 +63,36 @@ using RegionEvictCallback =
 using RegionCleanupCallback =
     std::function<void(RegionId rid, BufferView buffer)>;
 
+// Callback that is used to rebuild the index from a region read back from the
+// device by RegionManager::rebuild.
+//   @rid       Region ID
+//   @buffer    Region data up to the end of its last entry, valid during
+//              callback invocation
+using RegionScanCallback = std::function<void(RegionId rid, BufferView buffer)>;
+
+// A read of a region being reclaimed that runs on its own fiber, so that the
+// reclaim can process the data it read before meanwhile. Destroying it waits
+// for the read to finish.
+class PendingReclaimRead {
+ public:
+  PendingReclaimRead() = default;
+  PendingReclaimRead(const PendingReclaimRead&) = delete;
+  PendingReclaimRead& operator=(const PendingReclaimRead&) = delete;
+  ~PendingReclaimRead() { baton_.wait(); }
+
+  // Waits for the read to finish. Returns a null buffer if it failed.
+  Buffer get() {
+    baton_.wait();
+    return std::move(buffer_);
+  }
+
+ private:
+  friend class RegionManager;
+
+  folly::fibers::Baton baton_;
+  Buffer buffer_;
+};
+
 // Size class or stack allocator. Thread safe. Syncs access, reclaims regions
 // Controls the allocation of regions, status (open for read/write), and
 // eviction. Region manager doesn't have internal locks. External caller must
@@ -81,6 +119,30 @@ class RegionManager {
   //                                  regions
   // @param inMemBufFlushRetryLimit   max number of flushing retry times for
   //                                  in-mem buffer
+  // @param sparseReclaimThreshold    fraction of a region's written bytes
+  //                                  below which reclaim reads only the live
+  //                                  entries of a region whose slots are all
+  //                                  recorded. 0 disables sparse reclaim.
+  // @param reclaimExpiredWithoutRead whether a region whose entries have all
+  //                                  expired and whose slots are all recorded
+  //                                  is reclaimed without reading it
+  // @param reclaimDeadWithoutRead    whether a region none of whose entries
+  //                                  are live is reclaimed without reading it
+  // @param footerSize                bytes reserved at the end of every region
+  //                                  for a RegionFooter. Must be a multiple of
+  //                                  the device IO alignment. 0 disables
+  //                                  footers.
+  // @param numFlushedBuffers         number of flushed region buffers kept
+  //                                  in memory to serve reads before going
+  //                                  to the device. 0 disables it.
+  // @param numActiveRegions          number of regions, counted from the
+  //                                  first, that hold cache data initially.
+  //                                  0 means all of them.
+  // @param reclaimChunkSize          regions written past this many bytes
+  //                                  are not read whole during reclaim; the
+  //                                  evict callback streams through them.
+  //                                  Must be a multiple of the device IO
+  //                                  alignment. 0 reads whole regions.
   RegionManager(uint32_t numRegions,
                 uint64_t regionSize,
                 uint64_t baseOffset,
@@ -93,18 +155,52 @@ class RegionManager {
                 std::unique_ptr<EvictionPolicy> policy,
                 uint32_t numInMemBuffers,
                 uint16_t numPriorities,
-                uint16_t inMemBufFlushRetryLimit);
+                uint16_t inMemBufFlushRetryLimit,
+                double sparseReclaimThreshold = 0,
+                bool reclaimExpiredWithoutRead = false,
+                bool reclaimDeadWithoutRead = false,
+                uint32_t footerSize = 0,
+                uint32_t numFlushedBuffers = 0,
+                uint32_t numActiveRegions = 0,
+                uint32_t reclaimChunkSize = 0);
   RegionManager(const RegionManager&) = delete;
   RegionManager& operator=(const RegionManager&) = delete;
 
   // Destroy the worker thread for safety first
-  ~RegionManager() { workers_.clear(); }
+  ~RegionManager() {
+    workers_.clear();
+    // Reclaims hand their regions over to the discard worker
+    discardWorker_.reset();
+  }
 
   // return the size of usable space
   uint64_t getSize() const {
-    return static_cast<uint64_t>(numRegions_) * regionSize_;
+    return static_cast<uint64_t>(getNumActiveRegions()) * regionSize_;
+  }
+
+  // Returns the number of regions of the layout, active or not
+  uint32_t getNumRegions() const { return numRegions_; }
+
+  // Returns the number of regions, counted from the first, that hold cache
+  // data. The regions above them are retired: they are neither tracked by
+  // the eviction policy nor handed out as clean regions.
+  uint32_t getNumActiveRegions() const {
+    return numActiveRegions_.load(std::memory_order_acquire);
   }
 
+  // Makes the first @numActive regions the active ones. Retired regions
+  // below @numActive become clean regions right away. Regions at or above it
+  // are retired once they are reclaimed; see retireInactiveRegions().
+  // Throws std::invalid_argument if fewer regions than the clean pool would
+  // stay active.
+  void setNumActiveRegions(uint32_t numActive);
+
+  // Schedules the reclaim of every inactive region tracked by the eviction
+  // policy. Inactive regions that are being written are retired after they
+  // are flushed and reclaimed. Returns true once every inactive region is
+  // retired and its space can be used by someone else.
+  bool retireInactiveRegions();
+
   // Gets a region from a valid region ID.
   Region& getRegion(RegionId rid) {
     XDCHECK(rid.valid());
@@ -118,7 +214,7 @@ class RegionManager {
   }
 
   const RegionId getRandomRegion() const {
-    return RegionId{folly::Random::rand32(0, numRegions_)};
+    return RegionId{folly::Random::rand32(0, getNumActiveRegions())};
   }
   // Flushes the in memory buffer attached to a region in either async or
   // sync mode.
@@ -129,6 +225,45 @@ class RegionManager {
   // Returns the size of one region.
   uint64_t regionSize() const { return regionSize_; }
 
+  // Returns the bytes of a region that entries can be allocated from.
+  uint64_t regionDataSize() const { return regionSize_ - footerSize_; }
+
+  // Identifies a RegionFooter ("RGFT")
+  static constexpr uint32_t kFooterMagic{0x52474654};
+
+  // Written at the end of a region when its buffer is flushed, if footers are
+  // enabled. Describes the entries of the region so that its state can be
+  // rebuilt by scanning the device when no metadata was persisted.
+  struct RegionFooter {
+    // Flush sequence number. Grows across restarts; the higher one wins when
+    // a key is found in more than one region.
+    uint64_t seqNumber{};
+    uint32_t magic{kFooterMagic};
+    uint32_t regionSize{};
+    uint32_t lastEntryEndOffset{};
+    uint32_t numItems{};
+    uint16_t priority{};
+    uint16_t reserved{};
+    uint32_t csSelf{};
+
+    uint32_t computeChecksum() const {
+      return checksum(BufferView{offsetof(RegionFooter, csSelf),
+                                 reinterpret_cast<const uint8_t*>(this)});
+    }
+  };
+  static_assert(sizeof(RegionFooter) == 32, "packed struct required");
+
+  // Returns whether regions are written with a footer.
+  bool hasFooters() const { return footerSize_ > 0; }
+
+  // Returns the sequence number of the last footer written to or restored
+  // from region @rid, 0 if none. Only meaningful with footers. Not
+  // synchronized with flushes: meant for rebuild.
+  uint64_t getFooterSeqNumber(RegionId rid) const {
+    XDCHECK(hasFooters());
+    return footerSeqNumbers_[rid.index()];
+  }
+
   // Gets a region to evict.
   RegionId evict();
 
@@ -192,7 +327,40 @@ class RegionManager {
   // On success the returned buffer will have same size as "size" argument.
   // Caller must check the size of the buffer returned to determine if this
   // succeeded or not.
-  Buffer read(const RegionDescriptor& desc, RelAddress addr, size_t size) const;
+  // @ioClass tags the device read for in-flight limiting.
+  Buffer read(const RegionDescriptor& desc,
+              RelAddress addr,
+              size_t size,
+              IoClass ioClass = IoClass::UserRead) const;
+
+  // Returns a view of @size bytes at @addr if the region is still served from
+  // its in-mem buffer, or a null view if it has to be read from the device.
+  // The view stays valid as long as @desc is open.
+  BufferView readView(const RegionDescriptor& desc,
+                      RelAddress addr,
+                      size_t size) const;
+
+  // Reads @size bytes at @addr of a region that is being reclaimed. Returns
+  // an empty buffer on failure.
+  Buffer reclaimRead(RelAddress addr, size_t size) const;
+
+  // Starts reclaimRead(@addr, @size) on a separate fiber of the calling
+  // fiber's thread. Outside of a fiber the read is done right away.
+  std::unique_ptr<PendingReclaimRead> reclaimReadAhead(RelAddress addr,
+                                                       size_t size) const;
+
+  // Size of the chunks the entries of a region are read in during reclaim.
+  // 0 if regions are read whole.
+  uint32_t getReclaimChunkSize() const { return reclaimChunkSize_; }
+
+  // Accounts @bytes of an entry in region @rid as no longer live. The entry
+  // must already be unlinked from the index. @seqNumber has to be loaded
+  // before the entry was unlinked. If a reclamation finished since then, the
+  // region may have been reset, and the bytes are not subtracted.
+  void removeLiveBytes(RegionId rid, uint32_t bytes, uint64_t seqNumber) {
+    getRegion(rid).removeLiveBytes(
+        bytes, [this, seqNumber]() { return getSeqNumber() == seqNumber; });
+  }
 
   // Flushes all in memory buffers to the device and then issues device flush.
   void flush();
@@ -207,6 +375,8 @@ class RegionManager {
   Region::FlushRes flushBuffer(const RegionId& rid);
 
   // Detaches the buffer from the region and returns the buffer to pool.
+  // If flushed buffers are kept, the detached buffer is kept to serve reads
+  // of the region and the least recently used kept buffer goes to the pool.
   // This could block if there are active readers
   void detachBuffer(const RegionId& rid);
 
@@ -225,6 +395,15 @@ class RegionManager {
   // failure.
   void recover(RecordReader& rr);
 
+  // Resets RegionManager and restores every region that has a valid footer on
+  // the device, calling @scanCb with its data. Regions are read on up to
+  // @numThreads threads, so @scanCb must be thread safe. The footer sequence
+  // numbers of all regions are known before @scanCb is first called.
+  // Requires footers.
+  //
+  // @return  the number of regions restored
+  uint32_t rebuild(const RegionScanCallback& scanCb, uint32_t numThreads);
+
   // Exports RegionManager stats via CounterVisitor.
   void getCounters(const CounterVisitor& visitor) const;
 
@@ -284,11 +463,56 @@ class RegionManager {
     return workerSet_.count(thread) > 0;
   }
 
+  // Max eviction candidates passed over per evict() because they live on a
+  // degraded device
+  static constexpr uint32_t kMaxDegradedEvictSkips{8};
+
   void doReclaim();
   void doFlushInternal(RegionId rid);
 
+  // Evicts the entries of @rid, which has been taken off the eviction
+  // policy, and releases it
+  void reclaimRegion(RegionId rid);
+
+  // Puts @rid on the clean list, or retires it if it is inactive. Requires
+  // cleanRegionsMutex_.
+  void releaseCleanRegionLocked(RegionId rid);
+
+  // Checks whether the live entries of @region are few enough to be read
+  // one extent at a time during reclaim.
+  bool isSparse(const Region& region) const;
+
+  // Checks whether every entry of @region has expired so it can be dropped
+  // without being read.
+  bool isExpired(const Region& region) const;
+
   bool deviceWrite(RelAddress addr, BufferView buf);
 
+  // Keeps @buf, the flushed buffer of @rid, to serve reads and returns the
+  // buffer that is given up for it (a spare or the least recently used one)
+  std::unique_ptr<Buffer> keepFlushedBuffer(RegionId rid,
+                                            std::unique_ptr<Buffer> buf);
+
+  // Copies @size bytes at @addr from the kept flushed buffer of its region.
+  // Returns a null buffer if the region has no kept buffer.
+  Buffer readFlushedBuffer(RelAddress addr, size_t size) const;
+
+  // Stops serving reads of @rid from a kept buffer, before the region is
+  // reused
+  void dropFlushedBuffer(RegionId rid);
+
+  // Writes the footer of region @rid into its attached buffer
+  void writeFooter(Region& region);
+
+  // Reads the footer of region @rid from the device. Returns std::nullopt if
+  // the region has no valid footer, e.g. it was reclaimed since it was
+  // flushed.
+  std::optional<RegionFooter> readFooter(RegionId rid) const;
+
+  // Overwrites the footer of region @rid on the device, so a reclaimed
+  // region is not picked up by rebuild.
+  void invalidateFooter(RegionId rid);
+
   bool isValidIORange(uint32_t offset, uint32_t size) const;
   std::pair<OpenStatus, std::unique_ptr<CondWaiter>> assignBufferToRegion(
       RegionId rid, bool addWaiter);
@@ -303,6 +527,11 @@ class RegionManager {
   const uint32_t numRegions_{};
   const uint64_t regionSize_{};
   const uint64_t baseOffset_{};
+  const double sparseReclaimThreshold_{};
+  const bool reclaimExpiredWithoutRead_{};
+  const bool reclaimDeadWithoutRead_{};
+  const uint32_t footerSize_{};
+  const uint32_t reclaimChunkSize_{};
   Device& device_;
   const std::unique_ptr<EvictionPolicy> policy_;
   std::unique_ptr<std::unique_ptr<Region>[]> regions_;
@@ -315,9 +544,20 @@ class RegionManager {
   mutable util::ConditionVariable cleanRegionsCond_;
   std::vector<RegionId> cleanRegions_;
   const uint32_t numCleanRegions_{};
+  // Active regions after a reset
+  const uint32_t initialNumActiveRegions_{};
+  // Written under cleanRegionsMutex_
+  std::atomic<uint32_t> numActiveRegions_{0};
+  // Per region: whether it is retired. Guarded by cleanRegionsMutex_.
+  std::vector<bool> retired_;
   mutable AtomicCounter cleanRegionRetries_;
 
   std::atomic<uint64_t> seqNumber_{0};
+  // Next RegionFooter::seqNumber. Starts from the wall clock (in
+  // microseconds) so that it keeps growing across restarts.
+  std::atomic<uint64_t> footerSeqNumber_{0};
+  // Sequence number of the current footer of each region
+  std::vector<uint64_t> footerSeqNumbers_;
 
   uint32_t reclaimsOutstanding_{0};
 
@@ -325,6 +565,9 @@ class RegionManager {
   // async flushes will be run in-line on fiber by the async NavyThread itself
   std::vector<std::unique_ptr<NavyThread>> workers_;
   std::unordered_set<NavyThread*> workerSet_;
+  // Discards reclaimed regions before they are released to the clean list.
+  // Only set up if the device discards.
+  std::unique_ptr<NavyThread> discardWorker_;
   mutable AtomicCounter numReclaimScheduled_;
 
   const RegionEvictCallback evictCb_;
@@ -338,6 +581,19 @@ class RegionManager {
   mutable AtomicCounter reclaimCount_;
   mutable AtomicCounter reclaimTimeCountUs_;
   mutable AtomicCounter evictedCount_;
+  // Reclaims that skipped reading the region because it had no live data
+  mutable AtomicCounter reclaimNoReadCount_;
+  // Reclaims that read only the live extents of the region
+  mutable AtomicCounter reclaimSparseCount_;
+  // Reclaims that skipped reading the region because all entries expired
+  mutable AtomicCounter reclaimExpiredCount_;
+  // Reclaims that left it to the evict callback to read the region in chunks
+  mutable AtomicCounter reclaimStreamedCount_;
+  mutable AtomicCounter reclaimReadBytes_;
+  // Eviction candidates passed over because their device was degraded
+  mutable AtomicCounter degradedEvictSkips_;
+  // Footers of reclaimed regions that could not be overwritten
+  mutable AtomicCounter footerInvalidateErrors_;
 
   // Stats to keep track of inmem buffer usage
   mutable AtomicCounter numInMemBufActive_;
@@ -350,6 +606,24 @@ class RegionManager {
   mutable TimedMutex bufferMutex_;
   mutable util::ConditionVariable bufferCond_;
   std::vector<std::unique_ptr<Buffer>> buffers_;
+
+  // Flushed region buffers kept to serve reads, least recently used first.
+  // Each has been swapped out of the pool for a spare buffer or for the
+  // buffer it evicted, so the pool keeps numInMemBuffers_ buffers.
+  struct FlushedBuffer {
+    RegionId rid;
+    std::unique_ptr<Buffer> buffer;
+  };
+  const uint32_t numFlushedBuffers_{0};
+  mutable TimedMutex flushedBuffersMutex_;
+  mutable std::vector<FlushedBuffer> flushedBuffers_;
+  std::vector<std::unique_ptr<Buffer>> spareFlushedBuffers_;
+  // Per region: whether it may have a kept buffer. Lets reads of other
+  // regions skip flushedBuffersMutex_.
+  std::unique_ptr<std::atomic<bool>[]> hasFlushedBuffer_;
+  mutable AtomicCounter flushedBufferHits_;
+  mutable AtomicCounter flushedBufferMisses_;
+
   int placementHandle_;
 };
 } // namespace navy
@@ -24,6 +24,7 @@
 #include "cachelib/allocator/nvmcache/NavyConfig.h"
 #include "cachelib/common/ConditionVariable.h"
 #include "cachelib/common/Hash.h"
+#include "cachelib/common/Time.h"
 #include "cachelib/common/Utils.h"
 #include "cachelib/common/inject_pause.h"
 #include "cachelib/navy/block_cache/BlockCache.h"
@@ -46,7 +47,7 @@ namespace facebook::cachelib::navy::tests {
 namespace {
 constexpr uint64_t kDeviceSize{64 * 1024};
 constexpr uint64_t kRegionSize{16 * 1024};
-constexpr size_t kSizeOfEntryDesc{24};
+constexpr size_t kSizeOfEntryDesc{32};
 constexpr uint16_t kFlushRetryLimit{5};
 
 std::unique_ptr<JobScheduler> makeJobScheduler() {
@@ -333,6 +334,41 @@ TEST(BlockCache, AsyncCallbacks) {
   driver->flush();
 }
 
+TEST(BlockCache, LookupViewAsync) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.numInMemBuffers = 1;
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  // The first 16 entries fill region 0, which gets flushed to the device when
+  // the 17th entry opens region 1. The last entry is served from the in-mem
+  // buffer.
+  std::vector<CacheEntry> log;
+  BufferGen bg;
+  for (size_t i = 0; i < 17; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insert(e.key(), e.value()));
+    log.push_back(std::move(e));
+  }
+
+  // Lookups complete before flush() writes out the in-mem buffer
+  MockLookupCB cbLookup;
+  auto cb = [&cbLookup](Status status, HashedKey key, BufferView value) {
+    cbLookup.call(status, key, value);
+  };
+  for (const auto& e : log) {
+    EXPECT_CALL(cbLookup, call(Status::Ok, e.key(), e.value()));
+    driver->lookupViewAsync(e.key(), cb);
+  }
+  EXPECT_CALL(cbLookup, call(Status::NotFound, makeHK("cat"), BufferView{}));
+  driver->lookupViewAsync(makeHK("cat"), cb);
+  driver->flush();
+}
+
 TEST(BlockCache, Remove) {
   std::vector<CacheEntry> log;
 
@@ -432,22 +468,703 @@ TEST(BlockCache, PreciseRemove) {
         EXPECT_EQ(1, count);
       }
     }});
-  }
-}
+  }
+}
+
+TEST(BlockCache, CollisionOverwrite) {
+  auto collision = CollisionCreator("key", "value", "abc");
+  Buffer value;
+  // Original key is not found, because it didn't pass key equality check
+  EXPECT_EQ(Status::NotFound, collision.driver->lookup(makeHK("key"), value));
+}
+
+TEST(BlockCache, SimpleReclaim) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  // Allocator region fills every 16 inserts.
+  BufferGen bg;
+  std::vector<CacheEntry> log;
+  for (size_t j = 0; j < 3; j++) {
+    for (size_t i = 0; i < 16; i++) {
+      CacheEntry e{bg.gen(8), bg.gen(800)};
+      EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+      log.push_back(std::move(e));
+    }
+    driver->flush();
+  }
+
+  // This insert will trigger reclamation because there are 4 regions in total
+  // and the device was configured to require 1 clean region at all times
+  for (size_t i = 0; i < 16; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    log.push_back(std::move(e));
+  }
+  driver->flush();
+
+  // First 16 are reclaimed and so missing
+  for (size_t i = 0; i < 16; i++) {
+    Buffer value;
+    EXPECT_EQ(Status::NotFound, driver->lookup(log[i].key(), value));
+  }
+  for (size_t i = 16; i < log.size(); i++) {
+    Buffer value;
+    EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+    EXPECT_EQ(log[i].value(), value.view());
+  }
+}
+
+TEST(BlockCache, HoleStats) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  // items which are accessed once will be reinserted on reclaim
+  config.reinsertionConfig = makeHitsReinsertionConfig(1);
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  // Allocator region fills every 16 inserts.
+  BufferGen bg;
+  std::vector<CacheEntry> log;
+  for (size_t j = 0; j < 3; j++) {
+    for (size_t i = 0; i < 16; i++) {
+      CacheEntry e{bg.gen(8), bg.gen(800)};
+      EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+      log.push_back(std::move(e));
+    }
+    driver->flush();
+  }
+
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_hole_count") {
+      EXPECT_EQ(0, count);
+    }
+    if (name == "navy_bc_hole_bytes") {
+      EXPECT_EQ(0, count);
+    }
+  }});
+
+  // Remove 3 entries from region 0
+  EXPECT_EQ(Status::Ok, driver->remove(log[0].key()));
+  EXPECT_EQ(Status::Ok, driver->remove(log[1].key()));
+  EXPECT_EQ(Status::Ok, driver->remove(log[2].key()));
+
+  // Remove 2 entries from region 2
+  EXPECT_EQ(Status::Ok, driver->remove(log[33].key()));
+  EXPECT_EQ(Status::Ok, driver->remove(log[34].key()));
+
+  // Drain all async removes
+  driver->drain();
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_hole_count") {
+      EXPECT_EQ(5, count);
+    }
+    if (name == "navy_bc_hole_bytes") {
+      EXPECT_EQ(5 * 1024, count);
+    }
+  }});
+
+  // lookup this entry from region 0 that will be soon reclaimed
+  Buffer val;
+  EXPECT_EQ(Status::Ok, driver->lookup(log[4].key(), val));
+  EXPECT_EQ(Status::Ok, driver->lookup(log[4].key(), val));
+
+  // Force reclamation on region 0. There are 4 regions and the device
+  // was configured to require 1 clean region at all times.
+  {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    log.push_back(std::move(e));
+  }
+  driver->drain();
+
+  // Reclaiming region 0 should have bumped down the hole count to
+  // 2 remaining (from region 2)
+  driver->getCounters({[](folly::StringPiece name, double count,
+                          CounterVisitor::CounterType type) {
+    if (name == "navy_bc_reinsertions" &&
+        type == CounterVisitor::CounterType::RATE) {
+      EXPECT_EQ(1, count);
+    }
+    if (name == "navy_bc_hole_count") {
+      EXPECT_EQ(2, count);
+    }
+    // Initial 4 reclaims and 1 reclaim for region 0
+    if (name == "navy_bc_reclaim") {
+      EXPECT_EQ(5, count);
+    }
+    if (name == "navy_bc_hole_bytes") {
+      EXPECT_EQ(2 * 1024, count);
+    }
+  }});
+}
+
+TEST(BlockCache, StreamedReclaim) {
+  // Without slots the region is read from its end in chunks that entries
+  // straddle. With slots only the live runs are read, cut at the chunk size.
+  for (const double sparseReclaimThreshold : {0.0, 0.1}) {
+    std::vector<uint32_t> hits(4);
+    auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+    auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+    auto ex = makeJobScheduler();
+    auto config = makeConfig(*ex, std::move(policy), *device);
+    config.reinsertionConfig = makeHitsReinsertionConfig(1);
+    config.sparseReclaimThreshold = sparseReclaimThreshold;
+    // Two and a half entries per chunk
+    config.reclaimChunkSize = 2560;
+    auto engine = makeEngine(std::move(config));
+    auto driver = makeDriver(std::move(engine), std::move(ex));
+
+    // Allocator region fills every 16 inserts.
+    BufferGen bg;
+    std::vector<CacheEntry> log;
+    for (size_t j = 0; j < 3; j++) {
+      for (size_t i = 0; i < 16; i++) {
+        CacheEntry e{bg.gen(8), bg.gen(800)};
+        EXPECT_EQ(Status::Ok,
+                  driver->insertAsync(e.key(), e.value(), nullptr));
+        log.push_back(std::move(e));
+      }
+      driver->flush();
+    }
+
+    // Leave holes at the start of region 0 and get one entry reinserted
+    for (size_t i = 0; i < 3; i++) {
+      EXPECT_EQ(Status::Ok, driver->remove(log[i].key()));
+    }
+    driver->drain();
+    Buffer val;
+    EXPECT_EQ(Status::Ok, driver->lookup(log[4].key(), val));
+
+    // Force reclamation on region 0
+    {
+      CacheEntry e{bg.gen(8), bg.gen(800)};
+      EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+      log.push_back(std::move(e));
+    }
+    driver->drain();
+
+    driver->getCounters({[sparseReclaimThreshold](
+                             folly::StringPiece name, double count,
+                             CounterVisitor::CounterType type) {
+      if (name == "navy_bc_reclaim_streamed") {
+        EXPECT_EQ(1, count);
+      }
+      if (name == "navy_bc_reinsertions" &&
+          type == CounterVisitor::CounterType::RATE) {
+        EXPECT_EQ(1, count);
+      }
+      if (name == "navy_bc_evictions") {
+        EXPECT_EQ(12, count);
+      }
+      if (name == "navy_bc_hole_count") {
+        EXPECT_EQ(0, count);
+      }
+      if (name == "navy_bc_reclaim_read_bytes") {
+        if (sparseReclaimThreshold > 0) {
+          EXPECT_EQ(13 * 1024, count);
+        } else {
+          EXPECT_LE(16 * 1024, count);
+        }
+      }
+    }});
+
+    for (size_t i = 0; i < 16; i++) {
+      Buffer value;
+      EXPECT_EQ(i == 4 ? Status::Ok : Status::NotFound,
+                driver->lookup(log[i].key(), value));
+    }
+    for (size_t i = 16; i < log.size(); i++) {
+      Buffer value;
+      EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+      EXPECT_EQ(log[i].value(), value.view());
+    }
+  }
+}
+
+TEST(BlockCache, DiscardReclaimedRegion) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  device->setDiscard(true);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  // Fill three regions and move on to the last one, which reclaims
+  // region 0
+  BufferGen bg;
+  std::vector<CacheEntry> log;
+  for (size_t i = 0; i < 3 * 16 + 1; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    log.push_back(std::move(e));
+    driver->drain();
+  }
+
+  // Region 0 was discarded before it became clean again
+  Buffer region{kRegionSize};
+  EXPECT_TRUE(device->read(0, kRegionSize, region.data()));
+  for (size_t i = 0; i < kRegionSize; i++) {
+    ASSERT_EQ(0, region.data()[i]);
+  }
+  for (size_t i = 16; i < log.size(); i++) {
+    Buffer value;
+    EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+    EXPECT_EQ(log[i].value(), value.view());
+  }
+}
+
+TEST(BlockCache, ResizeWhileWritingAndReclaiming) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = std::make_unique<NiceMock<MockDevice>>(kDeviceSize, 1024);
+  SeqPoints sp;
+  EXPECT_CALL(*device, readImpl(_, _, _)).Times(testing::AnyNumber());
+  // The second reclaim of region 3 blocks until the resize is under way
+  EXPECT_CALL(*device, readImpl(3 * kRegionSize, kRegionSize, _))
+      .WillOnce(Invoke([md = device.get(), &sp](uint64_t offset, uint32_t size,
+                                                void* buffer) {
+        sp.reached(0);
+        sp.wait(1);
+        return md->getRealDeviceRef().read(offset, size, buffer);
+      }));
+  auto ex = makeJobScheduler();
+  auto exPtr = ex.get();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  auto engine = makeEngine(std::move(config));
+  auto blockCache = engine.get();
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  // Go around the regions one and a half times. The last insert opens
+  // region 2 for writes and reclaims region 3.
+  BufferGen bg;
+  std::vector<CacheEntry> log;
+  for (size_t i = 0; i < 6 * 16 + 1; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    log.push_back(std::move(e));
+    if (i < 6 * 16) {
+      driver->drain();
+    }
+  }
+  sp.wait(0);
+  exPtr->finish();
+
+  // Regions 2 and 3 are given up. The resize waits for both the write to
+  // region 2 and the reclaim of region 3.
+  auto resized = std::async(std::launch::async, [blockCache] {
+    return blockCache->resize(2 * kRegionSize);
+  });
+  EXPECT_EQ(std::future_status::timeout,
+            resized.wait_for(std::chrono::milliseconds{100}));
+  sp.reached(1);
+  EXPECT_EQ(2 * kRegionSize, resized.get());
+  EXPECT_EQ(2 * kRegionSize, blockCache->getSize());
+  driver->drain();
+
+  Buffer value;
+  for (size_t i = 0; i < log.size(); i++) {
+    // Regions 0 and 1 keep the entries of the second time around
+    if (i >= 4 * 16 && i < 6 * 16) {
+      EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+      EXPECT_EQ(log[i].value(), value.view());
+    } else {
+      EXPECT_EQ(Status::NotFound, driver->lookup(log[i].key(), value));
+    }
+  }
+
+  // Regrown regions are clean and take the next two regions of entries,
+  // so region 1 is not reclaimed
+  EXPECT_EQ(kDeviceSize, blockCache->resize(kDeviceSize));
+  std::vector<CacheEntry> log2;
+  for (size_t i = 0; i < 2 * 16; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    log2.push_back(std::move(e));
+    driver->drain();
+  }
+  for (size_t i = 5 * 16; i < 6 * 16; i++) {
+    EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+    EXPECT_EQ(log[i].value(), value.view());
+  }
+  for (const auto& e : log2) {
+    EXPECT_EQ(Status::Ok, driver->lookup(e.key(), value));
+    EXPECT_EQ(e.value(), value.view());
+  }
+}
+
+TEST(BlockCache, ChunkedItems) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.maxChunkedItemSize = 2 * kRegionSize;
+  auto engine = makeEngine(std::move(config));
+  EXPECT_EQ(2 * kRegionSize, engine->getMaxItemSize());
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  // The first chunk takes all of region 0, the second chunk and the
+  // manifest half of region 1
+  BufferGen bg;
+  CacheEntry large{bg.gen(8), bg.gen(kRegionSize + kRegionSize / 2)};
+  EXPECT_EQ(Status::Ok,
+            driver->insertAsync(large.key(), large.value(), nullptr));
+  CacheEntry tooLarge{bg.gen(8), bg.gen(2 * kRegionSize + 1)};
+  EXPECT_EQ(Status::Ok,
+            driver->insertAsync(tooLarge.key(), tooLarge.value(), nullptr));
+  driver->drain();
+
+  Buffer value;
+  EXPECT_EQ(Status::Ok, driver->lookup(large.key(), value));
+  EXPECT_EQ(large.value(), value.view());
+  EXPECT_EQ(Status::NotFound, driver->lookup(tooLarge.key(), value));
+
+  // Fill regions 1 and 2 and move on to the last one, which reclaims the
+  // region of the first chunk
+  std::vector<CacheEntry> log;
+  for (size_t i = 0; i < 24; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    log.push_back(std::move(e));
+  }
+  driver->drain();
+
+  EXPECT_EQ(Status::NotFound, driver->lookup(large.key(), value));
+  for (auto& e : log) {
+    EXPECT_EQ(Status::Ok, driver->lookup(e.key(), value));
+    EXPECT_EQ(e.value(), value.view());
+  }
+
+  driver->getCounters({[](folly::StringPiece name, double count,
+                          CounterVisitor::CounterType type) {
+    if (type != CounterVisitor::CounterType::RATE) {
+      return;
+    }
+    if (name == "navy_bc_chunked_inserts") {
+      EXPECT_EQ(1, count);
+    }
+    if (name == "navy_bc_chunked_lookups") {
+      EXPECT_EQ(1, count);
+    }
+    if (name == "navy_bc_chunked_evictions") {
+      EXPECT_EQ(1, count);
+    }
+    if (name == "navy_bc_succ_inserts") {
+      EXPECT_EQ(25, count);
+    }
+  }});
+}
+
+TEST(BlockCache, ChunkedItemsRequireNoItemDestructor) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.maxChunkedItemSize = 2 * kRegionSize;
+  config.itemDestructorEnabled = true;
+  EXPECT_THROW(makeEngine(std::move(config)), std::invalid_argument);
+}
+
+TEST(BlockCache, ChunkedItemsDestructor) {
+  BufferGen bg;
+  CacheEntry large{bg.gen(8), bg.gen(kRegionSize + kRegionSize / 2)};
+  auto isHeadOfLarge = [&large](HashedKey, BufferView value,
+                                DestructorEvent) {
+    EXPECT_LT(value.size(), large.value().size());
+    EXPECT_EQ(large.value().slice(0, value.size()), value);
+  };
+
+  MockDestructor cb;
+  // Fillers evicted along the way
+  EXPECT_CALL(cb, call(_, _, DestructorEvent::Recycled))
+      .Times(testing::AnyNumber());
+  // Once per chunked item, with its first chunk
+  EXPECT_CALL(cb, call(large.key(), _, DestructorEvent::Recycled))
+      .WillOnce(Invoke(isHeadOfLarge));
+
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.maxChunkedItemSize = 2 * kRegionSize;
+  config.destructorCb = toCallback(cb);
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  EXPECT_EQ(Status::Ok,
+            driver->insertAsync(large.key(), large.value(), nullptr));
+  driver->drain();
+
+  // Reclaims the region of the first chunk, then the one of the second
+  // chunk and the manifest
+  for (size_t i = 0; i < 48; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(800)};
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    driver->drain();
+  }
+  Buffer value;
+  EXPECT_EQ(Status::NotFound, driver->lookup(large.key(), value));
+}
+
+TEST(BlockCache, ChunkedItemsRemoveAndOverwrite) {
+  BufferGen bg;
+  CacheEntry removed{bg.gen(8), bg.gen(kRegionSize + kRegionSize / 2)};
+  CacheEntry replaced{bg.gen(8), bg.gen(kRegionSize + kRegionSize / 2)};
+  CacheEntry replacement{replaced.key(), bg.gen(800)};
+
+  MockDestructor cb;
+  EXPECT_CALL(cb, call(removed.key(), _, DestructorEvent::Removed))
+      .WillOnce(Invoke([&removed](HashedKey, BufferView value,
+                                  DestructorEvent) {
+        EXPECT_EQ(removed.value().slice(0, value.size()), value);
+      }));
+  // The chunks of an overwritten item are dropped with it
+  EXPECT_CALL(cb, call(replaced.key(), _, _)).Times(0);
+
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.maxChunkedItemSize = 2 * kRegionSize;
+  config.preciseRemove = true;
+  config.destructorCb = toCallback(cb);
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  EXPECT_EQ(Status::Ok,
+            driver->insertAsync(removed.key(), removed.value(), nullptr));
+  driver->drain();
+  EXPECT_EQ(Status::Ok, driver->remove(removed.key()));
+
+  EXPECT_EQ(Status::Ok,
+            driver->insertAsync(replaced.key(), replaced.value(), nullptr));
+  driver->drain();
+  EXPECT_EQ(Status::Ok, driver->insertAsync(replacement.key(),
+                                            replacement.value(), nullptr));
+  driver->drain();
+
+  Buffer value;
+  EXPECT_EQ(Status::Ok, driver->lookup(replaced.key(), value));
+  EXPECT_EQ(replacement.value(), value.view());
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_items") {
+      EXPECT_EQ(1, count);
+    }
+  }});
+}
+
+// Telling whether an overwritten key is a chunked item takes no read
+TEST(BlockCache, ChunkedItemsOverwriteSmallNoRead) {
+  // Enough regions that none gets reclaimed
+  std::vector<uint32_t> hits(8);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = std::make_unique<NiceMock<MockDevice>>(2 * kDeviceSize, 1024);
+  auto* devicePtr = device.get();
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device, 2 * kDeviceSize);
+  config.maxChunkedItemSize = 2 * kRegionSize;
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  BufferGen bg;
+  CacheEntry small{bg.gen(8), bg.gen(100)};
+  CacheEntry large{bg.gen(8), bg.gen(kRegionSize + kRegionSize / 2)};
+  EXPECT_EQ(Status::Ok, driver->insert(small.key(), small.value()));
+  EXPECT_EQ(Status::Ok, driver->insert(large.key(), large.value()));
+  // Both are on the device, not in a buffer
+  driver->flush();
+
+  EXPECT_CALL(*devicePtr, readImpl(_, _, _)).Times(0);
+  CacheEntry newSmall{small.key(), bg.gen(100)};
+  EXPECT_EQ(Status::Ok, driver->insert(newSmall.key(), newSmall.value()));
+  testing::Mock::VerifyAndClearExpectations(devicePtr);
+
+  // Overwriting the chunked item reads its manifest to drop its chunks
+  EXPECT_CALL(*devicePtr, readImpl(_, _, _)).Times(testing::AtLeast(1));
+  CacheEntry newLarge{large.key(), bg.gen(100)};
+  EXPECT_EQ(Status::Ok, driver->insert(newLarge.key(), newLarge.value()));
+  testing::Mock::VerifyAndClearExpectations(devicePtr);
+
+  Buffer value;
+  EXPECT_EQ(Status::Ok, driver->lookup(newSmall.key(), value));
+  EXPECT_EQ(newSmall.value(), value.view());
+  EXPECT_EQ(Status::Ok, driver->lookup(newLarge.key(), value));
+  EXPECT_EQ(newLarge.value(), value.view());
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_items") {
+      EXPECT_EQ(2, count);
+    }
+  }});
+}
+
+TEST(BlockCache, ExportImport) {
+  auto makeDriverWithChunks = [](std::vector<uint32_t>& hits) {
+    auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+    auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+    auto ex = makeJobScheduler();
+    auto config = makeConfig(*ex, std::move(policy), *device);
+    config.maxChunkedItemSize = 2 * kRegionSize;
+    // The expiry time is stored in the first 4 bytes of the value
+    config.getExpiryTime = [](BufferView v) {
+      uint32_t expiryTime;
+      std::memcpy(&expiryTime, v.data(), sizeof(expiryTime));
+      return expiryTime;
+    };
+    auto engine = makeEngine(std::move(config));
+    return makeDriver(std::move(engine), std::move(ex), std::move(device));
+  };
+
+  BufferGen bg;
+  auto makeEntry = [&bg](HashedKey key, size_t size, uint32_t expiryTime) {
+    auto value = bg.gen(size);
+    std::memcpy(value.data(), &expiryTime, sizeof(expiryTime));
+    return CacheEntry{key, std::move(value)};
+  };
+
+  std::vector<uint32_t> hits(4);
+  auto driver = makeDriverWithChunks(hits);
+
+  // A chunked item, live entries, some of them overwritten and one removed,
+  // and expired entries
+  std::vector<CacheEntry> log;
+  std::vector<CacheEntry> gone;
+  log.push_back(
+      makeEntry(makeHK(bg.gen(8)), kRegionSize + kRegionSize / 2, 0));
+  for (size_t i = 0; i < 8; i++) {
+    log.push_back(makeEntry(makeHK(bg.gen(8)), 800, 0));
+  }
+  const uint32_t expiredTime = util::getCurrentTimeSec() - 1;
+  for (size_t i = 0; i < 4; i++) {
+    gone.push_back(makeEntry(makeHK(bg.gen(8)), 800, expiredTime));
+  }
+  for (const auto& e : log) {
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+  }
+  for (const auto& e : gone) {
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+  }
+  driver->drain();
+  for (size_t i = 1; i < 3; i++) {
+    log[i] = makeEntry(log[i].key(), 800, 0);
+    EXPECT_EQ(Status::Ok,
+              driver->insertAsync(log[i].key(), log[i].value(), nullptr));
+  }
+  driver->drain();
+  EXPECT_EQ(Status::Ok, driver->remove(log.back().key()));
+  gone.push_back(std::move(log.back()));
+  log.pop_back();
+
+  folly::IOBufQueue ioq;
+  auto rw = createMemoryRecordWriter(ioq);
+  EXPECT_EQ(log.size(), driver->exportEntries(*rw));
+
+  std::vector<uint32_t> newHits(4);
+  auto newDriver = makeDriverWithChunks(newHits);
+  auto rr = createMemoryRecordReader(ioq);
+  EXPECT_EQ(log.size(), newDriver->importEntries(*rr));
+  Buffer value;
+  for (const auto& e : log) {
+    EXPECT_EQ(Status::Ok, newDriver->lookup(e.key(), value));
+    EXPECT_EQ(e.value(), value.view());
+  }
+  for (const auto& e : gone) {
+    EXPECT_EQ(Status::NotFound, newDriver->lookup(e.key(), value));
+  }
+}
+
+TEST(BlockCache, ReclaimSkipsDeadRegion) {
+  // Both ways of reclaiming a region without live entries account for its
+  // entries the same way. Only the opt-in one skips the read.
+  for (bool withoutRead : {false, true}) {
+    std::vector<uint32_t> hits(4);
+    auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+    auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+    auto ex = makeJobScheduler();
+    auto config = makeConfig(*ex, std::move(policy), *device);
+    config.reclaimDeadWithoutRead = withoutRead;
+    auto engine = makeEngine(std::move(config));
+    auto driver = makeDriver(std::move(engine), std::move(ex));
+
+    // Allocator region fills every 16 inserts.
+    BufferGen bg;
+    std::vector<CacheEntry> log;
+    for (size_t j = 0; j < 3; j++) {
+      for (size_t i = 0; i < 16; i++) {
+        CacheEntry e{bg.gen(8), bg.gen(800)};
+        EXPECT_EQ(Status::Ok,
+                  driver->insertAsync(e.key(), e.value(), nullptr));
+        log.push_back(std::move(e));
+      }
+      driver->flush();
+    }
+
+    // Remove every entry from region 0
+    for (size_t i = 0; i < 16; i++) {
+      EXPECT_EQ(Status::Ok, driver->remove(log[i].key()));
+    }
+    driver->drain();
+
+    // Force reclamation on region 0. It has no live data.
+    {
+      CacheEntry e{bg.gen(8), bg.gen(800)};
+      EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+      log.push_back(std::move(e));
+    }
+    driver->drain();
+
+    driver->getCounters({[withoutRead](folly::StringPiece name, double count) {
+      if (name == "navy_bc_reclaim_no_read") {
+        EXPECT_EQ(withoutRead ? 1 : 0, count);
+      }
+      if (name == "navy_bc_reclaim_read_bytes") {
+        EXPECT_EQ(withoutRead ? 0 : kRegionSize, count);
+      }
+      if (name == "navy_bc_eviction_lookup_misses") {
+        EXPECT_EQ(16, count);
+      }
+      if (name == "navy_bc_items") {
+        EXPECT_EQ(33, count);
+      }
+      if (name == "navy_bc_used_size_bytes") {
+        EXPECT_EQ(33 * 1024, count);
+      }
+      if (name == "navy_bc_hole_count") {
+        EXPECT_EQ(0, count);
+      }
+      if (name == "navy_bc_hole_bytes") {
+        EXPECT_EQ(0, count);
+      }
+    }});
 
-TEST(BlockCache, CollisionOverwrite) {
-  auto collision = CollisionCreator("key", "value", "abc");
-  Buffer value;
-  // Original key is not found, because it didn't pass key equality check
-  EXPECT_EQ(Status::NotFound, collision.driver->lookup(makeHK("key"), value));
+    for (size_t i = 16; i < log.size(); i++) {
+      Buffer value;
+      EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+      EXPECT_EQ(log[i].value(), value.view());
+    }
+  }
 }
 
-TEST(BlockCache, SimpleReclaim) {
+TEST(BlockCache, SparseReclaim) {
   std::vector<uint32_t> hits(4);
   auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
   auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
   auto ex = makeJobScheduler();
   auto config = makeConfig(*ex, std::move(policy), *device);
+  config.sparseReclaimThreshold = 0.5;
   auto engine = makeEngine(std::move(config));
   auto driver = makeDriver(std::move(engine), std::move(ex));
 
@@ -463,16 +1180,35 @@ TEST(BlockCache, SimpleReclaim) {
     driver->flush();
   }
 
-  // This insert will trigger reclamation because there are 4 regions in total
-  // and the device was configured to require 1 clean region at all times
+  // Keep only two adjacent entries alive in region 0
   for (size_t i = 0; i < 16; i++) {
+    if (i != 4 && i != 5) {
+      EXPECT_EQ(Status::Ok, driver->remove(log[i].key()));
+    }
+  }
+  driver->drain();
+
+  // Force reclamation on region 0. Only the two live slots are read, as a
+  // single contiguous run.
+  {
     CacheEntry e{bg.gen(8), bg.gen(800)};
     EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
     log.push_back(std::move(e));
   }
-  driver->flush();
+  driver->drain();
+
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_reclaim_sparse") {
+      EXPECT_EQ(1, count);
+    }
+    if (name == "navy_bc_reclaim_read_bytes") {
+      EXPECT_EQ(2 * 1024, count);
+    }
+    if (name == "navy_bc_hole_count") {
+      EXPECT_EQ(0, count);
+    }
+  }});
 
-  // First 16 are reclaimed and so missing
   for (size_t i = 0; i < 16; i++) {
     Buffer value;
     EXPECT_EQ(Status::NotFound, driver->lookup(log[i].key(), value));
@@ -484,21 +1220,21 @@ TEST(BlockCache, SimpleReclaim) {
   }
 }
 
-TEST(BlockCache, HoleStats) {
+TEST(BlockCache, FlushedRegionCache) {
   std::vector<uint32_t> hits(4);
   auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
   auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
   auto ex = makeJobScheduler();
   auto config = makeConfig(*ex, std::move(policy), *device);
-  // items which are accessed once will be reinserted on reclaim
-  config.reinsertionConfig = makeHitsReinsertionConfig(1);
+  // Room for a single flushed region
+  config.flushedRegionCacheSize = kRegionSize;
   auto engine = makeEngine(std::move(config));
   auto driver = makeDriver(std::move(engine), std::move(ex));
 
   // Allocator region fills every 16 inserts.
   BufferGen bg;
   std::vector<CacheEntry> log;
-  for (size_t j = 0; j < 3; j++) {
+  for (size_t j = 0; j < 2; j++) {
     for (size_t i = 0; i < 16; i++) {
       CacheEntry e{bg.gen(8), bg.gen(800)};
       EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
@@ -507,68 +1243,246 @@ TEST(BlockCache, HoleStats) {
     driver->flush();
   }
 
+  // Region 1 was flushed last and is served from memory, region 0 was
+  // replaced by it and is read from the device
+  for (size_t i = 0; i < log.size(); i++) {
+    Buffer value;
+    EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+    EXPECT_EQ(log[i].value(), value.view());
+  }
+
   driver->getCounters({[](folly::StringPiece name, double count) {
-    if (name == "navy_bc_hole_count") {
-      EXPECT_EQ(0, count);
+    if (name == "navy_bc_flushed_buffer_hits") {
+      EXPECT_EQ(16, count);
     }
-    if (name == "navy_bc_hole_bytes") {
-      EXPECT_EQ(0, count);
+    if (name == "navy_bc_flushed_buffer_misses") {
+      EXPECT_EQ(16, count);
     }
   }});
+}
 
-  // Remove 3 entries from region 0
-  EXPECT_EQ(Status::Ok, driver->remove(log[0].key()));
-  EXPECT_EQ(Status::Ok, driver->remove(log[1].key()));
-  EXPECT_EQ(Status::Ok, driver->remove(log[2].key()));
+TEST(BlockCache, LookupBatch) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
 
-  // Remove 2 entries from region 2
-  EXPECT_EQ(Status::Ok, driver->remove(log[33].key()));
-  EXPECT_EQ(Status::Ok, driver->remove(log[34].key()));
+  // Two regions of 16 neighbouring entries each
+  BufferGen bg;
+  std::vector<CacheEntry> log;
+  for (size_t j = 0; j < 2; j++) {
+    for (size_t i = 0; i < 16; i++) {
+      CacheEntry e{bg.gen(8), bg.gen(800)};
+      EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+      log.push_back(std::move(e));
+    }
+    driver->flush();
+  }
 
-  // Drain all async removes
+  std::vector<HashedKey> keys;
+  for (const auto& e : log) {
+    keys.push_back(e.key());
+  }
+  CacheEntry missing{bg.gen(8), bg.gen(800)};
+  keys.push_back(missing.key());
+
+  std::vector<Status> statuses(keys.size(), Status::Retry);
+  std::vector<Buffer> values(keys.size());
+  driver->lookupBatchAsync(
+      keys, [&](size_t idx, Status status, HashedKey key, Buffer value) {
+        EXPECT_EQ(keys[idx], key);
+        statuses[idx] = status;
+        values[idx] = std::move(value);
+      });
   driver->drain();
+
+  for (size_t i = 0; i < log.size(); i++) {
+    EXPECT_EQ(Status::Ok, statuses[i]);
+    EXPECT_EQ(log[i].value(), values[i].view());
+  }
+  EXPECT_EQ(Status::NotFound, statuses.back());
+
+  // All but the first entry of each region share its device read
   driver->getCounters({[](folly::StringPiece name, double count) {
-    if (name == "navy_bc_hole_count") {
-      EXPECT_EQ(5, count);
-    }
-    if (name == "navy_bc_hole_bytes") {
-      EXPECT_EQ(5 * 1024, count);
+    if (name == "navy_bc_batch_reads_coalesced") {
+      EXPECT_EQ(30, count);
     }
   }});
+}
 
-  // lookup this entry from region 0 that will be soon reclaimed
-  Buffer val;
-  EXPECT_EQ(Status::Ok, driver->lookup(log[4].key(), val));
-  EXPECT_EQ(Status::Ok, driver->lookup(log[4].key(), val));
+TEST(BlockCache, ExpiryBuckets) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  // The expiry time is stored in the first 4 bytes of the value
+  config.getExpiryTime = [](BufferView v) {
+    uint32_t expiryTime;
+    std::memcpy(&expiryTime, v.data(), sizeof(expiryTime));
+    return expiryTime;
+  };
+  config.expiryBuckets = {60};
+  config.numInMemBuffers = 4;
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
 
-  // Force reclamation on region 0. There are 4 regions and the device
-  // was configured to require 1 clean region at all times.
-  {
-    CacheEntry e{bg.gen(8), bg.gen(800)};
-    EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
-    log.push_back(std::move(e));
+  BufferGen bg;
+  auto makeEntry = [&bg](uint32_t expiryTime) {
+    auto value = bg.gen(800);
+    std::memcpy(value.data(), &expiryTime, sizeof(expiryTime));
+    return CacheEntry{bg.gen(8), std::move(value)};
+  };
+
+  // Interleave expired entries with entries that never expire. They end up
+  // in two different regions, each of them filled by 16 inserts.
+  const uint32_t expiredTime = util::getCurrentTimeSec() - 1;
+  std::vector<CacheEntry> expired;
+  std::vector<CacheEntry> log;
+  for (size_t i = 0; i < 16; i++) {
+    CacheEntry e1 = makeEntry(expiredTime);
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e1.key(), e1.value(), nullptr));
+    expired.push_back(std::move(e1));
+    CacheEntry e2 = makeEntry(0);
+    EXPECT_EQ(Status::Ok, driver->insertAsync(e2.key(), e2.value(), nullptr));
+    log.push_back(std::move(e2));
+  }
+  driver->flush();
+  for (size_t j = 0; j < 2; j++) {
+    for (size_t i = 0; i < 16; i++) {
+      CacheEntry e = makeEntry(0);
+      EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+      log.push_back(std::move(e));
+    }
+    driver->flush();
   }
-  driver->drain();
 
-  // Reclaiming region 0 should have bumped down the hole count to
-  // 2 remaining (from region 2)
-  driver->getCounters({[](folly::StringPiece name, double count,
-                          CounterVisitor::CounterType type) {
-    if (name == "navy_bc_reinsertions" &&
-        type == CounterVisitor::CounterType::RATE) {
+  // The region of expired entries was the first to be tracked and is the one
+  // that got reclaimed, without being read.
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_reclaim_expired") {
       EXPECT_EQ(1, count);
     }
-    if (name == "navy_bc_hole_count") {
-      EXPECT_EQ(2, count);
+    if (name == "navy_bc_evictions_expired") {
+      EXPECT_EQ(16, count);
     }
-    // Initial 4 reclaims and 1 reclaim for region 0
-    if (name == "navy_bc_reclaim") {
-      EXPECT_EQ(5, count);
+    if (name == "navy_bc_reclaim_read_bytes") {
+      EXPECT_EQ(0, count);
     }
-    if (name == "navy_bc_hole_bytes") {
-      EXPECT_EQ(2 * 1024, count);
+  }});
+
+  for (size_t i = 0; i < expired.size(); i++) {
+    Buffer value;
+    EXPECT_EQ(Status::NotFound, driver->lookup(expired[i].key(), value));
+  }
+  for (size_t i = 0; i < log.size(); i++) {
+    Buffer value;
+    EXPECT_EQ(Status::Ok, driver->lookup(log[i].key(), value));
+    EXPECT_EQ(log[i].value(), value.view());
+  }
+}
+
+TEST(BlockCache, ExpiryBucketsDestructor) {
+  BufferGen bg;
+  auto makeEntry = [&bg](uint32_t expiryTime) {
+    auto value = bg.gen(800);
+    std::memcpy(value.data(), &expiryTime, sizeof(expiryTime));
+    return CacheEntry{bg.gen(8), std::move(value)};
+  };
+  const uint32_t expiredTime = util::getCurrentTimeSec() - 1;
+  std::vector<CacheEntry> expired;
+  std::vector<CacheEntry> log;
+  for (size_t i = 0; i < 16; i++) {
+    expired.push_back(makeEntry(expiredTime));
+    log.push_back(makeEntry(0));
+  }
+  for (size_t i = 0; i < 32; i++) {
+    log.push_back(makeEntry(0));
+  }
+
+  // Entries of an expired region are recycled like those of a region that
+  // is read
+  MockDestructor cb;
+  EXPECT_CALL(cb, call(_, _, _)).Times(0);
+  for (const auto& e : expired) {
+    EXPECT_CALL(cb, call(e.key(), e.value(), DestructorEvent::Recycled));
+  }
+
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.getExpiryTime = [](BufferView v) {
+    uint32_t expiryTime;
+    std::memcpy(&expiryTime, v.data(), sizeof(expiryTime));
+    return expiryTime;
+  };
+  config.expiryBuckets = {60};
+  config.numInMemBuffers = 4;
+  config.destructorCb = toCallback(cb);
+  auto engine = makeEngine(std::move(config));
+  auto driver = makeDriver(std::move(engine), std::move(ex));
+
+  // Same layout as in ExpiryBuckets: the expired entries fill the region
+  // that gets reclaimed
+  for (size_t i = 0; i < 16; i++) {
+    EXPECT_EQ(Status::Ok, driver->insertAsync(expired[i].key(),
+                                              expired[i].value(), nullptr));
+    EXPECT_EQ(Status::Ok,
+              driver->insertAsync(log[i].key(), log[i].value(), nullptr));
+  }
+  driver->flush();
+  for (size_t j = 0; j < 2; j++) {
+    for (size_t i = 0; i < 16; i++) {
+      const auto& e = log[16 * (j + 1) + i];
+      EXPECT_EQ(Status::Ok, driver->insertAsync(e.key(), e.value(), nullptr));
+    }
+    driver->flush();
+  }
+
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_reclaim_expired") {
+      EXPECT_EQ(1, count);
+    }
+    if (name == "navy_bc_evictions_expired") {
+      EXPECT_EQ(16, count);
     }
   }});
+  for (const auto& e : log) {
+    Buffer value;
+    EXPECT_EQ(Status::Ok, driver->lookup(e.key(), value));
+    EXPECT_EQ(e.value(), value.view());
+  }
+}
+
+TEST(BlockCache, ExpiryBucketsBadConfig) {
+  std::vector<uint32_t> hits(4);
+  auto device = createMemoryDevice(kDeviceSize, nullptr /* encryption */);
+  auto ex = makeJobScheduler();
+  auto makeExpiryConfig = [&](std::vector<uint32_t> expiryBuckets) {
+    auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+    auto config = makeConfig(*ex, std::move(policy), *device);
+    config.getExpiryTime = [](BufferView) -> uint32_t { return 0; };
+    config.expiryBuckets = std::move(expiryBuckets);
+    config.numInMemBuffers = 4;
+    return config;
+  };
+
+  EXPECT_THROW(makeExpiryConfig({60, 60}).validate(), std::invalid_argument);
+  EXPECT_THROW(makeExpiryConfig({0, 60}).validate(), std::invalid_argument);
+  // Not enough in-mem buffers for one open region per bucket
+  EXPECT_THROW(makeExpiryConfig({60, 3600, 86400, 604800}).validate(),
+               std::invalid_argument);
+  {
+    auto config = makeExpiryConfig({60});
+    config.getExpiryTime = nullptr;
+    EXPECT_THROW(config.validate(), std::invalid_argument);
+  }
+  EXPECT_NO_THROW(makeExpiryConfig({60, 3600, 86400}).validate());
 }
 
 TEST(BlockCache, ReclaimCorruption) {
@@ -1731,6 +2645,121 @@ TEST(BlockCache, RecoveryCorruptedData) {
   EXPECT_FALSE(driver->recover());
 }
 
+TEST(BlockCache, ScanRecovery) {
+  std::vector<uint32_t> hits(4);
+  uint32_t ioAlignSize = 4096;
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  size_t metadataSize = 3 * 1024 * 1024;
+  auto deviceSize = metadataSize + kDeviceSize;
+  auto device =
+      createMemoryDevice(deviceSize, nullptr /* encryption */, ioAlignSize);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.numInMemBuffers = 2;
+  config.scanRecovery = true;
+  auto engine = makeEngine(std::move(config), metadataSize);
+  // The footer takes the last IO block of every region
+  EXPECT_EQ(kRegionSize - ioAlignSize - kSizeOfEntryDesc,
+            engine->getMaxItemSize());
+  auto driver = makeDriver(std::move(engine), std::move(ex), std::move(device),
+                           metadataSize);
+
+  BufferGen bg;
+  std::vector<CacheEntry> log;
+  // Fill 2 regions, 3 entries each
+  for (size_t i = 0; i < 6; i++) {
+    CacheEntry e{bg.gen(8), bg.gen(3200)};
+    EXPECT_EQ(Status::Ok, driver->insert(e.key(), e.value()));
+    log.push_back(std::move(e));
+  }
+  // Overwrite the first key in a third region
+  CacheEntry updated{log[0].key(), bg.gen(3200)};
+  EXPECT_EQ(Status::Ok, driver->insert(updated.key(), updated.value()));
+  log[0] = std::move(updated);
+  driver->flush();
+
+  // Drop the in-memory state without persisting it, like a crash would
+  driver->reset();
+  for (auto& entry : log) {
+    Buffer value;
+    EXPECT_EQ(Status::NotFound, driver->lookup(entry.key(), value));
+  }
+
+  EXPECT_TRUE(driver->recover());
+  for (auto& entry : log) {
+    Buffer value;
+    EXPECT_EQ(Status::Ok, driver->lookup(entry.key(), value));
+    EXPECT_EQ(entry.value(), value.view());
+  }
+  driver->getCounters({[](folly::StringPiece name, double count,
+                          CounterVisitor::CounterType) {
+    if (name == "navy_bc_rebuild_entries") {
+      EXPECT_EQ(7, count);
+    }
+    if (name == "navy_bc_items") {
+      EXPECT_EQ(6, count);
+    }
+  }});
+}
+
+// Expired entries and chunked items are not rebuilt
+TEST(BlockCache, ScanRecoverySkipsExpiredAndChunked) {
+  std::vector<uint32_t> hits(4);
+  auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
+  size_t metadataSize = 3 * 1024 * 1024;
+  auto deviceSize = metadataSize + kDeviceSize;
+  auto device = createMemoryDevice(deviceSize, nullptr /* encryption */,
+                                   4096 /* ioAlignSize */);
+  auto ex = makeJobScheduler();
+  auto config = makeConfig(*ex, std::move(policy), *device);
+  config.numInMemBuffers = 2;
+  config.scanRecovery = true;
+  config.maxChunkedItemSize = 2 * kRegionSize;
+  // The expiry time is stored in the first 4 bytes of the value
+  config.getExpiryTime = [](BufferView v) {
+    uint32_t expiryTime;
+    std::memcpy(&expiryTime, v.data(), sizeof(expiryTime));
+    return expiryTime;
+  };
+  auto engine = makeEngine(std::move(config), metadataSize);
+  auto driver = makeDriver(std::move(engine), std::move(ex), std::move(device),
+                           metadataSize);
+
+  BufferGen bg;
+  auto makeEntry = [&bg](uint32_t expiryTime, size_t valueSize) {
+    auto value = bg.gen(valueSize);
+    std::memcpy(value.data(), &expiryTime, sizeof(expiryTime));
+    return CacheEntry{bg.gen(8), std::move(value)};
+  };
+  CacheEntry chunked = makeEntry(0, kRegionSize + kRegionSize / 2);
+  EXPECT_EQ(Status::Ok, driver->insert(chunked.key(), chunked.value()));
+  CacheEntry expired = makeEntry(util::getCurrentTimeSec() - 1, 800);
+  EXPECT_EQ(Status::Ok, driver->insert(expired.key(), expired.value()));
+  std::vector<CacheEntry> log;
+  for (size_t i = 0; i < 2; i++) {
+    log.push_back(makeEntry(0, 800));
+    EXPECT_EQ(Status::Ok, driver->insert(log[i].key(), log[i].value()));
+  }
+  driver->flush();
+
+  // Drop the in-memory state without persisting it, like a crash would
+  driver->reset();
+  EXPECT_TRUE(driver->recover());
+  Buffer value;
+  EXPECT_EQ(Status::NotFound, driver->lookup(chunked.key(), value));
+  EXPECT_EQ(Status::NotFound, driver->lookup(expired.key(), value));
+  for (auto& entry : log) {
+    EXPECT_EQ(Status::Ok, driver->lookup(entry.key(), value));
+    EXPECT_EQ(entry.value(), value.view());
+  }
+  driver->getCounters({[](folly::StringPiece name, double count,
+                          CounterVisitor::CounterType) {
+    if (name == "navy_bc_items") {
+      EXPECT_EQ(2, count);
+    }
+  }});
+}
+
 TEST(BlockCache, NoJobsOnStartup) {
   std::vector<uint32_t> hits(4);
   auto policy = std::make_unique<NiceMock<MockPolicy>>(&hits);
@@ -2334,14 +3363,14 @@ TEST(BlockCache, SizeAndAlignment) {
   EXPECT_EQ(engine->estimateWriteSize(HashedKey{"key"}, smallValue.view()),
             alignSize);
 
-  // assumption: the item descriptor size is 24.
+  // assumption: the item descriptor size is 32.
   // Make an item at the size of 1024.
-  auto largeValue = bg.gen(alignSize - 24 - 3);
+  auto largeValue = bg.gen(alignSize - 32 - 3);
   EXPECT_EQ(engine->estimateWriteSize(HashedKey{"key"}, largeValue.view()),
             alignSize);
 
   // Add one more byte and need 2*alignSize
-  auto hugeValue = bg.gen(alignSize - 24 - 3 + 1);
+  auto hugeValue = bg.gen(alignSize - 32 - 3 + 1);
   EXPECT_EQ(engine->estimateWriteSize(HashedKey{"key"}, hugeValue.view()),
             alignSize * 2);
 }
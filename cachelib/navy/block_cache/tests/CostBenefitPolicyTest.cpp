@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "cachelib/common/Time.h"
+#include "cachelib/navy/block_cache/CostBenefitPolicy.h"
+
+namespace facebook::cachelib::navy::tests {
+namespace {
+constexpr uint64_t kRegionSize{100};
+} // namespace
+
+TEST(EvictionPolicy, CostBenefitFifoWhenFull) {
+  Region region0{RegionId{0}, kRegionSize};
+  Region region1{RegionId{1}, kRegionSize};
+  Region region2{RegionId{2}, kRegionSize};
+  region0.addLiveBytes(kRegionSize);
+  region1.addLiveBytes(kRegionSize);
+  region2.addLiveBytes(kRegionSize);
+
+  CostBenefitPolicy policy{kRegionSize};
+  policy.track(region0);
+  policy.track(region1);
+  policy.track(region2);
+  // All regions are full, so ties are broken by tracking order
+  EXPECT_EQ(region0.id(), policy.evict());
+  EXPECT_EQ(region1.id(), policy.evict());
+  EXPECT_EQ(region2.id(), policy.evict());
+  EXPECT_EQ(RegionId{}, policy.evict());
+}
+
+TEST(EvictionPolicy, CostBenefitPrefersDeadRegions) {
+  Region region0{RegionId{0}, kRegionSize};
+  Region region1{RegionId{1}, kRegionSize};
+  Region region2{RegionId{2}, kRegionSize};
+  Region region3{RegionId{3}, kRegionSize};
+  region0.addLiveBytes(90);
+  region1.addLiveBytes(10);
+  region2.addLiveBytes(50);
+  region3.addLiveBytes(kRegionSize);
+
+  CostBenefitPolicy policy{kRegionSize};
+  policy.track(region0);
+  policy.track(region1);
+  policy.track(region2);
+  policy.track(region3);
+
+  // Live bytes change after tracking are picked up on eviction
+  region0.removeLiveBytes(90, []() { return true; });
+
+  EXPECT_EQ(region0.id(), policy.evict());
+  EXPECT_EQ(region1.id(), policy.evict());
+  EXPECT_EQ(region2.id(), policy.evict());
+  EXPECT_EQ(region3.id(), policy.evict());
+  EXPECT_EQ(RegionId{}, policy.evict());
+}
+
+TEST(EvictionPolicy, CostBenefitPrefersExpiredRegions) {
+  Region region0{RegionId{0}, kRegionSize};
+  Region region1{RegionId{1}, kRegionSize};
+  Region region2{RegionId{2}, kRegionSize};
+  const uint32_t currentTime = util::getCurrentTimeSec();
+  region0.addLiveBytes(10);
+  region0.updateMaxExpiryTime(0 /* never expires */);
+  region1.addLiveBytes(kRegionSize);
+  region1.updateMaxExpiryTime(currentTime + 3600);
+  region2.addLiveBytes(kRegionSize);
+  region2.updateMaxExpiryTime(currentTime - 10);
+
+  CostBenefitPolicy policy{kRegionSize};
+  policy.track(region0);
+  policy.track(region1);
+  policy.track(region2);
+  EXPECT_EQ(region2.id(), policy.evict());
+  EXPECT_EQ(region0.id(), policy.evict());
+  EXPECT_EQ(region1.id(), policy.evict());
+}
+
+TEST(EvictionPolicy, CostBenefitRemove) {
+  Region region0{RegionId{0}, kRegionSize};
+  Region region1{RegionId{1}, kRegionSize};
+  Region region2{RegionId{2}, kRegionSize};
+
+  CostBenefitPolicy policy{kRegionSize};
+  policy.track(region0);
+  policy.track(region1);
+  policy.track(region2);
+  EXPECT_TRUE(policy.remove(region0.id()));
+  EXPECT_FALSE(policy.remove(region0.id()));
+  EXPECT_FALSE(policy.remove(RegionId{5}));
+  EXPECT_EQ(region1.id(), policy.evict());
+  EXPECT_FALSE(policy.remove(region1.id()));
+  EXPECT_EQ(region2.id(), policy.evict());
+  EXPECT_EQ(RegionId{}, policy.evict());
+}
+
+TEST(EvictionPolicy, CostBenefitManyRegions) {
+  // More regions than eviction scores at once
+  constexpr uint32_t kNumRegions = 1000;
+  std::vector<std::unique_ptr<Region>> regions;
+  CostBenefitPolicy policy{kRegionSize};
+  for (uint32_t i = 0; i < kNumRegions; i++) {
+    regions.push_back(std::make_unique<Region>(RegionId{i}, kRegionSize));
+    regions.back()->addLiveBytes(kRegionSize);
+    policy.track(*regions.back());
+  }
+  std::set<uint32_t> tracked;
+  for (uint32_t i = 0; i < kNumRegions; i++) {
+    if (i % 3 == 0) {
+      EXPECT_TRUE(policy.remove(RegionId{i}));
+    } else {
+      tracked.insert(i);
+    }
+  }
+
+  // Every tracked region is evicted once
+  while (!tracked.empty()) {
+    auto rid = policy.evict();
+    ASSERT_TRUE(rid.valid());
+    EXPECT_EQ(1, tracked.erase(rid.index()));
+  }
+  EXPECT_EQ(RegionId{}, policy.evict());
+}
+
+TEST(EvictionPolicy, CostBenefitReset) {
+  Region region0{RegionId{0}, kRegionSize};
+  Region region1{RegionId{1}, kRegionSize};
+
+  CostBenefitPolicy policy{kRegionSize};
+  policy.track(region0);
+  policy.track(region1);
+  policy.reset();
+  EXPECT_EQ(RegionId{}, policy.evict());
+
+  policy.track(region1);
+  EXPECT_EQ(region1.id(), policy.evict());
+}
+
+TEST(EvictionPolicy, CostBenefitInvalidRegionSize) {
+  EXPECT_THROW(CostBenefitPolicy policy{0}, std::invalid_argument);
+}
+} // namespace facebook::cachelib::navy::tests
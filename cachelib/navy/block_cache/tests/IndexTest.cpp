@@ -19,6 +19,7 @@
 #include <thread>
 
 #include "cachelib/navy/block_cache/Index.h"
+#include "cachelib/navy/common/Device.h"
 
 namespace facebook::cachelib::navy::tests {
 TEST(Index, Recovery) {
@@ -48,6 +49,33 @@ TEST(Index, Recovery) {
   }
 }
 
+TEST(Index, RecoveryFromDevice) {
+  // Touch every bucket so persist and recover span many metadata IOs
+  Index index;
+  for (uint64_t i = 0; i < 64 * 1024; i++) {
+    for (uint64_t j = 0; j < 4; j++) {
+      index.insert(i << 32 | j, i + j, 0);
+    }
+  }
+
+  size_t metadataSize = 64 * 1024 * 1024;
+  auto dev = createMemoryDevice(metadataSize, nullptr /* encryption */);
+  {
+    auto rw = createMetadataRecordWriter(*dev, metadataSize);
+    index.persist(*rw);
+  }
+
+  auto rr = createMetadataRecordReader(*dev, metadataSize);
+  Index newIndex;
+  newIndex.recover(*rr);
+  EXPECT_TRUE(rr->isEnd());
+  for (uint64_t i = 0; i < 64 * 1024; i++) {
+    for (uint64_t j = 0; j < 4; j++) {
+      EXPECT_EQ(i + j, newIndex.lookup(i << 32 | j).address());
+    }
+  }
+}
+
 TEST(Index, EntrySize) {
   Index index;
   index.insert(111, 0, 11);
@@ -16,7 +16,9 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include "cachelib/common/inject_pause.h"
@@ -91,6 +93,129 @@ TEST(RegionManager, ReclaimLru) {
   EXPECT_EQ(kRegion1.id(), rm->evict());
 }
 
+TEST(RegionManager, EvictSkipsDegradedDevice) {
+  constexpr uint32_t kNumRegions = 4;
+  constexpr uint32_t kRegionSize = 4 * 1024;
+  // Reports the first region's device range as degraded
+  class DegradedDevice : public SizeMockDevice {
+   public:
+    using SizeMockDevice::SizeMockDevice;
+    bool isDegraded(uint64_t offset) const override {
+      return degraded && offset < kRegionSize;
+    }
+    bool degraded{true};
+  };
+
+  auto policy = std::make_unique<LruPolicy>(4);
+  auto& ep = *policy;
+  ep.track(kRegion0);
+  ep.track(kRegion1);
+  ep.track(kRegion2);
+  ep.track(kRegion3);
+
+  DegradedDevice device{kNumRegions * kRegionSize};
+  RegionEvictCallback evictCb{[](RegionId, BufferView) { return 0; }};
+  RegionCleanupCallback cleanupCb{[](RegionId, BufferView) {}};
+  auto rm = std::make_unique<RegionManager>(
+      kNumRegions, kRegionSize, 0, device, 1, 1, 0, std::move(evictCb),
+      std::move(cleanupCb), std::move(policy),
+      kNumRegions /* numInMemBuffers */, 0, kFlushRetryLimit);
+
+  // Region 0 is passed over while other victims remain
+  EXPECT_EQ(kRegion1.id(), rm->evict());
+  EXPECT_EQ(kRegion2.id(), rm->evict());
+
+  // It kept its place, so it is the first victim once the device recovers
+  device.degraded = false;
+  EXPECT_EQ(kRegion0.id(), rm->evict());
+  EXPECT_EQ(kRegion3.id(), rm->evict());
+
+  // It is used as the last resort once it is the only region left
+  device.degraded = true;
+  rm->track(kRegion0.id());
+  rm->track(kRegion1.id());
+  EXPECT_EQ(kRegion1.id(), rm->evict());
+  EXPECT_EQ(kRegion0.id(), rm->evict());
+  EXPECT_EQ(RegionId{}, rm->evict());
+
+  rm->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_bc_degraded_evict_skips") {
+      EXPECT_EQ(4, count);
+    }
+  }});
+}
+
+TEST(RegionManager, RetireInactiveRegions) {
+  constexpr uint32_t kNumRegions = 4;
+  constexpr uint32_t kRegionSize = 4 * 1024;
+  auto device =
+      createMemoryDevice(kNumRegions * kRegionSize, nullptr /* encryption */);
+  RegionEvictCallback evictCb{[](RegionId, BufferView) { return 0; }};
+  RegionCleanupCallback cleanupCb{[](RegionId, BufferView) {}};
+  auto rm = std::make_unique<RegionManager>(
+      kNumRegions, kRegionSize, 0, *device, 1, 1, 0, std::move(evictCb),
+      std::move(cleanupCb), std::make_unique<LruPolicy>(kNumRegions),
+      kNumRegions /* numInMemBuffers */, 0, kFlushRetryLimit);
+
+  // Reclaims run on the region manager's worker
+  auto waitRetired = [&rm] {
+    for (int i = 0; i < 500; i++) {
+      if (rm->retireInactiveRegions()) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    return false;
+  };
+
+  // Tracked regions are reclaimed and retired
+  rm->setNumActiveRegions(2);
+  EXPECT_EQ(2 * kRegionSize, rm->getSize());
+  EXPECT_TRUE(waitRetired());
+  EXPECT_TRUE(rm->retireInactiveRegions());
+  EXPECT_THROW(rm->setNumActiveRegions(0), std::invalid_argument);
+  EXPECT_THROW(rm->setNumActiveRegions(kNumRegions + 1),
+               std::invalid_argument);
+
+  // Revived regions are handed out as clean regions
+  rm->setNumActiveRegions(kNumRegions);
+  EXPECT_EQ(kNumRegions * kRegionSize, rm->getSize());
+  BufferGen bg;
+  std::vector<RegionId> open;
+  for (uint32_t i = 0; i < 2; i++) {
+    RegionId rid;
+    ASSERT_EQ(OpenStatus::Ready, rm->getCleanRegion(rid, false).first);
+    EXPECT_LE(2u, rid.index());
+    auto& region = rm->getRegion(rid);
+    auto [wDesc, addr] = region.openAndAllocate(1024);
+    EXPECT_EQ(OpenStatus::Ready, wDesc.status());
+    rm->write(RelAddress{rid, 0}, bg.gen(1024));
+    region.close(std::move(wDesc));
+    open.push_back(rid);
+  }
+  rm->drain();
+
+  // Regions open for writes are not retired until they are flushed
+  rm->setNumActiveRegions(2);
+  EXPECT_FALSE(rm->retireInactiveRegions());
+  std::this_thread::sleep_for(std::chrono::milliseconds{100});
+  EXPECT_FALSE(rm->retireInactiveRegions());
+  for (auto rid : open) {
+    rm->doFlush(rid, false /* async */);
+  }
+  EXPECT_TRUE(waitRetired());
+  rm->drain();
+
+  // Only active regions are handed out
+  for (uint32_t i = 0; i < kNumRegions; i++) {
+    RegionId rid;
+    ASSERT_EQ(OpenStatus::Ready, rm->getCleanRegion(rid, false).first);
+    EXPECT_GT(2u, rid.index());
+    rm->doFlush(rid, false /* async */);
+    rm->drain();
+  }
+}
+
 TEST(RegionManager, Recovery) {
   constexpr uint32_t kNumRegions = 4;
   constexpr uint32_t kRegionSize = 4 * 1024;
@@ -47,6 +47,9 @@ class MockPolicy : public EvictionPolicy {
     ON_CALL(*this, evict()).WillByDefault(Invoke([this] {
       return fifo_.evict();
     }));
+    ON_CALL(*this, remove(_)).WillByDefault(Invoke([this](RegionId rid) {
+      return fifo_.remove(rid);
+    }));
     ON_CALL(*this, reset()).WillByDefault(Invoke([this]() {
       std::fill(hits_.begin(), hits_.end(), 0);
       fifo_.reset();
@@ -69,6 +72,7 @@ class MockPolicy : public EvictionPolicy {
   MOCK_METHOD1(track, void(const Region& region));
   MOCK_METHOD1(touch, void(RegionId rid));
   MOCK_METHOD0(evict, RegionId());
+  MOCK_METHOD1(remove, bool(RegionId rid));
   MOCK_METHOD0(reset, void());
   MOCK_CONST_METHOD0(memorySize, size_t());
   MOCK_CONST_METHOD1(getCounters, void(const CounterVisitor&));
@@ -19,16 +19,30 @@
 #include <folly/File.h>
 #include <folly/Format.h>
 #include <folly/Function.h>
+#include <folly/ScopeGuard.h>
+#include <folly/String.h>
 #include <folly/ThreadLocal.h>
 #include <folly/experimental/io/AsyncIO.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
 #include <folly/experimental/io/IoUring.h>
+#include <folly/fibers/Baton.h>
 #include <folly/fibers/TimedMutex.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <folly/io/async/EventHandler.h>
-
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <mutex>
 #include <numeric>
 
 #include "cachelib/navy/common/FdpNvme.h"
@@ -52,17 +66,24 @@ static constexpr size_t kIOTimeoutMs = 1000;
 // IO Operation type supported by IOReq
 enum OpType : uint8_t { INVALID = 0, READ, WRITE };
 
+// Invoked on completion of every IOOp with the index of the underlying
+// device (file) it went to, its size and its device latency in us
+using IOOpLatencyTracker =
+    std::function<void(uint32_t devIdx, uint32_t size, double latencyUs)>;
+
 struct IOOp {
   explicit IOOp(IOReq& parent,
                 int idx,
+                uint32_t devIdx,
                 int fd,
                 uint64_t offset,
                 uint32_t size,
                 void* data,
-                std::function<void(double)> trackIOOpDeviceLatency,
+                IOOpLatencyTracker trackIOOpDeviceLatency,
                 std::optional<int> placeHandle = std::nullopt)
       : parent_(parent),
         idx_(idx),
+        devIdx_(devIdx),
         fd_(fd),
         offset_(offset),
         size_(size),
@@ -77,6 +98,8 @@ struct IOOp {
   IOReq& parent_;
   // idx_ is the index of this op in the request
   const uint32_t idx_;
+  // Index of the device (file) this op goes to
+  const uint32_t devIdx_;
 
   // Params for read/write
   const int fd_;
@@ -84,7 +107,7 @@ struct IOOp {
   const uint32_t size_ = 0;
   void* const data_;
   // Completion - Submit
-  std::function<void(double)> trackIOOpDeviceLatency_;
+  IOOpLatencyTracker trackIOOpDeviceLatency_;
   std::optional<int> placeHandle_;
 
   // The number of resubmission on EAGAIN error
@@ -106,7 +129,7 @@ struct IOReq {
                  uint64_t offset,
                  uint32_t size,
                  void* data,
-                 std::function<void(double)> trackIOOpDeviceLatency,
+                 IOOpLatencyTracker trackIOOpDeviceLatency,
                  std::optional<int> placeHandle = std::nullopt);
 
   const char* getOpName() const {
@@ -175,7 +198,7 @@ class IoContext {
       uint64_t offset,
       uint32_t size,
       void* data,
-      std::function<void(double)> trackIOOpDeviceLatency);
+      IOOpLatencyTracker trackIOOpDeviceLatency);
 
   // Create and submit write req
   std::shared_ptr<IOReq> submitWrite(
@@ -184,7 +207,7 @@ class IoContext {
       uint64_t offset,
       uint32_t size,
       const void* data,
-      std::function<void(double)> trackIOOpDeviceLatency,
+      IOOpLatencyTracker trackIOOpDeviceLatency,
       int placeHandle);
 
   // Submit a IOOp to the device; should not fail for AsyncIoContext
@@ -228,17 +251,45 @@ class CompletionHandler : public folly::EventHandler {
   AsyncIoContext& ioContext_;
 };
 
+// Stats of batched io_uring submission, shared by the contexts of a device
+struct SubmitBatchStats {
+  // Number of io_uring_submit calls made for batches
+  AtomicCounter numBatches;
+  // Number of ops submitted as part of a batch
+  AtomicCounter numOps;
+  // Number of completions reaped right after a batch was submitted
+  AtomicCounter numInlineCompletions;
+};
+
+// Submits the ops queued by AsyncIoContext once per event loop iteration
+class SubmitBatcher : public folly::EventBase::LoopCallback {
+ public:
+  explicit SubmitBatcher(AsyncIoContext& ioContext) : ioContext_(ioContext) {}
+
+  void runLoopCallback() noexcept override;
+
+ private:
+  AsyncIoContext& ioContext_;
+};
+
 // Per-thread context for AsyncIO like libaio or io_uring
 class AsyncIoContext : public IoContext {
  public:
+  // @param batchStats  if not null and the context is driven by an
+  //                    EventBase with io_uring, IOs submitted by the fibers
+  //                    during one loop iteration are queued and handed to
+  //                    the kernel with a single io_uring_submit at the end
+  //                    of it
   AsyncIoContext(std::unique_ptr<folly::AsyncBase>&& asyncBase,
                  size_t id,
                  folly::EventBase* evb,
                  size_t capacity,
                  bool useIoUring,
-                 std::vector<std::shared_ptr<FdpNvme>> fdpNvmeVec);
+                 std::vector<std::shared_ptr<FdpNvme>> fdpNvmeVec,
+                 std::vector<struct iovec> fixedBuffers = {},
+                 SubmitBatchStats* batchStats = nullptr);
 
-  ~AsyncIoContext() override = default;
+  ~AsyncIoContext() override;
 
   std::string getName() override { return fmt::format("ctx_{}", id_); }
   // IO is completed sync if compHandler_ is not available
@@ -250,6 +301,10 @@ class AsyncIoContext : public IoContext {
   // operation have finished
   void pollCompletion();
 
+  // Submits the ops queued during this loop iteration and reaps the
+  // completions that are already available
+  void submitBatch();
+
  private:
   void handleCompletion(folly::Range<folly::AsyncBaseOp**>& completed);
 
@@ -258,6 +313,10 @@ class AsyncIoContext : public IoContext {
   // Prepare an Nvme CMD IO through IOUring
   std::unique_ptr<folly::AsyncBaseOp> prepNvmeIo(IOOp& op);
 
+  // Return the index of the registered buffer fully containing
+  // [data, data + size), or -1 if there is none
+  int findFixedBuffer(const void* data, size_t size) const;
+
   // The maximum number of retries when IO failed with EBUSY.
   // For now, this could happen only for io_uring when combined with md
   // devices due to, suspectedly, a different way the partial EAGAINs for
@@ -294,6 +353,17 @@ class AsyncIoContext : public IoContext {
   const std::vector<std::shared_ptr<FdpNvme>> fdpNvmeVec_{};
   // As of now, only one FDP enabled Device is supported
   static constexpr uint16_t kDefaultFdpIdx = 0u;
+
+  // Buffers registered with the io_uring instance, sorted by address.
+  // IOs on these are issued as READ_FIXED/WRITE_FIXED
+  std::vector<struct iovec> fixedBuffers_;
+
+  // Set when submissions are batched per event loop iteration
+  SubmitBatchStats* batchStats_{nullptr};
+  folly::EventBase* evb_{nullptr};
+  SubmitBatcher batcher_{*this};
+  // Prepared ops waiting for the end of the loop iteration
+  std::vector<folly::AsyncBaseOp*> pendingSubmits_;
 };
 
 // An FileDevice manages direct I/O to either a single or multiple (RAID0)
@@ -309,20 +379,84 @@ class FileDevice : public Device {
              uint32_t maxDeviceWriteSize,
              IoEngine ioEngine,
              uint32_t qDepthPerContext,
-             std::shared_ptr<DeviceEncryptor> encryptor);
+             std::shared_ptr<DeviceEncryptor> encryptor,
+             bool ioUringRegisterBuffers = false,
+             bool ioUringBatchSubmit = false);
 
   FileDevice(const FileDevice&) = delete;
   FileDevice& operator=(const FileDevice&) = delete;
 
+  void registerIOBuffers(
+      const std::vector<MutableBufferView>& buffers) override;
+
+  bool isDegraded(uint64_t offset) const override;
+
  private:
+  // Stats of one of the underlying devices (files) in a RAID0 setup
+  struct PerDeviceStats {
+    void trackRead(uint32_t size, double latencyUs) {
+      bytesRead.add(size);
+      readLatency.trackValue(latencyUs);
+      // Unsynchronized read-modify-write; a rough average is good enough
+      const auto now = getSteadyClock();
+      auto avg = getAvgReadLatencyUs(now);
+      avg = avg == 0 ? latencyUs : avg + (latencyUs - avg) * kLatencyEwmaWeight;
+      avgReadLatencyUs.store(avg, std::memory_order_relaxed);
+      lastReadTime.store(now, std::memory_order_relaxed);
+    }
+
+    // Returns the read latency average as of @now. It decays while the
+    // device is not read, so that a device that recovered while it was
+    // avoided is not reported degraded forever.
+    double getAvgReadLatencyUs(std::chrono::nanoseconds now) const {
+      const std::chrono::duration<double> idle =
+          now - lastReadTime.load(std::memory_order_relaxed);
+      return avgReadLatencyUs.load(std::memory_order_relaxed) *
+             std::exp2(-idle / kLatencyHalfLife);
+    }
+
+    void trackWrite(uint32_t size, double latencyUs) {
+      bytesWritten.add(size);
+      writeLatency.trackValue(latencyUs);
+    }
+
+    AtomicCounter bytesRead;
+    AtomicCounter bytesWritten;
+    util::PercentileStats readLatency;
+    util::PercentileStats writeLatency;
+    // Exponentially weighted moving average of read op latency
+    std::atomic<double> avgReadLatencyUs{0};
+    // When the average was last updated
+    std::atomic<std::chrono::nanoseconds> lastReadTime{};
+  };
+
+  // Weight of a new sample in the read latency moving average
+  static constexpr double kLatencyEwmaWeight = 1.0 / 64;
+  // Time it takes the read latency average of a device that is not read to
+  // halve
+  static constexpr std::chrono::seconds kLatencyHalfLife{10};
+  // A device is degraded when its average read latency is this many times
+  // the one of the fastest device ...
+  static constexpr double kDegradedLatencyFactor = 4.0;
+  // ... and above this absolute floor, so that noise on fast devices
+  // doesn't flag them
+  static constexpr double kMinDegradedLatencyUs = 1000.0;
+
   IoContext* getIoContext();
 
+  bool isDeviceDegraded(uint32_t devIdx) const;
+
+  void getPerDeviceCounters(const CounterVisitor& visitor) const override;
+
   bool writeImpl(uint64_t, uint32_t, const void*, int) override;
 
   bool readImpl(uint64_t, uint32_t, void*) override;
 
   void flushImpl() override;
 
+  // BLKDISCARD on block devices, punching a hole in regular files
+  bool discardImpl(uint64_t offset, uint64_t size) override;
+
   int allocatePlacementHandle() override;
 
   // File vector for devices or regular files
@@ -351,8 +485,22 @@ class FileDevice : public Device {
   // determine the capacity of an io_uring/libaio queue
   const uint32_t qDepthPerContext_;
 
+  // Whether long-lived IO buffers are registered with each io_uring context
+  const bool ioUringRegisterBuffers_;
+  // Buffers passed via registerIOBuffers(), sorted by address. Each new
+  // io_uring context registers a snapshot of this list
+  std::mutex fixedBuffersMutex_;
+  std::vector<struct iovec> fixedBuffers_;
+
+  // Whether io_uring contexts batch their submissions per loop iteration
+  const bool ioUringBatchSubmit_;
+  SubmitBatchStats submitBatchStats_;
+
   AtomicCounter numProcessed_{0};
 
+  // One entry per file when multiple files are used, empty otherwise
+  std::vector<std::unique_ptr<PerDeviceStats>> perDeviceStats_;
+
   friend class IoContext;
 };
 
@@ -391,43 +539,218 @@ class MemoryDevice final : public Device {
     // Noop
   }
 
+  bool discardImpl(uint64_t offset, uint64_t size) override {
+    XDCHECK_LE(offset + size, getSize());
+    std::memset(buffer_.get() + offset, 0, size);
+    return true;
+  }
+
   std::unique_ptr<uint8_t[]> buffer_;
 };
 } // namespace
 
-bool Device::write(uint64_t offset, BufferView view, int placeHandle) {
+struct Device::CryptoTask {
+  folly::fibers::Baton baton;
+  bool result{false};
+};
+
+bool Device::write(uint64_t offset,
+                   BufferView view,
+                   int placeHandle,
+                   IoClass ioClass) {
   if (encryptor_) {
     auto writeBuffer = makeIOBuffer(view.size());
     writeBuffer.copyFrom(0, view);
-    return write(offset, std::move(writeBuffer), placeHandle);
+    return write(offset, std::move(writeBuffer), placeHandle, ioClass);
   }
 
   const auto size = view.size();
   XDCHECK_LE(offset + size, size_);
   const uint8_t* data = reinterpret_cast<const uint8_t*>(view.data());
-  return writeInternal(offset, data, size, placeHandle);
+  return writeInternal(offset, data, size, placeHandle, ioClass);
 }
 
-bool Device::write(uint64_t offset, Buffer buffer, int placeHandle) {
+bool Device::write(uint64_t offset,
+                   Buffer buffer,
+                   int placeHandle,
+                   IoClass ioClass) {
   const auto size = buffer.size();
   XDCHECK_LE(offset + buffer.size(), size_);
   uint8_t* data = reinterpret_cast<uint8_t*>(buffer.data());
   XDCHECK_EQ(reinterpret_cast<uint64_t>(data) % ioAlignmentSize_, 0ul);
   if (encryptor_) {
     XCHECK_EQ(offset % encryptor_->encryptionBlockSize(), 0ul);
-    auto res = encryptor_->encrypt(folly::MutableByteRange{data, size}, offset);
-    if (!res) {
+    if (shouldPipelineCrypto(size)) {
+      return writeEncryptedPipelined(offset, data, size, placeHandle, ioClass);
+    }
+    if (!cryptBatch(data, size, offset, true /* encrypt */)) {
       encryptionErrors_.inc();
       return false;
     }
   }
-  return writeInternal(offset, data, size, placeHandle);
+  return writeInternal(offset, data, size, placeHandle, ioClass);
+}
+
+bool Device::writeEncryptedPipelined(uint64_t offset,
+                                     uint8_t* data,
+                                     size_t size,
+                                     int placeHandle,
+                                     IoClass ioClass) {
+  // Queue all chunks up front so that the pool works ahead of the writes
+  std::vector<std::unique_ptr<CryptoTask>> tasks;
+  for (size_t pos = 0; pos < size; pos += cryptoChunkSize_) {
+    auto len = std::min(cryptoChunkSize_, size - pos);
+    tasks.push_back(scheduleCrypto(data + pos, len, offset + pos, true));
+  }
+  // The pool writes into @data; never return while a task is running
+  SCOPE_EXIT {
+    for (auto& task : tasks) {
+      task->baton.wait();
+    }
+  };
+
+  for (size_t i = 0; i < tasks.size(); i++) {
+    tasks[i]->baton.wait();
+    if (!tasks[i]->result) {
+      encryptionErrors_.inc();
+      return false;
+    }
+    auto pos = i * cryptoChunkSize_;
+    auto len = std::min(cryptoChunkSize_, size - pos);
+    if (!writeInternal(offset + pos, data + pos, len, placeHandle, ioClass)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Device::cryptBatch(uint8_t* data,
+                        size_t size,
+                        uint64_t offset,
+                        bool encrypt) const {
+  const uint32_t blockSize = encryptor_->encryptionBlockSize();
+  const size_t rangeSize =
+      std::max<size_t>(kCryptoRangeSize / blockSize, 1) * blockSize;
+  std::vector<CryptoRange> ranges;
+  ranges.reserve((size + rangeSize - 1) / rangeSize);
+  for (size_t pos = 0; pos < size; pos += rangeSize) {
+    auto len = std::min(rangeSize, size - pos);
+    ranges.push_back(
+        CryptoRange{folly::MutableByteRange{data + pos, len}, offset + pos});
+  }
+  folly::Range<const CryptoRange*> batch{ranges.data(), ranges.size()};
+  return encrypt ? encryptor_->encryptBatch(batch)
+                 : encryptor_->decryptBatch(batch);
+}
+
+std::unique_ptr<Device::CryptoTask> Device::scheduleCrypto(uint8_t* data,
+                                                           size_t size,
+                                                           uint64_t offset,
+                                                           bool encrypt) {
+  auto task = std::make_unique<CryptoTask>();
+  cryptoExecutor_->add([this, t = task.get(), data, size, offset, encrypt] {
+    t->result = cryptBatch(data, size, offset, encrypt);
+    t->baton.post();
+  });
+  return task;
+}
+
+void Device::setEncryptionThreads(uint32_t numThreads) {
+  if (!encryptor_ || numThreads == 0) {
+    cryptoExecutor_.reset();
+    return;
+  }
+  const uint32_t blockSize = encryptor_->encryptionBlockSize();
+  const size_t chunkSize =
+      maxWriteSize_ != 0 ? maxWriteSize_ : kDefaultCryptoChunkSize;
+  cryptoChunkSize_ = std::max<size_t>(chunkSize / blockSize, 1) * blockSize;
+  if (maxIOSize_ != 0) {
+    // A pipelined read issues one device read per chunk
+    cryptoChunkSize_ = std::min<size_t>(cryptoChunkSize_, maxIOSize_);
+  }
+  cryptoExecutor_ = std::make_unique<folly::CPUThreadPoolExecutor>(
+      numThreads,
+      std::make_shared<folly::NamedThreadFactory>("navy_crypto"));
+}
+
+void Device::setDiscard(bool enable, uint64_t maxBytesPerSec) {
+  discardEnabled_ = enable;
+  maxDiscardRate_ = maxBytesPerSec;
+}
+
+bool Device::discard(uint64_t offset, uint64_t size) {
+  if (!discardEnabled_ || size == 0) {
+    return false;
+  }
+  XDCHECK_EQ(offset % ioAlignmentSize_, 0ul);
+  XDCHECK_EQ(size % ioAlignmentSize_, 0ul);
+  XDCHECK_LE(offset + size, size_);
+  if (!tryConsumeDiscardBudget(size)) {
+    discardsThrottled_.inc();
+    return false;
+  }
+  if (!discardImpl(offset, size)) {
+    discardErrors_.inc();
+    return false;
+  }
+  bytesDiscarded_.add(size);
+  return true;
+}
+
+bool Device::tryConsumeDiscardBudget(uint64_t size) {
+  if (maxDiscardRate_ == 0) {
+    return true;
+  }
+  const int64_t nowSec =
+      std::chrono::duration_cast<std::chrono::seconds>(getSteadyClock())
+          .count();
+  std::lock_guard<std::mutex> lock{discardMutex_};
+  if (nowSec != discardWindowSec_) {
+    discardWindowSec_ = nowSec;
+    discardWindowBytes_ = 0;
+  }
+  if (discardWindowBytes_ > 0 && discardWindowBytes_ + size > maxDiscardRate_) {
+    return false;
+  }
+  discardWindowBytes_ += size;
+  return true;
+}
+
+void Device::setIoClassInflightLimit(IoClass ioClass, uint32_t limit) {
+  auto idx = static_cast<size_t>(ioClass);
+  if (limit == 0) {
+    ioClassSlots_[idx].reset();
+  } else {
+    ioClassSlots_[idx] = std::make_unique<folly::fibers::Semaphore>(limit);
+  }
+}
+
+void Device::acquireIoClassSlot(IoClass ioClass) {
+  auto idx = static_cast<size_t>(ioClass);
+  if (!ioClassSlots_[idx]) {
+    return;
+  }
+  auto timeBegin = getSteadyClock();
+  ioClassSlots_[idx]->wait();
+  ioClassQueueDelayEstimators_[idx].trackValue(
+      toMicros(getSteadyClock() - timeBegin).count());
+}
+
+void Device::releaseIoClassSlot(IoClass ioClass) {
+  auto idx = static_cast<size_t>(ioClass);
+  if (ioClassSlots_[idx]) {
+    ioClassSlots_[idx]->signal();
+  }
 }
 
 bool Device::writeInternal(uint64_t offset,
                            const uint8_t* data,
                            size_t size,
-                           int placeHandle) {
+                           int placeHandle,
+                           IoClass ioClass) {
+  acquireIoClassSlot(ioClass);
+  SCOPE_EXIT { releaseIoClassSlot(ioClass); };
+
   auto remainingSize = size;
   auto maxWriteSize = (maxWriteSize_ == 0) ? remainingSize : maxWriteSize_;
   bool result = true;
@@ -460,15 +783,34 @@ bool Device::writeInternal(uint64_t offset,
 // reads size number of bytes from the device from the offset into value.
 // Both offset and size are expected to be aligned for device IO operations.
 // If successful and encryptor_ is defined, size bytes from
-// validDataOffsetInValue offset in value are decrypted.
+// validDataOffsetInValue offset in value are decrypted. With a crypto pool,
+// large reads decrypt each chunk on the pool while the next one is read.
 //
 // returns true if successful, false otherwise.
-bool Device::readInternal(uint64_t offset, uint32_t size, void* value) {
+bool Device::readInternal(uint64_t offset,
+                          uint32_t size,
+                          void* value,
+                          IoClass ioClass) {
   XDCHECK_EQ(reinterpret_cast<uint64_t>(value) % ioAlignmentSize_, 0ul);
   XDCHECK_LE(offset + size, size_);
+  acquireIoClassSlot(ioClass);
+  SCOPE_EXIT { releaseIoClassSlot(ioClass); };
+
   uint8_t* data = reinterpret_cast<uint8_t*>(value);
   auto remainingSize = size;
   auto maxReadSize = (maxIOSize_ == 0) ? remainingSize : maxIOSize_;
+  const bool pipelined = encryptor_ && shouldPipelineCrypto(size);
+  std::vector<std::unique_ptr<CryptoTask>> decryptTasks;
+  if (pipelined) {
+    XCHECK_EQ(offset % encryptor_->encryptionBlockSize(), 0ul);
+    maxReadSize = cryptoChunkSize_;
+  }
+  // The pool writes into @value; never return while a task is running
+  SCOPE_EXIT {
+    for (auto& task : decryptTasks) {
+      task->baton.wait();
+    }
+  };
   bool result = true;
   uint64_t curOffset = offset;
   while (remainingSize > 0) {
@@ -486,16 +828,26 @@ bool Device::readInternal(uint64_t offset, uint32_t size, void* value) {
       return false;
     }
     bytesRead_.add(readSize);
+    if (pipelined) {
+      decryptTasks.push_back(
+          scheduleCrypto(data, readSize, curOffset, false /* encrypt */));
+    }
     curOffset += readSize;
     data += readSize;
     remainingSize -= readSize;
   }
-  if (encryptor_) {
+  if (pipelined) {
+    for (auto& task : decryptTasks) {
+      task->baton.wait();
+      if (!task->result) {
+        decryptionErrors_.inc();
+        return false;
+      }
+    }
+  } else if (encryptor_) {
     XCHECK_EQ(offset % encryptor_->encryptionBlockSize(), 0ul);
-    auto res = encryptor_->decrypt(
-        folly::MutableByteRange{reinterpret_cast<uint8_t*>(value), size},
-        offset);
-    if (!res) {
+    if (!cryptBatch(reinterpret_cast<uint8_t*>(value), size, offset,
+                    false /* encrypt */)) {
       decryptionErrors_.inc();
       return false;
     }
@@ -511,7 +863,7 @@ bool Device::readInternal(uint64_t offset, uint32_t size, void* value) {
 // the front and back.
 // An empty buffer is returned in case of error and the caller must check
 // the buffer size returned with size passed in to check for errors.
-Buffer Device::read(uint64_t offset, uint32_t size) {
+Buffer Device::read(uint64_t offset, uint32_t size, IoClass ioClass) {
   XDCHECK_LE(offset + size, size_);
   uint64_t readOffset =
       offset & ~(static_cast<uint64_t>(ioAlignmentSize_) - 1ul);
@@ -519,7 +871,7 @@ Buffer Device::read(uint64_t offset, uint32_t size) {
       offset & (static_cast<uint64_t>(ioAlignmentSize_) - 1ul);
   auto readSize = getIOAlignedSize(readPrefixSize + size);
   auto buffer = makeIOBuffer(readSize);
-  bool result = readInternal(readOffset, readSize, buffer.data());
+  bool result = readInternal(readOffset, readSize, buffer.data(), ioClass);
   if (!result) {
     return Buffer{};
   }
@@ -530,8 +882,11 @@ Buffer Device::read(uint64_t offset, uint32_t size) {
 
 // This API reads size bytes from the Device from the offset into value.
 // Both offset and size are expected to be IO aligned.
-bool Device::read(uint64_t offset, uint32_t size, void* value) {
-  return readInternal(offset, size, value);
+bool Device::read(uint64_t offset,
+                  uint32_t size,
+                  void* value,
+                  IoClass ioClass) {
+  return readInternal(offset, size, value, ioClass);
 }
 
 void Device::getCounters(const CounterVisitor& visitor) const {
@@ -547,6 +902,12 @@ void Device::getCounters(const CounterVisitor& visitor) const {
           CounterVisitor::CounterType::RATE);
   visitor("navy_device_decryption_errors", decryptionErrors_.get(),
           CounterVisitor::CounterType::RATE);
+  visitor("navy_device_bytes_discarded", bytesDiscarded_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_device_discard_errors", discardErrors_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_device_discards_throttled", discardsThrottled_.get(),
+          CounterVisitor::CounterType::RATE);
 
   readIOOpDeviceLatencyEstimator_.visitQuantileEstimator(
       visitor, "navy_device_async_io_op_read_device_latency_us");
@@ -556,6 +917,15 @@ void Device::getCounters(const CounterVisitor& visitor) const {
                                                "navy_device_read_latency_us");
   writeLatencyEstimator_.visitQuantileEstimator(visitor,
                                                 "navy_device_write_latency_us");
+  for (size_t i = 0; i < kNumIoClasses; i++) {
+    if (ioClassSlots_[i]) {
+      ioClassQueueDelayEstimators_[i].visitQuantileEstimator(
+          visitor,
+          folly::sformat("navy_device_{}_queue_delay_us",
+                         getIoClassName(static_cast<IoClass>(i))));
+    }
+  }
+  getPerDeviceCounters(visitor);
 }
 
 namespace {
@@ -591,7 +961,8 @@ bool IOOp::done(ssize_t len) {
                        toMillis(curTime - submitTime_).count(), toString());
   }
 
-  trackIOOpDeviceLatency_(toMicros(curTime - submitTime_).count());
+  trackIOOpDeviceLatency_(devIdx_, size_,
+                          toMicros(curTime - submitTime_).count());
 
   parent_.notifyOpResult(result);
   return result;
@@ -608,7 +979,7 @@ IOReq::IOReq(IoContext& context,
              uint64_t offset,
              uint32_t size,
              void* data,
-             std::function<void(double)> trackIOOpDeviceLatency,
+             IOOpLatencyTracker trackIOOpDeviceLatency,
              std::optional<int> placeHandle)
     : context_(context),
       opType_(opType),
@@ -627,7 +998,7 @@ IOReq::IOReq(IoContext& context,
       uint32_t ioOffsetInStripe = offset % stripeSize;
       uint32_t allowedIOSize = std::min(size, stripeSize - ioOffsetInStripe);
 
-      ops_.emplace_back(*this, idx++, fvec[fdIdx].fd(),
+      ops_.emplace_back(*this, idx++, fdIdx, fvec[fdIdx].fd(),
                         stripeStartOffset + ioOffsetInStripe, allowedIOSize,
                         buf, trackIOOpDeviceLatency, placeHandle_);
 
@@ -636,7 +1007,7 @@ IOReq::IOReq(IoContext& context,
       buf += allowedIOSize;
     }
   } else {
-    ops_.emplace_back(*this, idx++, fvec[0].fd(), offset_, size_, data_,
+    ops_.emplace_back(*this, idx++, 0, fvec[0].fd(), offset_, size_, data_,
                       trackIOOpDeviceLatency, placeHandle_);
   }
 
@@ -693,6 +1064,11 @@ void CompletionHandler::handlerReady(uint16_t /*events*/) noexcept {
   ioContext_.pollCompletion();
 }
 
+/*
+ * SubmitBatcher
+ */
+void SubmitBatcher::runLoopCallback() noexcept { ioContext_.submitBatch(); }
+
 /*
  * IoContext
  */
@@ -702,7 +1078,7 @@ std::shared_ptr<IOReq> IoContext::submitRead(
     uint64_t offset,
     uint32_t size,
     void* data,
-    std::function<void(double)> trackIOOpDeviceLatency) {
+    IOOpLatencyTracker trackIOOpDeviceLatency) {
   auto req =
       std::make_shared<IOReq>(*this, fvec, stripeSize, OpType::READ, offset,
                               size, data, trackIOOpDeviceLatency);
@@ -716,7 +1092,7 @@ std::shared_ptr<IOReq> IoContext::submitWrite(
     uint64_t offset,
     uint32_t size,
     const void* data,
-    std::function<void(double)> trackIOOpDeviceLatency,
+    IOOpLatencyTracker trackIOOpDeviceLatency,
     int placeHandle) {
   auto req = std::make_shared<IOReq>(*this, fvec, stripeSize, OpType::WRITE,
                                      offset, size, const_cast<void*>(data),
@@ -777,20 +1153,46 @@ AsyncIoContext::AsyncIoContext(std::unique_ptr<folly::AsyncBase>&& asyncBase,
                                folly::EventBase* evb,
                                size_t capacity,
                                bool useIoUring,
-                               std::vector<std::shared_ptr<FdpNvme>> fdpNvmeVec)
+                               std::vector<std::shared_ptr<FdpNvme>> fdpNvmeVec,
+                               std::vector<struct iovec> fixedBuffers,
+                               SubmitBatchStats* batchStats)
     : asyncBase_(std::move(asyncBase)),
       id_(id),
       qDepth_(capacity),
       useIoUring_(useIoUring),
-      fdpNvmeVec_(fdpNvmeVec) {
+      fdpNvmeVec_(fdpNvmeVec),
+      fixedBuffers_(std::move(fixedBuffers)) {
 #ifdef CACHELIB_IOURING_DISABLE
   // io_uring is not available on the system
   XDCHECK(!useIoUring_ && !(fdpNvmeVec_.size() > 0));
   useIoUring_ = false;
+  fixedBuffers_.clear();
+  batchStats = nullptr;
+#else
+  if (!useIoUring_) {
+    fixedBuffers_.clear();
+  }
+  if (!fixedBuffers_.empty()) {
+    auto ret = static_cast<folly::IoUring*>(asyncBase_.get())
+                   ->register_buffers(fixedBuffers_.data(),
+                                      fixedBuffers_.size());
+    if (ret != 0) {
+      // Most likely RLIMIT_MEMLOCK is too low. Fall back to regular IOs
+      XLOGF(ERR, "[{}] Failed to register {} io buffers: {}", getName(),
+            fixedBuffers_.size(), std::strerror(-ret));
+      fixedBuffers_.clear();
+    }
+  }
 #endif
   if (evb) {
     compHandler_ =
         std::make_unique<CompletionHandler>(*this, evb, asyncBase_->pollFd());
+    // Batching is only done for io_uring
+    if (batchStats && useIoUring_) {
+      batchStats_ = batchStats;
+      evb_ = evb;
+      pendingSubmits_.reserve(qDepth_);
+    }
   } else {
     // If EventBase is not provided, the completion will be waited
     // synchronously instead of being notified via epoll
@@ -800,10 +1202,18 @@ AsyncIoContext::AsyncIoContext(std::unique_ptr<folly::AsyncBase>&& asyncBase,
   }
 
   XLOGF(INFO,
-        "[{}] Created new async io context with qdepth {}{} io_engine {} {}",
+        "[{}] Created new async io context with qdepth {}{} io_engine {} {} "
+        "fixed_buffers {} batch_submit {}",
         getName(), qDepth_, qDepth_ == 1 ? " (sync wait)" : "",
         useIoUring_ ? "io_uring" : "libaio",
-        (fdpNvmeVec_.size() > 0) ? "FDP enabled" : "");
+        (fdpNvmeVec_.size() > 0) ? "FDP enabled" : "", fixedBuffers_.size(),
+        batchStats_ != nullptr);
+}
+
+AsyncIoContext::~AsyncIoContext() {
+  // Contexts go away with their thread, after its loop has stopped
+  XDCHECK(pendingSubmits_.empty());
+  batcher_.cancelLoopCallback();
 }
 
 void AsyncIoContext::pollCompletion() {
@@ -811,6 +1221,37 @@ void AsyncIoContext::pollCompletion() {
   handleCompletion(completed);
 }
 
+void AsyncIoContext::submitBatch() {
+  if (pendingSubmits_.empty()) {
+    return;
+  }
+  // Completions and retries below may queue more ops; they go to the next
+  // batch
+  std::vector<folly::AsyncBaseOp*> ops;
+  ops.reserve(qDepth_);
+  std::swap(ops, pendingSubmits_);
+
+  const auto now = getSteadyClock();
+  for (auto* aop : ops) {
+    reinterpret_cast<IOOp*>(aop->getUserData())->submitTime_ = now;
+  }
+  folly::Range<folly::AsyncBaseOp**> range{ops.data(), ops.size()};
+  while (!range.empty()) {
+    // The submission may stop short of the whole range
+    auto submitted = asyncBase_->submit(range);
+    XCHECK_GT(submitted, 0);
+    range.advance(submitted);
+  }
+  batchStats_->numBatches.inc();
+  batchStats_->numOps.add(ops.size());
+
+  // Whatever completed while the fibers of this iteration were running can
+  // be handled now instead of after another trip through epoll
+  auto completed = asyncBase_->pollCompleted();
+  batchStats_->numInlineCompletions.add(completed.size());
+  handleCompletion(completed);
+}
+
 void AsyncIoContext::handleCompletion(
     folly::Range<folly::AsyncBaseOp**>& completed) {
   for (auto op : completed) {
@@ -874,7 +1315,16 @@ bool AsyncIoContext::submitIo(IOOp& op) {
   std::unique_ptr<folly::AsyncBaseOp> asyncOp;
   asyncOp = prepAsyncIo(op);
   asyncOp->setUserData(&op);
-  asyncBase_->submit(asyncOp.release());
+  if (batchStats_) {
+    // Handed to the kernel by submitBatch() once the fibers runnable in
+    // this loop iteration have had their turn
+    pendingSubmits_.push_back(asyncOp.release());
+    if (!batcher_.isLoopCallbackScheduled()) {
+      evb_->runInLoop(&batcher_, true /* thisIteration */);
+    }
+  } else {
+    asyncBase_->submit(asyncOp.release());
+  }
 
   numOutstanding_++;
   numSubmitted_++;
@@ -904,16 +1354,46 @@ std::unique_ptr<folly::AsyncBaseOp> AsyncIoContext::prepAsyncIo(IOOp& op) {
     asyncOp = std::make_unique<folly::AsyncIOOp>();
   }
 
+  const int bufIdx = findFixedBuffer(op.data_, op.size_);
   if (req.opType_ == OpType::READ) {
-    asyncOp->pread(op.fd_, op.data_, op.size_, op.offset_);
+    if (bufIdx >= 0) {
+      asyncOp->pread(op.fd_, op.data_, op.size_, op.offset_, bufIdx);
+    } else {
+      asyncOp->pread(op.fd_, op.data_, op.size_, op.offset_);
+    }
   } else {
     XDCHECK_EQ(req.opType_, OpType::WRITE);
-    asyncOp->pwrite(op.fd_, op.data_, op.size_, op.offset_);
+    if (bufIdx >= 0) {
+      asyncOp->pwrite(op.fd_, op.data_, op.size_, op.offset_, bufIdx);
+    } else {
+      asyncOp->pwrite(op.fd_, op.data_, op.size_, op.offset_);
+    }
   }
 
   return asyncOp;
 }
 
+int AsyncIoContext::findFixedBuffer(const void* data, size_t size) const {
+  if (fixedBuffers_.empty()) {
+    return -1;
+  }
+  auto addr = reinterpret_cast<uintptr_t>(data);
+  auto it = std::upper_bound(
+      fixedBuffers_.begin(), fixedBuffers_.end(), addr,
+      [](uintptr_t a, const struct iovec& iov) {
+        return a < reinterpret_cast<uintptr_t>(iov.iov_base);
+      });
+  if (it == fixedBuffers_.begin()) {
+    return -1;
+  }
+  --it;
+  auto base = reinterpret_cast<uintptr_t>(it->iov_base);
+  if (addr + size > base + it->iov_len) {
+    return -1;
+  }
+  return static_cast<int>(it - fixedBuffers_.begin());
+}
+
 std::unique_ptr<folly::AsyncBaseOp> AsyncIoContext::prepNvmeIo(IOOp& op) {
 #ifndef CACHELIB_IOURING_DISABLE
   std::unique_ptr<folly::IoUringOp> iouringCmdOp;
@@ -951,7 +1431,9 @@ FileDevice::FileDevice(std::vector<folly::File>&& fvec,
                        uint32_t maxDeviceWriteSize,
                        IoEngine ioEngine,
                        uint32_t qDepthPerContext,
-                       std::shared_ptr<DeviceEncryptor> encryptor)
+                       std::shared_ptr<DeviceEncryptor> encryptor,
+                       bool ioUringRegisterBuffers,
+                       bool ioUringBatchSubmit)
     : Device(fileSize * fvec.size(),
              std::move(encryptor),
              blockSize,
@@ -961,7 +1443,12 @@ FileDevice::FileDevice(std::vector<folly::File>&& fvec,
       fdpNvmeVec_(std::move(fdpNvmeVec)),
       stripeSize_(stripeSize),
       ioEngine_(ioEngine),
-      qDepthPerContext_(qDepthPerContext) {
+      qDepthPerContext_(qDepthPerContext),
+      ioUringRegisterBuffers_(ioUringRegisterBuffers &&
+                              ioEngine == IoEngine::IoUring &&
+                              fdpNvmeVec_.empty()),
+      ioUringBatchSubmit_(ioUringBatchSubmit &&
+                          ioEngine == IoEngine::IoUring) {
   XDCHECK_GT(blockSize, 0u);
   if (fvec_.size() > 1) {
     XDCHECK_GT(stripeSize_, 0u);
@@ -983,6 +1470,12 @@ FileDevice::FileDevice(std::vector<folly::File>&& fvec,
   // 2. if io engine is Async, then qdepth per context must be greater than 0
   XDCHECK(ioEngine_ == IoEngine::Sync || qDepthPerContext_ > 0u);
 
+  if (fvec_.size() > 1) {
+    for (size_t i = 0; i < fvec_.size(); i++) {
+      perDeviceStats_.push_back(std::make_unique<PerDeviceStats>());
+    }
+  }
+
   // Create sync io context. It will be also used for async io as well
   // for the path where device IO is called from non-fiber thread
   // (e.g., recovery path, read random alloc path)
@@ -992,15 +1485,82 @@ FileDevice::FileDevice(std::vector<folly::File>&& fvec,
       INFO,
       "Created device with num_devices {} size {} block_size {},"
       "stripe_size {} max_write_size {} max_io_size {} io_engine {} qdepth {},"
-      "num_fdp_devices {}",
+      "num_fdp_devices {} io_uring_register_buffers {} "
+      "io_uring_batch_submit {}",
       fvec_.size(), getSize(), blockSize, stripeSize, maxDeviceWriteSize,
       maxIOSize, getIoEngineName(ioEngine_), qDepthPerContext_,
-      fdpNvmeVec_.size());
+      fdpNvmeVec_.size(), ioUringRegisterBuffers_, ioUringBatchSubmit_);
+}
+
+void FileDevice::registerIOBuffers(
+    const std::vector<MutableBufferView>& buffers) {
+  if (!ioUringRegisterBuffers_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{fixedBuffersMutex_};
+  for (const auto& buf : buffers) {
+    fixedBuffers_.push_back(struct iovec{buf.data(), buf.size()});
+  }
+  std::sort(fixedBuffers_.begin(), fixedBuffers_.end(),
+            [](const struct iovec& a, const struct iovec& b) {
+              return a.iov_base < b.iov_base;
+            });
+}
+
+bool FileDevice::isDegraded(uint64_t offset) const {
+  if (perDeviceStats_.empty()) {
+    return false;
+  }
+  return isDeviceDegraded((offset / stripeSize_) % fvec_.size());
+}
+
+bool FileDevice::isDeviceDegraded(uint32_t devIdx) const {
+  const auto now = getSteadyClock();
+  double minLatency = std::numeric_limits<double>::max();
+  for (const auto& stats : perDeviceStats_) {
+    auto avg = stats->getAvgReadLatencyUs(now);
+    if (avg > 0) {
+      minLatency = std::min(minLatency, avg);
+    }
+  }
+  auto latency = perDeviceStats_[devIdx]->getAvgReadLatencyUs(now);
+  return latency > kMinDegradedLatencyUs &&
+         latency > minLatency * kDegradedLatencyFactor;
+}
+
+void FileDevice::getPerDeviceCounters(const CounterVisitor& visitor) const {
+  if (ioUringBatchSubmit_) {
+    visitor("navy_device_io_uring_submit_batches",
+            submitBatchStats_.numBatches.get(),
+            CounterVisitor::CounterType::RATE);
+    visitor("navy_device_io_uring_batched_ops", submitBatchStats_.numOps.get(),
+            CounterVisitor::CounterType::RATE);
+    visitor("navy_device_io_uring_inline_completions",
+            submitBatchStats_.numInlineCompletions.get(),
+            CounterVisitor::CounterType::RATE);
+  }
+  for (uint32_t i = 0; i < perDeviceStats_.size(); i++) {
+    const auto& stats = *perDeviceStats_[i];
+    visitor(folly::sformat("navy_device_{}_bytes_read", i),
+            stats.bytesRead.get(), CounterVisitor::CounterType::RATE);
+    visitor(folly::sformat("navy_device_{}_bytes_written", i),
+            stats.bytesWritten.get(), CounterVisitor::CounterType::RATE);
+    visitor(folly::sformat("navy_device_{}_degraded", i),
+            isDeviceDegraded(i) ? 1 : 0);
+    perDeviceStats_[i]->readLatency.visitQuantileEstimator(
+        visitor, folly::sformat("navy_device_{}_read_latency_us", i));
+    perDeviceStats_[i]->writeLatency.visitQuantileEstimator(
+        visitor, folly::sformat("navy_device_{}_write_latency_us", i));
+  }
 }
 
 bool FileDevice::readImpl(uint64_t offset, uint32_t size, void* value) {
-  auto trackIOOpDeviceLatency = [this](double value) {
-    readIOOpDeviceLatencyEstimator_.trackValue(value);
+  auto trackIOOpDeviceLatency = [this](uint32_t devIdx, uint32_t opSize,
+                                       double latencyUs) {
+    readIOOpDeviceLatencyEstimator_.trackValue(latencyUs);
+    if (!perDeviceStats_.empty()) {
+      perDeviceStats_[devIdx]->trackRead(opSize, latencyUs);
+    }
   };
   auto req = getIoContext()->submitRead(fvec_, stripeSize_, offset, size, value,
                                         std::move(trackIOOpDeviceLatency));
@@ -1011,8 +1571,12 @@ bool FileDevice::writeImpl(uint64_t offset,
                            uint32_t size,
                            const void* value,
                            int placeHandle) {
-  auto trackIOOpDeviceLatency = [this](double value) {
-    writeIOOpDeviceLatencyEstimator_.trackValue(value);
+  auto trackIOOpDeviceLatency = [this](uint32_t devIdx, uint32_t opSize,
+                                       double latencyUs) {
+    writeIOOpDeviceLatencyEstimator_.trackValue(latencyUs);
+    if (!perDeviceStats_.empty()) {
+      perDeviceStats_[devIdx]->trackWrite(opSize, latencyUs);
+    }
   };
   auto req = getIoContext()->submitWrite(
       fvec_, stripeSize_, offset, size, value,
@@ -1026,6 +1590,50 @@ void FileDevice::flushImpl() {
   }
 }
 
+bool FileDevice::discardImpl(uint64_t offset, uint64_t size) {
+  auto discardRange = [](int fd, uint64_t rangeOffset, uint64_t rangeSize) {
+    struct stat st = {};
+    if (::fstat(fd, &st) != 0) {
+      return false;
+    }
+    if (S_ISBLK(st.st_mode)) {
+      uint64_t range[2] = {rangeOffset, rangeSize};
+      return ::ioctl(fd, BLKDISCARD, &range) == 0;
+    }
+    return ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                       rangeOffset, rangeSize) == 0;
+  };
+
+  bool result = true;
+  if (fvec_.size() > 1) {
+    // Split along RAID0 stripes the same way IOReq does
+    uint64_t curOffset = offset;
+    uint64_t remaining = size;
+    while (remaining > 0) {
+      uint64_t stripe = curOffset / stripeSize_;
+      uint32_t fdIdx = stripe % fvec_.size();
+      uint64_t stripeStartOffset = (stripe / fvec_.size()) * stripeSize_;
+      uint64_t offsetInStripe = curOffset % stripeSize_;
+      uint64_t rangeSize = std::min(remaining, stripeSize_ - offsetInStripe);
+      result = discardRange(fvec_[fdIdx].fd(),
+                            stripeStartOffset + offsetInStripe, rangeSize);
+      if (!result) {
+        break;
+      }
+      remaining -= rangeSize;
+      curOffset += rangeSize;
+    }
+  } else {
+    result = discardRange(fvec_[0].fd(), offset, size);
+  }
+  if (!result) {
+    XLOG_EVERY_MS(ERR, 10'000) << fmt::format(
+        "Discard failed at offset {} size {}: {}", offset, size,
+        folly::errnoStr(errno));
+  }
+  return result;
+}
+
 IoContext* FileDevice::getIoContext() {
   if (ioEngine_ == IoEngine::Sync) {
     return syncIoContext_.get();
@@ -1076,10 +1684,17 @@ IoContext* FileDevice::getIoContext() {
       asyncBase = std::make_unique<folly::AsyncIO>(qDepthPerContext_, pollMode);
     }
 
+    std::vector<struct iovec> fixedBuffers;
+    if (ioUringRegisterBuffers_) {
+      std::lock_guard<std::mutex> lock{fixedBuffersMutex_};
+      fixedBuffers = fixedBuffers_;
+    }
+
     auto idx = incrementalIdx_++;
-    tlContext_.reset(new AsyncIoContext(std::move(asyncBase), idx, evb,
-                                        qDepthPerContext_, useIoUring,
-                                        fdpNvmeVec_));
+    tlContext_.reset(new AsyncIoContext(
+        std::move(asyncBase), idx, evb, qDepthPerContext_, useIoUring,
+        fdpNvmeVec_, std::move(fixedBuffers),
+        ioUringBatchSubmit_ ? &submitBatchStats_ : nullptr));
 
     {
       // Keep pointers in a vector to ease the gdb debugging
@@ -1210,7 +1825,9 @@ std::unique_ptr<Device> createDirectIoFileDevice(
     IoEngine ioEngine,
     uint32_t qDepthPerContext,
     bool isFDPEnabled,
-    std::shared_ptr<DeviceEncryptor> encryptor) {
+    std::shared_ptr<DeviceEncryptor> encryptor,
+    bool ioUringRegisterBuffers,
+    bool ioUringBatchSubmit) {
   XDCHECK(folly::isPowTwo(blockSize));
 
   uint32_t maxIOSize = maxDeviceWriteSize;
@@ -1257,7 +1874,9 @@ std::unique_ptr<Device> createDirectIoFileDevice(
                                       maxDeviceWriteSize,
                                       ioEngine,
                                       qDepthPerContext,
-                                      encryptor);
+                                      encryptor,
+                                      ioUringRegisterBuffers,
+                                      ioUringBatchSubmit);
 }
 
 std::unique_ptr<Device> createDirectIoFileDevice(
@@ -1290,7 +1909,9 @@ std::unique_ptr<Device> createFileDevice(
     uint32_t qDepth,
     bool isFDPEnabled,
     std::shared_ptr<navy::DeviceEncryptor> encryptor,
-    bool isExclusiveOwner) {
+    bool isExclusiveOwner,
+    bool ioUringRegisterBuffers,
+    bool ioUringBatchSubmit) {
   // File paths are opened in the increasing order of the
   // path string. This ensures that RAID0 stripes aren't
   // out of order even if the caller changes the order of
@@ -1321,6 +1942,8 @@ std::unique_ptr<Device> createFileDevice(
                                   ioEngine,
                                   qDepth,
                                   isFDPEnabled,
-                                  std::move(encryptor));
+                                  std::move(encryptor),
+                                  ioUringRegisterBuffers,
+                                  ioUringBatchSubmit);
 }
 } // namespace facebook::cachelib::navy
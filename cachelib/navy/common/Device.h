@@ -17,8 +17,13 @@
 #pragma once
 
 #include <folly/File.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/fibers/Semaphore.h>
 #include <folly/io/IOBuf.h>
 
+#include <array>
+#include <mutex>
+
 #include "cachelib/allocator/nvmcache/NavyConfig.h"
 #include "cachelib/common/AtomicCounter.h"
 #include "cachelib/common/PercentileStats.h"
@@ -30,6 +35,13 @@ namespace facebook {
 namespace cachelib {
 namespace navy {
 
+// A piece of an IO buffer to encrypt or decrypt in place, together with the
+// salt it is (or was) encrypted with
+struct CryptoRange {
+  folly::MutableByteRange value;
+  uint64_t salt{};
+};
+
 class DeviceEncryptor {
  public:
   virtual ~DeviceEncryptor() = default;
@@ -51,6 +63,30 @@ class DeviceEncryptor {
   // @param salt    this must be the same earlier used for encryption
   // @return        true if success, false otherwise
   virtual bool decrypt(folly::MutableByteRange value, uint64_t salt) = 0;
+
+  // Encrypt a batch of independent ranges in one call. Each range follows
+  // the same rules as @encrypt. Implementations can override this to
+  // interleave blocks from several ranges (e.g. multi-buffer AES-NI); the
+  // default encrypts the ranges one after another.
+  // @return        true if all ranges succeeded, false otherwise
+  virtual bool encryptBatch(folly::Range<const CryptoRange*> ranges) {
+    for (const auto& range : ranges) {
+      if (!encrypt(range.value, range.salt)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Batched counterpart of @decrypt; see @encryptBatch.
+  virtual bool decryptBatch(folly::Range<const CryptoRange*> ranges) {
+    for (const auto& range : ranges) {
+      if (!decrypt(range.value, range.salt)) {
+        return false;
+      }
+    }
+    return true;
+  }
 };
 
 // Device abstraction
@@ -141,28 +177,82 @@ class Device {
   //                  way as `makeIOBuffer` would return.
   // @param offset    Must be ioAlignmentSize_ aligned
   // @param placeHandle    handle for data placement technology like FDP
-  bool write(uint64_t offset, Buffer buffer, int placeHandle = -1);
+  // @param ioClass        class of the IO for in-flight limiting
+  bool write(uint64_t offset,
+             Buffer buffer,
+             int placeHandle = -1,
+             IoClass ioClass = IoClass::UserWrite);
 
   // Write buffer view to the device. This call makes a copy of the buffer if
   // entryptor is present.
-  bool write(uint64_t offset, BufferView bufferView, int placeHandle = -1);
+  bool write(uint64_t offset,
+             BufferView bufferView,
+             int placeHandle = -1,
+             IoClass ioClass = IoClass::UserWrite);
 
   // Allocate a new stream and return the handle for Placement capable devices.
   virtual int allocatePlacementHandle() = 0;
 
+  // Hint that @buffers are long-lived IO buffers (e.g. in-mem region
+  // buffers) that stay valid for the lifetime of the device. Devices that
+  // can pin memory with the kernel ahead of time (io_uring fixed buffers)
+  // may register them so that IOs on these buffers skip per-IO page
+  // pinning. Buffers should be registered before IOs are issued; IO
+  // contexts created earlier keep using plain reads and writes.
+  virtual void registerIOBuffers(
+      const std::vector<MutableBufferView>& /* buffers */) {}
+
+  // Returns true if the physical device holding @offset is currently much
+  // slower than its peers, e.g. a degraded drive among RAID0 files. Engines
+  // may use this to steer new writes to other devices.
+  virtual bool isDegraded(uint64_t /* offset */) const { return false; }
+
   // Reads @size bytes from device at @deviceOffset and copys to @value
   // There must be sufficient space allocated already in the mutableView.
   // @offset and @size must be ioAligmentSize_ aligned
   // @offset + @size must be less than or equal to device size_
   // address in @value must be ioAligmentSize_ aligned
-  bool read(uint64_t offset, uint32_t size, void* value);
+  bool read(uint64_t offset,
+            uint32_t size,
+            void* value,
+            IoClass ioClass = IoClass::UserRead);
 
   // Reads @size bytes from device at @deviceOffset into a Buffer allocated
   // If the offset is not aligned or size is not aligned for device IO
   // alignment, they both are aligned to do the read operation successfully
   // from the device and then Buffer is adjusted to return only the size
   // bytes from offset.
-  Buffer read(uint64_t offset, uint32_t size);
+  Buffer read(uint64_t offset,
+              uint32_t size,
+              IoClass ioClass = IoClass::UserRead);
+
+  // Caps the number of in-flight IOs of @ioClass to @limit; 0 removes the
+  // cap. IOs over the cap wait (fiber-friendly) for a slot and the wait time
+  // is exported per class. Must be called before any IO is issued.
+  void setIoClassInflightLimit(IoClass ioClass, uint32_t limit);
+
+  // Encrypt and decrypt on a pool of @numThreads threads instead of the
+  // calling fiber. Large IOs are then split into chunks so that encrypting
+  // the next chunk overlaps writing the current one, and decrypting a chunk
+  // overlaps reading the next one. 0 (default) keeps encryption inline.
+  // No-op without an encryptor. Must be called before any IO is issued.
+  void setEncryptionThreads(uint32_t numThreads);
+
+  // Allow discard() to reach the device, at no more than @maxBytesPerSec
+  // (0 means unlimited). A single discard larger than the budget is let
+  // through once nothing else was discarded in the current second.
+  // Disabled by default.
+  void setDiscard(bool enable, uint64_t maxBytesPerSec = 0);
+
+  bool isDiscardEnabled() const { return discardEnabled_; }
+
+  // Tells the device that [offset, offset + size) holds no data until it is
+  // written again (TRIM), so an SSD doesn't have to preserve it during its
+  // garbage collection. Best effort: returns false if discarding is disabled,
+  // over its rate limit, unsupported or failed. Callers must make sure the
+  // range is not written concurrently.
+  // @offset and @size must be ioAlignmentSize_ aligned
+  bool discard(uint64_t offset, uint64_t size);
 
   // Everything should be on device after this call returns.
   void flush() { flushImpl(); }
@@ -182,6 +272,9 @@ class Device {
   // Returns the alignment size for device io operations
   uint32_t getIOAlignmentSize() const { return ioAlignmentSize_; }
 
+  // Returns the size device IOs are split at; 0 means unlimited
+  uint32_t getMaxIOSize() const { return maxIOSize_; }
+
  protected:
   virtual bool writeImpl(uint64_t offset,
                          uint32_t size,
@@ -189,6 +282,14 @@ class Device {
                          int placeHandle = -1) = 0;
   virtual bool readImpl(uint64_t offset, uint32_t size, void* value) = 0;
   virtual void flushImpl() = 0;
+  // Discards the range on the underlying device; unsupported by default
+  virtual bool discardImpl(uint64_t /* offset */, uint64_t /* size */) {
+    return false;
+  }
+
+  // Exports counters of the individual underlying devices, if any
+  virtual void getPerDeviceCounters(const CounterVisitor& /* visitor */) const {
+  }
 
   // This measures the latency of an individual read or write iop between its
   // submission and completion. Slowdowns in the kernel and the boundary between
@@ -205,6 +306,9 @@ class Device {
   mutable AtomicCounter readIOErrors_;
   mutable AtomicCounter encryptionErrors_;
   mutable AtomicCounter decryptionErrors_;
+  mutable AtomicCounter bytesDiscarded_;
+  mutable AtomicCounter discardErrors_;
+  mutable AtomicCounter discardsThrottled_;
 
   // This measures the latency of a read or write request. For synchronous IO,
   // this measures the latency of pread/pwrite. For async IO, this measures
@@ -213,12 +317,62 @@ class Device {
   mutable util::PercentileStats readLatencyEstimator_;
   mutable util::PercentileStats writeLatencyEstimator_;
 
-  bool readInternal(uint64_t offset, uint32_t size, void* value);
+  bool readInternal(uint64_t offset,
+                    uint32_t size,
+                    void* value,
+                    IoClass ioClass);
 
   bool writeInternal(uint64_t offset,
                      const uint8_t* data,
                      size_t size,
-                     int placeHandle = -1);
+                     int placeHandle,
+                     IoClass ioClass);
+
+  // Encrypts a large buffer on the crypto pool chunk by chunk and writes
+  // each chunk as soon as it is ready.
+  bool writeEncryptedPipelined(uint64_t offset,
+                               uint8_t* data,
+                               size_t size,
+                               int placeHandle,
+                               IoClass ioClass);
+
+  // Whether an IO of @size bytes is large enough to pipeline its encryption
+  bool shouldPipelineCrypto(size_t size) const {
+    return cryptoExecutor_ && size > cryptoChunkSize_;
+  }
+
+  // Encrypts or decrypts [data, data + size) which lives at device @offset.
+  // The range is handed to the encryptor as one batch of block aligned
+  // pieces, each salted with its own device offset.
+  bool cryptBatch(uint8_t* data,
+                  size_t size,
+                  uint64_t offset,
+                  bool encrypt) const;
+
+  // A cryptBatch() call running on the crypto pool
+  struct CryptoTask;
+
+  // Queues cryptBatch() on the crypto pool; the caller must wait for the
+  // returned task before the buffer goes away.
+  std::unique_ptr<CryptoTask> scheduleCrypto(uint8_t* data,
+                                             size_t size,
+                                             uint64_t offset,
+                                             bool encrypt);
+
+  // Takes @size bytes from the discard budget of the current second
+  bool tryConsumeDiscardBudget(uint64_t size);
+
+  // Waits for an in-flight slot of @ioClass if it is capped; every call
+  // must be paired with releaseIoClassSlot().
+  void acquireIoClassSlot(IoClass ioClass);
+  void releaseIoClassSlot(IoClass ioClass);
+
+  // Optional per IoClass in-flight caps; null means unlimited
+  std::array<std::unique_ptr<folly::fibers::Semaphore>, kNumIoClasses>
+      ioClassSlots_;
+  // Time spent waiting for an in-flight slot, per capped IoClass
+  mutable std::array<util::PercentileStats, kNumIoClasses>
+      ioClassQueueDelayEstimators_;
 
   // size of the device. All offsets for write/read should be contained
   // below this.
@@ -240,7 +394,25 @@ class Device {
 
   std::shared_ptr<DeviceEncryptor> encryptor_;
 
+  // Optional pool encrypting and decrypting off the IO path, and the
+  // granularity at which IOs are pipelined through it
+  std::unique_ptr<folly::CPUThreadPoolExecutor> cryptoExecutor_;
+  size_t cryptoChunkSize_{0};
+
+  bool discardEnabled_{false};
+  // Max bytes discarded per second; 0 means unlimited
+  uint64_t maxDiscardRate_{0};
+  std::mutex discardMutex_;
+  // Second (steady clock) the discard budget is tracked for and the bytes
+  // discarded in it
+  int64_t discardWindowSec_{0};
+  uint64_t discardWindowBytes_{0};
+
   static constexpr uint32_t kDefaultAlignmentSize{1};
+  // Size of the pieces handed to the encryptor in one batch
+  static constexpr uint32_t kCryptoRangeSize{64 * 1024};
+  // Pipelining granularity when there is no max write size
+  static constexpr uint32_t kDefaultCryptoChunkSize{1024 * 1024};
 };
 
 // Default ioAlignSize size for Memory Device is 1. In our tests, we create
@@ -267,6 +439,10 @@ std::unique_ptr<Device> createMemoryDevice(
 //                              If 0, sync IO will be used
 // @param isFDPEnabled          Whether FDP placement mode is enabled or not.
 // @param encryptor             encryption object
+// @param ioUringRegisterBuffers  register long-lived IO buffers with io_uring
+//                              and use READ_FIXED/WRITE_FIXED for them
+// @param ioUringBatchSubmit    submit the io_uring IOs of an IO thread once
+//                              per event loop iteration
 std::unique_ptr<Device> createDirectIoFileDevice(
     std::vector<folly::File> fVec,
     std::vector<std::string> filePaths,
@@ -277,7 +453,9 @@ std::unique_ptr<Device> createDirectIoFileDevice(
     IoEngine ioEngine,
     uint32_t qDepth,
     bool isFDPEnabled,
-    std::shared_ptr<DeviceEncryptor> encryptor);
+    std::shared_ptr<DeviceEncryptor> encryptor,
+    bool ioUringRegisterBuffers = false,
+    bool ioUringBatchSubmit = false);
 
 // A convenient wrapper for creating Device with a sync IO
 //
@@ -309,6 +487,8 @@ std::unique_ptr<Device> createDirectIoFileDevice(
 // @param isFDPEnabled          whether FDP placement mode enabled or not
 // @param encryptor             encryption object
 // @param isExclusiveOwner      fail if not sole owner of the file
+// @param ioUringRegisterBuffers  register long-lived IO buffers with io_uring
+// @param ioUringBatchSubmit    batch io_uring submissions per loop iteration
 std::unique_ptr<Device> createFileDevice(
     std::vector<std::string> filePaths,
     uint64_t fileSize,
@@ -320,7 +500,9 @@ std::unique_ptr<Device> createFileDevice(
     uint32_t qDepth,
     bool isFDPEnabled,
     std::shared_ptr<navy::DeviceEncryptor> encryptor,
-    bool isExclusiveOwner);
+    bool isExclusiveOwner,
+    bool ioUringRegisterBuffers = false,
+    bool ioUringBatchSubmit = false);
 } // namespace navy
 } // namespace cachelib
 } // namespace facebook
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cachelib/navy/common/EmulatedSsdDevice.h"
+
+#include <folly/ScopeGuard.h>
+#include <folly/fibers/Baton.h>
+#include <folly/fibers/Semaphore.h>
+#include <folly/system/ThreadName.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "cachelib/navy/common/Utils.h"
+
+namespace facebook::cachelib::navy {
+namespace {
+// Posts the baton of every waiting IO once its emulated completion time is
+// reached, so fibers can block on an untimed baton wait.
+class CompletionQueue {
+ public:
+  CompletionQueue() : thread_{[this] { run(); }} {}
+
+  ~CompletionQueue() {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  // Blocks the calling fiber or thread until @deadlineNs (steady clock)
+  void waitUntil(uint64_t deadlineNs) {
+    if (deadlineNs <= static_cast<uint64_t>(getSteadyClock().count())) {
+      return;
+    }
+    folly::fibers::Baton baton;
+    bool notify = false;
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      notify = pending_.empty() || deadlineNs < pending_.top().first;
+      pending_.emplace(deadlineNs, &baton);
+    }
+    if (notify) {
+      cv_.notify_one();
+    }
+    baton.wait();
+  }
+
+ private:
+  using Entry = std::pair<uint64_t, folly::fibers::Baton*>;
+
+  void run() {
+    folly::setThreadName("navy_emu_ssd");
+    std::unique_lock<std::mutex> lock{mutex_};
+    while (!stop_) {
+      if (pending_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+      const auto deadline = std::chrono::steady_clock::time_point{
+          std::chrono::nanoseconds{pending_.top().first}};
+      if (std::chrono::steady_clock::now() < deadline) {
+        cv_.wait_until(lock, deadline);
+        continue;
+      }
+      auto* baton = pending_.top().second;
+      pending_.pop();
+      lock.unlock();
+      baton->post();
+      lock.lock();
+    }
+    // Nobody may be left waiting on a destroyed device
+    while (!pending_.empty()) {
+      pending_.top().second->post();
+      pending_.pop();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>
+      pending_;
+  bool stop_{false};
+  std::thread thread_;
+};
+
+// Device that keeps data on a backing device and delays every IO by the
+// timing of an emulated SSD (see EmulatedSsdConfig)
+class EmulatedSsdDevice final : public Device {
+ public:
+  EmulatedSsdDevice(std::unique_ptr<Device> backingDevice,
+                    const EmulatedSsdConfig& config,
+                    uint32_t maxDeviceWriteSize,
+                    std::shared_ptr<DeviceEncryptor> encryptor)
+      : Device{backingDevice->getSize(), std::move(encryptor),
+               backingDevice->getIOAlignmentSize(), 0 /* max IO size */,
+               maxDeviceWriteSize},
+        backingDevice_{std::move(backingDevice)},
+        config_{config},
+        gcThresholdBytes_{getSize() / 100 * config.gcThresholdPct},
+        queueSlots_{config.queueDepth},
+        channelFreeAt_(config.numChannels, 0),
+        rng_{config.seed} {
+    XDCHECK_GT(config_.queueDepth, 0u);
+    XDCHECK_GT(config_.numChannels, 0u);
+    XDCHECK_GT(config_.eraseBlockSize, 0u);
+    // Discards are gated by this device's own setting
+    backingDevice_->setDiscard(true);
+  }
+  EmulatedSsdDevice(const EmulatedSsdDevice&) = delete;
+  EmulatedSsdDevice& operator=(const EmulatedSsdDevice&) = delete;
+  ~EmulatedSsdDevice() override = default;
+
+ private:
+  bool writeImpl(uint64_t offset,
+                 uint32_t size,
+                 const void* value,
+                 int /* unused */) override {
+    queueSlots_.wait();
+    SCOPE_EXIT { queueSlots_.signal(); };
+    const uint64_t completeAt = scheduleWrite(size);
+    bool result = backingDevice_->write(
+        offset, BufferView{size, static_cast<const uint8_t*>(value)});
+    completions_.waitUntil(completeAt);
+    return result;
+  }
+
+  bool readImpl(uint64_t offset, uint32_t size, void* value) override {
+    queueSlots_.wait();
+    SCOPE_EXIT { queueSlots_.signal(); };
+    const uint64_t completeAt = scheduleRead(size);
+    bool result = backingDevice_->read(offset, size, value);
+    completions_.waitUntil(completeAt);
+    return result;
+  }
+
+  int allocatePlacementHandle() override { return -1; }
+
+  void flushImpl() override { backingDevice_->flush(); }
+
+  bool discardImpl(uint64_t offset, uint64_t size) override {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      mappedBytes_ -= std::min(mappedBytes_, size);
+    }
+    // A backing device that can't discard still counts as trimmed for the
+    // model
+    backingDevice_->discard(offset, size);
+    return true;
+  }
+
+  void getPerDeviceCounters(const CounterVisitor& visitor) const override {
+    visitor("navy_device_emulated_gc_erases", gcErases_.get(),
+            CounterVisitor::CounterType::RATE);
+    visitor("navy_device_emulated_write_buffer_stalls",
+            writeBufferStalls_.get(), CounterVisitor::CounterType::RATE);
+  }
+
+  // Returns the steady clock time in ns a read of @size bytes completes at
+  uint64_t scheduleRead(uint32_t size) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const uint64_t now = getSteadyClock().count();
+    auto& channelFreeAt = earliestChannelLocked();
+    channelFreeAt = std::max(now, channelFreeAt) +
+                    sampleLatencyNsLocked(config_.readLatencyUs);
+    // Data of all channels leaves through the same host interface
+    readBusFreeAt_ = std::max(channelFreeAt, readBusFreeAt_) +
+                     transferNs(size, config_.readBandwidthMBps);
+    return readBusFreeAt_;
+  }
+
+  // Returns the steady clock time in ns a write of @size bytes completes at
+  uint64_t scheduleWrite(uint32_t size) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const uint64_t now = getSteadyClock().count();
+    drainWriteBufferLocked(now);
+
+    const bool gcActive = mappedBytes_ > gcThresholdBytes_;
+    mappedBytes_ = std::min(mappedBytes_ + size, getSize());
+    // Valid data relocated by GC is programmed through the same buffer
+    const uint64_t flashBytes =
+        gcActive ? static_cast<uint64_t>(size * config_.gcWriteAmplification)
+                 : size;
+    uint64_t startAt = now;
+    if (config_.writeBandwidthMBps > 0 &&
+        bufferedBytes_ + flashBytes > config_.writeBufferSize) {
+      startAt += transferNs(
+          bufferedBytes_ + flashBytes - config_.writeBufferSize,
+          config_.writeBandwidthMBps);
+      writeBufferStalls_.inc();
+    }
+    bufferedBytes_ += flashBytes;
+
+    if (gcActive) {
+      // Erases hold a channel and delay reads queued behind them
+      gcDebtBytes_ += size;
+      while (gcDebtBytes_ >= config_.eraseBlockSize) {
+        gcDebtBytes_ -= config_.eraseBlockSize;
+        auto& channelFreeAt = earliestChannelLocked();
+        channelFreeAt = std::max(now, channelFreeAt) +
+                        sampleLatencyNsLocked(config_.eraseLatencyUs);
+        gcErases_.inc();
+      }
+    }
+    return startAt + sampleLatencyNsLocked(config_.writeLatencyUs);
+  }
+
+  // Removes what was programmed to flash since the last call
+  void drainWriteBufferLocked(uint64_t now) {
+    if (config_.writeBandwidthMBps == 0) {
+      bufferedBytes_ = 0;
+    } else if (now > lastDrainAt_) {
+      const double drained = static_cast<double>(now - lastDrainAt_) *
+                             config_.writeBandwidthMBps * 1024 * 1024 / 1e9;
+      bufferedBytes_ -=
+          std::min(bufferedBytes_, static_cast<uint64_t>(drained));
+    }
+    lastDrainAt_ = now;
+  }
+
+  uint64_t& earliestChannelLocked() {
+    return *std::min_element(channelFreeAt_.begin(), channelFreeAt_.end());
+  }
+
+  uint64_t sampleLatencyNsLocked(uint32_t meanUs) {
+    double latency = meanUs * 1000.0;
+    if (config_.latencyJitterPct > 0) {
+      const double jitter = config_.latencyJitterPct / 100.0;
+      latency *= std::uniform_real_distribution<double>{1 - jitter,
+                                                        1 + jitter}(rng_);
+    }
+    if (config_.tailProbability > 0 &&
+        std::bernoulli_distribution{config_.tailProbability}(rng_)) {
+      latency *= config_.tailLatencyFactor;
+    }
+    return static_cast<uint64_t>(std::max(latency, 0.0));
+  }
+
+  static uint64_t transferNs(uint64_t bytes, uint32_t bandwidthMBps) {
+    if (bandwidthMBps == 0) {
+      return 0;
+    }
+    return static_cast<uint64_t>(static_cast<double>(bytes) * 1e9 /
+                                 (bandwidthMBps * 1024.0 * 1024.0));
+  }
+
+  const std::unique_ptr<Device> backingDevice_;
+  const EmulatedSsdConfig config_;
+  // Mapped bytes above which writes pay for GC
+  const uint64_t gcThresholdBytes_;
+
+  // Bounds the IOs the emulated device works on at once
+  folly::fibers::Semaphore queueSlots_;
+
+  // Protects the model state below
+  std::mutex mutex_;
+  // Steady clock time in ns each channel becomes idle
+  std::vector<uint64_t> channelFreeAt_;
+  uint64_t readBusFreeAt_{0};
+  // Bytes accepted by the write buffer but not yet programmed to flash
+  uint64_t bufferedBytes_{0};
+  uint64_t lastDrainAt_{0};
+  // Bytes written and not discarded since the device was created
+  uint64_t mappedBytes_{0};
+  // Bytes written under GC since the last emulated erase
+  uint64_t gcDebtBytes_{0};
+  std::mt19937_64 rng_;
+
+  mutable AtomicCounter gcErases_;
+  mutable AtomicCounter writeBufferStalls_;
+
+  // Declared last so that it stops before the state above is destroyed
+  CompletionQueue completions_;
+};
+} // namespace
+
+std::unique_ptr<Device> createEmulatedSsdDevice(
+    std::unique_ptr<Device> backingDevice,
+    const EmulatedSsdConfig& config,
+    uint32_t maxDeviceWriteSize,
+    std::shared_ptr<DeviceEncryptor> encryptor) {
+  return std::make_unique<EmulatedSsdDevice>(std::move(backingDevice), config,
+                                             maxDeviceWriteSize,
+                                             std::move(encryptor));
+}
+} // namespace facebook::cachelib::navy
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "cachelib/allocator/nvmcache/NavyConfig.h"
+#include "cachelib/navy/common/Device.h"
+
+namespace facebook {
+namespace cachelib {
+namespace navy {
+// Creates a device that stores data on @backingDevice (e.g. a memory device
+// or a file device) but times every IO with the SSD model of @config:
+// queue depth, channel parallelism, latency distributions, write buffer,
+// GC slowdown and bandwidth caps. An IO returns once its emulated
+// completion time is reached; on a fiber only the fiber waits, the same way
+// it does for async IO on a real device. This makes Navy benchmarks
+// reproducible on machines without NVMe drives.
+//
+// @param backingDevice         device holding the data; must not encrypt
+// @param config                SSD performance model
+// @param maxDeviceWriteSize    device maximum granularity of writes
+// @param encryptor             encryption object
+std::unique_ptr<Device> createEmulatedSsdDevice(
+    std::unique_ptr<Device> backingDevice,
+    const EmulatedSsdConfig& config,
+    uint32_t maxDeviceWriteSize,
+    std::shared_ptr<DeviceEncryptor> encryptor);
+} // namespace navy
+} // namespace cachelib
+} // namespace facebook
@@ -17,6 +17,7 @@
 #include "cachelib/navy/common/Hash.h"
 
 #include <folly/hash/Checksum.h>
+#include <folly/logging/xlog.h>
 
 namespace facebook::cachelib::navy {
 uint64_t hashBuffer(BufferView key, uint64_t seed) {
@@ -26,4 +27,17 @@ uint64_t hashBuffer(BufferView key, uint64_t seed) {
 uint32_t checksum(BufferView data, uint32_t startingChecksum) {
   return folly::crc32(data.data(), data.size(), startingChecksum);
 }
+
+uint32_t checksum(BufferView data,
+                  ChecksumType type,
+                  uint32_t startingChecksum) {
+  switch (type) {
+  case ChecksumType::Crc32:
+    return checksum(data, startingChecksum);
+  case ChecksumType::Crc32c:
+    return folly::crc32c(data.data(), data.size(), startingChecksum);
+  }
+  XDCHECK(false);
+  return checksum(data, startingChecksum);
+}
 } // namespace facebook::cachelib::navy
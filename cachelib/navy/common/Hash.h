@@ -18,6 +18,7 @@
 
 #include <cstdint>
 
+#include "cachelib/allocator/nvmcache/NavyConfig.h"
 #include "cachelib/common/Hash.h"
 #include "cachelib/navy/common/Buffer.h"
 
@@ -30,6 +31,12 @@ uint64_t hashBuffer(BufferView key, uint64_t seed = 0);
 // Default checksumming function
 uint32_t checksum(BufferView data, uint32_t startingChecksum = 0);
 
+// Checksum @data with the selected function. Crc32c uses the hardware CRC
+// instructions where the CPU has them.
+uint32_t checksum(BufferView data,
+                  ChecksumType type,
+                  uint32_t startingChecksum = 0);
+
 // Convenience utils to convert a piece of buffer to a hashed key
 inline HashedKey makeHK(const void* ptr, size_t size) {
   return HashedKey{
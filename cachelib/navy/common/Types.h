@@ -65,6 +65,9 @@ using DestructorCallback =
 // Checking NvmItem expired
 using ExpiredCheck = std::function<bool(BufferView value)>;
 
+// Getting NvmItem expiry time in seconds since epoch, 0 if it never expires
+using ExpiryTimeGetter = std::function<uint32_t(BufferView value)>;
+
 // Get CounterVisitor into navy namespace.
 using CounterVisitor = util::CounterVisitor;
 
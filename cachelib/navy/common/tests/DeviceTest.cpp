@@ -23,10 +23,14 @@
 
 #include <cstring>
 #include <thread>
+#include <unordered_map>
 
 #include "cachelib/common/Utils.h"
 #include "cachelib/navy/common/Device.h"
+#include "cachelib/navy/common/EmulatedSsdDevice.h"
 #include "cachelib/navy/common/FdpNvme.h"
+#include "cachelib/navy/common/NavyThread.h"
+#include "cachelib/navy/common/Utils.h"
 #include "cachelib/navy/testing/BufferGen.h"
 #include "cachelib/navy/testing/Callbacks.h"
 #include "cachelib/navy/testing/MockDevice.h"
@@ -187,6 +191,150 @@ TEST(Device, EncryptorFail) {
   }
 }
 
+TEST(Device, EncryptionThreads) {
+  // Keystream depends on the device offset of every byte, so data encrypted
+  // in pipelined chunks must decrypt with any other split and vice versa
+  class XorEncryptor : public DeviceEncryptor {
+   public:
+    uint32_t encryptionBlockSize() const override { return 512; }
+
+    bool encrypt(folly::MutableByteRange value, uint64_t salt) override {
+      apply(value, salt);
+      return true;
+    }
+
+    bool decrypt(folly::MutableByteRange value, uint64_t salt) override {
+      apply(value, salt);
+      return true;
+    }
+
+   private:
+    static void apply(folly::MutableByteRange value, uint64_t salt) {
+      for (size_t i = 0; i < value.size(); i++) {
+        value[i] ^= static_cast<uint8_t>((salt + i) / 512 * 31 + 7);
+      }
+    }
+  };
+
+  constexpr uint32_t kSize = 4 * 1024 * 1024;
+  auto device =
+      createMemoryDevice(kSize, std::make_shared<XorEncryptor>(), 512);
+  device->setEncryptionThreads(4);
+
+  BufferGen bufGen;
+  Buffer expected = bufGen.gen(3 * 1024 * 1024 + 512);
+  auto writeBuf = device->makeIOBuffer(expected.size());
+  writeBuf.copyFrom(0, expected.view());
+  ASSERT_TRUE(device->write(512, std::move(writeBuf)));
+
+  // Large read is decrypted on the pool
+  auto readBuf = device->read(512, expected.size());
+  ASSERT_EQ(expected.size(), readBuf.size());
+  EXPECT_EQ(expected.view(), readBuf.view());
+
+  // Small read stays inline and sees the same plaintext
+  auto smallBuf = device->read(512 + 1024 * 1024 + 4096, 4096);
+  EXPECT_EQ(expected.view().slice(1024 * 1024 + 4096, 4096), smallBuf.view());
+}
+
+TEST(Device, Discard) {
+  constexpr uint32_t kSize = 64 * 1024;
+  auto device = createMemoryDevice(kSize, nullptr, 4096);
+  BufferGen bufGen;
+  Buffer expected = bufGen.gen(kSize);
+  auto writeBuf = device->makeIOBuffer(kSize);
+  writeBuf.copyFrom(0, expected.view());
+  ASSERT_TRUE(device->write(0, std::move(writeBuf)));
+
+  // Disabled by default: data stays
+  EXPECT_FALSE(device->discard(0, 4096));
+  EXPECT_EQ(expected.view(), device->read(0, kSize).view());
+
+  device->setDiscard(true);
+  EXPECT_TRUE(device->discard(4096, 8192));
+  auto readBuf = device->read(0, kSize);
+  EXPECT_EQ(expected.view().slice(0, 4096), readBuf.view().slice(0, 4096));
+  Buffer zeros{8192};
+  std::memset(zeros.data(), 0, zeros.size());
+  EXPECT_EQ(zeros.view(), readBuf.view().slice(4096, 8192));
+  EXPECT_EQ(expected.view().slice(3 * 4096, kSize - 3 * 4096),
+            readBuf.view().slice(3 * 4096, kSize - 3 * 4096));
+
+  // With a budget of one page per second most discards are throttled
+  device->setDiscard(true, 4096);
+  uint32_t numThrottled = 0;
+  for (uint32_t i = 0; i < 16; i++) {
+    if (!device->discard(0, 4096)) {
+      numThrottled++;
+    }
+  }
+  EXPECT_GT(numThrottled, 0u);
+
+  std::unordered_map<std::string, double> counters;
+  device->getCounters({[&counters](folly::StringPiece name, double count,
+                                    CounterVisitor::CounterType) {
+    counters[name.str()] = count;
+  }});
+  EXPECT_EQ(numThrottled, counters["navy_device_discards_throttled"]);
+  EXPECT_EQ(8192 + (16 - numThrottled) * 4096,
+            counters["navy_device_bytes_discarded"]);
+  EXPECT_EQ(0, counters["navy_device_discard_errors"]);
+}
+
+TEST(Device, EmulatedSsd) {
+  constexpr uint32_t kSize = 4 * 1024 * 1024;
+  EmulatedSsdConfig config;
+  config.queueDepth = 8;
+  config.numChannels = 1;
+  config.readLatencyUs = 20'000;
+  config.writeLatencyUs = 0;
+  config.eraseLatencyUs = 0;
+  config.latencyJitterPct = 0;
+  config.tailProbability = 0;
+  config.readBandwidthMBps = 0;
+  config.writeBandwidthMBps = 0;
+  config.gcThresholdPct = 50;
+  config.eraseBlockSize = 1024 * 1024;
+  auto device = createEmulatedSsdDevice(
+      createMemoryDevice(kSize, nullptr, 4096), config, 0, nullptr);
+
+  BufferGen bufGen;
+  Buffer expected = bufGen.gen(kSize);
+  auto writeBuf = device->makeIOBuffer(kSize);
+  writeBuf.copyFrom(0, expected.view());
+  ASSERT_TRUE(device->write(0, std::move(writeBuf)));
+
+  // Data round trips and a read takes at least the read latency
+  auto timeBegin = getSteadyClock();
+  auto readBuf = device->read(0, kSize);
+  EXPECT_GE(getSteadyClock() - timeBegin, std::chrono::milliseconds{20});
+  EXPECT_EQ(expected.view(), readBuf.view());
+
+  // A single channel serves concurrent reads one after another
+  timeBegin = getSteadyClock();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&device, i] {
+      EXPECT_EQ(4096, device->read(i * 4096, 4096).size());
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_GE(getSteadyClock() - timeBegin, std::chrono::milliseconds{80});
+
+  // Rewriting a device that is more than half full triggers GC erases
+  writeBuf = device->makeIOBuffer(kSize);
+  writeBuf.copyFrom(0, expected.view());
+  ASSERT_TRUE(device->write(0, std::move(writeBuf)));
+  std::unordered_map<std::string, double> counters;
+  device->getCounters({[&counters](folly::StringPiece name, double count,
+                                    CounterVisitor::CounterType) {
+    counters[name.str()] = count;
+  }});
+  EXPECT_EQ(4, counters["navy_device_emulated_gc_erases"]);
+}
+
 TEST(Device, Latency) {
   // Device size must be at least 1 because we try to write 1 byte to it
   MockDevice device{1, 1};
@@ -216,6 +364,39 @@ TEST(Device, Latency) {
   device.getCounters(toCallback(visitor));
 }
 
+TEST(Device, IoClassInflightLimit) {
+  MockDevice device{1, 1};
+  device.setIoClassInflightLimit(IoClass::Reclaim, 1);
+  EXPECT_CALL(device, readImpl(0, 1, _))
+      .Times(2)
+      .WillRepeatedly(testing::InvokeWithoutArgs([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        return true;
+      }));
+
+  // With a cap of one, the second reclaim read has to wait for the first
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 2; i++) {
+    threads.emplace_back([&device] {
+      Buffer buf{1};
+      EXPECT_TRUE(device.read(0, 1, buf.data(), IoClass::Reclaim));
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  MockCounterVisitor visitor;
+  EXPECT_CALL(visitor, call(_, _)).WillRepeatedly(testing::Return());
+  EXPECT_CALL(visitor, call(strPiece("navy_device_reclaim_queue_delay_us_max"),
+                            testing::Ge(50'000)));
+  // Uncapped classes don't export queueing delay
+  EXPECT_CALL(visitor,
+              call(strPiece("navy_device_user_read_queue_delay_us_max"), _))
+      .Times(0);
+  device.getCounters(toCallback(visitor));
+}
+
 TEST(Device, IOError) {
   // Device size must be at least 1 because we try to write 1 byte to it
   MockDevice device{1, 1};
@@ -555,11 +736,116 @@ TEST_P(DeviceParamTest, RAID0IOAlignment) {
       std::invalid_argument);
 }
 
+TEST_P(DeviceParamTest, RegisteredIOBuffers) {
+  auto filePath =
+      folly::sformat("/tmp/DEVICE_REGISTERED_BUFFERS_TEST-{}", ::getpid());
+  SCOPE_EXIT { util::removePath(filePath); };
+  std::vector<std::string> filePaths{filePath};
+
+  int deviceSize = 64 * 1024;
+  int ioAlignSize = 4096;
+  uint32_t bufSize = 16 * 1024;
+
+  auto device = createFileDevice(
+      filePaths, deviceSize, false /* truncateFile */, ioAlignSize, ioAlignSize,
+      0 /* max device write size */, ioEngine_, qDepth_,
+      false /* isFDPEnabled */, nullptr /* encryptor */,
+      false /* isExclusiveOwner */, true /* ioUringRegisterBuffers */);
+
+  // Registered before the first IO, which creates the IO context. IOs on
+  // the pool use READ_FIXED and WRITE_FIXED with io_uring, the others
+  // plain reads and writes.
+  Buffer pool = device->makeIOBuffer(2 * bufSize);
+  device->registerIOBuffers({pool.mutableView()});
+  auto* fixedWriteData = pool.data();
+  auto* fixedReadData = pool.data() + bufSize;
+  Buffer wbuf = device->makeIOBuffer(bufSize);
+  Buffer rbuf = device->makeIOBuffer(bufSize);
+  for (uint32_t i = 0; i < bufSize; i++) {
+    fixedWriteData[i] = folly::Random::rand32() % 64;
+    wbuf.data()[i] = folly::Random::rand32() % 64;
+  }
+
+  EXPECT_TRUE(device->write(0, BufferView{bufSize, fixedWriteData}));
+  EXPECT_TRUE(device->write(bufSize, wbuf.view()));
+
+  // Each write is read back through both paths
+  EXPECT_TRUE(device->read(0, bufSize, fixedReadData));
+  EXPECT_EQ(0, std::memcmp(fixedWriteData, fixedReadData, bufSize));
+  EXPECT_TRUE(device->read(0, bufSize, rbuf.data()));
+  EXPECT_EQ(0, std::memcmp(fixedWriteData, rbuf.data(), bufSize));
+  EXPECT_TRUE(device->read(bufSize, bufSize, fixedReadData));
+  EXPECT_EQ(0, std::memcmp(wbuf.data(), fixedReadData, bufSize));
+  EXPECT_TRUE(device->read(bufSize, bufSize, rbuf.data()));
+  EXPECT_EQ(0, std::memcmp(wbuf.data(), rbuf.data(), bufSize));
+}
+
+TEST_P(DeviceParamTest, ConcurrentIO) {
+  auto filePath =
+      folly::sformat("/tmp/DEVICE_CONCURRENT_IO_TEST-{}", ::getpid());
+  SCOPE_EXIT { util::removePath(filePath); };
+  std::vector<std::string> filePaths{filePath};
+
+  constexpr uint32_t kNumIos = 8;
+  constexpr uint32_t kIoSize = 4096;
+
+  auto device = createFileDevice(
+      filePaths, kNumIos * kIoSize, false /* truncateFile */, kIoSize,
+      kIoSize, 0 /* max device write size */, ioEngine_, qDepth_,
+      false /* isFDPEnabled */, nullptr /* encryptor */,
+      false /* isExclusiveOwner */, false /* ioUringRegisterBuffers */,
+      true /* ioUringBatchSubmit */);
+
+  std::vector<Buffer> wbufs;
+  std::vector<Buffer> rbufs;
+  for (uint32_t i = 0; i < kNumIos; i++) {
+    wbufs.push_back(device->makeIOBuffer(kIoSize));
+    std::memset(wbufs.back().data(), 'A' + i, kIoSize);
+    rbufs.push_back(device->makeIOBuffer(kIoSize));
+  }
+
+  // Every IO is issued by its own fiber, all of them started in the same
+  // event loop iteration
+  {
+    NavyThread thread{"device_test"};
+    thread.addTaskRemote([&]() {
+      for (uint32_t i = 0; i < kNumIos; i++) {
+        thread.addTask([&, i]() {
+          EXPECT_TRUE(device->write(i * kIoSize, wbufs[i].view()));
+          EXPECT_TRUE(device->read(i * kIoSize, kIoSize, rbufs[i].data()));
+        });
+      }
+    });
+    thread.drain();
+  }
+  for (uint32_t i = 0; i < kNumIos; i++) {
+    EXPECT_EQ(wbufs[i].view(), rbufs[i].view());
+  }
+
+  if (ioEngine_ == IoEngine::IoUring && qDepth_ > 1) {
+    // The IOs of an iteration went to the kernel with a single submit
+    double numBatches = 0;
+    double numOps = 0;
+    device->getCounters({[&](folly::StringPiece name, double count) {
+      if (name == "navy_device_io_uring_submit_batches") {
+        numBatches = count;
+      }
+      if (name == "navy_device_io_uring_batched_ops") {
+        numOps = count;
+      }
+    }});
+    EXPECT_EQ(2 * kNumIos, numOps);
+    EXPECT_LT(numBatches, numOps);
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(DeviceParamTestSuite,
                          DeviceParamTest,
                          testing::Values(std::make_tuple(IoEngine::Sync, 0),
                                          std::make_tuple(IoEngine::LibAio, 1),
                                          std::make_tuple(IoEngine::IoUring,
-                                                         1)));
+                                                         1),
+                                         std::make_tuple(IoEngine::IoUring,
+                                                         8)));
 
 } // namespace facebook::cachelib::navy::tests
@@ -30,4 +30,21 @@ TEST(Hash, HashedKeyCollision) {
   EXPECT_NE(hk1, hk3);
   EXPECT_NE(hk2, hk3);
 }
+
+TEST(Hash, ChecksumType) {
+  const char data[] = "navy checksum";
+  BufferView view{sizeof(data) - 1, reinterpret_cast<const uint8_t*>(data)};
+
+  EXPECT_EQ(checksum(view), checksum(view, ChecksumType::Crc32));
+  EXPECT_EQ(checksum(view, ChecksumType::Crc32c),
+            checksum(view, ChecksumType::Crc32c));
+  EXPECT_NE(checksum(view, ChecksumType::Crc32),
+            checksum(view, ChecksumType::Crc32c));
+
+  // Chaining a checksum over two halves matches checksumming the whole
+  auto first = checksum(view.slice(0, 5), ChecksumType::Crc32c);
+  EXPECT_EQ(checksum(view, ChecksumType::Crc32c),
+            checksum(view.slice(5, view.size() - 5), ChecksumType::Crc32c,
+                     first));
+}
 } // namespace facebook::cachelib::navy::tests
@@ -16,15 +16,33 @@
 
 #include "cachelib/navy/driver/Driver.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include <folly/Format.h>
 #include <folly/Range.h>
 #include <folly/fibers/Baton.h>
+#include <folly/io/IOBuf.h>
 
 #include "cachelib/common/Serialization.h"
+#include "cachelib/common/Time.h"
 #include "cachelib/navy/admission_policy/DynamicRandomAP.h"
 #include "cachelib/navy/scheduler/JobScheduler.h"
+#include "cachelib/navy/serialization/Serialization.h"
 
 namespace facebook::cachelib::navy {
 namespace {
+constexpr int32_t kExportFormatVersion = 1;
+// Exported entries are batched into records of about this size
+constexpr size_t kExportRecordSize = 1024 * 1024;
+
+// Every exported entry is this header followed by the key and the value
+struct FOLLY_PACK_ATTR ExportEntryHeader {
+  uint32_t keySize{};
+  uint32_t valueSize{};
+  uint32_t expiryTime{};
+};
+
 // get discrete_distribution based on enginePair sizes.
 std::discrete_distribution<size_t> getDist(
     const std::vector<EnginePair>& enginePairs) {
@@ -45,6 +63,13 @@ Driver::Config& Driver::Config::validate() {
   for (auto& p : enginePairs) {
     p.validate();
   }
+  if (tiered) {
+    if (enginePairs.size() != 2 || selector) {
+      throw std::invalid_argument(
+          "Tiered engines need exactly two engine pairs and no selector.");
+    }
+    return *this;
+  }
   if (enginePairs.size() > 1 && (!selector)) {
     throw std::invalid_argument("More than one engine pairs with no selector.");
   }
@@ -59,15 +84,22 @@ Driver::Driver(Config&& config, ValidConfigTag)
       maxParcelMemory_{config.maxParcelMemory},
       metadataSize_{config.metadataSize},
       useEstimatedWriteSize_{config.useEstimatedWriteSize},
+      tiered_{config.tiered},
       device_{std::move(config.device)},
       scheduler_{std::move(config.scheduler)},
       selector_{std::move(config.selector)},
       enginePairs_{std::move(config.enginePairs)},
       admissionPolicy_{std::move(config.admissionPolicy)} {
   getRandomAllocDist = getDist(enginePairs_);
+  if (tiered_) {
+    // Everything is routed to the hot pair (selectEnginePair returns 0),
+    // which falls through to the cold pair on misses
+    enginePairs_[0].setLowerTier(&enginePairs_[1]);
+  }
   XLOGF(INFO, "Max concurrent inserts: {}", maxConcurrentInserts_);
   XLOGF(INFO, "Max parcel memory: {}", maxParcelMemory_);
   XLOGF(INFO, "Use Write Estimated Size: {}", useEstimatedWriteSize_);
+  XLOGF(INFO, "Tiered engines: {}", tiered_);
 }
 
 Driver::~Driver() {
@@ -172,6 +204,45 @@ Status Driver::insertAsync(HashedKey hk, BufferView value, InsertCallback cb) {
   return Status::Ok;
 }
 
+bool Driver::demote(HashedKey hk,
+                    BufferView value,
+                    const DestructorCallback& onDrop) {
+  XDCHECK(tiered_);
+  // Evictions during shutdown have nowhere to go
+  if (!scheduler_ || !admissionTest(hk, value)) {
+    demoteRejectedCount_.inc();
+    return false;
+  }
+
+  // The evicted entry lives in a region or bucket that is about to be
+  // reused. Keep our own copy until the cold tier insert completes.
+  const size_t keySize = hk.key().size();
+  Buffer entry{keySize + value.size()};
+  std::memcpy(entry.data(), hk.key().data(), keySize);
+  std::memcpy(entry.data() + keySize, value.data(), value.size());
+  auto entryHk = HashedKey::precomputed(
+      folly::StringPiece{reinterpret_cast<const char*>(entry.data()), keySize},
+      hk.keyHash());
+  auto entryValue = entry.view().slice(keySize, value.size());
+
+  enginePairs_[0].scheduleDemote(
+      entryHk, entryValue,
+      [this, entry = std::move(entry), entryValue, onDrop](
+          Status s, HashedKey hashedKey) {
+        if (s == Status::Ok) {
+          demotedCount_.inc();
+        } else {
+          demoteFailedCount_.inc();
+          if (onDrop) {
+            onDrop(hashedKey, entryValue, DestructorEvent::Recycled);
+          }
+        }
+        parcelMemory_.sub(entry.size());
+        concurrentInserts_.dec();
+      });
+  return true;
+}
+
 Status Driver::lookup(HashedKey hk, Buffer& value) {
   return enginePairs_[selectEnginePair(hk)].lookupSync(hk, value);
 }
@@ -181,6 +252,43 @@ void Driver::lookupAsync(HashedKey hk, LookupCallback cb) {
   enginePairs_[selectEnginePair(hk)].scheduleLookup(hk, std::move(cb));
 }
 
+void Driver::lookupViewAsync(HashedKey hk, LookupViewCallback cb) {
+  XDCHECK(cb);
+  enginePairs_[selectEnginePair(hk)].scheduleLookupView(hk, std::move(cb));
+}
+
+void Driver::lookupBatchAsync(std::vector<HashedKey> keys,
+                              LookupBatchCallback cb) {
+  XDCHECK(cb);
+  if (keys.empty()) {
+    return;
+  }
+  if (enginePairs_.size() == 1) {
+    enginePairs_[0].scheduleLookupBatch(std::move(keys), std::move(cb));
+    return;
+  }
+
+  std::vector<std::vector<HashedKey>> pairKeys(enginePairs_.size());
+  std::vector<std::vector<size_t>> pairIdx(enginePairs_.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    const auto pair = selectEnginePair(keys[i]);
+    pairKeys[pair].push_back(keys[i]);
+    pairIdx[pair].push_back(i);
+  }
+  auto sharedCb = std::make_shared<LookupBatchCallback>(std::move(cb));
+  for (size_t pair = 0; pair < enginePairs_.size(); pair++) {
+    if (pairKeys[pair].empty()) {
+      continue;
+    }
+    enginePairs_[pair].scheduleLookupBatch(
+        std::move(pairKeys[pair]),
+        [sharedCb, idx = std::move(pairIdx[pair])](
+            size_t i, Status status, HashedKey key, Buffer value) {
+          (*sharedCb)(idx[i], status, key, std::move(value));
+        });
+  }
+}
+
 Status Driver::remove(HashedKey hk) {
   return enginePairs_[selectEnginePair(hk)].removeSync(hk);
 }
@@ -212,6 +320,10 @@ void Driver::reset() {
   if (admissionPolicy_) {
     admissionPolicy_->reset();
   }
+  // All cached data is dropped; no-op unless discard is enabled
+  const uint64_t align = device_->getIOAlignmentSize();
+  device_->discard(metadataSize_,
+                   (device_->getSize() - metadataSize_) / align * align);
 }
 
 void Driver::persist() const {
@@ -229,7 +341,9 @@ bool Driver::recover() {
     return false;
   }
   if (rr->isEnd()) {
-    return false;
+    // Nothing was persisted, e.g. the last run did not shut down cleanly.
+    // Engines that can rebuild their state from the device do so instead.
+    return rebuild();
   }
   // Because we insert item and remove from the other engine, partial recovery
   // is potentially possible.
@@ -256,6 +370,14 @@ bool Driver::recover() {
   return recovered;
 }
 
+bool Driver::rebuild() {
+  bool rebuilt = false;
+  for (auto& enginePair : enginePairs_) {
+    rebuilt |= enginePair.rebuild();
+  }
+  return rebuilt;
+}
+
 bool Driver::updateMaxRateForDynamicRandomAP(uint64_t maxRate) {
   DynamicRandomAP* ptr = dynamic_cast<DynamicRandomAP*>(admissionPolicy_.get());
   if (ptr) {
@@ -265,6 +387,10 @@ bool Driver::updateMaxRateForDynamicRandomAP(uint64_t maxRate) {
   return false;
 }
 
+uint64_t Driver::resizeSmallItemCache(uint64_t size) {
+  return enginePairs_.back().resizeSmallItemCache(size);
+}
+
 uint64_t Driver::getSize() const { return device_->getSize(); }
 
 uint64_t Driver::getUsableSize() const {
@@ -293,6 +419,24 @@ void Driver::getCounters(const CounterVisitor& visitor) const {
   visitor("navy_parcel_memory", parcelMemory_.get());
   visitor("navy_concurrent_inserts", concurrentInserts_.get());
 
+  if (tiered_) {
+    visitor("navy_tier_demoted", demotedCount_.get(),
+            CounterVisitor::CounterType::RATE);
+    visitor("navy_tier_demote_rejected", demoteRejectedCount_.get(),
+            CounterVisitor::CounterType::RATE);
+    visitor("navy_tier_demote_failed", demoteFailedCount_.get(),
+            CounterVisitor::CounterType::RATE);
+  }
+
+  visitor("navy_exported_entries", exportedCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_imported_entries", importedCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_import_expired", importExpiredCount_.get(),
+          CounterVisitor::CounterType::RATE);
+  visitor("navy_import_failed", importFailedCount_.get(),
+          CounterVisitor::CounterType::RATE);
+
   scheduler_->getCounters(visitor);
   if (enginePairs_.size() > 1) {
     for (size_t idx = 0; idx < enginePairs_.size(); idx++) {
@@ -320,4 +464,93 @@ std::pair<Status, std::string> Driver::getRandomAlloc(Buffer& value) {
   size_t idx = getRandomAllocDist(getRandomAllocGen);
   return enginePairs_[idx].getRandomAlloc(value);
 }
+
+uint64_t Driver::exportEntries(RecordWriter& rw) {
+  serialization::NavyExportHeader header;
+  *header.version() = kExportFormatVersion;
+  serializeProto(header, rw);
+
+  auto record = folly::IOBuf::create(kExportRecordSize);
+  uint64_t numExported = 0;
+  for (auto& enginePair : enginePairs_) {
+    numExported += enginePair.forEachEntry(
+        [&](HashedKey hk, BufferView value, uint32_t expiryTime) {
+          const size_t entrySize =
+              sizeof(ExportEntryHeader) + hk.key().size() + value.size();
+          if (record->tailroom() < entrySize) {
+            if (record->length() > 0) {
+              rw.writeRecord(std::move(record));
+            }
+            record = folly::IOBuf::create(
+                std::max(entrySize, kExportRecordSize));
+          }
+          ExportEntryHeader entryHeader;
+          entryHeader.keySize = static_cast<uint32_t>(hk.key().size());
+          entryHeader.valueSize = static_cast<uint32_t>(value.size());
+          entryHeader.expiryTime = expiryTime;
+          auto* data = record->writableTail();
+          std::memcpy(data, &entryHeader, sizeof(entryHeader));
+          data += sizeof(entryHeader);
+          std::memcpy(data, hk.key().data(), hk.key().size());
+          value.copyTo(data + hk.key().size());
+          record->append(entrySize);
+          return true;
+        });
+  }
+  if (record->length() > 0) {
+    rw.writeRecord(std::move(record));
+  }
+  exportedCount_.add(numExported);
+  XLOGF(INFO, "Exported {} entries", numExported);
+  return numExported;
+}
+
+uint64_t Driver::importEntries(RecordReader& rr) {
+  if (rr.isEnd()) {
+    throw std::invalid_argument("Empty export stream");
+  }
+  auto header = deserializeProto<serialization::NavyExportHeader>(rr);
+  if (*header.version() != kExportFormatVersion) {
+    throw std::invalid_argument(folly::sformat(
+        "Unsupported export format version {}", *header.version()));
+  }
+
+  uint64_t numImported = 0;
+  while (!rr.isEnd()) {
+    auto record = rr.readRecord();
+    record->coalesce();
+    folly::ByteRange data{record->data(), record->length()};
+    const uint32_t currentTime = util::getCurrentTimeSec();
+    while (!data.empty()) {
+      ExportEntryHeader entryHeader;
+      if (data.size() < sizeof(entryHeader)) {
+        throw std::invalid_argument("Truncated export entry header");
+      }
+      std::memcpy(&entryHeader, data.data(), sizeof(entryHeader));
+      data.advance(sizeof(entryHeader));
+      if (data.size() < static_cast<uint64_t>(entryHeader.keySize) +
+                            entryHeader.valueSize) {
+        throw std::invalid_argument("Truncated export entry");
+      }
+      auto hk = makeHK(data.data(), entryHeader.keySize);
+      BufferView value{entryHeader.valueSize,
+                       data.data() + entryHeader.keySize};
+      data.advance(entryHeader.keySize + entryHeader.valueSize);
+
+      if (entryHeader.expiryTime > 0 && entryHeader.expiryTime < currentTime) {
+        importExpiredCount_.inc();
+        continue;
+      }
+      if (enginePairs_[selectEnginePair(hk)].insertSync(hk, value) ==
+          Status::Ok) {
+        numImported++;
+      } else {
+        importFailedCount_.inc();
+      }
+    }
+  }
+  importedCount_.add(numImported);
+  XLOGF(INFO, "Imported {} entries", numImported);
+  return numImported;
+}
 } // namespace facebook::cachelib::navy
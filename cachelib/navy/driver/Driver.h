@@ -57,6 +57,12 @@ class Driver final : public AbstractCache {
 
     EnginePairSelector selector{};
 
+    // If true, there must be exactly two engine pairs and no selector. The
+    // first pair is a hot tier that takes all inserts and is looked up
+    // first; the second is a cold tier that receives the hot tier's
+    // evictions through demote().
+    bool tiered{false};
+
     Config& validate();
   };
 
@@ -109,6 +115,19 @@ class Driver final : public AbstractCache {
   //             the result will be provided to the function.
   void lookupAsync(HashedKey key, LookupCallback cb) override;
 
+  // lookup a key in the cache asynchronously, passing a view of the value
+  // that is only valid during the callback.
+  // @param key  the item key to lookup
+  // @param cb   a callback function be triggered when the lookup complete
+  void lookupViewAsync(HashedKey key, LookupViewCallback cb) override;
+
+  // lookup keys in the cache asynchronously, one job per engine pair.
+  // @param keys  the item keys to lookup
+  // @param cb    a callback function triggered when the lookup of each key
+  //              completes
+  void lookupBatchAsync(std::vector<HashedKey> keys,
+                        LookupBatchCallback cb) override;
+
   // remove the key from cache
   // @param key  the item key to be removed
   // @return a status indicates success or failure, and the reason for failure
@@ -151,10 +170,31 @@ class Driver final : public AbstractCache {
   //         false if AdissionPolicy is not set or not DynamicRandom.
   bool updateMaxRateForDynamicRandomAP(uint64_t maxRate) override;
 
+  // Resizes the small item engine of the last engine pair to @size bytes and
+  // gives the rest to its large item engine.
+  uint64_t resizeSmallItemCache(uint64_t size) override;
+
   // return a Buffer containing NvmItem randomly sampled in the backing store
   std::pair<Status, std::string /* key */> getRandomAlloc(
       Buffer& value) override;
 
+  // Exports the entries engine pair by engine pair
+  uint64_t exportEntries(RecordWriter& rw) override;
+
+  // Imports the entries into the engine pair each key maps to. In tiered
+  // mode they all go to the hot tier.
+  uint64_t importEntries(RecordReader& rr) override;
+
+  // Demote an entry evicted from the hot tier into the cold tier (tiered
+  // mode only). Key and value are copied, so they only need to be valid
+  // for the duration of the call. Demotions go through the same admission
+  // as inserts. An insert or remove of the key cancels a demotion that was
+  // not written yet, so that it never brings back a stale value.
+  // @param onDrop  invoked if the cold tier insert fails or is cancelled
+  //                after admission
+  // @return false if the demotion was not admitted
+  bool demote(HashedKey hk, BufferView value, const DestructorCallback& onDrop);
+
  private:
   struct ValidConfigTag {};
 
@@ -167,10 +207,15 @@ class Driver final : public AbstractCache {
   uint64_t estimateWriteSize(HashedKey hk, BufferView value) const;
   size_t selectEnginePair(HashedKey hk) const;
 
+  // Rebuilds the engine pairs from the device when no metadata was
+  // persisted. Returns true if any of them was rebuilt.
+  bool rebuild();
+
   const uint32_t maxConcurrentInserts_{};
   const uint64_t maxParcelMemory_{};
   const size_t metadataSize_{};
   const bool useEstimatedWriteSize_;
+  const bool tiered_{false};
 
   std::unique_ptr<Device> device_;
   std::unique_ptr<JobScheduler> scheduler_;
@@ -195,6 +240,17 @@ class Driver final : public AbstractCache {
   mutable AtomicCounter parcelMemory_; // In bytes
   mutable AtomicCounter concurrentInserts_;
 
+  // demotions from the hot to the cold tier
+  mutable AtomicCounter demotedCount_;
+  mutable AtomicCounter demoteRejectedCount_;
+  mutable AtomicCounter demoteFailedCount_;
+
+  // bulk export and import of entries
+  mutable AtomicCounter exportedCount_;
+  mutable AtomicCounter importedCount_;
+  mutable AtomicCounter importExpiredCount_;
+  mutable AtomicCounter importFailedCount_;
+
   FRIEND_TEST(Driver, MultiRecovery);
   FRIEND_TEST(Driver, EstimateWriteSize);
 };
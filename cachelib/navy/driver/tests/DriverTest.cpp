@@ -14,10 +14,14 @@
  * limitations under the License.
  */
 
+#include <folly/Format.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "cachelib/navy/common/Hash.h"
 #include "cachelib/navy/driver/Driver.h"
@@ -124,6 +128,17 @@ class MockEngine : public Engine {
     return std::make_pair(Status::NotFound, "");
   }
 
+  uint64_t forEachEntry(EntryVisitor visitor) override {
+    uint64_t numVisited = 0;
+    for (auto& kv : cache_) {
+      numVisited++;
+      if (!visitor(makeHK(kv.second.first), kv.second.second.view(), 0)) {
+        break;
+      }
+    }
+    return numVisited;
+  }
+
   uint64_t estimateWriteSize(HashedKey hk, BufferView value) const override {
     return defaultWriteSize_ == 0 ? hk.key().size() + value.size()
                                   : defaultWriteSize_;
@@ -821,6 +836,207 @@ TEST(Driver, EnginePairSetupErrors) {
   }
 }
 
+TEST(Driver, TieredEnginePairs) {
+  BufferGen bg;
+  const char hotKey[] = "hot key";
+  const char coldKey[] = "cold key";
+  auto hotValue = bg.gen(40);
+  auto coldValue = bg.gen(40);
+  auto newValue = bg.gen(40);
+
+  auto bc0 = std::make_unique<MockEngine>("bc 0");
+  auto bc1 = std::make_unique<MockEngine>("bc 1");
+  auto* rawBc0 = bc0.get();
+  auto* rawBc1 = bc1.get();
+
+  auto ex = makeJobScheduler();
+  auto config = makeDriverConfig(std::move(bc0), nullptr, std::move(ex));
+  config.enginePairs.push_back(
+      makeEnginePair(config.scheduler.get(), std::move(bc1)));
+  config.tiered = true;
+  auto driver = std::make_unique<Driver>(std::move(config));
+
+  // Inserts always go to the hot tier
+  EXPECT_EQ(Status::Ok, driver->insert(makeHK(hotKey), hotValue.view()));
+  EXPECT_TRUE(rawBc0->couldExist(makeHK(hotKey)));
+  EXPECT_FALSE(rawBc1->couldExist(makeHK(hotKey)));
+
+  // A demoted item lands in the cold tier and lookups fall through to it
+  MockDestructor onDrop;
+  EXPECT_CALL(onDrop, call(_, _, _)).Times(0);
+  EXPECT_TRUE(driver->demote(
+      makeHK(coldKey), coldValue.view(),
+      [&onDrop](HashedKey hk, BufferView value, DestructorEvent event) {
+        onDrop.call(hk, value, event);
+      }));
+  driver->drain();
+  EXPECT_FALSE(rawBc0->couldExist(makeHK(coldKey)));
+  EXPECT_TRUE(driver->couldExist(makeHK(coldKey)));
+  Buffer valueLookup;
+  EXPECT_EQ(Status::Ok, driver->lookup(makeHK(coldKey), valueLookup));
+  EXPECT_EQ(coldValue.view(), valueLookup.view());
+
+  // Reinserting the key moves it back to the hot tier and drops the cold copy
+  EXPECT_EQ(Status::Ok, driver->insert(makeHK(coldKey), newValue.view()));
+  EXPECT_FALSE(rawBc1->couldExist(makeHK(coldKey)));
+  EXPECT_EQ(Status::Ok, driver->lookup(makeHK(coldKey), valueLookup));
+  EXPECT_EQ(newValue.view(), valueLookup.view());
+
+  EXPECT_EQ(Status::Ok, driver->remove(makeHK(coldKey)));
+  EXPECT_EQ(Status::NotFound, driver->lookup(makeHK(coldKey), valueLookup));
+  EXPECT_EQ(Status::Ok, driver->lookup(makeHK(hotKey), valueLookup));
+  EXPECT_EQ(hotValue.view(), valueLookup.view());
+}
+
+TEST(Driver, ExportImport) {
+  BufferGen bg;
+  std::vector<std::pair<std::string, Buffer>> entries;
+  for (size_t i = 0; i < 20; i++) {
+    entries.emplace_back(folly::sformat("key {}", i),
+                         bg.gen(i % 2 == 0 ? 16 : 40));
+  }
+
+  auto config = makeDriverConfig(std::make_unique<MockEngine>(),
+                                 std::make_unique<MockEngine>(),
+                                 makeJobScheduler());
+  auto driver = std::make_unique<Driver>(std::move(config));
+  for (const auto& [key, value] : entries) {
+    EXPECT_EQ(Status::Ok, driver->insert(makeHK(key.c_str()), value.view()));
+  }
+
+  folly::IOBufQueue ioq;
+  auto rw = createMemoryRecordWriter(ioq);
+  EXPECT_EQ(entries.size(), driver->exportEntries(*rw));
+
+  auto newConfig = makeDriverConfig(std::make_unique<MockEngine>(),
+                                    std::make_unique<MockEngine>(),
+                                    makeJobScheduler());
+  auto newDriver = std::make_unique<Driver>(std::move(newConfig));
+  auto rr = createMemoryRecordReader(ioq);
+  EXPECT_EQ(entries.size(), newDriver->importEntries(*rr));
+  for (const auto& [key, value] : entries) {
+    Buffer valueLookup;
+    EXPECT_EQ(Status::Ok, newDriver->lookup(makeHK(key.c_str()), valueLookup));
+    EXPECT_EQ(value.view(), valueLookup.view());
+  }
+
+  // Anything that is not an export is rejected
+  folly::IOBufQueue emptyQueue;
+  auto emptyReader = createMemoryRecordReader(emptyQueue);
+  EXPECT_THROW(newDriver->importEntries(*emptyReader), std::invalid_argument);
+}
+
+TEST(Driver, TieredDemoteCancelled) {
+  BufferGen bg;
+  const char key[] = "key";
+  auto value = bg.gen(40);
+
+  auto bc0 = std::make_unique<MockEngine>("bc 0");
+  auto bc1 = std::make_unique<MockEngine>("bc 1");
+  auto* rawBc1 = bc1.get();
+
+  auto ex = std::make_unique<MockJobScheduler>();
+  auto* exPtr = ex.get();
+  auto config = makeDriverConfig(std::move(bc0), nullptr, std::move(ex));
+  config.enginePairs.push_back(
+      makeEnginePair(config.scheduler.get(), std::move(bc1)));
+  config.tiered = true;
+  auto driver = std::make_unique<Driver>(std::move(config));
+
+  MockDestructor onDrop;
+  EXPECT_CALL(onDrop,
+              call(makeHK(key), value.view(), DestructorEvent::Recycled));
+  EXPECT_TRUE(driver->demote(
+      makeHK(key), value.view(),
+      [&onDrop](HashedKey hk, BufferView v, DestructorEvent event) {
+        onDrop.call(hk, v, event);
+      }));
+
+  // The key is removed before the demotion is written
+  EXPECT_EQ(Status::NotFound, driver->remove(makeHK(key)));
+  EXPECT_TRUE(exPtr->runFirstIf("demote"));
+  EXPECT_EQ(0, exPtr->getQueueSize());
+  EXPECT_FALSE(rawBc1->couldExist(makeHK(key)));
+  Buffer valueLookup;
+  EXPECT_EQ(Status::NotFound, driver->lookup(makeHK(key), valueLookup));
+
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_tier_demote_cancelled_0") {
+      EXPECT_EQ(1, count);
+    }
+    if (name == "navy_tier_demoted") {
+      EXPECT_EQ(0, count);
+    }
+  }});
+}
+
+TEST(Driver, TieredDemoteCancelledWhileWritten) {
+  BufferGen bg;
+  const char key[] = "key";
+  auto value = bg.gen(40);
+
+  auto bc0 = std::make_unique<MockEngine>("bc 0");
+  auto bc1 = std::make_unique<MockEngine>("bc 1");
+  auto* rawBc1 = bc1.get();
+
+  auto ex = std::make_unique<MockJobScheduler>();
+  auto* exPtr = ex.get();
+  auto config = makeDriverConfig(std::move(bc0), nullptr, std::move(ex));
+  config.enginePairs.push_back(
+      makeEnginePair(config.scheduler.get(), std::move(bc1)));
+  config.tiered = true;
+  auto driver = std::make_unique<Driver>(std::move(config));
+
+  // The key is removed while the demotion is written to the cold tier. The
+  // remove must not wait for the write, and finds no cold copy yet.
+  EXPECT_CALL(*rawBc1, insert(makeHK(key), _))
+      .WillOnce(Invoke([&](HashedKey, BufferView) {
+        EXPECT_EQ(Status::NotFound, driver->remove(makeHK(key)));
+        return Status::Ok;
+      }));
+  // So the demotion removes the copy it wrote once it completes
+  EXPECT_CALL(*rawBc1, remove(makeHK(key)));
+
+  MockDestructor onDrop;
+  EXPECT_CALL(onDrop,
+              call(makeHK(key), value.view(), DestructorEvent::Recycled));
+  EXPECT_TRUE(driver->demote(
+      makeHK(key), value.view(),
+      [&onDrop](HashedKey hk, BufferView v, DestructorEvent event) {
+        onDrop.call(hk, v, event);
+      }));
+  EXPECT_TRUE(exPtr->runFirstIf("demote"));
+  EXPECT_EQ(0, exPtr->getQueueSize());
+
+  driver->getCounters({[](folly::StringPiece name, double count) {
+    if (name == "navy_tier_demote_cancelled_0") {
+      EXPECT_EQ(1, count);
+    }
+  }});
+}
+
+TEST(Driver, TieredEnginePairsSetupErrors) {
+  {
+    // Tiering needs a cold pair
+    auto ex = makeJobScheduler();
+    auto config = makeDriverConfig(nullptr, nullptr, std::move(ex));
+    config.tiered = true;
+    EXPECT_THROW(std::make_unique<Driver>(std::move(config)),
+                 std::invalid_argument);
+  }
+
+  {
+    // Tiering decides placement, a selector is not allowed
+    auto ex = makeJobScheduler();
+    auto config = makeDriverConfig(nullptr, nullptr, std::move(ex));
+    config.enginePairs.push_back(makeEnginePair(config.scheduler.get()));
+    config.selector = [](HashedKey) { return 1; };
+    config.tiered = true;
+    EXPECT_THROW(std::make_unique<Driver>(std::move(config)),
+                 std::invalid_argument);
+  }
+}
+
 // Test the functionality of estimate write size:
 // - Write size should be sent to different engine pairs accordingly to the
 // selection function.
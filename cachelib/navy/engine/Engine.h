@@ -16,12 +16,20 @@
 
 #pragma once
 
+#include <folly/logging/xlog.h>
+
 #include "cachelib/navy/AbstractCache.h"
 #include "cachelib/navy/common/Hash.h"
 
 namespace facebook {
 namespace cachelib {
 namespace navy {
+// Called by Engine::forEachEntry with the key, the value and the absolute
+// expiry time (0 if none) of an entry. @value is only valid during the call.
+// Returns false to stop the iteration.
+using EntryVisitor = folly::FunctionRef<bool(
+    HashedKey hk, BufferView value, uint32_t expiryTime)>;
+
 // Abstract base class of an engine.
 class Engine {
  public:
@@ -45,6 +53,34 @@ class Engine {
   // Looks up a key in the engine.
   virtual Status lookup(HashedKey hk, Buffer& value) = 0;
 
+  // Looks up a key and, if found, calls @visitor with a view of the value
+  // that is only valid during the call. Engines override this to hand out
+  // data they already hold in memory without copying it into a Buffer.
+  // Returns the same statuses as lookup(); @visitor is called only on Ok.
+  virtual Status lookupView(HashedKey hk,
+                            folly::FunctionRef<void(BufferView)> visitor) {
+    Buffer value;
+    auto status = lookup(hk, value);
+    if (status == Status::Ok) {
+      visitor(value.view());
+    }
+    return status;
+  }
+
+  // Looks up all of @keys, setting statuses[i] and values[i] for keys[i].
+  // Engines override this to serve keys stored close to each other on the
+  // device with shared reads. Statuses are the same as for lookup(); Retry
+  // only means that this key has to be looked up again.
+  virtual void lookupBatch(folly::Range<const HashedKey*> keys,
+                           folly::Range<Status*> statuses,
+                           folly::Range<Buffer*> values) {
+    XDCHECK_EQ(keys.size(), statuses.size());
+    XDCHECK_EQ(keys.size(), values.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      statuses[i] = lookup(keys[i], values[i]);
+    }
+  }
+
   // Remove must not return Status::Retry.
   virtual Status remove(HashedKey hk) = 0;
 
@@ -65,6 +101,24 @@ class Engine {
   // @return  true if recovery succeeds, false otherwise.
   virtual bool recover(RecordReader& rr) = 0;
 
+  // Rebuilds engine state by scanning the device, when there is no state
+  // persisted by a clean shutdown to recover from.
+  //
+  // @return  true if rebuilt, false if the engine does not support it.
+  virtual bool rebuild() { return false; }
+
+  // Returns false if @hk maps to a part of the engine given up by resize().
+  // Such keys are inserted into the other engine of the pair instead.
+  virtual bool acceptsKey(HashedKey /* hk */) const { return true; }
+
+  // Resizes the part of the engine's device range that holds cache data to
+  // @size bytes, evicting everything in the part that is given up. Blocks
+  // until the space given up is no longer used. Returns the new size, which
+  // is @size rounded down to the engine's allocation unit. Engines that
+  // cannot resize, or that time out waiting for the space given up, keep
+  // their size.
+  virtual uint64_t resize(uint64_t /* size */) { return getSize(); }
+
   // Gets engine specific counters. Calls back @visitor with key name and value.
   virtual void getCounters(const CounterVisitor& visitor) const = 0;
 
@@ -74,6 +128,13 @@ class Engine {
   // Get key and Buffer for a random sample
   virtual std::pair<Status, std::string /* key */> getRandomAlloc(
       Buffer& value) = 0;
+
+  // Calls @visitor for every entry the engine holds, in device order,
+  // reading the device with large sequential IOs. Entries that are expired,
+  // replaced or removed are skipped. Entries inserted or removed during the
+  // iteration may or may not be visited. Returns the number of entries
+  // visited. Engines that can't be iterated visit nothing.
+  virtual uint64_t forEachEntry(EntryVisitor /* visitor */) { return 0; }
 };
 } // namespace navy
 } // namespace cachelib
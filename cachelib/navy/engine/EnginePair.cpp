@@ -16,6 +16,8 @@
 
 #include "cachelib/navy/engine/EnginePair.h"
 
+#include <algorithm>
+
 #include "cachelib/navy/engine/NoopEngine.h"
 
 namespace facebook::cachelib::navy {
@@ -35,7 +37,7 @@ bool EnginePair::isItemLarge(HashedKey key, BufferView value) const {
 
 std::pair<Engine&, Engine&> EnginePair::select(HashedKey key,
                                                BufferView value) const {
-  if (isItemLarge(key, value)) {
+  if (isItemLarge(key, value) || !smallItemCache_->acceptsKey(key)) {
     return {*largeItemCache_, *smallItemCache_};
   } else {
     return {*smallItemCache_, *largeItemCache_};
@@ -43,14 +45,21 @@ std::pair<Engine&, Engine&> EnginePair::select(HashedKey key,
 }
 
 bool EnginePair::couldExist(HashedKey key) const {
-  bool couldExist =
-      smallItemCache_->couldExist(key) || largeItemCache_->couldExist(key);
+  bool couldExist = smallItemCache_->couldExist(key) ||
+                    largeItemCache_->couldExist(key) ||
+                    lowerTierCouldExist(key);
   if (!couldExist) {
     lookupCount_.inc();
   }
   return couldExist;
 }
 
+bool EnginePair::lowerTierCouldExist(HashedKey hk) const {
+  return lowerTier_ != nullptr &&
+         (lowerTier_->smallItemCache_->couldExist(hk) ||
+          lowerTier_->largeItemCache_->couldExist(hk));
+}
+
 uint64_t EnginePair::estimateWriteSize(HashedKey hk, BufferView value) const {
   return select(hk, value).first.estimateWriteSize(hk, value);
 }
@@ -67,6 +76,14 @@ Status EnginePair::lookupSync(HashedKey hk, Buffer& value) const {
       std::this_thread::yield();
     }
   }
+  if (status == Status::NotFound && lowerTierCouldExist(hk)) {
+    lowerTierLookupCount_.inc();
+    status = lowerTier_->lookupSync(hk, value);
+    if (status == Status::Ok) {
+      lowerTierHitCount_.inc();
+    }
+    return status;
+  }
   updateLookupStats(status);
   return status;
 }
@@ -93,6 +110,21 @@ Status EnginePair::insertInternal(HashedKey hk,
       status = Status::BadState;
     }
   }
+  if (pendingDemotes_) {
+    cancelDemote(hk);
+  }
+  if (status != Status::DeviceError && lowerTierCouldExist(hk)) {
+    // A retry repeats the removes above, which then find nothing
+    bool skipSmallItemCache = false;
+    auto rs = lowerTier_->removeHashedKeyInternal(hk, skipSmallItemCache);
+    if (rs == Status::Retry) {
+      return rs;
+    }
+    if (rs != Status::Ok && rs != Status::NotFound) {
+      XLOGF(ERR, "Insert failed to remove lower tier: {}", toString(rs));
+      status = Status::BadState;
+    }
+  }
 
   switch (status) {
   case Status::Ok:
@@ -130,6 +162,89 @@ void EnginePair::scheduleInsert(HashedKey hk,
       hk.keyHash());
 }
 
+void EnginePair::scheduleDemote(HashedKey hk,
+                                BufferView value,
+                                InsertCallback cb) {
+  XDCHECK(lowerTier_ != nullptr);
+  const uint64_t demoteId = pendingDemotes_->nextId.fetch_add(1);
+  {
+    auto& shard = pendingDemotes_->getShard(hk.keyHash());
+    std::lock_guard<folly::fibers::TimedMutex> l{shard.mutex};
+    shard.ids[hk.keyHash()] = demoteId;
+  }
+  lowerTier_->insertCount_.inc();
+  scheduler_->enqueueWithKey(
+      [this, cb = std::move(cb), hk, value, demoteId, skipInsertion = false,
+       skipLowerSmallItemCache = false, cancelled = false]() mutable {
+        Status status = Status::Rejected;
+        if (!cancelled) {
+          cancelled = !isDemotePending(hk, demoteId, false /* finish */);
+        }
+        if (!cancelled) {
+          // Written without the shard lock, so that inserts and removes of
+          // other keys in the shard don't wait on the lower tier device.
+          status = lowerTier_->insertInternal(hk, value, skipInsertion);
+          if (status == Status::Retry) {
+            return JobExitCode::Reschedule;
+          }
+          cancelled = !isDemotePending(hk, demoteId, true /* finish */);
+        }
+        if (cancelled) {
+          // The key was inserted or removed above while it was written, and
+          // the lower tier copy may have landed after the caller dropped it.
+          if (skipInsertion) {
+            auto rs = lowerTier_->removeHashedKeyInternal(
+                hk, skipLowerSmallItemCache);
+            if (rs == Status::Retry) {
+              return JobExitCode::Reschedule;
+            }
+          }
+          demoteCancelledCount_.inc();
+          status = Status::Rejected;
+        }
+
+        if (cb) {
+          cb(status, hk);
+        }
+        return JobExitCode::Done;
+      },
+      "demote",
+      JobType::Write,
+      hk.keyHash());
+}
+
+bool EnginePair::isDemotePending(HashedKey hk,
+                                 uint64_t demoteId,
+                                 bool finish) {
+  auto& shard = pendingDemotes_->getShard(hk.keyHash());
+  std::lock_guard<folly::fibers::TimedMutex> l{shard.mutex};
+  auto it = shard.ids.find(hk.keyHash());
+  if (it == shard.ids.end() || it->second != demoteId) {
+    return false;
+  }
+  if (finish) {
+    shard.ids.erase(it);
+  }
+  return true;
+}
+
+void EnginePair::cancelDemote(HashedKey hk) {
+  auto& shard = pendingDemotes_->getShard(hk.keyHash());
+  std::lock_guard<folly::fibers::TimedMutex> l{shard.mutex};
+  shard.ids.erase(hk.keyHash());
+}
+
+Status EnginePair::insertSync(HashedKey hk, BufferView value) {
+  insertCount_.inc();
+  Status status{Status::Ok};
+  bool skipInsertion = false;
+  while ((status = insertInternal(hk, value, skipInsertion)) ==
+         Status::Retry) {
+    std::this_thread::yield();
+  }
+  return status;
+}
+
 void EnginePair::updateLookupStats(Status status) const {
   switch (status) {
   case Status::Ok:
@@ -159,6 +274,53 @@ Status EnginePair::lookupInternal(HashedKey hk,
       return status;
     }
   }
+  if (status == Status::NotFound && lowerTierCouldExist(hk)) {
+    bool skipLowerLargeItemCache = false;
+    status = lowerTier_->lookupInternal(hk, value, skipLowerLargeItemCache);
+    if (status == Status::Retry) {
+      return status;
+    }
+    lowerTierLookupCount_.inc();
+    if (status == Status::Ok) {
+      lowerTierHitCount_.inc();
+    }
+    return status;
+  }
+  updateLookupStats(status);
+  return status;
+}
+
+Status EnginePair::lookupViewInternal(
+    HashedKey hk,
+    folly::FunctionRef<void(BufferView)> visitor,
+    bool& skipLargeItemCache) const {
+  Status status{Status::NotFound};
+  if (!skipLargeItemCache) {
+    status = largeItemCache_->lookupView(hk, visitor);
+    if (status == Status::Retry) {
+      return status;
+    }
+    skipLargeItemCache = true;
+  }
+  if (status == Status::NotFound) {
+    status = smallItemCache_->lookupView(hk, visitor);
+    if (status == Status::Retry) {
+      return status;
+    }
+  }
+  if (status == Status::NotFound && lowerTierCouldExist(hk)) {
+    bool skipLowerLargeItemCache = false;
+    status = lowerTier_->lookupViewInternal(hk, visitor,
+                                            skipLowerLargeItemCache);
+    if (status == Status::Retry) {
+      return status;
+    }
+    lowerTierLookupCount_.inc();
+    if (status == Status::Ok) {
+      lowerTierHitCount_.inc();
+    }
+    return status;
+  }
   updateLookupStats(status);
   return status;
 }
@@ -182,6 +344,100 @@ void EnginePair::scheduleLookup(HashedKey hk, LookupCallback cb) {
       hk.keyHash());
 }
 
+void EnginePair::scheduleLookupView(HashedKey hk, LookupViewCallback cb) {
+  scheduler_->enqueueWithKey(
+      [this, cb = std::move(cb), hk, skipLargeItemCache = false]() mutable {
+        bool found = false;
+        Status status = lookupViewInternal(
+            hk,
+            [&](BufferView value) {
+              found = true;
+              if (cb) {
+                cb(Status::Ok, hk, value);
+              }
+            },
+            skipLargeItemCache);
+        if (status == Status::Retry) {
+          return JobExitCode::Reschedule;
+        }
+        if (cb && !found) {
+          cb(status, hk, BufferView{});
+        }
+
+        return JobExitCode::Done;
+      },
+      "lookup",
+      JobType::Read,
+      hk.keyHash());
+}
+
+void EnginePair::scheduleLookupBatch(std::vector<HashedKey> keys,
+                                     LookupBatchCallback cb) {
+  XDCHECK(!keys.empty());
+  const auto firstKeyHash = keys.front().keyHash();
+  scheduler_->enqueueWithKey(
+      [this, keys = std::move(keys),
+       cb = std::make_shared<LookupBatchCallback>(std::move(cb))]() mutable {
+        lookupBatchInternal(keys, std::move(cb));
+        return JobExitCode::Done;
+      },
+      "lookupBatch",
+      JobType::Read,
+      firstKeyHash);
+}
+
+void EnginePair::lookupBatchInternal(const std::vector<HashedKey>& keys,
+                                     std::shared_ptr<LookupBatchCallback> cb) {
+  std::vector<Status> statuses(keys.size(), Status::NotFound);
+  std::vector<Buffer> values(keys.size());
+  largeItemCache_->lookupBatch(folly::range(keys), folly::range(statuses),
+                               folly::range(values));
+
+  // Keys the large item engine doesn't have go to the small item engine
+  std::vector<size_t> smallIdx;
+  std::vector<HashedKey> smallKeys;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (statuses[i] == Status::NotFound) {
+      smallIdx.push_back(i);
+      smallKeys.push_back(keys[i]);
+    }
+  }
+  if (!smallKeys.empty()) {
+    std::vector<Status> smallStatuses(smallKeys.size(), Status::NotFound);
+    std::vector<Buffer> smallValues(smallKeys.size());
+    smallItemCache_->lookupBatch(folly::range(smallKeys),
+                                 folly::range(smallStatuses),
+                                 folly::range(smallValues));
+    for (size_t j = 0; j < smallIdx.size(); j++) {
+      statuses[smallIdx[j]] = smallStatuses[j];
+      values[smallIdx[j]] = std::move(smallValues[j]);
+    }
+  }
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (statuses[i] == Status::Retry) {
+      scheduleLookup(keys[i],
+                     [cb, i](Status status, HashedKey key, Buffer value) {
+                       (*cb)(i, status, key, std::move(value));
+                     });
+      continue;
+    }
+    if (statuses[i] == Status::NotFound && lowerTierCouldExist(keys[i])) {
+      lowerTierLookupCount_.inc();
+      lowerTier_->scheduleLookup(
+          keys[i], [this, cb, i](Status status, HashedKey key, Buffer value) {
+            if (status == Status::Ok) {
+              lowerTierHitCount_.inc();
+            }
+            (*cb)(i, status, key, std::move(value));
+          });
+      continue;
+    }
+    updateLookupStats(statuses[i]);
+    (*cb)(i, statuses[i], keys[i], std::move(values[i]));
+  }
+}
+
 Status EnginePair::removeSync(HashedKey hk) {
   Status status{Status::Ok};
   bool skipSmallItemCache = false;
@@ -203,6 +459,20 @@ Status EnginePair::removeHashedKeyInternal(HashedKey hk,
     status = largeItemCache_->remove(hk);
     skipSmallItemCache = true;
   }
+  if (status != Status::Retry && pendingDemotes_) {
+    cancelDemote(hk);
+  }
+  if (status != Status::Retry && status != Status::DeviceError &&
+      lowerTierCouldExist(hk)) {
+    // A demotion may have left an older copy below even if this tier had
+    // the key. On retry the engines above are removed from again; they no
+    // longer hold the key by then.
+    bool skipLowerSmallItemCache = false;
+    auto rs = lowerTier_->removeHashedKeyInternal(hk, skipLowerSmallItemCache);
+    if (rs != Status::NotFound) {
+      status = rs;
+    }
+  }
   switch (status) {
   case Status::Ok:
     succRemoveCount_.inc();
@@ -261,6 +531,12 @@ bool EnginePair::recover(RecordReader& rr) {
   return largeItemCache_->recover(rr) && smallItemCache_->recover(rr);
 }
 
+// rebuild the navy engines state from the device
+bool EnginePair::rebuild() {
+  smallItemCache_->reset();
+  return largeItemCache_->rebuild();
+}
+
 void EnginePair::getCounters(const CounterVisitor& visitor) const {
   visitor(
       "navy_inserts", insertCount_.get(), CounterVisitor::CounterType::RATE);
@@ -279,6 +555,17 @@ void EnginePair::getCounters(const CounterVisitor& visitor) const {
           CounterVisitor::CounterType::RATE);
   visitor(
       "navy_io_errors", ioErrorCount_.get(), CounterVisitor::CounterType::RATE);
+  if (lowerTier_ != nullptr) {
+    visitor("navy_lower_tier_lookups",
+            lowerTierLookupCount_.get(),
+            CounterVisitor::CounterType::RATE);
+    visitor("navy_lower_tier_hits",
+            lowerTierHitCount_.get(),
+            CounterVisitor::CounterType::RATE);
+    visitor("navy_tier_demote_cancelled",
+            demoteCancelledCount_.get(),
+            CounterVisitor::CounterType::RATE);
+  }
   visitor("navy_total_usable_size", getUsableSize());
   largeItemCache_->getCounters(visitor);
   smallItemCache_->getCounters(visitor);
@@ -288,6 +575,20 @@ uint64_t EnginePair::getUsableSize() const {
   return largeItemCache_->getSize() + smallItemCache_->getSize();
 }
 
+uint64_t EnginePair::resizeSmallItemCache(uint64_t size) {
+  std::lock_guard<std::mutex> lock{resizeMutex_};
+  size = std::min(size, combinedSize_);
+  // The engine that shrinks goes first, so that both never use the same space
+  if (size < smallItemCache_->getSize()) {
+    const auto smallSize = smallItemCache_->resize(size);
+    largeItemCache_->resize(combinedSize_ - smallSize);
+  } else if (size > smallItemCache_->getSize()) {
+    const auto largeSize = largeItemCache_->resize(combinedSize_ - size);
+    smallItemCache_->resize(combinedSize_ - largeSize);
+  }
+  return smallItemCache_->getSize();
+}
+
 std::pair<Status, std::string> EnginePair::getRandomAlloc(Buffer& value) {
   uint64_t largeCacheSize = largeItemCache_->getSize();
   uint64_t smallCacheSize = smallItemCache_->getSize();
@@ -303,6 +604,20 @@ std::pair<Status, std::string> EnginePair::getRandomAlloc(Buffer& value) {
   return smallItemCache_->getRandomAlloc(value);
 }
 
+uint64_t EnginePair::forEachEntry(EntryVisitor visitor) {
+  bool stopped = false;
+  auto visitUntilStopped = [&](HashedKey hk, BufferView value,
+                               uint32_t expiryTime) {
+    stopped = !visitor(hk, value, expiryTime);
+    return !stopped;
+  };
+  auto numVisited = largeItemCache_->forEachEntry(visitUntilStopped);
+  if (!stopped) {
+    numVisited += smallItemCache_->forEachEntry(visitUntilStopped);
+  }
+  return numVisited;
+}
+
 void EnginePair::validate() {
   if (smallItemCache_ != nullptr) {
     if (smallItemMaxSize_ == 0) {
@@ -324,6 +639,7 @@ void EnginePair::validate() {
     XLOG(INFO, "Small item cache is noop.");
     smallItemCache_ = std::make_unique<NoopEngine>();
   }
+  combinedSize_ = getUsableSize();
 }
 
 } // namespace facebook::cachelib::navy
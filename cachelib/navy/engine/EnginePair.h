@@ -19,6 +19,12 @@
 #include <cachelib/common/Hash.h>
 #include <cachelib/navy/common/Buffer.h>
 #include <folly/Random.h>
+#include <folly/container/F14Map.h>
+#include <folly/fibers/TimedMutex.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
 
 #include "cachelib/navy/engine/Engine.h"
 #include "cachelib/navy/scheduler/JobScheduler.h"
@@ -41,7 +47,11 @@ class EnginePair {
       : EnginePair(std::move(ep.smallItemCache_),
                    std::move(ep.largeItemCache_),
                    ep.smallItemMaxSize_,
-                   ep.scheduler_) {}
+                   ep.scheduler_) {
+    lowerTier_ = ep.lowerTier_;
+    pendingDemotes_ = std::move(ep.pendingDemotes_);
+    combinedSize_ = ep.combinedSize_;
+  }
 
   // Move assignment operator.
   EnginePair& operator=(EnginePair&& other) = delete;
@@ -67,6 +77,15 @@ class EnginePair {
   // Schedule an insert.
   void scheduleInsert(HashedKey hk, BufferView value, InsertCallback cb);
 
+  // Perform insert by keeping retrying until a result (Ok, Rejected, Error)
+  // is reached.
+  Status insertSync(HashedKey hk, BufferView value);
+
+  // Schedule an insert of an entry evicted from this pair into the lower
+  // tier. An insert or remove of the key in the meantime cancels it, and
+  // @cb is called with Status::Rejected.
+  void scheduleDemote(HashedKey hk, BufferView value, InsertCallback cb);
+
   // Perform lookup by keeping retrying until a result (Ok, NotFound, Error) is
   // reached.
   Status lookupSync(HashedKey hk, Buffer& value) const;
@@ -78,6 +97,17 @@ class EnginePair {
   // Schedule a lookup.
   void scheduleLookup(HashedKey hk, LookupCallback cb);
 
+  // Schedule a lookup whose callback receives a view of the value instead
+  // of a Buffer. See AbstractCache::lookupViewAsync.
+  void scheduleLookupView(HashedKey hk, LookupViewCallback cb);
+
+  // Schedule a lookup of all of @keys in one job, so that the engines can
+  // share device reads between them. Keys that have to be retried or go to
+  // the lower tier are looked up by separate jobs. @cb may then be called
+  // concurrently.
+  void scheduleLookupBatch(std::vector<HashedKey> keys,
+                           LookupBatchCallback cb);
+
   // Schedule a remove.
   void scheduleRemove(HashedKey hk, RemoveCallback cb);
 
@@ -96,15 +126,39 @@ class EnginePair {
   // recover the navy engines state
   bool recover(RecordReader& rr);
 
+  // rebuild the navy engines state from the device. Only the large item
+  // engine can be rebuilt; the small item engine starts empty.
+  bool rebuild();
+
   // returns the navy stats
   void getCounters(const CounterVisitor& visitor) const;
 
   uint64_t getUsableSize() const;
 
+  // Moves device space between the engines: resizes the small item engine
+  // to @size bytes and gives the large item engine what is left of the space
+  // both had after validate(). The space given up is taken over only after
+  // its entries are evicted. Space can only move if the engines' device
+  // ranges overlap; otherwise each engine is capped at its own range.
+  // Returns the new size of the small item engine.
+  uint64_t resizeSmallItemCache(uint64_t size);
+
   std::pair<Status, std::string> getRandomAlloc(Buffer& value);
 
+  // Visits the entries of the large item engine, then those of the small
+  // item engine. See Engine::forEachEntry.
+  uint64_t forEachEntry(EntryVisitor visitor);
+
   void validate();
 
+  // Stack this pair on top of a colder @lowerTier pair. Lookups that miss
+  // here fall through to the lower tier, and inserts and removes also drop
+  // its copy so that it never serves a stale value.
+  void setLowerTier(EnginePair* lowerTier) {
+    lowerTier_ = lowerTier;
+    pendingDemotes_ = std::make_unique<PendingDemotes>();
+  }
+
  private:
   // Update statistics for lookup
   void updateLookupStats(Status status) const;
@@ -119,6 +173,16 @@ class EnginePair {
                         Buffer& value,
                         bool& skipLargeItemCache) const;
 
+  // Same as lookupInternal, but passes the value to @visitor.
+  Status lookupViewInternal(HashedKey hk,
+                            folly::FunctionRef<void(BufferView)> visitor,
+                            bool& skipLargeItemCache) const;
+
+  // Looks up @keys in both engines and calls @cb for every key. Keys that
+  // need a retry or the lower tier are handed to scheduleLookup().
+  void lookupBatchInternal(const std::vector<HashedKey>& keys,
+                           std::shared_ptr<LookupBatchCallback> cb);
+
   // insert an item to one of the engine and remove it from the other.
   // An option can be specified to skip insertion on retry.
   Status insertInternal(HashedKey key, BufferView value, bool& skipInsertion);
@@ -126,6 +190,36 @@ class EnginePair {
   // Performa a remove by hashed key in a retry friendly manner.
   Status removeHashedKeyInternal(HashedKey hk, bool& skipSmallItemCache);
 
+  // Fast check if the lower tier may hold the key. Unlike couldExist, this
+  // doesn't count as a lookup of the lower tier.
+  bool lowerTierCouldExist(HashedKey hk) const;
+
+  // Cancels a demotion of @hk that has not completed yet
+  void cancelDemote(HashedKey hk);
+
+  // Returns whether demotion @demoteId of @hk is still pending, and marks it
+  // completed if @finish is set.
+  bool isDemotePending(HashedKey hk, uint64_t demoteId, bool finish);
+
+  // Demotions scheduled but not completed yet, by key hash. The lower tier
+  // write happens outside of the shard lock. A demotion cancelled while it
+  // was written removes its lower tier copy again, so a cancelled demotion
+  // never leaves a stale copy behind.
+  struct PendingDemotes {
+    static constexpr size_t kNumShards = 64;
+    struct Shard {
+      // Locks may wait on a fiber
+      folly::fibers::TimedMutex mutex;
+      // key hash -> id of the pending demotion
+      folly::F14FastMap<uint64_t, uint64_t> ids;
+    };
+
+    Shard& getShard(uint64_t keyHash) { return shards[keyHash % kNumShards]; }
+
+    std::array<Shard, kNumShards> shards;
+    std::atomic<uint64_t> nextId{0};
+  };
+
   const uint32_t smallItemMaxSize_{};
   // Large item cache assumed to have fast response in case entry doesn't
   // exists (check metadata only).
@@ -135,6 +229,17 @@ class EnginePair {
 
   JobScheduler* scheduler_;
 
+  // Colder pair below this one, if tiered. Not owned.
+  EnginePair* lowerTier_{nullptr};
+  // Only set up if there is a lower tier
+  std::unique_ptr<PendingDemotes> pendingDemotes_;
+
+  // Sum of the engine sizes after validate(). Resizes keep the sizes of the
+  // engines within it, so that their active parts never overlap.
+  uint64_t combinedSize_{};
+  // Serializes resizes
+  std::mutex resizeMutex_;
+
   // These stats are bumped only once per call.
   mutable TLCounter insertCount_;
   mutable TLCounter lookupCount_;
@@ -145,6 +250,9 @@ class EnginePair {
   mutable AtomicCounter succLookupCount_;
   mutable AtomicCounter succRemoveCount_;
   mutable AtomicCounter ioErrorCount_;
+  mutable AtomicCounter lowerTierLookupCount_;
+  mutable AtomicCounter lowerTierHitCount_;
+  mutable AtomicCounter demoteCancelledCount_;
 };
 } // namespace navy
 } // namespace cachelib
@@ -16,14 +16,20 @@
 
 #include "cachelib/navy/serialization/RecordIO.h"
 
+#include <folly/FileUtil.h>
 #include <folly/Format.h>
 #include <folly/Range.h>
 #include <folly/io/RecordIO.h>
 
+#include <algorithm>
+#include <array>
+#include <system_error>
+
 using namespace folly::recordio_helpers;
 
 namespace facebook::cachelib::navy {
 constexpr uint32_t kMetadataHeaderFileId = 1;
+constexpr uint32_t kStreamHeaderFileId = 2;
 namespace {
 class FileRecordWriter final : public RecordWriter {
  public:
@@ -61,25 +67,136 @@ class FileRecordReader final : public RecordReader {
   folly::RecordIOReader::Iterator curr_;
 };
 
+class StreamRecordWriter final : public RecordWriter {
+ public:
+  explicit StreamRecordWriter(folly::File file) : file_(std::move(file)) {}
+  ~StreamRecordWriter() override = default;
+
+  void writeRecord(std::unique_ptr<folly::IOBuf> buf) override {
+    if (prependHeader(buf, kStreamHeaderFileId) == 0) {
+      return;
+    }
+    auto iov = buf->getIov();
+    if (folly::writevFull(file_.fd(), iov.data(), iov.size()) < 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "failed to write record");
+    }
+  }
+  bool invalidate() override { return false; }
+
+ private:
+  folly::File file_;
+};
+
+class StreamRecordReader final : public RecordReader {
+ public:
+  explicit StreamRecordReader(folly::File file) : file_(std::move(file)) {}
+  ~StreamRecordReader() override = default;
+
+  std::unique_ptr<folly::IOBuf> readRecord() override {
+    if (!readHeader()) {
+      throw std::logic_error("end of record stream");
+    }
+    if (!validateRecordHeader(
+            folly::ByteRange(header_.data(), header_.size()),
+            kStreamHeaderFileId)) {
+      throw std::logic_error("Invalid record header");
+    }
+    const auto* h =
+        reinterpret_cast<const recordio_detail::Header*>(header_.data());
+    auto buf = folly::IOBuf::create(header_.size() + h->dataLength);
+    memcpy(buf->writableData(), header_.data(), header_.size());
+    buf->append(header_.size() + h->dataLength);
+    headerLen_ = 0;
+
+    auto len = folly::readFull(file_.fd(),
+                               buf->writableData() + header_.size(),
+                               h->dataLength);
+    if (len < 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "failed to read record");
+    }
+    if (static_cast<size_t>(len) != h->dataLength) {
+      throw std::logic_error("Truncated record");
+    }
+    auto record = validateRecordData(
+        folly::ByteRange(buf->data(), buf->length()));
+    if (record.fileId == 0) {
+      throw std::invalid_argument(
+          folly::sformat("Invalid record : length = {}", buf->length()));
+    }
+    buf->trimStart(header_.size());
+    return buf;
+  }
+
+  bool isEnd() const override { return !readHeader(); }
+
+ private:
+  // Reads the header of the next record unless it was read already.
+  // Returns false if the stream ended before it.
+  bool readHeader() const {
+    if (headerLen_ < header_.size()) {
+      auto len = folly::readFull(file_.fd(), header_.data() + headerLen_,
+                                 header_.size() - headerLen_);
+      if (len < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "failed to read record header");
+      }
+      headerLen_ += len;
+    }
+    if (headerLen_ == 0) {
+      return false;
+    }
+    if (headerLen_ < header_.size()) {
+      throw std::logic_error("Truncated record header");
+    }
+    return true;
+  }
+
+  folly::File file_;
+  // Header of the next record, read ahead by isEnd()
+  mutable std::array<uint8_t, sizeof(recordio_detail::Header)> header_;
+  mutable size_t headerLen_{0};
+};
+
+// Metadata is laid out as a stream of blocks. A record may span blocks, but
+// a record header never straddles a block boundary. Device IOs cover up to
+// kMaxIOSize bytes (many blocks) at once, which keeps persist and recovery
+// of large indexes from being bound by per-block IO latency. The layout does
+// not depend on the IO size.
+constexpr size_t kBlockSizeDefault = 4096;
+constexpr size_t kMaxIOSize = 1024 * 1024;
+
+size_t getMetadataBlockSize(const Device& dev) {
+  return dev.getIOAlignmentSize() >= kBlockSizeDefault
+             ? dev.getIOAlignmentSize()
+             : kBlockSizeDefault;
+}
+
+size_t getMetadataIOSize(size_t blockSize, size_t metadataSize) {
+  auto ioSize = std::min(kMaxIOSize, metadataSize);
+  return std::max(blockSize, ioSize - ioSize % blockSize);
+}
+
 class DeviceMetaDataWriter final : public RecordWriter {
  public:
   explicit DeviceMetaDataWriter(Device& dev, size_t metadataSize)
       : dev_(dev),
         metadataSize_{metadataSize},
-        blockSize_{dev_.getIOAlignmentSize() >= kBlockSizeDefault
-                       ? dev_.getIOAlignmentSize()
-                       : kBlockSizeDefault} {}
+        blockSize_{getMetadataBlockSize(dev_)},
+        ioSize_{getMetadataIOSize(blockSize_, metadataSize_)} {}
 
   ~DeviceMetaDataWriter() override {
-    uint8_t* bufferData = buffer_.data();
-    // Write the last remaining bytes to the device
+    // Write the remaining bytes to the device. The last block is only
+    // written if there is still room after it for the end marker.
     if (bufIndex_ > 0) {
-      if (offset_ + blockSize_ < metadataSize_) {
-        Buffer buffer = dev_.makeIOBuffer(blockSize_);
-        memcpy(buffer.data(), bufferData, bufIndex_);
-        memset(buffer.data() + bufIndex_, 0, blockSize_ - bufIndex_);
-        dev_.write(offset_, std::move(buffer));
-        offset_ += blockSize_;
+      auto len = alignUp(bufIndex_);
+      memset(buffer_.data() + bufIndex_, 0, len - bufIndex_);
+      if (offset_ + len >= metadataSize_) {
+        len -= blockSize_;
+      }
+      if (len > 0) {
+        writeBuffer(len);
       }
     }
     if (offset_ + blockSize_ <= metadataSize_) {
@@ -109,25 +226,14 @@ class DeviceMetaDataWriter final : public RecordWriter {
     auto dataOffset = 0;
     uint8_t* bufferData = buffer_.data();
 
-    auto flushBuffer = [=]() mutable {
-      auto extraBytes = blockSize_ - bufIndex_;
-      // zero the unused bytes in the buffer
-      memset(&bufferData[bufIndex_], 0, extraBytes);
-      Buffer buffer = dev_.makeIOBuffer(blockSize_);
-      memcpy(buffer.data(), bufferData, blockSize_);
-
-      if (!dev_.write(offset_, std::move(buffer))) {
-        throw std::invalid_argument(
-            folly::sformat("write failed: offset = {}", offset_));
-      }
-
-      offset_ += blockSize_;
-      bufIndex_ = 0;
-    };
-
     do {
-      // flush current buffer if it has no room for header
-      if (bufIndex_ + headerSize() > blockSize_) {
+      // skip to the next block if the current one has no room for header
+      auto blockUsed = bufIndex_ % blockSize_;
+      if (blockUsed != 0 && blockUsed + headerSize() > blockSize_) {
+        memset(&bufferData[bufIndex_], 0, blockSize_ - blockUsed);
+        bufIndex_ += blockSize_ - blockUsed;
+      }
+      if (bufIndex_ == ioSize_) {
         flushBuffer();
       }
 
@@ -141,7 +247,7 @@ class DeviceMetaDataWriter final : public RecordWriter {
       }
 
       // fill local buffer with input data
-      auto cpBytes = std::min(static_cast<uint64_t>(blockSize_ - bufIndex_),
+      auto cpBytes = std::min(static_cast<uint64_t>(ioSize_ - bufIndex_),
                               static_cast<uint64_t>(size));
       memcpy(&bufferData[bufIndex_], data + dataOffset, cpBytes);
       dataOffset += cpBytes;
@@ -157,13 +263,37 @@ class DeviceMetaDataWriter final : public RecordWriter {
   }
 
  private:
-  static constexpr size_t kBlockSizeDefault = 4096;
+  size_t alignUp(size_t size) const {
+    return (size + blockSize_ - 1) / blockSize_ * blockSize_;
+  }
+
+  // Writes the whole blocks used so far, zeroing the unused tail of the last
+  // one.
+  void flushBuffer() {
+    auto len = alignUp(bufIndex_);
+    memset(buffer_.data() + bufIndex_, 0, len - bufIndex_);
+    writeBuffer(len);
+  }
+
+  void writeBuffer(size_t len) {
+    Buffer buffer = dev_.makeIOBuffer(len);
+    memcpy(buffer.data(), buffer_.data(), len);
+    if (!dev_.write(offset_, std::move(buffer))) {
+      throw std::invalid_argument(
+          folly::sformat("write failed: offset = {}", offset_));
+    }
+    offset_ += len;
+    bufIndex_ = 0;
+  }
+
   Device& dev_;
   size_t metadataSize_;
   const size_t blockSize_;
+  const size_t ioSize_;
+  // device offset of the start of buffer_
   uint64_t offset_{0};
   uint32_t bufIndex_{0};
-  Buffer buffer_{blockSize_, blockSize_};
+  Buffer buffer_{ioSize_, blockSize_};
 };
 
 class DeviceMetaDataReader final : public RecordReader {
@@ -171,9 +301,8 @@ class DeviceMetaDataReader final : public RecordReader {
   explicit DeviceMetaDataReader(Device& dev, size_t metadataSize)
       : dev_{dev},
         metadataSize_{metadataSize},
-        blockSize_{dev_.getIOAlignmentSize() >= kBlockSizeDefault
-                       ? dev_.getIOAlignmentSize()
-                       : kBlockSizeDefault} {}
+        blockSize_{getMetadataBlockSize(dev_)},
+        ioSize_{getMetadataIOSize(blockSize_, metadataSize_)} {}
   ~DeviceMetaDataReader() override = default;
 
   std::unique_ptr<folly::IOBuf> readRecord() override {
@@ -185,22 +314,14 @@ class DeviceMetaDataReader final : public RecordReader {
     auto dataOffset = 0;
 
     do {
-      // This is true when we have to read a header and there are not
-      // enough bytes in the buffer OR we have to read the next block
-      // in the multi-block read
-      if (bufIndex_ + headerSize() > blockSize_) {
-        // read new block from the device if the number of bytes left from
-        // previous read are less than header size.
-        if (offset_ + blockSize_ > metadataSize_) {
-          throw std::logic_error("exceeding metadata limit");
-        }
-        // read from device to the middle of the buffer 'kReadOffset'
-        if (!dev_.read(offset_, blockSize_, bufferData)) {
-          throw std::invalid_argument(
-              folly::sformat("read failed: offset = {}", offset_));
-        }
-        offset_ += blockSize_;
-        bufIndex_ = 0;
+      // A header never starts in the last few bytes of a block
+      auto blockUsed = bufIndex_ % blockSize_;
+      if (readHeader && blockUsed != 0 &&
+          blockUsed + headerSize() > blockSize_) {
+        bufIndex_ += blockSize_ - blockUsed;
+      }
+      if (bufIndex_ == bufLen_) {
+        readAhead();
       }
 
       // Parse the header if we are expecting header
@@ -208,7 +329,7 @@ class DeviceMetaDataReader final : public RecordReader {
         readHeader = false;
         auto valid = validateRecordHeader(
             folly::Range<unsigned char*>(&bufferData[bufIndex_],
-                                         blockSize_ - bufIndex_),
+                                         bufLen_ - bufIndex_),
             kMetadataHeaderFileId);
         if (!valid) {
           throw std::logic_error("Invalid record header");
@@ -226,8 +347,7 @@ class DeviceMetaDataReader final : public RecordReader {
         data = buf->writableData();
         dataOffset = 0;
       }
-      auto cpSize =
-          std::min(static_cast<uint64_t>(blockSize_ - bufIndex_), size);
+      auto cpSize = std::min(static_cast<uint64_t>(bufLen_ - bufIndex_), size);
       memcpy(data + dataOffset, &bufferData[bufIndex_], cpSize);
       bufIndex_ += cpSize;
       dataOffset += cpSize;
@@ -237,8 +357,10 @@ class DeviceMetaDataReader final : public RecordReader {
     auto record =
         validateRecordData(folly::Range<unsigned char*>(data, buf->length()));
     if (record.fileId == 0) {
-      throw std::invalid_argument(folly::sformat(
-          "Invalid record : offset = {}, length = {}", offset_, buf->length()));
+      throw std::invalid_argument(
+          folly::sformat("Invalid record : offset = {}, length = {}",
+                         offset_ + bufIndex_,
+                         buf->length()));
     }
     // skip the header part and return
     buf->trimStart(headerSize());
@@ -246,12 +368,15 @@ class DeviceMetaDataReader final : public RecordReader {
     return buf;
   }
 
+  // Checks for a record at the start of the next unread block
   bool isEnd() const override {
     Buffer headerBuf{blockSize_, blockSize_};
-    if (offset_ + blockSize_ > metadataSize_) {
+    auto nextBlockOffset =
+        offset_ + (bufIndex_ + blockSize_ - 1) / blockSize_ * blockSize_;
+    if (nextBlockOffset + blockSize_ > metadataSize_) {
       return true;
     }
-    auto res = dev_.read(offset_, blockSize_, headerBuf.data());
+    auto res = dev_.read(nextBlockOffset, blockSize_, headerBuf.data());
     if (!res) {
       return true;
     }
@@ -263,13 +388,33 @@ class DeviceMetaDataReader final : public RecordReader {
   }
 
  private:
-  static constexpr size_t kBlockSizeDefault = 4096;
+  // Reads the next batch of blocks, up to ioSize_ bytes, into buffer_
+  void readAhead() {
+    auto offset = offset_ + bufLen_;
+    if (offset + blockSize_ > metadataSize_) {
+      throw std::logic_error("exceeding metadata limit");
+    }
+    auto len = std::min<uint64_t>(ioSize_, metadataSize_ - offset);
+    len -= len % blockSize_;
+    if (!dev_.read(offset, len, buffer_.data())) {
+      throw std::invalid_argument(
+          folly::sformat("read failed: offset = {}", offset));
+    }
+    offset_ = offset;
+    bufLen_ = len;
+    bufIndex_ = 0;
+  }
+
   Device& dev_;
   size_t metadataSize_;
   const size_t blockSize_;
+  const size_t ioSize_;
+  // device offset of the start of buffer_
   uint64_t offset_{0};
-  uint64_t bufIndex_{blockSize_};
-  Buffer buffer_{blockSize_, blockSize_};
+  // number of bytes read into buffer_
+  uint64_t bufLen_{0};
+  uint64_t bufIndex_{0};
+  Buffer buffer_{ioSize_, blockSize_};
 };
 
 } // namespace
@@ -300,4 +445,12 @@ std::unique_ptr<RecordReader> createFileRecordReader(folly::File file) {
   return std::make_unique<FileRecordReader>(std::move(file));
 }
 
+std::unique_ptr<RecordWriter> createStreamRecordWriter(folly::File file) {
+  return std::make_unique<StreamRecordWriter>(std::move(file));
+}
+
+std::unique_ptr<RecordReader> createStreamRecordReader(folly::File file) {
+  return std::make_unique<StreamRecordReader>(std::move(file));
+}
+
 } // namespace facebook::cachelib::navy
@@ -48,6 +48,14 @@ std::unique_ptr<RecordWriter> createFileRecordWriter(folly::File file);
 
 // @param fd    The file the record reader will deserialize from
 std::unique_ptr<RecordReader> createFileRecordReader(folly::File file);
+
+// Records are written back to back and read sequentially, without seeking
+// or mapping the file, so that pipes and sockets can be used as well.
+// @param file  The file or pipe the record writer will serialize to
+std::unique_ptr<RecordWriter> createStreamRecordWriter(folly::File file);
+
+// @param file  The file or pipe the record reader will deserialize from
+std::unique_ptr<RecordReader> createStreamRecordReader(folly::File file);
 } // namespace navy
 } // namespace cachelib
 } // namespace facebook
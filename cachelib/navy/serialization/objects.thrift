@@ -36,11 +36,17 @@ struct Region {
   4: i32 numItems = 0;
   5: bool pinned = false;
   6: i32 priority = 0;
+  // -1 if the region was persisted before live bytes were tracked
+  7: i32 liveBytes = -1;
+  // 0 if the expiry of the entries is unknown
+  8: i64 maxExpiryTime = 0;
 }
 
 struct RegionData {
   1: list<Region> regions;
   2: i32 regionSize = 0;
+  // 0 if all regions were active
+  3: i32 numActiveRegions = 0;
 }
 
 struct FifoPolicyNodeData {
@@ -80,6 +86,8 @@ struct BlockCacheConfig {
   9: i64 holeSizeTotal = 0;
   10: bool reinsertionPolicyEnabled = false;
   11: i64 usedSizeBytes = 0;
+  12: i32 regionFooterSize = 0;
+  13: i32 checksumType = 0;
 }
 
 struct ValidBucketCheckerState {
@@ -99,4 +107,10 @@ struct BigHashPersistentData {
   7: map<i64, i64> deprecated_sizeDist;
   8: i64 usedSizeBytes = 0;
   9: ValidBucketCheckerState validBucketCheckerState;
+  10: i32 checksumType = 0;
+  11: i64 firstActiveBucket = 0;
+}
+
+struct NavyExportHeader {
+  1: i32 version = 0;
 }
@@ -17,6 +17,7 @@
 #include <folly/File.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 #include "cachelib/navy/serialization/RecordIO.h"
 
@@ -72,6 +73,22 @@ TEST(RecordIO, File) {
   checkRecords(*rr);
 }
 
+TEST(RecordIO, Stream) {
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  folly::File readEnd{fds[0], true /* ownsFd */};
+  {
+    auto rw = createStreamRecordWriter(folly::File{fds[1], true /* ownsFd */});
+    writeRecords(*rw);
+    // Empty records are not written
+    rw->writeRecord(folly::IOBuf::create(0));
+  }
+  // The write end is closed, so the reader sees the end of the stream
+  auto rr = createStreamRecordReader(std::move(readEnd));
+  checkRecords(*rr);
+  EXPECT_THROW(rr->readRecord(), std::logic_error);
+}
+
 TEST(RecordIO, Memory) {
   folly::IOBufQueue ioq;
   auto rw = createMemoryRecordWriter(ioq);